@@ -6,10 +6,11 @@
  */
 
 /**
- * @brief simple demo of subdivision surface
+ * @brief simple demo of subdivision surface. The cage is animated using the precomputed stencil
  */
 
 #include <cstdlib>
+#include <cmath>
 #include <filesystem>
 #if defined(_WIN32) // windows
 #  define NOMINMAX   // to remove min,max macro
@@ -94,6 +95,36 @@ int main() {
       if (glfwWindowShouldClose(viewer.window)) break;
     }
     if (glfwWindowShouldClose(viewer.window)) break;
+    { // animate the cage. The stencil is computed once and only the points are updated in every frame
+      std::vector<unsigned int> quad_vtx1, stencil_ind, stencil_vtx;
+      std::vector<double> stencil_weight;
+      dfm2::SubdivStencil_MeshQuadCatmullClark(
+          quad_vtx1, stencil_ind, stencil_vtx, stencil_weight,
+          array_quad_vtx[0].data(), array_quad_vtx[0].size() / 4, array_vtx_xyz[0].size() / 3,
+          nlevel_subdiv, true, 0);
+      std::vector<double> vtx_xyz0 = array_vtx_xyz[0], vtx_xyz1;
+      for (unsigned int iframe = 0; iframe < 120; ++iframe) {
+        const double s = 1.0 + 0.3 * std::sin(iframe * 0.1);
+        for (unsigned int ip = 0; ip < vtx_xyz0.size() / 3; ++ip) {
+          vtx_xyz0[ip * 3 + 1] = array_vtx_xyz[0][ip * 3 + 1] * s;
+        }
+        dfm2::Points_Stencil(
+            vtx_xyz1,
+            stencil_ind, stencil_vtx, stencil_weight,
+            vtx_xyz0.data(), 3, 0);
+        viewer.DrawBegin_oldGL();
+        ::glColorMaterial(GL_FRONT_AND_BACK, GL_DIFFUSE);
+        ::glEnable(GL_LIGHTING);
+        delfem2::opengl::DrawMeshQuad3D_FaceNorm(vtx_xyz1, quad_vtx1);
+        ::glDisable(GL_LIGHTING);
+        ::glColor3d(0, 0, 0);
+        delfem2::opengl::DrawMeshQuad3D_Edge(vtx_xyz0, array_quad_vtx[0]);
+        viewer.SwapBuffers();
+        glfwPollEvents();
+        if (glfwWindowShouldClose(viewer.window)) break;
+      }
+    }
+    if (glfwWindowShouldClose(viewer.window)) break;
   }
   // ----------------------
   glfwDestroyWindow(viewer.window);
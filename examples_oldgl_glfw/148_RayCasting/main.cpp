@@ -16,8 +16,9 @@
 
 #include "delfem2/srch_trimesh3_class.h"
 #include "delfem2/srch_bruteforce.h"
-#include "delfem2/srch_bv3_sphere.h"
+#include "delfem2/srch_bv3_aabb.h"
 #include "delfem2/srch_bvh.h"
+#include "delfem2/srch_bvh_wide.h"
 #include "delfem2/msh_affine_transformation.h"
 #include "delfem2/msh_io_ply.h"
 #include "delfem2/msh_normal.h"
@@ -77,10 +78,14 @@ int main() {
   }
 
   std::vector<dfm2::CNodeBVH2> bvh_nodes;
-  std::vector<dfm2::CBV3_Sphere<double>> bvh_volumes;
+  std::vector<dfm2::CBV3d_AABB> bvh_volumes;
   delfem2::ConstructBVHTriangleMeshMortonCode(
       bvh_nodes, bvh_volumes,
       vec_xyz, vec_tri);
+  dfm2::CBVHWide_MeshTri3D<4> bvh_wide;
+  bvh_wide.Build(
+      0, bvh_nodes, bvh_volumes,
+      vec_xyz.data(), vec_tri.data());
 
   dfm2::opengl::CTexRGB_Rect2D tex;
   {
@@ -117,7 +122,7 @@ int main() {
       Intersection_ImageRay_TriMesh3(
           vec_point_on_tri,
           tex.height, tex.width, mMVP.data(),
-          bvh_nodes, bvh_volumes, vec_xyz, vec_tri, true);
+          bvh_wide, true);
       ShadingImageRayLambertian(
           tex.pixel_color,
           tex.height, tex.width, mMVP.data(),
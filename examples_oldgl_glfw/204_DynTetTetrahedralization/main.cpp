@@ -248,20 +248,9 @@ void AddRandomPoint(
   aPo3D[ip_ins].p = dfm2::CVec3d(x0,y0,z0);
   aPo3D[ip_ins].e = UINT_MAX;
   aPo3D[ip_ins].poel = UINT_MAX;
-  unsigned int itet_ins = UINT_MAX;
-  for (unsigned int it = 0; it<aSTet.size(); ++it){
-    unsigned int j0 = aSTet[it].v[0];
-    unsigned int j1 = aSTet[it].v[1];
-    unsigned int j2 = aSTet[it].v[2];
-    unsigned int j3 = aSTet[it].v[3];
-    if( j0 == UINT_MAX ) continue; // floating tet
-    double v0 = TetVolume(ip_ins, j1, j2, j3, aPo3D);
-    double v1 = TetVolume(j0, ip_ins, j2, j3, aPo3D);
-    double v2 = TetVolume(j0, j1, ip_ins, j3, aPo3D);
-    double v3 = TetVolume(j0, j1, j2, ip_ins, aPo3D);
-    //    double v4 = TetVolume(j0, j1, j2, j3, aPo3D);
-    if (v0>0&&v1>0&&v2>0&&v3>0){ itet_ins = it; break; }
-  }
+  unsigned int itet_start = aPo3D[ip_ins-1].e; // start from the previous point
+  if( itet_start == UINT_MAX ){ itet_start = aPo3D[0].e; }
+  const unsigned int itet_ins = dfm2::FindTet_Walk(aPo3D[ip_ins].p, itet_start, aPo3D, aSTet);
   if (itet_ins==UINT_MAX){ return; }
   AddPointTetDelaunay(ip_ins,itet_ins, aPo3D, aSTet,aCent, tmp_buffer);
 #ifndef NDEBUG
@@ -9,19 +9,59 @@
 
 #include <stack>
 #include <map>
+#include <climits>
+#include <iostream>
 
 #include "delfem2/vec3.h"
 #include "delfem2/vec3_funcs.h"
 #include "delfem2/srch_selfintersection_bvh.h"
 #include "delfem2/srch_bv3_aabb.h"
 #include "delfem2/srch_bvh.h"
+#include "delfem2/msh_topology_uniform.h"
+#include "delfem2/thread.h"
 
 namespace dfm2 = delfem2;
 
+namespace delfem2::cloth_selfcollision {
+
+/**
+ * call "func(ice)" for all the contact elements. The elements are colored such that the elements with the same
+ * color do not share a vertex. The colors are processed one after another and the elements with a color in parallel.
+ * The result does not depend on the number of threads.
+ */
+template <typename FUNC>
+void ForEachContactElement_Colored(
+    const std::vector<dfm2::CContactElement>& aContactElem,
+    size_t nvtx,
+    FUNC&& func,
+    unsigned int nthread)
+{
+  std::vector<unsigned int> aContactVtx(aContactElem.size()*4);
+  for(unsigned int ice=0;ice<aContactElem.size();++ice){
+    aContactVtx[ice*4+0] = aContactElem[ice].ino0;
+    aContactVtx[ice*4+1] = aContactElem[ice].ino1;
+    aContactVtx[ice*4+2] = aContactElem[ice].ino2;
+    aContactVtx[ice*4+3] = aContactElem[ice].ino3;
+  }
+  std::vector<unsigned int> color_ind, color_elem;
+  dfm2::JArray_ElemColoring_MeshElem(
+      color_ind, color_elem,
+      aContactVtx.data(), aContactElem.size(), 4, nvtx);
+  for(unsigned int icolor=0;icolor+1<color_ind.size();++icolor){
+    const unsigned int* aIndCE = color_elem.data() + color_ind[icolor];
+    dfm2::parallel_for_range(
+        color_ind[icolor+1]-color_ind[icolor],
+        [&func, aIndCE](unsigned int ib, unsigned int ie){
+          for(unsigned int i=ib;i<ie;++i){ func(aIndCE[i]); }
+        },
+        32u, nthread);
+  }
+}
+
 /**
  * compute impulse force
  */
-void SelfCollisionImpulse_Proximity(
+DFM2_INLINE void SelfCollisionImpulse_Proximity(
 	std::vector<double>& aUVWm, // (in,out)velocity
 	// 
 	double delta,
@@ -30,93 +70,98 @@ void SelfCollisionImpulse_Proximity(
 	double mass,
 	const std::vector<double>& aXYZ,
 	[[maybe_unused]] const std::vector<unsigned int>& aTri,
-	const std::vector<dfm2::CContactElement>& aContactElem)
+	const std::vector<dfm2::CContactElement>& aContactElem,
+	unsigned int nthread)
 {
-  for(const auto & ce : aContactElem){
-    const int ino0 = ce.ino0;
-    const int ino1 = ce.ino1;
-    const int ino2 = ce.ino2;
-    const int ino3 = ce.ino3;
-    dfm2::CVec3d p0( aXYZ[ ino0*3+0], aXYZ[ ino0*3+1], aXYZ[ ino0*3+2] );
-    dfm2::CVec3d p1( aXYZ[ ino1*3+0], aXYZ[ ino1*3+1], aXYZ[ ino1*3+2] );
-    dfm2::CVec3d p2( aXYZ[ ino2*3+0], aXYZ[ ino2*3+1], aXYZ[ ino2*3+2] );
-    dfm2::CVec3d p3( aXYZ[ ino3*3+0], aXYZ[ ino3*3+1], aXYZ[ ino3*3+2] );
-    dfm2::CVec3d v0( aUVWm[ino0*3+0], aUVWm[ino0*3+1], aUVWm[ino0*3+2] );
-    dfm2::CVec3d v1( aUVWm[ino1*3+0], aUVWm[ino1*3+1], aUVWm[ino1*3+2] );
-    dfm2::CVec3d v2( aUVWm[ino2*3+0], aUVWm[ino2*3+1], aUVWm[ino2*3+2] );
-    dfm2::CVec3d v3( aUVWm[ino3*3+0], aUVWm[ino3*3+1], aUVWm[ino3*3+2] );
-    if( ce.is_fv ){ // face-vtx      
-      double w0,w1;
-      {
-        double dist = DistanceFaceVertex(p0, p1, p2, p3, w0,w1);
-        if( w0 < 0 || w0 > 1 ) continue;
-        if( w1 < 0 || w1 > 1 ) continue;
-        if( dist > delta ) continue;
-      }
-      double w2 = 1.0 - w0 - w1;
-      dfm2::CVec3d pc = w0*p0 + w1*p1 + w2*p2;
-      dfm2::CVec3d norm = p3-pc; norm.normalize();
-      double p_depth = delta - (p3-pc).dot(norm); // penetration depth
-      double rel_v = (v3-w0*v0-w1*v1-w2*v2).dot(norm);
-      if( rel_v > 0.1*p_depth/dt ) continue;
-      double imp_el = dt*stiffness*p_depth;
-      double imp_ie = mass*(0.1*p_depth/dt-rel_v);
-      double imp_min = ( imp_el < imp_ie ) ? imp_el : imp_ie;
-      double imp_mod = 2*imp_min / (1+w0*w0+w1*w1+w2*w2);
-      imp_mod /= mass;
-      imp_mod *= 0.25;
-      aUVWm[ino0*3+0] += -norm.x*imp_mod*w0;
-      aUVWm[ino0*3+1] += -norm.y*imp_mod*w0;
-      aUVWm[ino0*3+2] += -norm.z*imp_mod*w0;
-      aUVWm[ino1*3+0] += -norm.x*imp_mod*w1;
-      aUVWm[ino1*3+1] += -norm.y*imp_mod*w1;
-      aUVWm[ino1*3+2] += -norm.z*imp_mod*w1;
-      aUVWm[ino2*3+0] += -norm.x*imp_mod*w2;
-      aUVWm[ino2*3+1] += -norm.y*imp_mod*w2;
-      aUVWm[ino2*3+2] += -norm.z*imp_mod*w2;
-      aUVWm[ino3*3+0] += +norm.x*imp_mod;
-      aUVWm[ino3*3+1] += +norm.y*imp_mod;
-      aUVWm[ino3*3+2] += +norm.z*imp_mod;
-    }
-    else{ // edge-edge
-      double w01,w23;
-      {
-        double dist = Distance_Edge3_Edge3(p0, p1, p2, p3, w01, w23);
-        if( w01 < 0 || w01 > 1 ) continue;
-        if( w23 < 0 || w23 > 1 ) continue;
-        if( dist > delta ) continue;
-      }
-      dfm2::CVec3d c01 = (1-w01)*p0 + w01*p1;
-      dfm2::CVec3d c23 = (1-w23)*p2 + w23*p3;
-      dfm2::CVec3d norm = (c23-c01); norm.normalize();
-      double p_depth = delta - (c23-c01).norm();
-      double rel_v = ((1-w23)*v2+w23*v3-(1-w01)*v0-w01*v1).dot(norm);
-      if( rel_v > 0.1*p_depth/dt ) continue;
-      double imp_el = dt*stiffness*p_depth;
-      double imp_ie = mass*(0.1*p_depth/dt-rel_v);
-      double imp_min = ( imp_el < imp_ie ) ? imp_el : imp_ie;
-      double imp_mod = 2*imp_min / ( w01*w01+(1-w01)*(1-w01) + w23*w23+(1-w23)*(1-w23) );
-      imp_mod /= mass;
-      imp_mod *= 0.25;      
-      aUVWm[ino0*3+0] += -norm.x*imp_mod*(1-w01);
-      aUVWm[ino0*3+1] += -norm.y*imp_mod*(1-w01);
-      aUVWm[ino0*3+2] += -norm.z*imp_mod*(1-w01);
-      aUVWm[ino1*3+0] += -norm.x*imp_mod*w01;
-      aUVWm[ino1*3+1] += -norm.y*imp_mod*w01;
-      aUVWm[ino1*3+2] += -norm.z*imp_mod*w01;
-      aUVWm[ino2*3+0] += +norm.x*imp_mod*(1-w23);
-      aUVWm[ino2*3+1] += +norm.y*imp_mod*(1-w23);
-      aUVWm[ino2*3+2] += +norm.z*imp_mod*(1-w23);
-      aUVWm[ino3*3+0] += +norm.x*imp_mod*w23;
-      aUVWm[ino3*3+1] += +norm.y*imp_mod*w23;
-      aUVWm[ino3*3+2] += +norm.z*imp_mod*w23;
-    }
-  }
+  ForEachContactElement_Colored(
+      aContactElem, aXYZ.size()/3,
+      [&](unsigned int ice){
+        const dfm2::CContactElement& ce = aContactElem[ice];
+        const int ino0 = ce.ino0;
+        const int ino1 = ce.ino1;
+        const int ino2 = ce.ino2;
+        const int ino3 = ce.ino3;
+        dfm2::CVec3d p0( aXYZ[ ino0*3+0], aXYZ[ ino0*3+1], aXYZ[ ino0*3+2] );
+        dfm2::CVec3d p1( aXYZ[ ino1*3+0], aXYZ[ ino1*3+1], aXYZ[ ino1*3+2] );
+        dfm2::CVec3d p2( aXYZ[ ino2*3+0], aXYZ[ ino2*3+1], aXYZ[ ino2*3+2] );
+        dfm2::CVec3d p3( aXYZ[ ino3*3+0], aXYZ[ ino3*3+1], aXYZ[ ino3*3+2] );
+        dfm2::CVec3d v0( aUVWm[ino0*3+0], aUVWm[ino0*3+1], aUVWm[ino0*3+2] );
+        dfm2::CVec3d v1( aUVWm[ino1*3+0], aUVWm[ino1*3+1], aUVWm[ino1*3+2] );
+        dfm2::CVec3d v2( aUVWm[ino2*3+0], aUVWm[ino2*3+1], aUVWm[ino2*3+2] );
+        dfm2::CVec3d v3( aUVWm[ino3*3+0], aUVWm[ino3*3+1], aUVWm[ino3*3+2] );
+        if( ce.is_fv ){ // face-vtx      
+          double w0,w1;
+          {
+            double dist = DistanceFaceVertex(p0, p1, p2, p3, w0,w1);
+            if( w0 < 0 || w0 > 1 ) return;
+            if( w1 < 0 || w1 > 1 ) return;
+            if( dist > delta ) return;
+          }
+          double w2 = 1.0 - w0 - w1;
+          dfm2::CVec3d pc = w0*p0 + w1*p1 + w2*p2;
+          dfm2::CVec3d norm = p3-pc; norm.normalize();
+          double p_depth = delta - (p3-pc).dot(norm); // penetration depth
+          double rel_v = (v3-w0*v0-w1*v1-w2*v2).dot(norm);
+          if( rel_v > 0.1*p_depth/dt ) return;
+          double imp_el = dt*stiffness*p_depth;
+          double imp_ie = mass*(0.1*p_depth/dt-rel_v);
+          double imp_min = ( imp_el < imp_ie ) ? imp_el : imp_ie;
+          double imp_mod = 2*imp_min / (1+w0*w0+w1*w1+w2*w2);
+          imp_mod /= mass;
+          imp_mod *= 0.25;
+          aUVWm[ino0*3+0] += -norm.x*imp_mod*w0;
+          aUVWm[ino0*3+1] += -norm.y*imp_mod*w0;
+          aUVWm[ino0*3+2] += -norm.z*imp_mod*w0;
+          aUVWm[ino1*3+0] += -norm.x*imp_mod*w1;
+          aUVWm[ino1*3+1] += -norm.y*imp_mod*w1;
+          aUVWm[ino1*3+2] += -norm.z*imp_mod*w1;
+          aUVWm[ino2*3+0] += -norm.x*imp_mod*w2;
+          aUVWm[ino2*3+1] += -norm.y*imp_mod*w2;
+          aUVWm[ino2*3+2] += -norm.z*imp_mod*w2;
+          aUVWm[ino3*3+0] += +norm.x*imp_mod;
+          aUVWm[ino3*3+1] += +norm.y*imp_mod;
+          aUVWm[ino3*3+2] += +norm.z*imp_mod;
+        }
+        else{ // edge-edge
+          double w01,w23;
+          {
+            double dist = Distance_Edge3_Edge3(p0, p1, p2, p3, w01, w23);
+            if( w01 < 0 || w01 > 1 ) return;
+            if( w23 < 0 || w23 > 1 ) return;
+            if( dist > delta ) return;
+          }
+          dfm2::CVec3d c01 = (1-w01)*p0 + w01*p1;
+          dfm2::CVec3d c23 = (1-w23)*p2 + w23*p3;
+          dfm2::CVec3d norm = (c23-c01); norm.normalize();
+          double p_depth = delta - (c23-c01).norm();
+          double rel_v = ((1-w23)*v2+w23*v3-(1-w01)*v0-w01*v1).dot(norm);
+          if( rel_v > 0.1*p_depth/dt ) return;
+          double imp_el = dt*stiffness*p_depth;
+          double imp_ie = mass*(0.1*p_depth/dt-rel_v);
+          double imp_min = ( imp_el < imp_ie ) ? imp_el : imp_ie;
+          double imp_mod = 2*imp_min / ( w01*w01+(1-w01)*(1-w01) + w23*w23+(1-w23)*(1-w23) );
+          imp_mod /= mass;
+          imp_mod *= 0.25;      
+          aUVWm[ino0*3+0] += -norm.x*imp_mod*(1-w01);
+          aUVWm[ino0*3+1] += -norm.y*imp_mod*(1-w01);
+          aUVWm[ino0*3+2] += -norm.z*imp_mod*(1-w01);
+          aUVWm[ino1*3+0] += -norm.x*imp_mod*w01;
+          aUVWm[ino1*3+1] += -norm.y*imp_mod*w01;
+          aUVWm[ino1*3+2] += -norm.z*imp_mod*w01;
+          aUVWm[ino2*3+0] += +norm.x*imp_mod*(1-w23);
+          aUVWm[ino2*3+1] += +norm.y*imp_mod*(1-w23);
+          aUVWm[ino2*3+2] += +norm.z*imp_mod*(1-w23);
+          aUVWm[ino3*3+0] += +norm.x*imp_mod*w23;
+          aUVWm[ino3*3+1] += +norm.y*imp_mod*w23;
+          aUVWm[ino3*3+2] += +norm.z*imp_mod*w23;
+        }
+      },
+      nthread);
 }
 
 
 // compute impulse force
-void SelfCollisionImpulse_CCD(
+DFM2_INLINE void SelfCollisionImpulse_CCD(
     std::vector<double>& aUVWm, // (in,out)velocity
     //
     double delta,
@@ -125,167 +170,107 @@ void SelfCollisionImpulse_CCD(
     double mass,
     const std::vector<double>& aXYZ,
     [[maybe_unused]] const std::vector<unsigned int>& aTri,
-    const std::vector<dfm2::CContactElement>& aContactElem)
-{
-  for(const auto & ce : aContactElem){
-    const int ino0 = ce.ino0;
-    const int ino1 = ce.ino1;
-    const int ino2 = ce.ino2;
-    const int ino3 = ce.ino3;
-    dfm2::CVec3d p0( aXYZ[ ino0*3+0], aXYZ[ ino0*3+1], aXYZ[ ino0*3+2] );
-    dfm2::CVec3d p1( aXYZ[ ino1*3+0], aXYZ[ ino1*3+1], aXYZ[ ino1*3+2] );
-    dfm2::CVec3d p2( aXYZ[ ino2*3+0], aXYZ[ ino2*3+1], aXYZ[ ino2*3+2] );
-    dfm2::CVec3d p3( aXYZ[ ino3*3+0], aXYZ[ ino3*3+1], aXYZ[ ino3*3+2] );
-    dfm2::CVec3d v0( aUVWm[ino0*3+0], aUVWm[ino0*3+1], aUVWm[ino0*3+2] );
-    dfm2::CVec3d v1( aUVWm[ino1*3+0], aUVWm[ino1*3+1], aUVWm[ino1*3+2] );
-    dfm2::CVec3d v2( aUVWm[ino2*3+0], aUVWm[ino2*3+1], aUVWm[ino2*3+2] );
-    dfm2::CVec3d v3( aUVWm[ino3*3+0], aUVWm[ino3*3+1], aUVWm[ino3*3+2] );
-    double t;
-    {
-      bool res = FindCoplanerInterp(
-          t,
-          p0,p1,p2,p3, p0+v0,p1+v1,p2+v2,p3+v3);
-      if( !res ) continue;
-      assert( t >= 0 && t <= 1 );
-    }
-    if( ce.is_fv ){ // face-vtx
-      double w0,w1;
-      {        
-        dfm2::CVec3d p0m = p0 + t*v0;
-        dfm2::CVec3d p1m = p1 + t*v1;
-        dfm2::CVec3d p2m = p2 + t*v2;
-        dfm2::CVec3d p3m = p3 + t*v3;
-        double dist = DistanceFaceVertex(p0m, p1m, p2m, p3m, w0,w1);
-        if( w0 < 0 || w0 > 1 ) continue;
-        if( w1 < 0 || w1 > 1 ) continue;
-        if( dist > delta ) continue;
-      }
-      double w2 = 1.0 - w0 - w1;
-      dfm2::CVec3d pc = w0*p0 + w1*p1 + w2*p2;
-      dfm2::CVec3d norm = p3 - pc; norm.normalize();
-      double rel_v = (v3-w0*v0-w1*v1-w2*v2).dot(norm); // relative velocity (positive if separating)
-      if( rel_v > 0.1*delta/dt ) continue; // separating
-      double imp = mass*(0.1*delta/dt-rel_v);
-      double imp_mod = 2*imp/(1.0+w0*w0+w1*w1+w2*w2);
-      imp_mod /= mass;
-      imp_mod *= 0.1;
-      aUVWm[ino0*3+0] += -norm.x*imp_mod*w0;
-      aUVWm[ino0*3+1] += -norm.y*imp_mod*w0;
-      aUVWm[ino0*3+2] += -norm.z*imp_mod*w0;
-      aUVWm[ino1*3+0] += -norm.x*imp_mod*w1;
-      aUVWm[ino1*3+1] += -norm.y*imp_mod*w1;
-      aUVWm[ino1*3+2] += -norm.z*imp_mod*w1;
-      aUVWm[ino2*3+0] += -norm.x*imp_mod*w2;
-      aUVWm[ino2*3+1] += -norm.y*imp_mod*w2;
-      aUVWm[ino2*3+2] += -norm.z*imp_mod*w2;
-      aUVWm[ino3*3+0] += +norm.x*imp_mod;
-      aUVWm[ino3*3+1] += +norm.y*imp_mod;
-      aUVWm[ino3*3+2] += +norm.z*imp_mod;
-    }
-    else{ // edge-edge
-      double w01,w23;
-      {
-        dfm2::CVec3d p0m = p0 + t*v0;
-        dfm2::CVec3d p1m = p1 + t*v1;
-        dfm2::CVec3d p2m = p2 + t*v2;
-        dfm2::CVec3d p3m = p3 + t*v3;
-        double dist = Distance_Edge3_Edge3(p0m, p1m, p2m, p3m, w01, w23);
-        if( w01 < 0 || w01 > 1 ) continue;
-        if( w23 < 0 || w23 > 1 ) continue;
-        if( dist > delta ) continue;
-      }      
-      dfm2::CVec3d c01 = (1-w01)*p0 + w01*p1;
-      dfm2::CVec3d c23 = (1-w23)*p2 + w23*p3;
-      dfm2::CVec3d norm = (c23-c01); norm.normalize();
-      double rel_v = ((1-w23)*v2+w23*v3-(1-w01)*v0-w01*v1).dot(norm);
-      if( rel_v > 0.1*delta/dt ) continue; // separating
-      double imp = mass*(0.1*delta/dt-rel_v); // reasonable
-      double imp_mod = 2*imp/( w01*w01+(1-w01)*(1-w01) + w23*w23+(1-w23)*(1-w23) );
-      imp_mod /= mass;
-      imp_mod *= 0.1;
-      aUVWm[ino0*3+0] += -norm.x*imp_mod*(1-w01);
-      aUVWm[ino0*3+1] += -norm.y*imp_mod*(1-w01);
-      aUVWm[ino0*3+2] += -norm.z*imp_mod*(1-w01);
-      aUVWm[ino1*3+0] += -norm.x*imp_mod*w01;
-      aUVWm[ino1*3+1] += -norm.y*imp_mod*w01;
-      aUVWm[ino1*3+2] += -norm.z*imp_mod*w01;
-      aUVWm[ino2*3+0] += +norm.x*imp_mod*(1-w23);
-      aUVWm[ino2*3+1] += +norm.y*imp_mod*(1-w23);
-      aUVWm[ino2*3+2] += +norm.z*imp_mod*(1-w23);
-      aUVWm[ino3*3+0] += +norm.x*imp_mod*w23;
-      aUVWm[ino3*3+1] += +norm.y*imp_mod*w23;
-      aUVWm[ino3*3+2] += +norm.z*imp_mod*w23;
-    }
-  }
-}
-
-// ---------------------------------------------------
-
-// RIZを更新する
-void MakeRigidImpactZone
-(std::vector< std::set<int> >& aRIZ, // (in,ou)RIZに属する節点のインデックスの集合の配列
- const std::vector<dfm2::CContactElement>& aContactElem, // 自己交差する接触要素の配列
-// const CJaggedArray& aEdge
- const std::vector<unsigned int> &psup_ind,
- const std::vector<unsigned int> &psup) // 三角形メッシュの辺の配列
+    const std::vector<dfm2::CContactElement>& aContactElem,
+    unsigned int nthread)
 {
-  for(const auto & ce : aContactElem){
-    const int n[4] = {ce.ino0, ce.ino1, ce.ino2, ce.ino3};
-    std::set<int> ind_inc; // 接触要素が接するRIZの集合
-    for(int ino : n){
-      for(unsigned int iriz=0;iriz<aRIZ.size();iriz++){
-        if( aRIZ[iriz].find(ino) != aRIZ[iriz].end() ){
-          ind_inc.insert(iriz);
+  ForEachContactElement_Colored(
+      aContactElem, aXYZ.size()/3,
+      [&](unsigned int ice){
+        const dfm2::CContactElement& ce = aContactElem[ice];
+        const int ino0 = ce.ino0;
+        const int ino1 = ce.ino1;
+        const int ino2 = ce.ino2;
+        const int ino3 = ce.ino3;
+        dfm2::CVec3d p0( aXYZ[ ino0*3+0], aXYZ[ ino0*3+1], aXYZ[ ino0*3+2] );
+        dfm2::CVec3d p1( aXYZ[ ino1*3+0], aXYZ[ ino1*3+1], aXYZ[ ino1*3+2] );
+        dfm2::CVec3d p2( aXYZ[ ino2*3+0], aXYZ[ ino2*3+1], aXYZ[ ino2*3+2] );
+        dfm2::CVec3d p3( aXYZ[ ino3*3+0], aXYZ[ ino3*3+1], aXYZ[ ino3*3+2] );
+        dfm2::CVec3d v0( aUVWm[ino0*3+0], aUVWm[ino0*3+1], aUVWm[ino0*3+2] );
+        dfm2::CVec3d v1( aUVWm[ino1*3+0], aUVWm[ino1*3+1], aUVWm[ino1*3+2] );
+        dfm2::CVec3d v2( aUVWm[ino2*3+0], aUVWm[ino2*3+1], aUVWm[ino2*3+2] );
+        dfm2::CVec3d v3( aUVWm[ino3*3+0], aUVWm[ino3*3+1], aUVWm[ino3*3+2] );
+        double t;
+        {
+          bool res = FindCoplanerInterp(
+              t,
+              p0,p1,p2,p3, p0+v0,p1+v1,p2+v2,p3+v3);
+          if( !res ) return;
+          assert( t >= 0 && t <= 1 );
         }
-        else{
-          for(unsigned int iedge=psup_ind[ino];iedge<psup_ind[ino+1];iedge++){
-            int jno = psup[iedge];
-            if( aRIZ[iriz].find(jno) != aRIZ[iriz].end() ){
-              ind_inc.insert(iriz);  break;
-            }
+        if( ce.is_fv ){ // face-vtx
+          double w0,w1;
+          {        
+            dfm2::CVec3d p0m = p0 + t*v0;
+            dfm2::CVec3d p1m = p1 + t*v1;
+            dfm2::CVec3d p2m = p2 + t*v2;
+            dfm2::CVec3d p3m = p3 + t*v3;
+            double dist = DistanceFaceVertex(p0m, p1m, p2m, p3m, w0,w1);
+            if( w0 < 0 || w0 > 1 ) return;
+            if( w1 < 0 || w1 > 1 ) return;
+            if( dist > delta ) return;
           }
+          double w2 = 1.0 - w0 - w1;
+          dfm2::CVec3d pc = w0*p0 + w1*p1 + w2*p2;
+          dfm2::CVec3d norm = p3 - pc; norm.normalize();
+          double rel_v = (v3-w0*v0-w1*v1-w2*v2).dot(norm); // relative velocity (positive if separating)
+          if( rel_v > 0.1*delta/dt ) return; // separating
+          double imp = mass*(0.1*delta/dt-rel_v);
+          double imp_mod = 2*imp/(1.0+w0*w0+w1*w1+w2*w2);
+          imp_mod /= mass;
+          imp_mod *= 0.1;
+          aUVWm[ino0*3+0] += -norm.x*imp_mod*w0;
+          aUVWm[ino0*3+1] += -norm.y*imp_mod*w0;
+          aUVWm[ino0*3+2] += -norm.z*imp_mod*w0;
+          aUVWm[ino1*3+0] += -norm.x*imp_mod*w1;
+          aUVWm[ino1*3+1] += -norm.y*imp_mod*w1;
+          aUVWm[ino1*3+2] += -norm.z*imp_mod*w1;
+          aUVWm[ino2*3+0] += -norm.x*imp_mod*w2;
+          aUVWm[ino2*3+1] += -norm.y*imp_mod*w2;
+          aUVWm[ino2*3+2] += -norm.z*imp_mod*w2;
+          aUVWm[ino3*3+0] += +norm.x*imp_mod;
+          aUVWm[ino3*3+1] += +norm.y*imp_mod;
+          aUVWm[ino3*3+2] += +norm.z*imp_mod;
         }
-      }
-    }
-    if( ind_inc.empty() ){ // 接触要素はどのRIZにも属していない
-      int ind0 = (int)aRIZ.size();
-      aRIZ.resize(ind0+1);
-      aRIZ[ind0].insert(n[0]);
-      aRIZ[ind0].insert(n[1]);
-      aRIZ[ind0].insert(n[2]);
-      aRIZ[ind0].insert(n[3]);
-    }
-    else if( ind_inc.size() == 1 ){ // 接触要素は一つのRIZに接する
-      int ind0 = *(ind_inc.begin());
-      aRIZ[ind0].insert(n[0]);
-      aRIZ[ind0].insert(n[1]);
-      aRIZ[ind0].insert(n[2]);
-      aRIZ[ind0].insert(n[3]);
-    }
-    else{ // overlapping two reagion，接触要素が複数のRIZに接するー＞接する複数のRIZをマージする
-      std::vector< std::set<int> > aRIZ1; // マージされた後のRIZの配列
-      for(unsigned int iriz=0;iriz<aRIZ.size();iriz++){ // 接さないRIZをコピー
-        if( ind_inc.find(iriz) != ind_inc.end() ) continue;
-        aRIZ1.push_back( aRIZ[iriz] );
-      }
-      // マージしたRIZを，aRIZ1の最後に追加
-      int ind0 = (int)aRIZ1.size();
-      aRIZ1.resize(ind0+1);
-      for(auto ind1 : ind_inc){
-        assert( ind1 < (int)aRIZ.size() );
-        for(auto jtr=aRIZ[ind1].begin();jtr!=aRIZ[ind1].end();jtr++){
-          aRIZ1[ind0].insert(*jtr);
+        else{ // edge-edge
+          double w01,w23;
+          {
+            dfm2::CVec3d p0m = p0 + t*v0;
+            dfm2::CVec3d p1m = p1 + t*v1;
+            dfm2::CVec3d p2m = p2 + t*v2;
+            dfm2::CVec3d p3m = p3 + t*v3;
+            double dist = Distance_Edge3_Edge3(p0m, p1m, p2m, p3m, w01, w23);
+            if( w01 < 0 || w01 > 1 ) return;
+            if( w23 < 0 || w23 > 1 ) return;
+            if( dist > delta ) return;
+          }      
+          dfm2::CVec3d c01 = (1-w01)*p0 + w01*p1;
+          dfm2::CVec3d c23 = (1-w23)*p2 + w23*p3;
+          dfm2::CVec3d norm = (c23-c01); norm.normalize();
+          double rel_v = ((1-w23)*v2+w23*v3-(1-w01)*v0-w01*v1).dot(norm);
+          if( rel_v > 0.1*delta/dt ) return; // separating
+          double imp = mass*(0.1*delta/dt-rel_v); // reasonable
+          double imp_mod = 2*imp/( w01*w01+(1-w01)*(1-w01) + w23*w23+(1-w23)*(1-w23) );
+          imp_mod /= mass;
+          imp_mod *= 0.1;
+          aUVWm[ino0*3+0] += -norm.x*imp_mod*(1-w01);
+          aUVWm[ino0*3+1] += -norm.y*imp_mod*(1-w01);
+          aUVWm[ino0*3+2] += -norm.z*imp_mod*(1-w01);
+          aUVWm[ino1*3+0] += -norm.x*imp_mod*w01;
+          aUVWm[ino1*3+1] += -norm.y*imp_mod*w01;
+          aUVWm[ino1*3+2] += -norm.z*imp_mod*w01;
+          aUVWm[ino2*3+0] += +norm.x*imp_mod*(1-w23);
+          aUVWm[ino2*3+1] += +norm.y*imp_mod*(1-w23);
+          aUVWm[ino2*3+2] += +norm.z*imp_mod*(1-w23);
+          aUVWm[ino3*3+0] += +norm.x*imp_mod*w23;
+          aUVWm[ino3*3+1] += +norm.y*imp_mod*w23;
+          aUVWm[ino3*3+2] += +norm.z*imp_mod*w23;
         }
-      }
-      aRIZ1[ind0].insert(n[0]); aRIZ1[ind0].insert(n[1]); aRIZ1[ind0].insert(n[2]); aRIZ1[ind0].insert(n[3]);
-      aRIZ = aRIZ1;
-    }
-  }
+      },
+      nthread);
 }
 
-
 // t is a tmporary buffer size of 9
-static inline void CalcInvMat3(double ainv[], const double a[])
+DFM2_INLINE void CalcInvMat3(double ainv[], const double a[])
 {
 	const double det =
   + a[0]*a[4]*a[8] + a[3]*a[7]*a[2] + a[6]*a[1]*a[5]
@@ -305,14 +290,81 @@ static inline void CalcInvMat3(double ainv[], const double a[])
 	ainv[8] = inv_det*(a[0]*a[4]-a[1]*a[3]);
 }
 
-void ApplyRigidImpactZone
+}
+
+// ---------------------------------------------------
+
+// RIZを更新する
+// the RIZs are the groups of the union-find of the vertices, so the cost is almost linear to the number of contacts
+DFM2_INLINE void MakeRigidImpactZone
+(std::vector< std::set<int> >& aRIZ, // (in,ou)RIZに属する節点のインデックスの集合の配列
+ const std::vector<dfm2::CContactElement>& aContactElem, // 自己交差する接触要素の配列
+// const CJaggedArray& aEdge
+ const std::vector<unsigned int> &psup_ind,
+ const std::vector<unsigned int> &psup) // 三角形メッシュの辺の配列
+{
+  const size_t nvtx = psup_ind.size()-1;
+  std::vector<unsigned int> aParent(nvtx); // union-find of the vertices
+  for(unsigned int ip=0;ip<nvtx;++ip){ aParent[ip] = ip; }
+  std::vector<unsigned char> aFlgRIZ(nvtx, 0); // 1 if the vertex is in a RIZ
+  const auto find = [&aParent](unsigned int ip){
+    while( aParent[ip] != ip ){
+      aParent[ip] = aParent[aParent[ip]];
+      ip = aParent[ip];
+    }
+    return ip;
+  };
+  const auto unite = [&aParent, &find](unsigned int ip, unsigned int jp){
+    ip = find(ip);
+    jp = find(jp);
+    if( ip < jp ){ aParent[jp] = ip; }
+    else if( jp < ip ){ aParent[ip] = jp; }
+  };
+  for(const auto & riz : aRIZ){
+    for(int ino : riz){
+      aFlgRIZ[ino] = 1;
+      unite(*riz.begin(), ino);
+    }
+  }
+  for(const auto & ce : aContactElem){
+    const int n[4] = {ce.ino0, ce.ino1, ce.ino2, ce.ino3};
+    // merge the RIZs having the vertices or their neighbours (接触要素が接するRIZ)
+    for(int ino : n){
+      for(unsigned int iedge=psup_ind[ino];iedge<psup_ind[ino+1];iedge++){
+        const unsigned int jno = psup[iedge];
+        if( aFlgRIZ[jno] ){ unite(n[0], jno); }
+      }
+    }
+    for(int ino : n){
+      unite(n[0], ino);
+      aFlgRIZ[ino] = 1;
+    }
+  }
+  aRIZ.clear();
+  std::vector<unsigned int> aRoot2RIZ(nvtx, UINT_MAX);
+  for(unsigned int ip=0;ip<nvtx;++ip){
+    if( !aFlgRIZ[ip] ){ continue; }
+    const unsigned int iroot = find(ip);
+    if( aRoot2RIZ[iroot] == UINT_MAX ){
+      aRoot2RIZ[iroot] = static_cast<unsigned int>(aRIZ.size());
+      aRIZ.resize(aRIZ.size()+1);
+    }
+    aRIZ[aRoot2RIZ[iroot]].insert(static_cast<int>(ip));
+  }
+}
+
+
+DFM2_INLINE void ApplyRigidImpactZone
 (std::vector<double>& aUVWm, // (in,out)RIZで更新された中間速度
  ////
  const std::vector< std::set<int> >& aRIZ,  // (in)各RIZに属する節点の集合(set)の配列
  const std::vector<double>& aXYZ, // (in) 前ステップの節点の位置の配列
- const std::vector<double>& aUVWm0) // (in) RIZを使う前の中間速度
+ const std::vector<double>& aUVWm0, // (in) RIZを使う前の中間速度
+ unsigned int nthread)
 {
-  for(const auto & iriz : aRIZ){
+  // the RIZs do not share a vertex. update them in parallel
+  dfm2::parallel_for(static_cast<unsigned int>(aRIZ.size()), [&](unsigned int iriz0){
+    const std::set<int>& iriz = aRIZ[iriz0];
     std::vector<int> aInd; // index of points belong to this RIZ
     for(auto jtr=iriz.begin();jtr!=iriz.end();jtr++){
       aInd.push_back(*jtr);
@@ -338,7 +390,7 @@ void ApplyRigidImpactZone
     }
     // 角速度を求める
     double Iinv[9];
-    CalcInvMat3(Iinv,I);
+    dfm2::cloth_selfcollision::CalcInvMat3(Iinv,I);
     dfm2::CVec3d omg;
     omg.p[0] = Iinv[0]*L.x + Iinv[1]*L.y + Iinv[2]*L.z;
     omg.p[1] = Iinv[3]*L.x + Iinv[4]*L.y + Iinv[5]*L.z;
@@ -351,13 +403,13 @@ void ApplyRigidImpactZone
       aUVWm[ino*3+1] = av.y + rot.y;
       aUVWm[ino*3+2] = av.z + rot.z;
     }
-  }
+  }, nthread);
 }
 
 // --------------------------------------------------------
 
 // 衝突が解消された中間速度を返す
-void GetIntermidiateVelocityContactResolved(
+DFM2_INLINE void GetIntermidiateVelocityContactResolved(
     std::vector<double>& aUVWm,
     bool& is_impulse_applied,
     //
@@ -372,7 +424,8 @@ void GetIntermidiateVelocityContactResolved(
     const std::vector<unsigned int> &psup,
     int iroot_bvh,
     const std::vector<delfem2::CNodeBVH2>& aNodeBVH,
-    std::vector<dfm2::CBV3d_AABB> &aBB)
+    std::vector<dfm2::CBV3d_AABB> &aBB,
+    unsigned int nthread)
 {
   {
     std::vector<dfm2::CContactElement> aContactElem;
@@ -389,7 +442,8 @@ void GetIntermidiateVelocityContactResolved(
                                         contact_clearance,
                                         aXYZ,aTri,
                                         iroot_bvh,
-                                        aNodeBVH,aBB); // output
+                                        aNodeBVH,aBB,
+                                        nthread); // output
       aContactElem.assign(setCE.begin(),setCE.end());
 //      aContactElem.clear();
 //      for(std::set<CContactElement>::iterator itr=setCE.begin();itr!=setCE.end();itr++){
@@ -398,28 +452,59 @@ void GetIntermidiateVelocityContactResolved(
       std::cout << "  Proximity      Contact Elem Size: " << aContactElem.size() << std::endl;
     }
     is_impulse_applied = aContactElem.size() > 0;
-    SelfCollisionImpulse_Proximity(aUVWm,
+    dfm2::cloth_selfcollision::SelfCollisionImpulse_Proximity(aUVWm,
                               contact_clearance,
                               cloth_contact_stiffness,
                               dt,
                               mass_point,
                               aXYZ,aTri,
-                              aContactElem);
+                              aContactElem,
+                              nthread);
   }
   // -------------------------
+  // the impulses change the velocities of the vertices of the contact elements and of the rigid impact zones.
+  // Only the volumes of the triangles around them are refitted
+  std::vector<unsigned int> elsup_ind, elsup, aElem2Leaf, aIndTriDirty;
+  dfm2::JArray_ElSuP_MeshElem(
+      elsup_ind, elsup,
+      aTri.data(), aTri.size()/3, 3, aXYZ.size()/3);
+  dfm2::BVH_LeafNodeOfElement(aElem2Leaf, aTri.size()/3, aNodeBVH);
+  std::vector<unsigned char> aFlgNodeDirty(aNodeBVH.size(),0);
+  bool is_bvh_ccd = false; // the volumes are made for the CCD
+  std::vector<unsigned int> aIndVtxDirty; // vertices whose velocities changed since the last update
+  const auto update_bvh_ccd = [&](){
+    dfm2::CLeafVolumeMaker_DynamicTriangle<dfm2::CBV3d_AABB,double> lvm(
+        dt,aXYZ,aUVWm,aTri,1.0e-10);
+    if( !is_bvh_ccd ){
+      dfm2::BVH_BuildBVHGeometry(aBB,
+          iroot_bvh, aNodeBVH, lvm);
+      is_bvh_ccd = true;
+    }
+    else{
+      aIndTriDirty.clear();
+      for(unsigned int ip : aIndVtxDirty){
+        aIndTriDirty.insert(aIndTriDirty.end(),
+                            elsup.begin()+elsup_ind[ip],
+                            elsup.begin()+elsup_ind[ip+1]);
+      }
+      dfm2::BVH_RefitElements(
+          aBB, aFlgNodeDirty, nullptr,
+          aIndTriDirty.data(), aIndTriDirty.size(), aElem2Leaf,
+          iroot_bvh, aNodeBVH, lvm);
+    }
+    aIndVtxDirty.clear();
+  };
   for(int itr=0;itr<5;itr++){
     std::vector<dfm2::CContactElement> aContactElem;
     {
-      dfm2::CLeafVolumeMaker_DynamicTriangle<dfm2::CBV3d_AABB,double> lvm(
-          dt,aXYZ,aUVWm,aTri,1.0e-10);
-      dfm2::BVH_BuildBVHGeometry(aBB,
-          iroot_bvh, aNodeBVH, lvm);
+      update_bvh_ccd();
       std::set<dfm2::CContactElement> setCE;
       GetContactElement_CCD(setCE,
                             dt,contact_clearance,
                             aXYZ,aUVWm,aTri,
                             iroot_bvh,
-                            aNodeBVH,aBB); // output
+                            aNodeBVH,aBB,
+                            nthread); // output
       aContactElem.assign(setCE.begin(),setCE.end());
 //      aContactElem.clear();
 //      for(std::set<CContactElement>::iterator itr=setCE.begin();itr!=setCE.end();itr++){
@@ -429,29 +514,31 @@ void GetIntermidiateVelocityContactResolved(
       std::cout << "  CCD iter: " << itr << "    Contact Elem Size: " << aContactElem.size() << std::endl;    
     if( aContactElem.empty() ){ return; }
     is_impulse_applied = is_impulse_applied || (!aContactElem.empty());
-    SelfCollisionImpulse_CCD(aUVWm,
+    dfm2::cloth_selfcollision::SelfCollisionImpulse_CCD(aUVWm,
                               contact_clearance,
                               cloth_contact_stiffness,
                               dt,
                               mass_point,
                               aXYZ,aTri,
-                              aContactElem);
+                              aContactElem,
+                              nthread);
+    for(const auto& ce : aContactElem){
+      for(int ino : {ce.ino0, ce.ino1, ce.ino2, ce.ino3}){ aIndVtxDirty.push_back(static_cast<unsigned int>(ino)); }
+    }
   }
   std::vector<double> aUVWm0 = aUVWm;
   std::vector< std::set<int> > aRIZ;
   for(int itr=0;itr<100;itr++){
     std::vector<dfm2::CContactElement> aContactElem;
     {
-      dfm2::CLeafVolumeMaker_DynamicTriangle<dfm2::CBV3d_AABB,double> lvm(
-          dt,aXYZ,aUVWm,aTri,1.0e-10);
-      dfm2::BVH_BuildBVHGeometry(aBB,
-          iroot_bvh, aNodeBVH, lvm);
+      update_bvh_ccd();
       std::set<dfm2::CContactElement> setCE;
       GetContactElement_CCD(setCE,
                             dt,contact_clearance,
                             aXYZ,aUVWm,aTri,
                             iroot_bvh,
-                            aNodeBVH,aBB); // output
+                            aNodeBVH,aBB,
+                            nthread); // output
       aContactElem.assign(setCE.begin(),setCE.end());
 //      for(std::set<CContactElement>::iterator itr=setCE.begin();itr!=setCE.end();itr++){
 //        aContactElem.push_back(*itr);
@@ -467,7 +554,10 @@ void GetIntermidiateVelocityContactResolved(
       break;
     }
     MakeRigidImpactZone(aRIZ, aContactElem, psup_ind,psup);
-    ApplyRigidImpactZone(aUVWm, aRIZ,aXYZ,aUVWm0);
+    ApplyRigidImpactZone(aUVWm, aRIZ,aXYZ,aUVWm0, nthread);
+    for(const auto& riz : aRIZ){
+      for(int ino : riz){ aIndVtxDirty.push_back(static_cast<unsigned int>(ino)); }
+    }
   }
 }
 
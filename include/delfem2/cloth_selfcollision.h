@@ -9,12 +9,41 @@
 #define contact_self_collision_cloth_h
 
 #include <vector>
+#include <set>
 
+#include "delfem2/dfm2_inline.h"
 #include "delfem2/srch_bv3_aabb.h"
 #include "delfem2/srch_bvh.h"
+#include "delfem2/srch_selfintersection_bvh.h"
+
+/**
+ * @brief update the rigid impact zones (RIZs) with the contact elements
+ * @details a contact element is merged to the RIZs that have its vertices or their neighbours.
+ * The RIZs are ordered by their smallest vertex
+ * @param aRIZ (in,out) set of the vertices of each RIZ. The RIZs do not share a vertex
+ */
+DFM2_INLINE void MakeRigidImpactZone(
+    std::vector< std::set<int> >& aRIZ,
+    const std::vector<delfem2::CContactElement>& aContactElem,
+    const std::vector<unsigned int> &psup_ind,
+    const std::vector<unsigned int> &psup);
+
+/**
+ * @brief set the velocities of the vertices in each RIZ to the rigid motion of the RIZ
+ * @param aUVWm0 velocities before the RIZs are applied
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool"
+ */
+DFM2_INLINE void ApplyRigidImpactZone(
+    std::vector<double>& aUVWm,
+    const std::vector< std::set<int> >& aRIZ,
+    const std::vector<double>& aXYZ,
+    const std::vector<double>& aUVWm0,
+    unsigned int nthread = 0);
 
 // 衝突が解消された中間速度を返す
-void GetIntermidiateVelocityContactResolved(
+// nthread: number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+// The result does not depend on the number of threads
+DFM2_INLINE void GetIntermidiateVelocityContactResolved(
     std::vector<double>& aUVWm,
     bool& is_impulse_applied,
     //
@@ -29,6 +58,11 @@ void GetIntermidiateVelocityContactResolved(
     const std::vector<unsigned int> &psup,
     int iroot_bvh,
     const std::vector<delfem2::CNodeBVH2>& aNodeBVH,
-    std::vector<delfem2::CBV3d_AABB>& aBB);
-    
+    std::vector<delfem2::CBV3d_AABB>& aBB,
+    unsigned int nthread = 0);
+
+#ifndef DFM2_STATIC_LIBRARY
+#  include "delfem2/cloth_selfcollision.cpp"
+#endif
+
 #endif
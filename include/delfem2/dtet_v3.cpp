@@ -12,8 +12,12 @@
 #include <iostream>
 #include <ctime>
 #include <cstdio>
+#include <cfloat>
+#include <algorithm>
+#include <array>
 
 #include "delfem2/dtet_v3.h"
+#include "delfem2/srch_bvh.h"
 
 namespace delfem2{
 namespace dtet{
@@ -1805,31 +1809,57 @@ bool delfem2::CheckTet(const std::vector<CDynTet>& tet)
 
 // --------------------------------------------------------------
 
-void delfem2::AddPointTetDelaunay(
+namespace delfem2 {
+namespace dtet {
+
+// reset the marks of the faces of the tetrahedra in the cavity
+DFM2_INLINE void ClearCavityMark(
+    std::vector<int>& tmp_buffer,
+    const std::vector<CTetOld>& aOld)
+{
+  for (const auto & iold : aOld){
+    const unsigned int it0 = iold.it_old;
+    tmp_buffer[it0*4+0] = -1;
+    tmp_buffer[it0*4+1] = -1;
+    tmp_buffer[it0*4+2] = -1;
+    tmp_buffer[it0*4+3] = -1;
+  }
+}
+
+/**
+ * @brief body of "AddPointTetDelaunay". The arrays for the cavity are passed to reuse them for many points.
+ * @return false if the faces of the cavity are not closed (e.g., degenerated by the round-off error).
+ * Then the mesh is not changed
+ */
+DFM2_INLINE bool AddPointTetDelaunay_Cavity(
     unsigned int ip_ins,
     unsigned int itet_ins,
     std::vector<CDynPointTet>& aPo3D,
     std::vector<CDynTet>& aSTet,
     std::vector<CVec3d>& aCent,
-    std::vector<int>& tmp_buffer)
+    std::vector<int>& tmp_buffer,
+    std::vector<CTriNew>& aNew, // faces outside
+    std::vector<CTetOld>& aOld,
+    std::vector< std::pair<unsigned int, unsigned int> >& stackFace,
+    std::vector< std::array<unsigned int,3> >& aEdge)
 {
   assert( aSTet.size() == aCent.size() );
   // ----------------------------------------
-  std::vector<dtet::CTriNew> aNew; // faces outside
-  std::vector<dtet::CTetOld> aOld;
+  aNew.clear();
+  aOld.clear();
+  stackFace.clear();
   {
     tmp_buffer.resize(aSTet.size()*4, -1);
     const CVec3d& p_ins = aPo3D[ip_ins].p;
-    std::stack< std::pair<unsigned int, unsigned int> > stackFace;
-    stackFace.push(std::make_pair(itet_ins, 0));
-    stackFace.push(std::make_pair(itet_ins, 1));
-    stackFace.push(std::make_pair(itet_ins, 2));
-    stackFace.push(std::make_pair(itet_ins, 3));
+    stackFace.emplace_back(itet_ins, 0);
+    stackFace.emplace_back(itet_ins, 1);
+    stackFace.emplace_back(itet_ins, 2);
+    stackFace.emplace_back(itet_ins, 3);
     for (;;){
       if (stackFace.empty()) break;
-      const unsigned int itet0 = stackFace.top().first;
-      const unsigned int itfc0 = stackFace.top().second;
-      stackFace.pop();
+      const unsigned int itet0 = stackFace.back().first;
+      const unsigned int itfc0 = stackFace.back().second;
+      stackFace.pop_back();
       unsigned int iold0 = UINT_MAX;
       {
         if(      tmp_buffer[itet0*4+0] != -1 ){ iold0 = tmp_buffer[itet0*4+0]; }
@@ -1838,7 +1868,7 @@ void delfem2::AddPointTetDelaunay(
         else if( tmp_buffer[itet0*4+3] != -1 ){ iold0 = tmp_buffer[itet0*4+3]; }
         else{
           iold0 = static_cast<unsigned int>(aOld.size());
-          aOld.push_back(dtet::CTetOld(itet0,aSTet[itet0]));
+          aOld.push_back(CTetOld(itet0,aSTet[itet0]));
         }
       }
       if (tmp_buffer[itet0*4+itfc0]>=0) continue; // already examined
@@ -1851,7 +1881,7 @@ void delfem2::AddPointTetDelaunay(
         else if ( !IsInsideCircumSphere(p_ins,aSTet[jtet0],aCent[jtet0],aPo3D) ){ is_out = true; }
         //
         if (is_out){
-          dtet::CTriNew trinew(itet0, itfc0);
+          CTriNew trinew(itet0, itfc0);
           trinew.iold = iold0;
           aNew.push_back(trinew);
           continue;
@@ -1866,9 +1896,9 @@ void delfem2::AddPointTetDelaunay(
       const unsigned int jtf1 = tetRel[irel0][ift1];
       const unsigned int jtf2 = tetRel[irel0][ift2];
       const unsigned int jtf3 = tetRel[irel0][ift3];
-      stackFace.push(std::make_pair(jtet0, jtf1));
-      stackFace.push(std::make_pair(jtet0, jtf2));
-      stackFace.push(std::make_pair(jtet0, jtf3));
+      stackFace.emplace_back(jtet0, jtf1);
+      stackFace.emplace_back(jtet0, jtf2);
+      stackFace.emplace_back(jtet0, jtf3);
     }
 #ifndef NDEBUG
     { // assertion new is on the boundary
@@ -1915,25 +1945,28 @@ void delfem2::AddPointTetDelaunay(
   }
 #endif
   { // find adjancy of new
+    // the edges of the new faces sorted by the vertex indexes. The opposite edge is found by the binary search
+    aEdge.clear();
     for (unsigned int itetnew = 0; itetnew<aNew.size(); ++itetnew){
-      for (int iedtri = 0; iedtri<3; ++iedtri){
+      for (unsigned int iedtri = 0; iedtri<3; ++iedtri){
         const unsigned int i0 = aNew[itetnew].v[(iedtri+1)%3];
         const unsigned int i1 = aNew[itetnew].v[(iedtri+2)%3];
+        aEdge.push_back({i0, i1, itetnew});
         aNew[itetnew].inew_sur[iedtri] = UINT_MAX;
-        for (unsigned int jtrinew = 0; jtrinew<aNew.size(); ++jtrinew){
-          for (int jedtri = 0; jedtri<3; ++jedtri){
-			if (itetnew == jtrinew && iedtri == jedtri) { continue; }
-            const unsigned int j0 = aNew[jtrinew].v[(jedtri+1)%3];
-            const unsigned int j1 = aNew[jtrinew].v[(jedtri+2)%3];
-            assert(i0!=j0||i1!=j1); // consistent face orientatoin
-            if ( i0==j1 && i1==j0 ){
-              aNew[itetnew].inew_sur[iedtri] = jtrinew;
-              break;
-            }
-          }
-          if ( aNew[itetnew].inew_sur[iedtri] != UINT_MAX ){ break; }
+      }
+    }
+    std::sort(aEdge.begin(), aEdge.end());
+    for (unsigned int itetnew = 0; itetnew<aNew.size(); ++itetnew){
+      for (int iedtri = 0; iedtri<3; ++iedtri){
+        const unsigned int i0 = aNew[itetnew].v[(iedtri+1)%3];
+        const unsigned int i1 = aNew[itetnew].v[(iedtri+2)%3];
+        const std::array<unsigned int,3> key = {i1, i0, 0};
+        const auto itr = std::lower_bound(aEdge.begin(), aEdge.end(), key);
+        if( itr == aEdge.end() || (*itr)[0] != i1 || (*itr)[1] != i0 ){ // no face on the opposite side
+          ClearCavityMark(tmp_buffer, aOld);
+          return false;
         }
-        assert( aNew[itetnew].inew_sur[iedtri] != UINT_MAX );
+        aNew[itetnew].inew_sur[iedtri] = (*itr)[2];
       }
     }
 #ifndef NDEBUG
@@ -2075,14 +2108,123 @@ void delfem2::AddPointTetDelaunay(
   }
 #endif
 
+  ClearCavityMark(tmp_buffer, aOld);
+  return true;
+}
+
+}
+}
 
-  for (auto & iold : aOld){
-    const int it0 = iold.it_old;
-    tmp_buffer[it0*4+0] = -1;
-    tmp_buffer[it0*4+1] = -1;
-    tmp_buffer[it0*4+2] = -1;
-    tmp_buffer[it0*4+3] = -1;
+bool delfem2::AddPointTetDelaunay(
+    unsigned int ip_ins,
+    unsigned int itet_ins,
+    std::vector<CDynPointTet>& aPo3D,
+    std::vector<CDynTet>& aSTet,
+    std::vector<CVec3d>& aCent,
+    std::vector<int>& tmp_buffer)
+{
+  std::vector<dtet::CTriNew> aNew;
+  std::vector<dtet::CTetOld> aOld;
+  std::vector< std::pair<unsigned int, unsigned int> > stackFace;
+  std::vector< std::array<unsigned int,3> > aEdge;
+  return dtet::AddPointTetDelaunay_Cavity(
+      ip_ins, itet_ins,
+      aPo3D, aSTet, aCent, tmp_buffer,
+      aNew, aOld, stackFace, aEdge);
+}
+
+DFM2_INLINE unsigned int delfem2::FindTet_Walk(
+    const CVec3d& p,
+    unsigned int itet_start,
+    const std::vector<CDynPointTet>& aPo3D,
+    const std::vector<CDynTet>& aSTet)
+{
+  unsigned int itet = itet_start;
+  for(unsigned int istep=0;istep<aSTet.size();++istep){
+    assert( itet < aSTet.size() && aSTet[itet].isActive() );
+    const CDynTet& tet = aSTet[itet];
+    unsigned int ifc_out = UINT_MAX;
+    for(unsigned int ifc0=0;ifc0<4;++ifc0){
+      const unsigned int ifc = (ifc0+istep)%4; // rotate the first face to avoid the cycle
+      const CVec3d& p0 = aPo3D[ tet.v[ noelTetFace[ifc][0] ] ].p;
+      const CVec3d& p1 = aPo3D[ tet.v[ noelTetFace[ifc][1] ] ].p;
+      const CVec3d& p2 = aPo3D[ tet.v[ noelTetFace[ifc][2] ] ].p;
+      if( Volume_Tet(p, p0, p1, p2) >= 0 ){ continue; } // "p" is on the inner side of the face
+      ifc_out = ifc;
+      break;
+    }
+    if( ifc_out == UINT_MAX ){ return itet; }
+    if( tet.s[ifc_out] == UINT_MAX ){ return UINT_MAX; } // outside of the mesh
+    itet = tet.s[ifc_out];
+  }
+  return UINT_MAX;
+}
+
+DFM2_INLINE unsigned int delfem2::AddPointsTetDelaunay(
+    std::vector<CDynPointTet>& aPo3D,
+    std::vector<CDynTet>& aSTet,
+    std::vector<CVec3d>& aCent)
+{
+  std::vector<unsigned int> aIP_ins;
+  for(unsigned int ip=0;ip<aPo3D.size();++ip){
+    if( aPo3D[ip].e == UINT_MAX ){ aIP_ins.push_back(ip); }
+  }
+  if( aIP_ins.empty() ){ return 0; }
+  { // sort the points along the Morton curve so that the consecutive points are close
+    double bbmin[3] = {+DBL_MAX, +DBL_MAX, +DBL_MAX}, bbmax[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+    std::vector<double> aXYZ(aIP_ins.size()*3);
+    for(unsigned int iip=0;iip<aIP_ins.size();++iip){
+      const CVec3d& p = aPo3D[aIP_ins[iip]].p;
+      for(int idim=0;idim<3;++idim){
+        aXYZ[iip*3+idim] = p[idim];
+        bbmin[idim] = std::min(bbmin[idim], p[idim]);
+        bbmax[idim] = std::max(bbmax[idim], p[idim]);
+      }
+    }
+    const double size = std::max({bbmax[0]-bbmin[0], bbmax[1]-bbmin[1], bbmax[2]-bbmin[2], 1.0e-10});
+    for(int idim=0;idim<3;++idim){ // cube enclosing the points
+      const double c = (bbmin[idim]+bbmax[idim])*0.5;
+      bbmin[idim] = c - size*0.51;
+      bbmax[idim] = c + size*0.51;
+    }
+    std::vector<unsigned int> aIndex;
+    std::vector<std::uint32_t> aMC;
+    SortedMortenCode_Points3(aIndex, aMC, aXYZ, bbmin, bbmax);
+    for(unsigned int& iip : aIndex){ iip = aIP_ins[iip]; }
+    aIP_ins.swap(aIndex);
+  }
+  std::vector<int> tmp_buffer;
+  std::vector<dtet::CTriNew> aNew;
+  std::vector<dtet::CTetOld> aOld;
+  std::vector< std::pair<unsigned int, unsigned int> > stackFace;
+  std::vector< std::array<unsigned int,3> > aEdge;
+  unsigned int itet_start = UINT_MAX;
+  for(unsigned int itet=0;itet<aSTet.size();++itet){
+    if( aSTet[itet].isActive() ){ itet_start = itet; break; }
+  }
+  unsigned int nfail = 0;
+  for(unsigned int ip_ins : aIP_ins){
+    const CVec3d& p_ins = aPo3D[ip_ins].p;
+    unsigned int itet_ins = UINT_MAX;
+    if( itet_start != UINT_MAX ){
+      itet_ins = FindTet_Walk(p_ins, itet_start, aPo3D, aSTet);
+    }
+    if( itet_ins == UINT_MAX ){ nfail++; continue; } // outside
+    { // skip the point at the same position as a vertex
+      const CDynTet& tet = aSTet[itet_ins];
+      bool is_duplicated = false;
+      for(unsigned int ino : tet.v){
+        if( aPo3D[ino].p == p_ins ){ is_duplicated = true; }
+      }
+      if( is_duplicated ){ nfail++; continue; }
+    }
+    if( !dtet::AddPointTetDelaunay_Cavity(
+        ip_ins, itet_ins,
+        aPo3D, aSTet, aCent, tmp_buffer,
+        aNew, aOld, stackFace, aEdge) ){ nfail++; continue; }
+    itet_start = aPo3D[ip_ins].e; // the next point is likely to be around
   }
+  return nfail;
 }
 
 // -------------------------------
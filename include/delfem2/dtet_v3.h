@@ -504,8 +504,10 @@ bool AddPointTet_Edge
 /**
  * @breaf Add point inside tetrahedra and maintain delaunay
  * @param tmp_buffer should be an array of -1. (if input values are all -1, then output values are -1)
+ * @return false if the point is not added because the cavity is broken by the round-off error.
+ * The mesh is not changed then
  */
-void AddPointTetDelaunay(
+bool AddPointTetDelaunay(
     unsigned int ip_ins,
     unsigned int itet_ins,
     std::vector<CDynPointTet> &aPo3D,
@@ -513,6 +515,30 @@ void AddPointTetDelaunay(
     std::vector<CVec3d> &aCent,
     std::vector<int> &tmp_buffer);
 
+/**
+ * @brief find the tetrahedron including the point by walking from "itet_start" toward the point
+ * @param itet_start active tetrahedron. The tetrahedron near the point makes the walk short.
+ * @return UINT_MAX if the point is outside the mesh
+ */
+DFM2_INLINE unsigned int FindTet_Walk(
+    const CVec3d &p,
+    unsigned int itet_start,
+    const std::vector<CDynPointTet> &aPo3D,
+    const std::vector<CDynTet> &aSTet);
+
+/**
+ * @brief add all the points not in the mesh (i.e., "aPo3D[ip].e == UINT_MAX") and maintain delaunay
+ * @details the points are inserted in the order of the Morton code so that the point is located by a short walk
+ * from the tetrahedron of the previous point. The buffers for the cavity are reused for all the points.
+ * The mesh should enclose the points (e.g., a super tetrahedron).
+ * @return the number of the points not added because they are outside the mesh, at the same position as a vertex
+ * or their cavities are broken
+ */
+DFM2_INLINE unsigned int AddPointsTetDelaunay(
+    std::vector<CDynPointTet> &aPo3D,
+    std::vector<CDynTet> &aSTet,
+    std::vector<CVec3d> &aCent);
+
 
 /*
 //! 四面体の中に点を加える
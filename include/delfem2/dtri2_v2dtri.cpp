@@ -142,6 +142,88 @@ DFM2_INLINE bool FindEdgePoint_AcrossEdge(
   return false;
 }
 
+/**
+ * @brief walk from the triangle "itri_start" toward the point "p" crossing the edges the point is beyond.
+ * @details the first edge tested is rotated at each step to avoid the cycle in the walk.
+ * @return the triangle where the walk stops (it may not include "p" if the walk hits the boundary).
+ * UINT_MAX if the walk does not converge.
+ */
+DFM2_INLINE unsigned int FindTriangle_Walk(
+    const CVec2d &p,
+    unsigned int itri_start,
+    const std::vector<CDynTri> &aTri,
+    const std::vector<CVec2d> &aVec2) {
+  unsigned int itri = itri_start;
+  for (unsigned int istep = 0; istep < aTri.size(); ++istep) {
+    assert(itri < aTri.size());
+    const CDynTri &tri = aTri[itri];
+    unsigned int itri_nex = UINT_MAX;
+    for (unsigned int iedge0 = 0; iedge0 < 3; ++iedge0) {
+      const unsigned int iedge = (iedge0 + istep) % 3;
+      if (tri.s2[iedge] == UINT_MAX) { continue; }
+      if (Area_Tri2(p, aVec2[tri.v[(iedge + 1) % 3]], aVec2[tri.v[(iedge + 2) % 3]]) >= 0) { continue; }
+      itri_nex = tri.s2[iedge];
+      break;
+    }
+    if (itri_nex == UINT_MAX) { return itri; }
+    itri = itri_nex;
+  }
+  return UINT_MAX;
+}
+
+/**
+ * @brief check if the point can be added inside the triangle or on its edge
+ * @param[out] iedge edge index where the point is on. UINT_MAX if the point is inside the triangle
+ * @return 0: the point cannot be added to this triangle, 1: the point can be added,
+ * 2: the point is on the boundary edge and should not be added
+ */
+DFM2_INLINE int CheckPointInTriangle(
+    unsigned int &iedge,
+    const CVec2d &po_add,
+    unsigned int itri,
+    const std::vector<CDynTri> &aTri,
+    const std::vector<CVec2d> &aVec2,
+    double MIN_TRI_AREA) {
+  int iflg1 = 0, iflg2 = 0;
+  if (Area_Tri2(po_add, aVec2[aTri[itri].v[1]], aVec2[aTri[itri].v[2]]) > MIN_TRI_AREA) {
+    iflg1++;
+    iflg2 += 0;
+  }
+  if (Area_Tri2(po_add, aVec2[aTri[itri].v[2]], aVec2[aTri[itri].v[0]]) > MIN_TRI_AREA) {
+    iflg1++;
+    iflg2 += 1;
+  }
+  if (Area_Tri2(po_add, aVec2[aTri[itri].v[0]], aVec2[aTri[itri].v[1]]) > MIN_TRI_AREA) {
+    iflg1++;
+    iflg2 += 2;
+  }
+  if (iflg1 == 3) { // add in triangle
+    iedge = UINT_MAX;
+    return 1;
+  }
+  if (iflg1 != 2) { return 0; }
+  // add in edge
+  const int ied0 = 3 - iflg2;
+  const unsigned int ipo_e0 = aTri[itri].v[(ied0 + 1) % 3];
+  const unsigned int ipo_e1 = aTri[itri].v[(ied0 + 2) % 3];
+  const unsigned int itri_s = aTri[itri].s2[ied0];
+  if (itri_s == UINT_MAX) { return 2; }
+  const unsigned int jno0 = FindAdjEdgeIndex(aTri[itri], ied0, aTri);
+  assert(aTri[itri_s].v[(jno0 + 2) % 3] == ipo_e0);
+  assert(aTri[itri_s].v[(jno0 + 1) % 3] == ipo_e1);
+  const unsigned int inoel_d = jno0;
+  assert(aTri[itri_s].s2[inoel_d] == itri);
+  const unsigned int ipo_d = aTri[itri_s].v[inoel_d];
+  assert(Area_Tri2(po_add, aVec2[ipo_e1], aVec2[aTri[itri].v[ied0]]) > MIN_TRI_AREA);
+  assert(Area_Tri2(po_add, aVec2[aTri[itri].v[ied0]], aVec2[ipo_e0]) > MIN_TRI_AREA);
+  if (Area_Tri2(po_add, aVec2[ipo_e0], aVec2[ipo_d]) < MIN_TRI_AREA) { return 0; }
+  if (Area_Tri2(po_add, aVec2[ipo_d], aVec2[ipo_e1]) < MIN_TRI_AREA) { return 0; }
+  const int det_d = DetDelaunay(po_add, aVec2[ipo_e0], aVec2[ipo_e1], aVec2[ipo_d]);
+  if (det_d == 2 || det_d == 1) { return 0; }
+  iedge = ied0;
+  return 1;
+}
+
 } // cad2
 } // delfem2
 
@@ -352,56 +434,42 @@ DFM2_INLINE void delfem2::AddPointsMesh
   assert(aPo2D.size() == aVec2.size());
   if (aPo2D[ipoin].e != UINT_MAX) { return; } // already added
   const CVec2d &po_add = aVec2[ipoin];
-  int itri_in = -1;
-  int iedge = -1;
-  int iflg1 = 0, iflg2 = 0;
-  for (unsigned int itri = 0; itri < aTri.size(); itri++) {
-    iflg1 = 0;
-    iflg2 = 0;
-    if (Area_Tri2(po_add, aVec2[aTri[itri].v[1]], aVec2[aTri[itri].v[2]]) > MIN_TRI_AREA) {
-      iflg1++;
-      iflg2 += 0;
-    }
-    if (Area_Tri2(po_add, aVec2[aTri[itri].v[2]], aVec2[aTri[itri].v[0]]) > MIN_TRI_AREA) {
-      iflg1++;
-      iflg2 += 1;
-    }
-    if (Area_Tri2(po_add, aVec2[aTri[itri].v[0]], aVec2[aTri[itri].v[1]]) > MIN_TRI_AREA) {
-      iflg1++;
-      iflg2 += 2;
+  unsigned int itri_in = UINT_MAX;
+  unsigned int iedge = UINT_MAX;
+  if (!aTri.empty()) {
+    // the last triangle is made by the last insertion. Walk from it as the points are often added nearby.
+    const unsigned int itri0 = dtri2::FindTriangle_Walk(
+        po_add, static_cast<unsigned int>(aTri.size() - 1), aTri, aVec2);
+    if (itri0 != UINT_MAX) {
+      // the point may be on the edge of the triangle next to the one found
+      const unsigned int aTriCand[4] = {itri0, aTri[itri0].s2[0], aTri[itri0].s2[1], aTri[itri0].s2[2]};
+      for (unsigned int itri: aTriCand) {
+        if (itri == UINT_MAX) { continue; }
+        const int res = dtri2::CheckPointInTriangle(iedge, po_add, itri, aTri, aVec2, MIN_TRI_AREA);
+        if (res == 2) { return; }
+        if (res == 1) {
+          itri_in = itri;
+          break;
+        }
+      }
     }
-    if (iflg1 == 3) { // add in triangle
-      itri_in = itri;
-      break;
-    } else if (iflg1 == 2) { // add in edge
-      const int ied0 = 3 - iflg2;
-      const unsigned int ipo_e0 = aTri[itri].v[(ied0 + 1) % 3];
-      const unsigned int ipo_e1 = aTri[itri].v[(ied0 + 2) % 3];
-      const unsigned int itri_s = aTri[itri].s2[ied0];
-      if (itri_s == UINT_MAX) { return; }
-      const unsigned int jno0 = FindAdjEdgeIndex(aTri[itri], ied0, aTri);
-      assert(aTri[itri_s].v[(jno0 + 2) % 3] == ipo_e0);
-      assert(aTri[itri_s].v[(jno0 + 1) % 3] == ipo_e1);
-      const unsigned int inoel_d = jno0;
-      assert(aTri[itri_s].s2[inoel_d] == itri);
-      const unsigned int ipo_d = aTri[itri_s].v[inoel_d];
-      assert(Area_Tri2(po_add, aVec2[ipo_e1], aVec2[aTri[itri].v[ied0]]) > MIN_TRI_AREA);
-      assert(Area_Tri2(po_add, aVec2[aTri[itri].v[ied0]], aVec2[ipo_e0]) > MIN_TRI_AREA);
-      if (Area_Tri2(po_add, aVec2[ipo_e0], aVec2[ipo_d]) < MIN_TRI_AREA) { continue; }
-      if (Area_Tri2(po_add, aVec2[ipo_d], aVec2[ipo_e1]) < MIN_TRI_AREA) { continue; }
-      const int det_d = DetDelaunay(po_add, aVec2[ipo_e0], aVec2[ipo_e1], aVec2[ipo_d]);
-      if (det_d == 2 || det_d == 1) continue;
-      itri_in = itri;
-      iedge = ied0;
-      break;
+  }
+  if (itri_in == UINT_MAX) { // the walk failed (e.g., non-convex mesh). search all the triangles
+    for (unsigned int itri = 0; itri < aTri.size(); itri++) {
+      const int res = dtri2::CheckPointInTriangle(iedge, po_add, itri, aTri, aVec2, MIN_TRI_AREA);
+      if (res == 2) { return; }
+      if (res == 1) {
+        itri_in = itri;
+        break;
+      }
     }
   }
-  if (itri_in == -1) {
-    std::cout << "super triangle failure " << iflg1 << " " << iflg2 << std::endl;
+  if (itri_in == UINT_MAX) {
+    std::cout << "super triangle failure " << ipoin << std::endl;
     assert(0);
     abort();
   }
-  if (iedge == -1) {
+  if (iedge == UINT_MAX) {
     InsertPoint_Elem(ipoin, itri_in, aPo2D, aTri);
   } else {
     InsertPoint_ElemEdge(ipoin, itri_in, iedge, aPo2D, aTri);
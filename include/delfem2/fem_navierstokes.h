@@ -108,6 +108,92 @@ void MakeMat_NavierStokes3D_Dynamic_Newmark_P1P1(
     double emat_uu[4][4][3][3], double emat_up[4][4][3], double emat_pu[4][4][3], double emat_pp[4][4],
     double eres_u[4][3], double eres_p[4]);
 
+namespace navierstokes {
+
+template <class MAT>
+void MergeLinSys_NavierStokes2D(
+    MAT& mat_A,
+    double* vec_b,
+    const double myu,
+    const double rho,
+    const double g_x,
+    const double g_y,
+    const double dt_timestep,
+    const double gamma_newmark,
+    const double* aXY1,
+    const unsigned int* aTri1,
+    const double* aVal, // vx,vy,press
+    const double* aDtVal, // ax,ay,apress
+    unsigned int iel,
+    std::vector<unsigned int>& tmp_buffer)
+{
+  const unsigned int i0 = aTri1[iel*3+0];
+  const unsigned int i1 = aTri1[iel*3+1];
+  const unsigned int i2 = aTri1[iel*3+2];
+  const unsigned int aIP[3] = {i0,i1,i2};
+  double coords[3][2]; FetchData<3,2>(coords, aIP,aXY1);
+  double velo[3][3]; FetchData<3,3>(velo, aIP,aVal);
+  double acc[3][3]; FetchData<3,3>(acc, aIP,aDtVal);
+  //
+  double eres[3][3], emat[3][3][3][3];
+  EMat_NavierStokes2D_Dynamic_P1(
+      myu, rho,  g_x, g_y,
+      dt_timestep, gamma_newmark,
+      coords, velo, acc,
+      emat, eres);
+  for (int ino = 0; ino<3; ino++){
+    const unsigned int ip = aIP[ino];
+    vec_b[ip*3+0] += eres[ino][0];
+    vec_b[ip*3+1] += eres[ino][1];
+    vec_b[ip*3+2] += eres[ino][2];
+  }
+  Merge<3,3,3,3,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+}
+
+template <class MAT>
+void MergeLinSys_NavierStokes3D_Dynamic(
+    MAT& mat_A,
+    double* vec_b,
+    const double myu,
+    const double rho,
+    const double g_x,
+    const double g_y,
+    const double g_z,
+    const double dt_timestep,
+    const double gamma_newmark,
+    const double* aXYZ,
+    const unsigned int* aTet,
+    const double* aVal,
+    const double* aVelo,
+    unsigned int iel,
+    std::vector<unsigned int>& tmp_buffer)
+{
+  const unsigned int aIP[4] = {
+    aTet[iel*4+0],
+    aTet[iel*4+1],
+    aTet[iel*4+2],
+    aTet[iel*4+3] };
+  double coords[4][3]; FetchData<4,3>(coords, aIP,aXYZ);
+  double velo_press[4][4]; FetchData<4,4>(velo_press, aIP,aVal);
+  double acc_apress[4][4]; FetchData<4,4>(acc_apress, aIP,aVelo);
+  double eres[4][4], emat[4][4][4][4];
+  MakeMat_NavierStokes3D_Dynamic_P1(
+      myu, rho,  g_x, g_y,g_z,
+      dt_timestep, gamma_newmark,
+      coords, velo_press, acc_apress,
+      emat, eres);
+  for (int ino = 0; ino<4; ino++){
+    const unsigned int ip = aIP[ino];
+    vec_b[ip*4+0] += eres[ino][0];
+    vec_b[ip*4+1] += eres[ino][1];
+    vec_b[ip*4+2] += eres[ino][2];
+    vec_b[ip*4+3] += eres[ino][3];
+  }
+  Merge<4,4,4,4,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+}
+
+}
+
 template <class MAT>
 void MergeLinSys_NavierStokes2D(
     MAT& mat_A,
@@ -128,31 +214,50 @@ void MergeLinSys_NavierStokes2D(
   const size_t np = nXY;
   std::vector<unsigned int> tmp_buffer(np, UINT_MAX);
   for (unsigned int iel = 0; iel<nTri; ++iel){
-    const unsigned int i0 = aTri1[iel*3+0];
-    const unsigned int i1 = aTri1[iel*3+1];
-    const unsigned int i2 = aTri1[iel*3+2];
-    const unsigned int aIP[3] = {i0,i1,i2};
-    double coords[3][2]; FetchData<3,2>(coords, aIP,aXY1);
-    double velo[3][3]; FetchData<3,3>(velo, aIP,aVal);
-    double acc[3][3]; FetchData<3,3>(acc, aIP,aDtVal);
-    //
-    double eres[3][3], emat[3][3][3][3];
-    EMat_NavierStokes2D_Dynamic_P1(
-        myu, rho,  g_x, g_y,
+    navierstokes::MergeLinSys_NavierStokes2D(
+        mat_A, vec_b,
+        myu, rho, g_x, g_y,
         dt_timestep, gamma_newmark,
-        coords, velo, acc,
-        emat, eres);
-    for (int ino = 0; ino<3; ino++){
-      const unsigned int ip = aIP[ino];
-      vec_b[ip*3+0] += eres[ino][0];
-      vec_b[ip*3+1] += eres[ino][1];
-      vec_b[ip*3+2] += eres[ino][2];
-    }
-//    mat_A.Mearge(3, aIP, 3, aIP, 9, &emat[0][0][0][0], tmp_buffer);
-    Merge<3,3,3,3,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+        aXY1, aTri1, aVal, aDtVal, iel, tmp_buffer);
   }
 }
 
+/**
+ * parallel assembly where the elements with the same color are merged in parallel
+ * @param color_ind jagged array index of the colored triangles (see JArray_ElemColoring_MeshElem)
+ * @param color_elem jagged array value of the colored triangles
+ * @param nthread number of threads. 0 uses all the threads
+ */
+template <class MAT>
+void MergeLinSys_NavierStokes2D(
+    MAT& mat_A,
+    double* vec_b,
+    const double myu,
+    const double rho,
+    const double g_x,
+    const double g_y,
+    const double dt_timestep,
+    const double gamma_newmark,
+    const double* aXY1,
+    const unsigned int* aTri1,
+    const double* aVal, // vx,vy,press
+    const double* aDtVal, // ax,ay,apress
+    const std::vector<unsigned int>& color_ind,
+    const std::vector<unsigned int>& color_elem,
+    unsigned int nthread = 0)
+{
+  MergeParallel_ColoredElem(
+      color_ind, color_elem,
+      [&](unsigned int iel, std::vector<unsigned int>& tmp_buffer) {
+        navierstokes::MergeLinSys_NavierStokes2D(
+            mat_A, vec_b,
+            myu, rho, g_x, g_y,
+            dt_timestep, gamma_newmark,
+            aXY1, aTri1, aVal, aDtVal, iel, tmp_buffer);
+      },
+      nthread);
+}
+
 template <class MAT>
 void MergeLinSys_NavierStokes3D_Dynamic(
     MAT& mat_A,
@@ -175,32 +280,53 @@ void MergeLinSys_NavierStokes3D_Dynamic(
   vec_b.assign(nDoF, 0.0);
   std::vector<unsigned int> tmp_buffer(np, UINT_MAX);
   for (unsigned int iel = 0; iel<aTet.size()/4; ++iel){
-    const unsigned int aIP[4] = {
-      aTet[iel*4+0],
-      aTet[iel*4+1],
-      aTet[iel*4+2],
-      aTet[iel*4+3] };
-    double coords[4][3]; FetchData<4,3>(coords, aIP,aXYZ.data());
-    double velo_press[4][4]; FetchData<4,4>(velo_press, aIP,aVal.data());
-    double acc_apress[4][4]; FetchData<4,4>(acc_apress, aIP,aVelo.data());
-    double eres[4][4], emat[4][4][4][4];
-    MakeMat_NavierStokes3D_Dynamic_P1(
-        myu, rho,  g_x, g_y,g_z,
+    navierstokes::MergeLinSys_NavierStokes3D_Dynamic(
+        mat_A, vec_b.data(),
+        myu, rho, g_x, g_y, g_z,
         dt_timestep, gamma_newmark,
-        coords, velo_press, acc_apress,
-        emat, eres);
-    for (int ino = 0; ino<4; ino++){
-      const unsigned int ip = aIP[ino];
-      vec_b[ip*4+0] += eres[ino][0];
-      vec_b[ip*4+1] += eres[ino][1];
-      vec_b[ip*4+2] += eres[ino][2];
-      vec_b[ip*4+3] += eres[ino][3];
-    }
-//    mat_A.Mearge(4, aIP, 4, aIP,16, &emat[0][0][0][0], tmp_buffer);
-    Merge<4,4,4,4,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+        aXYZ.data(), aTet.data(), aVal.data(), aVelo.data(), iel, tmp_buffer);
   }
 }
 
+/**
+ * parallel assembly where the elements with the same color are merged in parallel
+ * @param color_ind jagged array index of the colored tetrahedra (see JArray_ElemColoring_MeshElem)
+ * @param color_elem jagged array value of the colored tetrahedra
+ * @param nthread number of threads. 0 uses all the threads
+ */
+template <class MAT>
+void MergeLinSys_NavierStokes3D_Dynamic(
+    MAT& mat_A,
+    std::vector<double>& vec_b,
+    const double myu,
+    const double rho,
+    const double g_x,
+    const double g_y,
+    const double g_z,
+    const double dt_timestep,
+    const double gamma_newmark,
+    const std::vector<double>& aXYZ,
+    const std::vector<unsigned int>& aTet,
+    const std::vector<double>& aVal,
+    const std::vector<double>& aVelo,
+    const std::vector<unsigned int>& color_ind,
+    const std::vector<unsigned int>& color_elem,
+    unsigned int nthread = 0)
+{
+  mat_A.setZero();
+  vec_b.assign(aXYZ.size()/3*4, 0.0);
+  MergeParallel_ColoredElem(
+      color_ind, color_elem,
+      [&](unsigned int iel, std::vector<unsigned int>& tmp_buffer) {
+        navierstokes::MergeLinSys_NavierStokes3D_Dynamic(
+            mat_A, vec_b.data(),
+            myu, rho, g_x, g_y, g_z,
+            dt_timestep, gamma_newmark,
+            aXYZ.data(), aTet.data(), aVal.data(), aVelo.data(), iel, tmp_buffer);
+      },
+      nthread);
+}
+
 
 
 } // namespace delfem2
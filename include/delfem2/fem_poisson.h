@@ -89,6 +89,148 @@ DFM2_INLINE void EMat_Diffusion_Newmark_Tet3D(
 // --------------------------------------------
 
 
+namespace poisson {
+
+template <class MAT, typename T0, typename T1>
+void MergeLinSys_Poission_Tri2D(
+    MAT& mat_A,
+    double* vec_b,
+    const double alpha,
+    const double source,
+    const T0* aXY1,
+    const unsigned int* aTri1,
+    const T1* aVal,
+    unsigned int iel,
+    std::vector<unsigned int>& tmp_buffer)
+{
+  const unsigned int i0 = aTri1[iel*3+0];
+  const unsigned int i1 = aTri1[iel*3+1];
+  const unsigned int i2 = aTri1[iel*3+2];
+  const unsigned int aIP[3] = {i0,i1,i2};
+  double coords[3][2]; FetchData<3,2>(coords, aIP,aXY1);
+  const double value[3] = { aVal[i0], aVal[i1], aVal[i2] };
+  //
+  double eres[3], emat[3][3];
+  EMat_Poisson_Tri2D(
+      eres,emat,
+      alpha, source,
+      coords, value);
+  for (int ino = 0; ino<3; ino++){
+    const unsigned int ip = aIP[ino];
+    vec_b[ip] += eres[ino];
+  }
+  Merge<3,3,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+}
+
+template <class MAT>
+void MergeLinSys_Poission_Tet3D(
+    MAT& mat_A,
+    double* vec_b,
+    const double alpha,
+    const double source,
+    const double* aXYZ,
+    const unsigned int* aTet,
+    const double* aVal,
+    unsigned int itet,
+    std::vector<unsigned int>& tmp_buffer)
+{
+  const unsigned int i0 = aTet[itet*4+0];
+  const unsigned int i1 = aTet[itet*4+1];
+  const unsigned int i2 = aTet[itet*4+2];
+  const unsigned int i3 = aTet[itet*4+3];
+  const unsigned int aIP[4] = {i0,i1,i2,i3};
+  double coords[4][3]; FetchData<4,3>(coords, aIP,aXYZ);
+  const double value[4] = { aVal[i0], aVal[i1], aVal[i2], aVal[i3] };
+  //
+  double eres[4], emat[4][4];
+  EMat_Poisson_Tet3D(
+      eres,emat,
+      alpha, source,
+      coords, value);
+  for (int ino = 0; ino<4; ino++){
+    const unsigned int ip = aIP[ino];
+    vec_b[ip] += eres[ino];
+  }
+  Merge<4,4,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+}
+
+template <class MAT>
+void MergeLinSys_Diffusion_Tri2D(
+    MAT& mat_A,
+    double* vec_b,
+    const double alpha,
+    const double rho,
+    const double source,
+    const double dt_timestep,
+    const double gamma_newmark,
+    const double* aXY1,
+    const unsigned int* aTri1,
+    const double* aVal,
+    const double* aVelo,
+    unsigned int iel,
+    std::vector<unsigned int>& tmp_buffer)
+{
+  const unsigned int i0 = aTri1[iel*3+0];
+  const unsigned int i1 = aTri1[iel*3+1];
+  const unsigned int i2 = aTri1[iel*3+2];
+  const unsigned int aIP[3] = {i0,i1,i2};
+  double coords[3][2]; FetchData<3,2>(coords, aIP,aXY1);
+  const double value[3] = { aVal[ i0], aVal[ i1], aVal[ i2] };
+  const double velo[ 3] = { aVelo[i0], aVelo[i1], aVelo[i2] };
+  // --
+  double eres[3], emat[3][3];
+  EMat_Diffusion_Tri2D(
+      eres,emat,
+      alpha, source,
+      dt_timestep, gamma_newmark, rho,
+      coords, value, velo);
+  for (int ino = 0; ino<3; ino++){
+    const unsigned int ip = aIP[ino];
+    vec_b[ip] += eres[ino];
+  }
+  Merge<3,3,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+}
+
+template <class MAT>
+void MergeLinSys_Diffusion_Tet3D(
+    MAT& mat_A,
+    double* vec_b,
+    const double alpha,
+    const double rho,
+    const double source,
+    const double dt_timestep,
+    const double gamma_newmark,
+    const double* aXYZ,
+    const unsigned int* aTet,
+    const double* aVal,
+    const double* aVelo,
+    unsigned int iel,
+    std::vector<unsigned int>& tmp_buffer)
+{
+  const unsigned int i0 = aTet[iel*4+0];
+  const unsigned int i1 = aTet[iel*4+1];
+  const unsigned int i2 = aTet[iel*4+2];
+  const unsigned int i3 = aTet[iel*4+3];
+  const unsigned int aIP[4] = {i0,i1,i2,i3};
+  double coords[4][3]; FetchData<4,3>(coords, aIP,aXYZ);
+  const double value[4] = { aVal[ i0], aVal[ i1], aVal[ i2], aVal[ i3] };
+  const double velo[ 4] = { aVelo[i0], aVelo[i1], aVelo[i2], aVelo[i3] };
+  // ---------------------
+  double eres[4], emat[4][4];
+  EMat_Diffusion_Newmark_Tet3D(
+      eres,emat,
+      alpha, source,
+      dt_timestep, gamma_newmark, rho,
+      coords, value, velo);
+  for (int ino = 0; ino<4; ino++){
+    const unsigned int ip = aIP[ino];
+    vec_b[ip] += eres[ino];
+  }
+  Merge<4,4,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+}
+
+}
+
 template <class MAT, typename T0, typename T1>
 void MergeLinSys_Poission_MeshTri2D(
     MAT& mat_A,
@@ -105,26 +247,43 @@ void MergeLinSys_Poission_MeshTri2D(
   //
   std::vector<unsigned int> tmp_buffer(nDoF, UINT_MAX);
   for (unsigned int iel = 0; iel<nTri; ++iel){
-    const unsigned int i0 = aTri1[iel*3+0];
-    const unsigned int i1 = aTri1[iel*3+1];
-    const unsigned int i2 = aTri1[iel*3+2];
-    const unsigned int aIP[3] = {i0,i1,i2};
-    double coords[3][2]; FetchData<3,2>(coords, aIP,aXY1);
-    const double value[3] = { aVal[i0], aVal[i1], aVal[i2] };
-    //
-    double eres[3], emat[3][3];
-    EMat_Poisson_Tri2D(
-        eres,emat,
+    poisson::MergeLinSys_Poission_Tri2D(
+        mat_A, vec_b,
         alpha, source,
-        coords, value);
-    for (int ino = 0; ino<3; ino++){
-      const unsigned int ip = aIP[ino];
-      vec_b[ip] += eres[ino];
-    }
-    Merge<3,3,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+        aXY1, aTri1, aVal, iel, tmp_buffer);
   }
 }
 
+/**
+ * parallel assembly where the elements with the same color are merged in parallel
+ * @param color_ind jagged array index of the colored triangles (see JArray_ElemColoring_MeshElem)
+ * @param color_elem jagged array value of the colored triangles
+ * @param nthread number of threads. 0 uses all the threads
+ */
+template <class MAT, typename T0, typename T1>
+void MergeLinSys_Poission_MeshTri2D(
+    MAT& mat_A,
+    double* vec_b,
+    const double alpha,
+    const double source,
+    const T0* aXY1,
+    const unsigned int* aTri1,
+    const T1* aVal,
+    const std::vector<unsigned int>& color_ind,
+    const std::vector<unsigned int>& color_elem,
+    unsigned int nthread = 0)
+{
+  MergeParallel_ColoredElem(
+      color_ind, color_elem,
+      [&](unsigned int iel, std::vector<unsigned int>& tmp_buffer) {
+        poisson::MergeLinSys_Poission_Tri2D(
+            mat_A, vec_b,
+            alpha, source,
+            aXY1, aTri1, aVal, iel, tmp_buffer);
+      },
+      nthread);
+}
+
 template <class MAT>
 void MergeLinSys_Poission_MeshTet3D(
     MAT& mat_A,
@@ -140,27 +299,43 @@ void MergeLinSys_Poission_MeshTet3D(
   const size_t np = nXYZ;
   std::vector<unsigned int> tmp_buffer(np, UINT_MAX);
   for (unsigned int itet = 0; itet<nTet; ++itet){
-    const unsigned int i0 = aTet[itet*4+0];
-    const unsigned int i1 = aTet[itet*4+1];
-    const unsigned int i2 = aTet[itet*4+2];
-    const unsigned int i3 = aTet[itet*4+3];
-    const unsigned int aIP[4] = {i0,i1,i2,i3};
-    double coords[4][3]; FetchData<4,3>(coords, aIP,aXYZ);
-    const double value[4] = { aVal[i0], aVal[i1], aVal[i2], aVal[i3] };
-    //
-    double eres[4], emat[4][4];
-    EMat_Poisson_Tet3D(
-        eres,emat,
+    poisson::MergeLinSys_Poission_Tet3D(
+        mat_A, vec_b,
         alpha, source,
-        coords, value);
-    for (int ino = 0; ino<4; ino++){
-      const unsigned int ip = aIP[ino];
-      vec_b[ip] += eres[ino];
-    }
-    Merge<4,4,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+        aXYZ, aTet, aVal, itet, tmp_buffer);
   }
 }
 
+/**
+ * parallel assembly where the elements with the same color are merged in parallel
+ * @param color_ind jagged array index of the colored tetrahedra (see JArray_ElemColoring_MeshElem)
+ * @param color_elem jagged array value of the colored tetrahedra
+ * @param nthread number of threads. 0 uses all the threads
+ */
+template <class MAT>
+void MergeLinSys_Poission_MeshTet3D(
+    MAT& mat_A,
+    double* vec_b,
+    const double alpha,
+    const double source,
+    const double* aXYZ,
+    const unsigned int* aTet,
+    const double* aVal,
+    const std::vector<unsigned int>& color_ind,
+    const std::vector<unsigned int>& color_elem,
+    unsigned int nthread = 0)
+{
+  MergeParallel_ColoredElem(
+      color_ind, color_elem,
+      [&](unsigned int itet, std::vector<unsigned int>& tmp_buffer) {
+        poisson::MergeLinSys_Poission_Tet3D(
+            mat_A, vec_b,
+            alpha, source,
+            aXYZ, aTet, aVal, itet, tmp_buffer);
+      },
+      nthread);
+}
+
 template <class MAT>
 void MergeLinSys_Diffusion_MeshTri2D(
     MAT& mat_A,
@@ -179,28 +354,47 @@ void MergeLinSys_Diffusion_MeshTri2D(
 {
   std::vector<unsigned int> tmp_buffer(nXY, UINT_MAX);
   for (unsigned int iel = 0; iel<nTri; ++iel){
-    const unsigned int i0 = aTri1[iel*3+0];
-    const unsigned int i1 = aTri1[iel*3+1];
-    const unsigned int i2 = aTri1[iel*3+2];
-    const unsigned int aIP[3] = {i0,i1,i2};
-    double coords[3][2]; FetchData<3,2>(coords, aIP,aXY1);
-    const double value[3] = { aVal[ i0], aVal[ i1], aVal[ i2] };
-    const double velo[ 3] = { aVelo[i0], aVelo[i1], aVelo[i2] };
-    // --
-    double eres[3], emat[3][3];
-    EMat_Diffusion_Tri2D(
-        eres,emat,
-        alpha, source,
-        dt_timestep, gamma_newmark, rho,
-        coords, value, velo);
-    for (int ino = 0; ino<3; ino++){
-      const unsigned int ip = aIP[ino];
-      vec_b[ip] += eres[ino];
-    }
-    Merge<3,3,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+    poisson::MergeLinSys_Diffusion_Tri2D(
+        mat_A, vec_b,
+        alpha, rho, source, dt_timestep, gamma_newmark,
+        aXY1, aTri1, aVal, aVelo, iel, tmp_buffer);
   }
 }
 
+/**
+ * parallel assembly where the elements with the same color are merged in parallel
+ * @param color_ind jagged array index of the colored triangles (see JArray_ElemColoring_MeshElem)
+ * @param color_elem jagged array value of the colored triangles
+ * @param nthread number of threads. 0 uses all the threads
+ */
+template <class MAT>
+void MergeLinSys_Diffusion_MeshTri2D(
+    MAT& mat_A,
+    double* vec_b,
+    const double alpha,
+    const double rho,
+    const double source,
+    const double dt_timestep,
+    const double gamma_newmark,
+    const double* aXY1,
+    const unsigned int* aTri1,
+    const double* aVal,
+    const double* aVelo,
+    const std::vector<unsigned int>& color_ind,
+    const std::vector<unsigned int>& color_elem,
+    unsigned int nthread = 0)
+{
+  MergeParallel_ColoredElem(
+      color_ind, color_elem,
+      [&](unsigned int iel, std::vector<unsigned int>& tmp_buffer) {
+        poisson::MergeLinSys_Diffusion_Tri2D(
+            mat_A, vec_b,
+            alpha, rho, source, dt_timestep, gamma_newmark,
+            aXY1, aTri1, aVal, aVelo, iel, tmp_buffer);
+      },
+      nthread);
+}
+
 template <class MAT>
 void MergeLinSys_Diffusion_MeshTet3D(
     MAT& mat_A,
@@ -220,30 +414,46 @@ void MergeLinSys_Diffusion_MeshTet3D(
   const size_t np = nXYZ;
   std::vector<unsigned int> tmp_buffer(np, UINT_MAX);
   for (unsigned int iel = 0; iel<nTet; ++iel){
-    const unsigned int i0 = aTet[iel*4+0];
-    const unsigned int i1 = aTet[iel*4+1];
-    const unsigned int i2 = aTet[iel*4+2];
-    const unsigned int i3 = aTet[iel*4+3];
-    const unsigned int aIP[4] = {i0,i1,i2,i3};
-    double coords[4][3]; FetchData<4,3>(coords, aIP,aXYZ);
-    const double value[4] = { aVal[ i0], aVal[ i1], aVal[ i2], aVal[ i3] };
-    const double velo[ 4] = { aVelo[i0], aVelo[i1], aVelo[i2], aVelo[i3] };
-    // ---------------------
-    double eres[4], emat[4][4];
-    EMat_Diffusion_Newmark_Tet3D(
-        eres,emat,
-        alpha, source,
-        dt_timestep, gamma_newmark, rho,
-        coords, value, velo);
-    for (int ino = 0; ino<4; ino++){
-      const unsigned int ip = aIP[ino];
-      vec_b[ip] += eres[ino];
-    }
-//    mat_A.Mearge(4, aIP, 4, aIP, 1, &emat[0][0], tmp_buffer);
-    Merge<4,4,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+    poisson::MergeLinSys_Diffusion_Tet3D(
+        mat_A, vec_b,
+        alpha, rho, source, dt_timestep, gamma_newmark,
+        aXYZ, aTet, aVal, aVelo, iel, tmp_buffer);
   }
 }
 
+/**
+ * parallel assembly where the elements with the same color are merged in parallel
+ * @param color_ind jagged array index of the colored tetrahedra (see JArray_ElemColoring_MeshElem)
+ * @param color_elem jagged array value of the colored tetrahedra
+ * @param nthread number of threads. 0 uses all the threads
+ */
+template <class MAT>
+void MergeLinSys_Diffusion_MeshTet3D(
+    MAT& mat_A,
+    double* vec_b,
+    const double alpha,
+    const double rho,
+    const double source,
+    const double dt_timestep,
+    const double gamma_newmark,
+    const double* aXYZ,
+    const unsigned int* aTet,
+    const double* aVal,
+    const double* aVelo,
+    const std::vector<unsigned int>& color_ind,
+    const std::vector<unsigned int>& color_elem,
+    unsigned int nthread = 0)
+{
+  MergeParallel_ColoredElem(
+      color_ind, color_elem,
+      [&](unsigned int iel, std::vector<unsigned int>& tmp_buffer) {
+        poisson::MergeLinSys_Diffusion_Tet3D(
+            mat_A, vec_b,
+            alpha, rho, source, dt_timestep, gamma_newmark,
+            aXYZ, aTet, aVal, aVelo, iel, tmp_buffer);
+      },
+      nthread);
+}
 
 } // namespace delfem2
 
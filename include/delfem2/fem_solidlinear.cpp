@@ -203,7 +203,7 @@ DFM2_INLINE void delfem2::EMat_SolidDynamicLinear_Tri2D(
 // -----------------------------------------
 // below: quad
 
-void delfem2::EMat_SolidLinear2_QuadOrth_GaussInt(
+DFM2_INLINE void delfem2::EMat_SolidLinear2_QuadOrth_GaussInt(
   double emat[4][4][2][2],
   double lx,
   double ly,
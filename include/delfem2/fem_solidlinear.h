@@ -28,7 +28,7 @@
 
 namespace delfem2 {
 
-void EMat_SolidLinear2_QuadOrth_GaussInt(
+DFM2_INLINE void EMat_SolidLinear2_QuadOrth_GaussInt(
     double emat[4][4][2][2],
     double lx,
     double ly,
@@ -152,6 +152,85 @@ void SetEmat_LinearSolid3(
   }
 }
 
+namespace solidlinear {
+
+template <class MAT, typename T0, typename T1>
+void MergeLinSys_SolidLinear_Static_Tri2D(
+    MAT& mat_A,
+    double* vec_b,
+    const double myu,
+    const double lambda,
+    const double rho,
+    const double g_x,
+    const double g_y,
+    const T0* aXY1,
+    const unsigned int* aTri1,
+    const T1* aVal,
+    unsigned int iel,
+    std::vector<unsigned int>& tmp_buffer)
+{
+  const unsigned int aIP[3] = {aTri1[iel*3+0], aTri1[iel*3+1], aTri1[iel*3+2]};
+  double coords[3][2]; FetchData<3,2>(coords,aIP, aXY1);
+  double disps[3][2]; FetchData<3,2>(disps,aIP, aVal);
+  //
+  double eres[3][2], emat[3][3][2][2];
+  EMat_SolidStaticLinear_Tri2D(
+      eres,emat,
+      myu, lambda, rho, g_x, g_y,
+      disps, coords);
+  for (int ino = 0; ino<3; ino++){
+    const unsigned int ip = aIP[ino];
+    vec_b[ip*2+0] += eres[ino][0];
+    vec_b[ip*2+1] += eres[ino][1];
+  }
+  Merge<3,3,2,2,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+}
+
+template <class MAT>
+void MergeLinSys_SolidLinear_Static_Tet3D(
+    MAT& mat_A,
+    double* vec_b,
+    const double myu,
+    const double lambda,
+    const double rho,
+    const double *g,
+    const double* aXYZ,
+    const unsigned int* aTet,
+    const double* aDisp,
+    unsigned int iel,
+    std::vector<unsigned int>& tmp_buffer)
+{
+  const unsigned int* aIP = aTet + iel*4;
+  double P[4][3];  FetchData<4,3>(P, aIP, aXYZ);
+  double disps[4][3]; FetchData<4,3>(disps, aIP, aDisp);
+  //
+  double eres[4][3];
+  {
+    const double vol = femutil::TetVolume3D(P[0],P[1],P[2],P[3]);
+    for(auto & ere : eres){
+      ere[0] = vol*rho*g[0]*0.25;
+      ere[1] = vol*rho*g[1]*0.25;
+      ere[2] = vol*rho*g[2]*0.25;
+    }
+  }
+  double emat[4][4][3][3];
+  for(int i=0;i<144;++i){ (&emat[0][0][0][0])[i] = 0.0; } // zero-clear
+  EMat_SolidLinear_Static_Tet(
+      emat,eres,
+      myu, lambda,
+      P, disps,
+      true); // additive
+  for (int ino = 0; ino<4; ino++){
+    const unsigned int ip = aIP[ino];
+    vec_b[ip*3+0] += eres[ino][0];
+    vec_b[ip*3+1] += eres[ino][1];
+    vec_b[ip*3+2] += eres[ino][2];
+  }
+  Merge<4,4,3,3,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+}
+
+}
+
 template <class MAT, typename T0, typename T1>
 void MergeLinSys_SolidLinear_Static_MeshTri2D(
     MAT& mat_A,
@@ -170,24 +249,45 @@ void MergeLinSys_SolidLinear_Static_MeshTri2D(
   const size_t np = nXY;
   std::vector<unsigned int> tmp_buffer(np, UINT_MAX);
   for(unsigned int iel=0; iel<nTri; ++iel){
-    const unsigned int aIP[3] = {aTri1[iel*3+0], aTri1[iel*3+1], aTri1[iel*3+2]};
-    double coords[3][2]; FetchData<3,2>(coords,aIP, aXY1);
-    double disps[3][2]; FetchData<3,2>(disps,aIP, aVal);
-    //
-    double eres[3][2], emat[3][3][2][2];
-    EMat_SolidStaticLinear_Tri2D(
-        eres,emat,
+    solidlinear::MergeLinSys_SolidLinear_Static_Tri2D(
+        mat_A, vec_b,
         myu, lambda, rho, g_x, g_y,
-        disps, coords);
-    for (int ino = 0; ino<3; ino++){
-      const unsigned int ip = aIP[ino];
-      vec_b[ip*2+0] += eres[ino][0];
-      vec_b[ip*2+1] += eres[ino][1];
-    }
-    Merge<3,3,2,2,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+        aXY1, aTri1, aVal, iel, tmp_buffer);
   }
 }
 
+/**
+ * parallel assembly where the elements with the same color are merged in parallel
+ * @param color_ind jagged array index of the colored triangles (see JArray_ElemColoring_MeshElem)
+ * @param color_elem jagged array value of the colored triangles
+ * @param nthread number of threads. 0 uses all the threads
+ */
+template <class MAT, typename T0, typename T1>
+void MergeLinSys_SolidLinear_Static_MeshTri2D(
+    MAT& mat_A,
+    double* vec_b,
+    const double myu,
+    const double lambda,
+    const double rho,
+    const double g_x,
+    const double g_y,
+    const T0* aXY1,
+    const unsigned int* aTri1,
+    const T1* aVal,
+    const std::vector<unsigned int>& color_ind,
+    const std::vector<unsigned int>& color_elem,
+    unsigned int nthread = 0)
+{
+  MergeParallel_ColoredElem(
+      color_ind, color_elem,
+      [&](unsigned int iel, std::vector<unsigned int>& tmp_buffer) {
+        solidlinear::MergeLinSys_SolidLinear_Static_Tri2D(
+            mat_A, vec_b,
+            myu, lambda, rho, g_x, g_y,
+            aXY1, aTri1, aVal, iel, tmp_buffer);
+      },
+      nthread);
+}
 
 template <class MAT>
 void MergeLinSys_SolidLinear_Static_MeshTet3D(
@@ -206,36 +306,45 @@ void MergeLinSys_SolidLinear_Static_MeshTet3D(
   const size_t np = nXYZ;
   std::vector<unsigned int> tmp_buffer(np, UINT_MAX);
   for (unsigned int iel = 0; iel<nTet; ++iel){
-    const unsigned int* aIP = aTet + iel*4;
-    double P[4][3];  FetchData<4,3>(P, aIP, aXYZ);
-    double disps[4][3]; FetchData<4,3>(disps, aIP, aDisp);
-    //
-    double eres[4][3];
-    {
-      const double vol = femutil::TetVolume3D(P[0],P[1],P[2],P[3]);
-      for(auto & ere : eres){
-        ere[0] = vol*rho*g[0]*0.25;
-        ere[1] = vol*rho*g[1]*0.25;
-        ere[2] = vol*rho*g[2]*0.25;
-      }
-    }
-    double emat[4][4][3][3];
-    for(int i=0;i<144;++i){ (&emat[0][0][0][0])[i] = 0.0; } // zero-clear
-    EMat_SolidLinear_Static_Tet(
-        emat,eres,
-        myu, lambda,
-        P, disps,
-        true); // additive
-    for (int ino = 0; ino<4; ino++){
-      const unsigned int ip = aIP[ino];
-      vec_b[ip*3+0] += eres[ino][0];
-      vec_b[ip*3+1] += eres[ino][1];
-      vec_b[ip*3+2] += eres[ino][2];
-    }
-    Merge<4,4,3,3,double>(mat_A,aIP,aIP,emat,tmp_buffer);
+    solidlinear::MergeLinSys_SolidLinear_Static_Tet3D(
+        mat_A, vec_b,
+        myu, lambda, rho, g,
+        aXYZ, aTet, aDisp, iel, tmp_buffer);
   }
 }
 
+/**
+ * parallel assembly where the elements with the same color are merged in parallel
+ * @param color_ind jagged array index of the colored tetrahedra (see JArray_ElemColoring_MeshElem)
+ * @param color_elem jagged array value of the colored tetrahedra
+ * @param nthread number of threads. 0 uses all the threads
+ */
+template <class MAT>
+void MergeLinSys_SolidLinear_Static_MeshTet3D(
+    MAT& mat_A,
+    double* vec_b,
+    const double myu,
+    const double lambda,
+    const double rho,
+    const double *g,
+    const double* aXYZ,
+    const unsigned int* aTet,
+    const double* aDisp,
+    const std::vector<unsigned int>& color_ind,
+    const std::vector<unsigned int>& color_elem,
+    unsigned int nthread = 0)
+{
+  MergeParallel_ColoredElem(
+      color_ind, color_elem,
+      [&](unsigned int iel, std::vector<unsigned int>& tmp_buffer) {
+        solidlinear::MergeLinSys_SolidLinear_Static_Tet3D(
+            mat_A, vec_b,
+            myu, lambda, rho, g,
+            aXYZ, aTet, aDisp, iel, tmp_buffer);
+      },
+      nthread);
+}
+
 template <class MAT>
 void MergeLinSys_LinearSolid3D_Static_Q1(
     MAT& mat_A,
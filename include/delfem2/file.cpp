@@ -14,6 +14,18 @@
 
 #include "delfem2/file.h"
 
+#if defined(_WIN32)
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
 namespace delfem2{
 namespace file{
 
@@ -130,4 +142,80 @@ DFM2_INLINE bool delfem2::GetFileContents(
 error:
   if (fp) fclose(fp);
   return false;
-}
\ No newline at end of file
+}
+// ----------------------
+
+DFM2_INLINE bool delfem2::MemoryMappedFile::Open(
+    const std::string& fpath)
+{
+  this->Close();
+#if defined(_WIN32)
+  HANDLE hfile = CreateFileA(
+      fpath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if( hfile == INVALID_HANDLE_VALUE ){ return false; }
+  LARGE_INTEGER fsize;
+  if( GetFileSizeEx(hfile, &fsize) ){
+    size_ = static_cast<size_t>(fsize.QuadPart);
+    if( size_ == 0 ){
+      is_empty_file_ = true;
+      CloseHandle(hfile);
+      return true;
+    }
+    HANDLE hmap = CreateFileMappingA(hfile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if( hmap != nullptr ){
+      mapping_ = MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(hmap);  // the view keeps the mapping alive
+    }
+  }
+  CloseHandle(hfile);
+#else
+  const int fd = ::open(fpath.c_str(), O_RDONLY);
+  if( fd == -1 ){ return false; }
+  struct stat st{};
+  if( ::fstat(fd, &st) == 0 ){
+    size_ = static_cast<size_t>(st.st_size);
+    if( size_ == 0 ){
+      is_empty_file_ = true;
+      ::close(fd);
+      return true;
+    }
+    void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if( p != MAP_FAILED ){
+      ::madvise(p, size_, MADV_SEQUENTIAL);
+      mapping_ = p;
+    }
+  }
+  ::close(fd);  // the mapping keeps the file alive
+#endif
+  if( mapping_ != nullptr ){
+    data_ = static_cast<const char*>(mapping_);
+    return true;
+  }
+  // fall back to reading the whole file
+  if( !GetFileContents(buffer_, fpath) ){
+    size_ = 0;
+    return false;
+  }
+  size_ = buffer_.size() - 1;  // "GetFileContents" appends the null character
+  data_ = buffer_.data();
+  is_empty_file_ = (size_ == 0);
+  return true;
+}
+
+DFM2_INLINE void delfem2::MemoryMappedFile::Close()
+{
+  if( mapping_ != nullptr ){
+#if defined(_WIN32)
+    UnmapViewOfFile(mapping_);
+#else
+    ::munmap(mapping_, size_);
+#endif
+  }
+  mapping_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+  is_empty_file_ = false;
+  buffer_.clear();
+  buffer_.shrink_to_fit();
+}
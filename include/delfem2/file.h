@@ -56,6 +56,36 @@ DFM2_INLINE bool WriteParam(
 DFM2_INLINE std::string LoadFile(
     const std::string& fname);
 
+/**
+ * @brief read-only view of a file mapped to the memory
+ * @details "mmap" on POSIX and "MapViewOfFile" on Windows.
+ * If the mapping is not available, the whole file is read into a buffer instead.
+ */
+class MemoryMappedFile {
+ public:
+  MemoryMappedFile() = default;
+  explicit MemoryMappedFile(const std::string& fpath) { this->Open(fpath); }
+  MemoryMappedFile(const MemoryMappedFile&) = delete;
+  MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+  ~MemoryMappedFile() { this->Close(); }
+
+  /**
+   * @return false if the file cannot be opened
+   */
+  DFM2_INLINE bool Open(const std::string& fpath);
+  DFM2_INLINE void Close();
+
+  [[nodiscard]] bool IsOpen() const { return data_ != nullptr || is_empty_file_; }
+  [[nodiscard]] const char* data() const { return data_; }
+  [[nodiscard]] size_t size() const { return size_; }
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool is_empty_file_ = false;
+  void* mapping_ = nullptr;  // address of the mapped view. nullptr if "buffer_" is used
+  std::vector<char> buffer_;
+};
+
 //DFM2_INLINE std::map<std::string, std::string> ReadDictionary(
 //    const std::string& path);
 
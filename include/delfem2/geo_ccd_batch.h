@@ -0,0 +1,625 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * @file batched continuous collision detection (CCD) of the vertex-face and edge-edge pairs
+ * @details the candidate pairs found by the broad phase are stored in the SoA layout and they are tested
+ * in the blocks of "N" pairs (4 doubles or 8 floats fill a 256 bit register).
+ * Every stage (the coplanarity cubic, the isolation of its root, the bisection and the proximity at the time of
+ * the contact) is written as a branch-free loop over the lanes of a block, so the compiler vectorizes it.
+ * In double precision, the operations are in the same order as "IsContact_FV_CCD2" and the edge-edge test of
+ * "IsContact_EE_CCD", so the results are bit-identical to them when both are compiled with the same floating-point
+ * flags (e.g., the same "-ffp-contract"). Keep the order of the operations when editing either side.
+ */
+
+#ifndef DFM2_GEO_CCD_BATCH_H
+#define DFM2_GEO_CCD_BATCH_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#if defined(__SSE2__) || defined(__AVX__)
+#  include <immintrin.h>
+#endif
+
+namespace delfem2 {
+
+/**
+ * @brief SoA of the pairs of the primitives for the CCD
+ * @details "ps[ipoint][idim][ipair]" is the position at the start and "pe[ipoint][idim][ipair]" at the end.
+ * For the vertex-face pairs, the points 0,1,2 are the face and the point 3 is the vertex.
+ * For the edge-edge pairs, the points (0,1) and (2,3) are the edges.
+ * @tparam REAL float or double
+ */
+template<typename REAL>
+class CPairsCCD {
+ public:
+  [[nodiscard]] size_t Size() const { return ps[0][0].size(); }
+
+  void Clear() {
+    for (unsigned int ipoint = 0; ipoint < 4; ++ipoint) {
+      for (unsigned int idim = 0; idim < 3; ++idim) {
+        ps[ipoint][idim].clear();
+        pe[ipoint][idim].clear();
+      }
+    }
+  }
+
+  /**
+   * @tparam VEC any type with "operator[]" (e.g., "CVec3d" or "double*")
+   */
+  template<typename VEC>
+  void PushBack(
+      const VEC &p0, const VEC &p1, const VEC &p2, const VEC &p3,
+      const VEC &q0, const VEC &q1, const VEC &q2, const VEC &q3) {
+    const VEC *aP[4] = {&p0, &p1, &p2, &p3};
+    const VEC *aQ[4] = {&q0, &q1, &q2, &q3};
+    for (unsigned int ipoint = 0; ipoint < 4; ++ipoint) {
+      for (unsigned int idim = 0; idim < 3; ++idim) {
+        ps[ipoint][idim].push_back(static_cast<REAL>((*aP[ipoint])[idim]));
+        pe[ipoint][idim].push_back(static_cast<REAL>((*aQ[ipoint])[idim]));
+      }
+    }
+  }
+
+ public:
+  std::vector<REAL> ps[4][3];
+  std::vector<REAL> pe[4][3];
+};
+
+/**
+ * @brief vertex-face CCD of all the pairs in "pairs"
+ * @param[out] is_contact 1 if the vertex passes the face in the time step, 0 otherwise
+ */
+template<typename REAL, unsigned int N = 32 / sizeof(REAL)>
+void IsContact_FV_CCD_Batch(
+    std::vector<unsigned char> &is_contact,
+    const CPairsCCD<REAL> &pairs);
+
+/**
+ * @brief edge-edge CCD of all the pairs in "pairs"
+ * @param[out] is_contact 1 if the edges get closer than "dist_max" when they get coplanar
+ */
+template<typename REAL, unsigned int N = 32 / sizeof(REAL)>
+void IsContact_EE_CCD_Batch(
+    std::vector<unsigned char> &is_contact,
+    const CPairsCCD<REAL> &pairs,
+    REAL dist_max);
+
+/**
+ * @brief time of the first coplanarity of the four points in [0,1] for all the pairs
+ * @param[out] t time of the coplanarity. Undefined if "is_coplanar" is zero
+ * @param[out] is_coplanar 1 if the four points get coplanar in the time step
+ */
+template<typename REAL, unsigned int N = 32 / sizeof(REAL)>
+void FindCoplanarTime_Batch(
+    std::vector<REAL> &t,
+    std::vector<unsigned char> &is_coplanar,
+    const CPairsCCD<REAL> &pairs);
+
+// ---------------------------------------------------------------
+// below: the kernels for a block of "N" pairs
+
+namespace ccd_batch {
+
+/**
+ * square root of the lanes. The specializations use the packed instruction because "std::sqrt" prevents
+ * the vectorization when "errno" is set for the negative values (i.e., without "-fno-math-errno")
+ */
+template<typename REAL, unsigned int N>
+void Sqrt(REAL y[N], const REAL x[N]) {
+  for (unsigned int k = 0; k < N; ++k) { y[k] = std::sqrt(x[k]); }
+}
+
+#if defined(__SSE2__)
+template<>
+inline void Sqrt<double, 4>(double y[4], const double x[4]) {
+#  if defined(__AVX__)
+  _mm256_storeu_pd(y, _mm256_sqrt_pd(_mm256_loadu_pd(x)));
+#  else
+  _mm_storeu_pd(y, _mm_sqrt_pd(_mm_loadu_pd(x)));
+  _mm_storeu_pd(y + 2, _mm_sqrt_pd(_mm_loadu_pd(x + 2)));
+#  endif
+}
+
+template<>
+inline void Sqrt<float, 8>(float y[8], const float x[8]) {
+#  if defined(__AVX__)
+  _mm256_storeu_ps(y, _mm256_sqrt_ps(_mm256_loadu_ps(x)));
+#  else
+  _mm_storeu_ps(y, _mm_sqrt_ps(_mm_loadu_ps(x)));
+  _mm_storeu_ps(y + 4, _mm_sqrt_ps(_mm_loadu_ps(x + 4)));
+#  endif
+}
+#endif
+
+template<typename REAL, unsigned int N>
+void Sub(REAL c[3][N], const REAL a[3][N], const REAL b[3][N]) {
+  for (unsigned int idim = 0; idim < 3; ++idim) {
+    for (unsigned int k = 0; k < N; ++k) { c[idim][k] = a[idim][k] - b[idim][k]; }
+  }
+}
+
+template<typename REAL, unsigned int N>
+void Dot(REAL d[N], const REAL a[3][N], const REAL b[3][N]) {
+  for (unsigned int k = 0; k < N; ++k) { d[k] = a[0][k] * b[0][k] + a[1][k] * b[1][k] + a[2][k] * b[2][k]; }
+}
+
+/**
+ * same order of the operations as "Cross" in "vec3_funcs.h"
+ */
+template<typename REAL, unsigned int N>
+void Cross(REAL c[3][N], const REAL a[3][N], const REAL b[3][N]) {
+  for (unsigned int k = 0; k < N; ++k) {
+    c[0][k] = a[1][k] * b[2][k] - b[1][k] * a[2][k];
+    c[1][k] = a[2][k] * b[0][k] - b[2][k] * a[0][k];
+    c[2][k] = a[0][k] * b[1][k] - b[0][k] * a[1][k];
+  }
+}
+
+/**
+ * norm of the vectors of the lanes
+ */
+template<typename REAL, unsigned int N>
+void Norm(REAL n[N], const REAL a[3][N]) {
+  REAL sq[N];
+  Dot<REAL, N>(sq, a, a);
+  Sqrt<REAL, N>(n, sq);
+}
+
+/**
+ * same order of the operations as "ScalarTripleProduct" in "vec3_funcs.h"
+ */
+template<typename REAL, unsigned int N>
+void ScalarTripleProduct(REAL v[N], const REAL a[3][N], const REAL b[3][N], const REAL c[3][N]) {
+  for (unsigned int k = 0; k < N; ++k) {
+    const REAL v0 = a[0][k] * (b[1][k] * c[2][k] - b[2][k] * c[1][k]);
+    const REAL v1 = a[1][k] * (b[2][k] * c[0][k] - b[0][k] * c[2][k]);
+    const REAL v2 = a[2][k] * (b[0][k] * c[1][k] - b[1][k] * c[0][k]);
+    v[k] = v0 + v1 + v2;
+  }
+}
+
+template<typename REAL>
+inline REAL EvaluateCubic(REAL x, REAL k0, REAL k1, REAL k2, REAL k3) {
+  return k0 + k1 * x + k2 * x * x + k3 * x * x * x;
+}
+
+template<typename REAL>
+inline bool IsInUnit(REAL w) { return !((w < 0) | (w > 1)); }
+
+/**
+ * points of a block of pairs. "ps[ipoint][idim][k]" is the point of the "k"-th lane
+ */
+template<typename REAL, unsigned int N>
+class CBlock {
+ public:
+  /**
+   * the lanes after the end of the pairs repeat the last pair. Their results are not used
+   */
+  void Load(const CPairsCCD<REAL> &pairs, size_t ib) {
+    const size_t npair = pairs.Size();
+    for (unsigned int ipoint = 0; ipoint < 4; ++ipoint) {
+      for (unsigned int idim = 0; idim < 3; ++idim) {
+        const REAL *s = pairs.ps[ipoint][idim].data();
+        const REAL *e = pairs.pe[ipoint][idim].data();
+        for (unsigned int k = 0; k < N; ++k) {
+          const size_t ipair = std::min(ib + k, npair - 1);
+          ps[ipoint][idim][k] = s[ipair];
+          pe[ipoint][idim][k] = e[ipair];
+        }
+      }
+    }
+  }
+  /**
+   * positions at the time "t" of each lane
+   */
+  void Interpolate(REAL pm[4][3][N], const REAL t[N]) const {
+    for (unsigned int ipoint = 0; ipoint < 4; ++ipoint) {
+      for (unsigned int idim = 0; idim < 3; ++idim) {
+        for (unsigned int k = 0; k < N; ++k) {
+          pm[ipoint][idim][k] = (1 - t[k]) * ps[ipoint][idim][k] + t[k] * pe[ipoint][idim][k];
+        }
+      }
+    }
+  }
+ public:
+  REAL ps[4][3][N];
+  REAL pe[4][3][N];
+};
+
+/**
+ * same as "FindCoplanerInterp" for the lanes.
+ * The interval of the root is isolated first, then all the lanes are bisected together
+ */
+template<typename REAL, unsigned int N>
+void CoplanarTime(
+    REAL t[N],
+    unsigned char is_coplanar[N],
+    const CBlock<REAL, N> &b) {
+  REAL k0[N], k1[N], k2[N], k3[N];
+  {
+    REAL x1[3][N], x2[3][N], x3[3][N], v1[3][N], v2[3][N], v3[3][N], tmp[3][N];
+    Sub<REAL, N>(x1, b.ps[1], b.ps[0]);
+    Sub<REAL, N>(x2, b.ps[2], b.ps[0]);
+    Sub<REAL, N>(x3, b.ps[3], b.ps[0]);
+    Sub<REAL, N>(tmp, b.pe[1], b.pe[0]);
+    Sub<REAL, N>(v1, tmp, x1);
+    Sub<REAL, N>(tmp, b.pe[2], b.pe[0]);
+    Sub<REAL, N>(v2, tmp, x2);
+    Sub<REAL, N>(tmp, b.pe[3], b.pe[0]);
+    Sub<REAL, N>(v3, tmp, x3);
+    REAL a[N], c[N];
+    ScalarTripleProduct<REAL, N>(k0, x3, x1, x2);
+    ScalarTripleProduct<REAL, N>(k1, v3, x1, x2);
+    ScalarTripleProduct<REAL, N>(a, x3, v1, x2);
+    ScalarTripleProduct<REAL, N>(c, x3, x1, v2);
+    for (unsigned int k = 0; k < N; ++k) { k1[k] = k1[k] + a[k] + c[k]; }
+    ScalarTripleProduct<REAL, N>(k2, v3, v1, x2);
+    ScalarTripleProduct<REAL, N>(a, v3, x1, v2);
+    ScalarTripleProduct<REAL, N>(c, x3, v1, v2);
+    for (unsigned int k = 0; k < N; ++k) { k2[k] = k2[k] + a[k] + c[k]; }
+    ScalarTripleProduct<REAL, N>(k3, v3, v1, v2);
+  }
+  // isolate the root in [r0,r1]
+  REAL r0[N], r1[N], f0[N], f1[N];
+  {
+    REAL det[N], sqrt_det[N];
+    for (unsigned int k = 0; k < N; ++k) {
+      det[k] = k2[k] * k2[k] - 3 * k1[k] * k3[k];
+      sqrt_det[k] = (det[k] > 0) ? det[k] : REAL(0);
+    }
+    Sqrt<REAL, N>(sqrt_det, sqrt_det);
+    for (unsigned int k = 0; k < N; ++k) {
+      const REAL fa = EvaluateCubic<REAL>(0, k0[k], k1[k], k2[k], k3[k]);
+      const REAL fb = EvaluateCubic<REAL>(1, k0[k], k1[k], k2[k], k3[k]);
+      // cubic function. the root is before one of the extreme values
+      const REAL r3 = (-k2[k] - sqrt_det[k]) / (3 * k3[k]);
+      const REAL r4 = (-k2[k] + sqrt_det[k]) / (3 * k3[k]);
+      const REAL f3 = EvaluateCubic(r3, k0[k], k1[k], k2[k], k3[k]);
+      const REAL f4 = EvaluateCubic(r4, k0[k], k1[k], k2[k], k3[k]);
+      const bool is_cubic = std::fabs(k3[k]) > REAL(1.0e-30);
+      const bool is_r3 = is_cubic & (det[k] >= 0) & (r3 > 0) & (r3 < 1) & (fa * f3 <= 0);
+      const bool is_r4 = is_cubic & (det[k] >= 0) & (r4 > 0) & (r4 < 1) & (fa * f4 <= 0);
+      // quadric function. the root is before the extreme value
+      const REAL r2 = -k1[k] / (2 * k2[k]);
+      const REAL f2 = EvaluateCubic(r2, k0[k], k1[k], k2[k], k3[k]);
+      const bool is_r2 = !is_cubic & (std::fabs(k2[k]) > REAL(1.0e-30)) & (r2 > 0) & (r2 < 1) & (fa * f2 < 0);
+      //
+      const bool is_r1 = fa * fb <= 0;
+      is_coplanar[k] = (is_r1 | is_r2 | is_r3 | is_r4) ? 1 : 0;
+      r0[k] = 0;
+      f0[k] = fa;
+      r1[k] = is_r1 ? REAL(1) : (is_r3 ? r3 : (is_r4 ? r4 : r2));
+      f1[k] = is_r1 ? fb : (is_r3 ? f3 : (is_r4 ? f4 : f2));
+    }
+  }
+  // bisection. the lanes whose root is found keep r0 == r1
+  for (unsigned int k = 0; k < N; ++k) {
+    const bool is_zero0 = (f0[k] * f1[k] == 0) & (f0[k] == 0);
+    const bool is_zero1 = (f0[k] * f1[k] == 0) & (f0[k] != 0);
+    r1[k] = is_zero0 ? r0[k] : r1[k];
+    r0[k] = is_zero1 ? r1[k] : r0[k];
+  }
+  for (unsigned int itr = 0; itr < 15; ++itr) {
+    for (unsigned int k = 0; k < N; ++k) {
+      const bool is_found = (r0[k] == r1[k]);
+      const REAL r2 = REAL(0.5) * (r0[k] + r1[k]);
+      const REAL f2 = EvaluateCubic(r2, k0[k], k1[k], k2[k], k3[k]);
+      const bool is_zero = !is_found & (f2 == 0);
+      const bool is_left = !is_found & !is_zero & (f0[k] * f2 < 0);
+      const bool is_right = !is_found & !is_zero & !is_left;
+      r0[k] = (is_zero | is_right) ? r2 : r0[k];
+      f0[k] = is_right ? f2 : f0[k];
+      r1[k] = (is_zero | is_left) ? r2 : r1[k];
+    }
+  }
+  for (unsigned int k = 0; k < N; ++k) {
+    const REAL rm = REAL(0.5) * (r0[k] + r1[k]);
+    t[k] = (r0[k] == r1[k]) ? r0[k] : rm;
+  }
+}
+
+/**
+ * same as "DistanceFaceVertex" for the lanes
+ */
+template<typename REAL, unsigned int N>
+void DistanceFaceVertex(
+    REAL dist[N], REAL w0[N], REAL w1[N],
+    const REAL p[4][3][N]) {
+  REAL v20[3][N], v21[3][N], v23[3][N];
+  Sub<REAL, N>(v20, p[0], p[2]);
+  Sub<REAL, N>(v21, p[1], p[2]);
+  Sub<REAL, N>(v23, p[3], p[2]);
+  REAL t0[N], t1[N], t2[N], t3[N], t4[N];
+  Dot<REAL, N>(t0, v20, v20);
+  Dot<REAL, N>(t1, v21, v21);
+  Dot<REAL, N>(t2, v20, v21);
+  Dot<REAL, N>(t3, v20, v23);
+  Dot<REAL, N>(t4, v21, v23);
+  REAL w2[N];
+  for (unsigned int k = 0; k < N; ++k) {
+    const REAL det = t0[k] * t1[k] - t2[k] * t2[k];
+    const REAL invdet = 1 / det;
+    w0[k] = (+t1[k] * t3[k] - t2[k] * t4[k]) * invdet;
+    w1[k] = (-t2[k] * t3[k] + t0[k] * t4[k]) * invdet;
+    w2[k] = 1 - w0[k] - w1[k];
+  }
+  REAL d[3][N];
+  for (unsigned int idim = 0; idim < 3; ++idim) {
+    for (unsigned int k = 0; k < N; ++k) {
+      d[idim][k] = (w0[k] * p[0][idim][k] + w1[k] * p[1][idim][k] + w2[k] * p[2][idim][k]) - p[3][idim][k];
+    }
+  }
+  Norm<REAL, N>(dist, d);
+}
+
+/**
+ * distance between the point "ip" and the edge ("is","ie") of the lanes. same as "Nearest_Edge_Point"
+ */
+template<typename REAL, unsigned int N>
+void DistanceEdgePoint(
+    REAL dist[N],
+    const REAL p[4][3][N],
+    unsigned int ip, unsigned int is, unsigned int ie) {
+  REAL s[3][N], e[3][N], d[3][N];
+  Sub<REAL, N>(s, p[is], p[ip]);
+  Sub<REAL, N>(e, p[ie], p[ip]);
+  Sub<REAL, N>(d, e, s);
+  REAL a[N], ds[N], r[N];
+  Dot<REAL, N>(a, d, d);
+  Dot<REAL, N>(ds, d, s);
+  for (unsigned int k = 0; k < N; ++k) {
+    const REAL r0 = -ds[k] / a[k];
+    const REAL r1 = (r0 < 0) ? REAL(0) : r0;
+    const REAL r2 = (r1 > 1) ? REAL(1) : r1;
+    r[k] = (a[k] < REAL(1.0e-20)) ? REAL(0.5) : r2;
+  }
+  REAL v[3][N];
+  for (unsigned int idim = 0; idim < 3; ++idim) {
+    for (unsigned int k = 0; k < N; ++k) {
+      const REAL n0 = (s[idim][k] + e[idim][k]) * r[k];
+      const REAL n1 = (1 - r[k]) * s[idim][k] + r[k] * e[idim][k];
+      const REAL n = (a[k] < REAL(1.0e-20)) ? n0 : n1;
+      v[idim][k] = (n + p[ip][idim][k]) - p[ip][idim][k];
+    }
+  }
+  Norm<REAL, N>(dist, v);
+}
+
+/**
+ * same as "Distance_Edge3_Edge3" for the edges (0,1) and (2,3) of the lanes
+ */
+template<typename REAL, unsigned int N>
+void DistanceEdgeEdge(
+    REAL dist[N], REAL ratio_p[N], REAL ratio_q[N],
+    const REAL p[4][3][N]) {
+  REAL vp[3][N], vq[3][N], c[3][N], len_c[N];
+  Sub<REAL, N>(vp, p[1], p[0]);
+  Sub<REAL, N>(vq, p[3], p[2]);
+  Cross<REAL, N>(c, vp, vq);
+  Norm<REAL, N>(len_c, c);
+  // parallel edges
+  REAL dist_par[N], rp_par[N], rq_par[N];
+  {
+    REAL len_p[N], nvp[3][N], pq0[3][N], vert[3][N], dot[N];
+    Norm<REAL, N>(len_p, vp);
+    for (unsigned int idim = 0; idim < 3; ++idim) {
+      for (unsigned int k = 0; k < N; ++k) { nvp[idim][k] = vp[idim][k] * (1 / len_p[k]); }
+    }
+    Sub<REAL, N>(pq0, p[0], p[2]);
+    Dot<REAL, N>(dot, pq0, nvp);
+    for (unsigned int idim = 0; idim < 3; ++idim) {
+      for (unsigned int k = 0; k < N; ++k) { vert[idim][k] = pq0[idim][k] - dot[k] * nvp[idim][k]; }
+    }
+    Norm<REAL, N>(dist_par, vert);
+    REAL lp0[N], lp1[N], lq0[N], lq1[N];
+    Dot<REAL, N>(lp0, p[0], nvp);
+    Dot<REAL, N>(lp1, p[1], nvp);
+    Dot<REAL, N>(lq0, p[2], nvp);
+    Dot<REAL, N>(lq1, p[3], nvp);
+    for (unsigned int k = 0; k < N; ++k) {
+      const REAL p_min = (lp0[k] < lp1[k]) ? lp0[k] : lp1[k];
+      const REAL p_max = (lp0[k] > lp1[k]) ? lp0[k] : lp1[k];
+      const REAL q_min = (lq0[k] < lq1[k]) ? lq0[k] : lq1[k];
+      const REAL q_max = (lq0[k] > lq1[k]) ? lq0[k] : lq1[k];
+      const bool is_pq = (p_max < q_min) | (!(q_max < p_min) & (p_max < q_max));
+      const REAL lm0 = (p_max + q_min) * REAL(0.5);
+      const REAL lm1 = (q_max + p_min) * REAL(0.5);
+      const REAL lm = is_pq ? lm0 : lm1;
+      rp_par[k] = (lm - lp0[k]) / (lp1[k] - lp0[k]);
+      rq_par[k] = (lm - lq0[k]) / (lq1[k] - lq0[k]);
+    }
+  }
+  // skew edges
+  REAL dist_skw[N], rp_skw[N], rq_skw[N];
+  {
+    REAL pq[3][N], t0[N], t1[N], t2[N], t3[N], t4[N];
+    Sub<REAL, N>(pq, p[2], p[0]);
+    Dot<REAL, N>(t0, vp, vp);
+    Dot<REAL, N>(t1, vq, vq);
+    Dot<REAL, N>(t2, vp, vq);
+    Dot<REAL, N>(t3, vp, pq);
+    Dot<REAL, N>(t4, vq, pq);
+    for (unsigned int k = 0; k < N; ++k) {
+      const REAL det = t0[k] * t1[k] - t2[k] * t2[k];
+      const REAL invdet = 1 / det;
+      rp_skw[k] = (+t1[k] * t3[k] - t2[k] * t4[k]) * invdet;
+      rq_skw[k] = (+t2[k] * t3[k] - t0[k] * t4[k]) * invdet;
+    }
+    REAL d[3][N];
+    for (unsigned int idim = 0; idim < 3; ++idim) {
+      for (unsigned int k = 0; k < N; ++k) {
+        d[idim][k] = (p[0][idim][k] + rp_skw[k] * vp[idim][k]) - (p[2][idim][k] + rq_skw[k] * vq[idim][k]);
+      }
+    }
+    Norm<REAL, N>(dist_skw, d);
+  }
+  for (unsigned int k = 0; k < N; ++k) {
+    const bool is_parallel = len_c[k] < REAL(1.0e-10);
+    dist[k] = is_parallel ? dist_par[k] : dist_skw[k];
+    ratio_p[k] = is_parallel ? rp_par[k] : rp_skw[k];
+    ratio_q[k] = is_parallel ? rq_par[k] : rq_skw[k];
+  }
+}
+
+/**
+ * same as "IsContact_FV_CCD2" for the lanes
+ */
+template<typename REAL, unsigned int N>
+void IsContact_FV_CCD(
+    unsigned char is_contact[N],
+    const CBlock<REAL, N> &b) {
+  unsigned char is_cull[N];
+  { // separating axis of the normal of the face at the start
+    REAL e1[3][N], e2[3][N], n[3][N], d[3][N];
+    Sub<REAL, N>(e1, b.ps[1], b.ps[0]);
+    Sub<REAL, N>(e2, b.ps[2], b.ps[0]);
+    Cross<REAL, N>(n, e1, e2);
+    REAL t0[N], t1[N], t2[N], t3[N];
+    Sub<REAL, N>(d, b.ps[0], b.ps[3]);
+    Dot<REAL, N>(t0, d, n);
+    Sub<REAL, N>(d, b.pe[0], b.pe[3]);
+    Dot<REAL, N>(t1, d, n);
+    Sub<REAL, N>(d, b.pe[1], b.pe[3]);
+    Dot<REAL, N>(t2, d, n);
+    Sub<REAL, N>(d, b.pe[2], b.pe[3]);
+    Dot<REAL, N>(t3, d, n);
+    for (unsigned int k = 0; k < N; ++k) {
+      is_cull[k] = ((t0[k] * t1[k] > 0) & (t0[k] * t2[k] > 0) & (t0[k] * t3[k] > 0)) ? 1 : 0;
+    }
+  }
+  { // the vertex cannot reach the face
+    REAL dist[N], r0[N], r1[N], dist01[N], dist12[N], dist20[N];
+    DistanceFaceVertex<REAL, N>(dist, r0, r1, b.ps);
+    DistanceEdgePoint<REAL, N>(dist01, b.ps, 3, 0, 1);
+    DistanceEdgePoint<REAL, N>(dist12, b.ps, 3, 1, 2);
+    DistanceEdgePoint<REAL, N>(dist20, b.ps, 3, 2, 0);
+    REAL vn[4][N];
+    for (unsigned int ipoint = 0; ipoint < 4; ++ipoint) {
+      REAL d[3][N];
+      Sub<REAL, N>(d, b.ps[ipoint], b.pe[ipoint]);
+      Norm<REAL, N>(vn[ipoint], d);
+    }
+    for (unsigned int k = 0; k < N; ++k) {
+      REAL vnt = (vn[0][k] > vn[1][k]) ? vn[0][k] : vn[1][k];
+      vnt = (vn[2][k] > vnt) ? vn[2][k] : vnt;
+      const REAL max_app = vnt + vn[3][k];
+      const REAL r2 = 1 - r0[k] - r1[k];
+      const bool is_outside = !IsInUnit(r0[k]) | !IsInUnit(r1[k]) | !IsInUnit(r2);
+      const bool is_far_edge = (dist01[k] > max_app) & (dist12[k] > max_app) & (dist20[k] > max_app);
+      const bool is_far = (dist[k] > max_app) | (is_outside & is_far_edge);
+      is_cull[k] = ((is_cull[k] != 0) | is_far) ? 1 : 0;
+    }
+  }
+  REAL t[N];
+  unsigned char is_coplanar[N];
+  CoplanarTime<REAL, N>(t, is_coplanar, b);
+  REAL pm[4][3][N];
+  b.Interpolate(pm, t);
+  REAL dist[N], w0[N], w1[N];
+  DistanceFaceVertex<REAL, N>(dist, w0, w1, pm);
+  for (unsigned int k = 0; k < N; ++k) {
+    const REAL w2 = 1 - w0[k] - w1[k];
+    const bool is_inside = IsInUnit(w0[k]) & IsInUnit(w1[k]) & IsInUnit(w2);
+    is_contact[k] = ((is_cull[k] == 0) & (is_coplanar[k] != 0) & is_inside) ? 1 : 0;
+  }
+}
+
+/**
+ * same as the test after the culling by the bounding boxes in "IsContact_EE_CCD" for the lanes
+ */
+template<typename REAL, unsigned int N>
+void IsContact_EE_CCD(
+    unsigned char is_contact[N],
+    const CBlock<REAL, N> &b,
+    REAL dist_max) {
+  REAL t[N];
+  unsigned char is_coplanar[N];
+  CoplanarTime<REAL, N>(t, is_coplanar, b);
+  REAL pm[4][3][N];
+  b.Interpolate(pm, t);
+  REAL dist[N], w0[N], w1[N];
+  DistanceEdgeEdge<REAL, N>(dist, w0, w1, pm);
+  for (unsigned int k = 0; k < N; ++k) {
+    const bool is_close = IsInUnit(w0[k]) & IsInUnit(w1[k]) & !(dist[k] > dist_max);
+    is_contact[k] = ((is_coplanar[k] != 0) & is_close) ? 1 : 0;
+  }
+}
+
+/**
+ * call "kernel(flag,block)" for the blocks of the pairs and store the flags of the lanes in the range
+ */
+template<typename REAL, unsigned int N, typename KERNEL>
+void ForEachBlock(
+    std::vector<unsigned char> &flag,
+    const CPairsCCD<REAL> &pairs,
+    KERNEL &&kernel) {
+  const size_t npair = pairs.Size();
+  flag.resize(npair);
+  CBlock<REAL, N> block;
+  unsigned char flag_block[N];
+  for (size_t ib = 0; ib < npair; ib += N) {
+    block.Load(pairs, ib);
+    kernel(flag_block, block);
+    const size_t nk = std::min(static_cast<size_t>(N), npair - ib);
+    for (unsigned int k = 0; k < nk; ++k) { flag[ib + k] = flag_block[k]; }
+  }
+}
+
+}  // namespace ccd_batch
+
+} // namespace delfem2
+
+// -------------------------------------------
+
+template<typename REAL, unsigned int N>
+void delfem2::IsContact_FV_CCD_Batch(
+    std::vector<unsigned char> &is_contact,
+    const CPairsCCD<REAL> &pairs) {
+  ccd_batch::ForEachBlock<REAL, N>(
+      is_contact, pairs,
+      [](unsigned char flag[N], const ccd_batch::CBlock<REAL, N> &block) {
+        ccd_batch::IsContact_FV_CCD<REAL, N>(flag, block);
+      });
+}
+
+template<typename REAL, unsigned int N>
+void delfem2::IsContact_EE_CCD_Batch(
+    std::vector<unsigned char> &is_contact,
+    const CPairsCCD<REAL> &pairs,
+    REAL dist_max) {
+  ccd_batch::ForEachBlock<REAL, N>(
+      is_contact, pairs,
+      [dist_max](unsigned char flag[N], const ccd_batch::CBlock<REAL, N> &block) {
+        ccd_batch::IsContact_EE_CCD<REAL, N>(flag, block, dist_max);
+      });
+}
+
+template<typename REAL, unsigned int N>
+void delfem2::FindCoplanarTime_Batch(
+    std::vector<REAL> &t,
+    std::vector<unsigned char> &is_coplanar,
+    const CPairsCCD<REAL> &pairs) {
+  const size_t npair = pairs.Size();
+  t.resize(npair);
+  is_coplanar.resize(npair);
+  ccd_batch::CBlock<REAL, N> block;
+  REAL t_block[N];
+  unsigned char flag_block[N];
+  for (size_t ib = 0; ib < npair; ib += N) {
+    block.Load(pairs, ib);
+    ccd_batch::CoplanarTime<REAL, N>(t_block, flag_block, block);
+    const size_t nk = std::min(static_cast<size_t>(N), npair - ib);
+    for (unsigned int k = 0; k < nk; ++k) {
+      t[ib + k] = t_block[k];
+      is_coplanar[ib + k] = flag_block[k];
+    }
+  }
+}
+
+#endif /* DFM2_GEO_CCD_BATCH_H */
@@ -0,0 +1,770 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "delfem2/ls_amg_block_sparse.h"
+
+#include <cassert>
+#include <cmath>
+#include <climits>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <memory>
+
+#include "delfem2/thread.h"
+
+// ----------------------------------------------------
+
+namespace delfem2::amg {
+
+/**
+ * minimum number of the row blocks processed by a thread
+ */
+constexpr unsigned int num_blk_grain = 512;
+
+/**
+ * the coarsest level is solved by the dense LU factorization if the number of its dofs is not larger than this
+ */
+constexpr unsigned int num_dof_dense_max = 512;
+
+template<typename T>
+T SquaredNormFrobenius(const T *a, unsigned int n) {
+  T s = 0;
+  for (unsigned int i = 0; i < n; ++i) { s += a[i] * a[i]; }
+  return s;
+}
+
+/**
+ * inverse of a dense matrix using the Gauss-Jordan elimination with the partial pivoting
+ * @return false if the matrix is singular. In that case, "a" is set to zero.
+ */
+template<typename T>
+bool InverseDense(
+    T *a,
+    unsigned int n) {
+  std::vector<unsigned int> piv(n);
+  std::iota(piv.begin(), piv.end(), 0);
+  for (unsigned int k = 0; k < n; ++k) {
+    unsigned int kmax = k;
+    for (unsigned int i = k + 1; i < n; ++i) {
+      if (std::fabs(a[i * n + k]) > std::fabs(a[kmax * n + k])) { kmax = i; }
+    }
+    if (std::fabs(a[kmax * n + k]) < 1.0e-30) {
+      for (unsigned int i = 0; i < n * n; ++i) { a[i] = 0; }
+      return false;
+    }
+    if (kmax != k) {
+      for (unsigned int j = 0; j < n; ++j) { std::swap(a[k * n + j], a[kmax * n + j]); }
+      std::swap(piv[k], piv[kmax]);
+    }
+    const T inv_pivot = 1 / a[k * n + k];
+    a[k * n + k] = 1;
+    for (unsigned int j = 0; j < n; ++j) { a[k * n + j] *= inv_pivot; }
+    for (unsigned int i = 0; i < n; ++i) {
+      if (i == k) { continue; }
+      const T f = a[i * n + k];
+      a[i * n + k] = 0;
+      for (unsigned int j = 0; j < n; ++j) { a[i * n + j] -= f * a[k * n + j]; }
+    }
+  }
+  // undo the row permutation as the column permutation of the inverse
+  std::vector<T> tmp(n);
+  for (unsigned int i = 0; i < n; ++i) {
+    for (unsigned int j = 0; j < n; ++j) { tmp[piv[j]] = a[i * n + j]; }
+    for (unsigned int j = 0; j < n; ++j) { a[i * n + j] = tmp[j]; }
+  }
+  return true;
+}
+
+/**
+ * {y} = [A]{x} + beta * {y} for the block sparse matrix whose diagonal blocks are included in the CRS
+ */
+template<typename T>
+void MatVec_BlockCrs(
+    T *y,
+    const std::vector<unsigned int> &ind,
+    const std::vector<unsigned int> &col,
+    const std::vector<T> &val,
+    unsigned int nrowdim,
+    unsigned int ncoldim,
+    const T *x,
+    T beta,
+    unsigned int nthread) {
+  const auto nrowblk = static_cast<unsigned int>(ind.size() - 1);
+  const unsigned int blksize = nrowdim * ncoldim;
+  parallel_for_range(
+      nrowblk,
+      [&](unsigned int ib, unsigned int ie) {
+        for (unsigned int iblk = ib; iblk < ie; ++iblk) {
+          T *yi = y + iblk * nrowdim;
+          for (unsigned int idim = 0; idim < nrowdim; ++idim) { yi[idim] = (beta == 0) ? 0 : yi[idim] * beta; }
+          for (unsigned int icrs = ind[iblk]; icrs < ind[iblk + 1]; ++icrs) {
+            const T *a = val.data() + icrs * blksize;
+            const T *xj = x + col[icrs] * ncoldim;
+            for (unsigned int idim = 0; idim < nrowdim; ++idim) {
+              T s = 0;
+              for (unsigned int jdim = 0; jdim < ncoldim; ++jdim) { s += a[idim * ncoldim + jdim] * xj[jdim]; }
+              yi[idim] += s;
+            }
+          }
+        }
+      },
+      num_blk_grain, nthread);
+}
+
+/**
+ * convert CMatrixSparse into the block CRS where the diagonal blocks are included
+ */
+template<typename T>
+void BlockCrs_MatrixSparse(
+    std::vector<unsigned int> &ind,
+    std::vector<unsigned int> &col,
+    std::vector<T> &val,
+    const CMatrixSparse<T> &mat) {
+  const unsigned int nblk = mat.nrowblk_;
+  const unsigned int blksize = mat.nrowdim_ * mat.ncoldim_;
+  const bool is_dia = !mat.val_dia_.empty();
+  ind.assign(nblk + 1, 0);
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+    ind[iblk + 1] = ind[iblk] + (mat.col_ind_[iblk + 1] - mat.col_ind_[iblk]) + (is_dia ? 1 : 0);
+  }
+  col.resize(ind[nblk]);
+  val.resize(ind[nblk] * blksize);
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+    unsigned int jcrs = ind[iblk];
+    if (is_dia) {
+      col[jcrs] = iblk;
+      std::copy_n(mat.val_dia_.data() + iblk * blksize, blksize, val.data() + jcrs * blksize);
+      ++jcrs;
+    }
+    for (unsigned int icrs = mat.col_ind_[iblk]; icrs < mat.col_ind_[iblk + 1]; ++icrs, ++jcrs) {
+      col[jcrs] = mat.row_ptr_[icrs];
+      std::copy_n(mat.val_crs_.data() + icrs * blksize, blksize, val.data() + jcrs * blksize);
+    }
+  }
+}
+
+/**
+ * product of the block sparse matrices [C] = [A][B]. The columns in each row of [C] are sorted.
+ * @param ncolblk_b number of the column blocks of [B]
+ * @param ndim_i row dimension of the blocks of [A]
+ * @param ndim_j column dimension of the blocks of [A] (= row dimension of the blocks of [B])
+ * @param ndim_k column dimension of the blocks of [B]
+ */
+template<typename T>
+void MatMat_BlockCrs(
+    std::vector<unsigned int> &c_ind,
+    std::vector<unsigned int> &c_col,
+    std::vector<T> &c_val,
+    const std::vector<unsigned int> &a_ind,
+    const std::vector<unsigned int> &a_col,
+    const std::vector<T> &a_val,
+    const std::vector<unsigned int> &b_ind,
+    const std::vector<unsigned int> &b_col,
+    const std::vector<T> &b_val,
+    unsigned int ncolblk_b,
+    unsigned int ndim_i,
+    unsigned int ndim_j,
+    unsigned int ndim_k) {
+  const auto nrowblk = static_cast<unsigned int>(a_ind.size() - 1);
+  const unsigned int blksize_a = ndim_i * ndim_j;
+  const unsigned int blksize_b = ndim_j * ndim_k;
+  const unsigned int blksize_c = ndim_i * ndim_k;
+  c_ind.assign(nrowblk + 1, 0);
+  c_col.clear();
+  c_val.clear();
+  std::vector<unsigned int> col2loc(ncolblk_b, UINT_MAX);
+  std::vector<unsigned int> row_col;
+  std::vector<T> row_val;
+  for (unsigned int iblk = 0; iblk < nrowblk; ++iblk) {
+    row_col.clear();
+    row_val.clear();
+    for (unsigned int icrs = a_ind[iblk]; icrs < a_ind[iblk + 1]; ++icrs) {
+      const unsigned int jblk = a_col[icrs];
+      const T *aij = a_val.data() + icrs * blksize_a;
+      for (unsigned int jcrs = b_ind[jblk]; jcrs < b_ind[jblk + 1]; ++jcrs) {
+        const unsigned int kblk = b_col[jcrs];
+        if (col2loc[kblk] == UINT_MAX) {
+          col2loc[kblk] = static_cast<unsigned int>(row_col.size());
+          row_col.push_back(kblk);
+          row_val.resize(row_val.size() + blksize_c, 0);
+        }
+        T *cik = row_val.data() + col2loc[kblk] * blksize_c;
+        const T *bjk = b_val.data() + jcrs * blksize_b;
+        for (unsigned int i = 0; i < ndim_i; ++i) {
+          for (unsigned int j = 0; j < ndim_j; ++j) {
+            const T a = aij[i * ndim_j + j];
+            for (unsigned int k = 0; k < ndim_k; ++k) { cik[i * ndim_k + k] += a * bjk[j * ndim_k + k]; }
+          }
+        }
+      }
+    }
+    std::vector<unsigned int> order(row_col.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&row_col](unsigned int a, unsigned int b) { return row_col[a] < row_col[b]; });
+    for (unsigned int iloc: order) {
+      c_col.push_back(row_col[iloc]);
+      c_val.insert(c_val.end(),
+                   row_val.begin() + iloc * blksize_c,
+                   row_val.begin() + (iloc + 1) * blksize_c);
+    }
+    for (unsigned int kblk: row_col) { col2loc[kblk] = UINT_MAX; }
+    c_ind[iblk + 1] = static_cast<unsigned int>(c_col.size());
+  }
+}
+
+/**
+ * transpose of the block sparse matrix. Each block is transposed as well
+ */
+template<typename T>
+void Transpose_BlockCrs(
+    std::vector<unsigned int> &t_ind,
+    std::vector<unsigned int> &t_col,
+    std::vector<T> &t_val,
+    const std::vector<unsigned int> &ind,
+    const std::vector<unsigned int> &col,
+    const std::vector<T> &val,
+    unsigned int ncolblk,
+    unsigned int nrowdim,
+    unsigned int ncoldim) {
+  const auto nrowblk = static_cast<unsigned int>(ind.size() - 1);
+  const unsigned int blksize = nrowdim * ncoldim;
+  t_ind.assign(ncolblk + 1, 0);
+  for (unsigned int icrs = 0; icrs < ind[nrowblk]; ++icrs) { t_ind[col[icrs] + 1]++; }
+  for (unsigned int jblk = 0; jblk < ncolblk; ++jblk) { t_ind[jblk + 1] += t_ind[jblk]; }
+  t_col.resize(ind[nrowblk]);
+  t_val.resize(ind[nrowblk] * blksize);
+  for (unsigned int iblk = 0; iblk < nrowblk; ++iblk) {
+    for (unsigned int icrs = ind[iblk]; icrs < ind[iblk + 1]; ++icrs) {
+      const unsigned int jblk = col[icrs];
+      const unsigned int jcrs = t_ind[jblk]++;
+      t_col[jcrs] = iblk;
+      for (unsigned int i = 0; i < nrowdim; ++i) {
+        for (unsigned int j = 0; j < ncoldim; ++j) {
+          t_val[jcrs * blksize + j * nrowdim + i] = val[icrs * blksize + i * ncoldim + j];
+        }
+      }
+    }
+  }
+  for (unsigned int jblk = ncolblk; jblk > 0; --jblk) { t_ind[jblk] = t_ind[jblk - 1]; }
+  t_ind[0] = 0;
+}
+
+/**
+ * aggregation of the blocks based on the strength of connection
+ * @param[out] blk2agg aggregate of each block. UINT_MAX for the block without the strong connection
+ * @return number of the aggregates
+ */
+template<typename T>
+unsigned int Aggregate(
+    std::vector<unsigned int> &blk2agg,
+    const CMatrixSparse<T> &mat,
+    double theta) {
+  const unsigned int nblk = mat.nrowblk_;
+  const unsigned int blksize = mat.nrowdim_ * mat.ncoldim_;
+  std::vector<T> sqnorm_dia(nblk);
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+    sqnorm_dia[iblk] = SquaredNormFrobenius(mat.val_dia_.data() + iblk * blksize, blksize);
+  }
+  // strong connections as a jagged array
+  std::vector<unsigned int> strong_ind(nblk + 1, 0), strong_blk;
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+    for (unsigned int icrs = mat.col_ind_[iblk]; icrs < mat.col_ind_[iblk + 1]; ++icrs) {
+      const unsigned int jblk = mat.row_ptr_[icrs];
+      if (jblk == iblk) { continue; }
+      const T sqnorm = SquaredNormFrobenius(mat.val_crs_.data() + icrs * blksize, blksize);
+      if (sqnorm <= theta * theta * std::sqrt(sqnorm_dia[iblk] * sqnorm_dia[jblk])) { continue; }
+      strong_blk.push_back(jblk);
+    }
+    strong_ind[iblk + 1] = static_cast<unsigned int>(strong_blk.size());
+  }
+  blk2agg.assign(nblk, UINT_MAX);
+  unsigned int nagg = 0;
+  // phase 1: a block whose strong neighbors are all free makes an aggregate with them
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+    if (blk2agg[iblk] != UINT_MAX || strong_ind[iblk] == strong_ind[iblk + 1]) { continue; }
+    bool is_free = true;
+    for (unsigned int is = strong_ind[iblk]; is < strong_ind[iblk + 1]; ++is) {
+      if (blk2agg[strong_blk[is]] != UINT_MAX) { is_free = false; break; }
+    }
+    if (!is_free) { continue; }
+    blk2agg[iblk] = nagg;
+    for (unsigned int is = strong_ind[iblk]; is < strong_ind[iblk + 1]; ++is) { blk2agg[strong_blk[is]] = nagg; }
+    nagg++;
+  }
+  // phase 2: the remaining blocks join the aggregate of a strong neighbor made in the phase 1
+  const std::vector<unsigned int> blk2agg1 = blk2agg;
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+    if (blk2agg1[iblk] != UINT_MAX) { continue; }
+    for (unsigned int is = strong_ind[iblk]; is < strong_ind[iblk + 1]; ++is) {
+      const unsigned int iagg = blk2agg1[strong_blk[is]];
+      if (iagg == UINT_MAX) { continue; }
+      blk2agg[iblk] = iagg;
+      break;
+    }
+  }
+  // phase 3: the blocks still free make the aggregates with their free strong neighbors
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+    if (blk2agg[iblk] != UINT_MAX || strong_ind[iblk] == strong_ind[iblk + 1]) { continue; }
+    blk2agg[iblk] = nagg;
+    for (unsigned int is = strong_ind[iblk]; is < strong_ind[iblk + 1]; ++is) {
+      if (blk2agg[strong_blk[is]] == UINT_MAX) { blk2agg[strong_blk[is]] = nagg; }
+    }
+    nagg++;
+  }
+  return nagg;
+}
+
+/**
+ * tentative prolongation computed by the QR factorization of the near null space restricted to each aggregate
+ * @param[out] nullspace_coarse near null space of the coarse level (the R factors)
+ * @param[out] is_zero_coarse 1 if the coarse dof is dropped because the nullspace is rank deficient in the aggregate
+ */
+template<typename T>
+void TentativeProlongation(
+    std::vector<unsigned int> &p_ind,
+    std::vector<unsigned int> &p_col,
+    std::vector<T> &p_val,
+    std::vector<T> &nullspace_coarse,
+    std::vector<int> &is_zero_coarse,
+    const std::vector<unsigned int> &blk2agg,
+    unsigned int nagg,
+    const std::vector<T> &nullspace,
+    unsigned int ndim,
+    unsigned int nns) {
+  const auto nblk = static_cast<unsigned int>(blk2agg.size());
+  std::vector<unsigned int> agg_ind(nagg + 1, 0), agg_blk;
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+    if (blk2agg[iblk] != UINT_MAX) { agg_ind[blk2agg[iblk] + 1]++; }
+  }
+  for (unsigned int iagg = 0; iagg < nagg; ++iagg) { agg_ind[iagg + 1] += agg_ind[iagg]; }
+  agg_blk.resize(agg_ind[nagg]);
+  {
+    std::vector<unsigned int> tmp(agg_ind.begin(), agg_ind.end() - 1);
+    for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+      if (blk2agg[iblk] != UINT_MAX) { agg_blk[tmp[blk2agg[iblk]]++] = iblk; }
+    }
+  }
+  // one block per row
+  p_ind.assign(nblk + 1, 0);
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+    p_ind[iblk + 1] = p_ind[iblk] + (blk2agg[iblk] != UINT_MAX ? 1 : 0);
+  }
+  p_col.resize(p_ind[nblk]);
+  p_val.assign(p_ind[nblk] * ndim * nns, 0);
+  nullspace_coarse.assign(nagg * nns * nns, 0);
+  is_zero_coarse.assign(nagg * nns, 0);
+  std::vector<T> q;
+  for (unsigned int iagg = 0; iagg < nagg; ++iagg) {
+    const unsigned int nrow = (agg_ind[iagg + 1] - agg_ind[iagg]) * ndim;
+    q.resize(nrow * nns);
+    for (unsigned int ib = agg_ind[iagg]; ib < agg_ind[iagg + 1]; ++ib) {
+      const unsigned int iblk = agg_blk[ib];
+      const unsigned int irow0 = (ib - agg_ind[iagg]) * ndim;
+      for (unsigned int idim = 0; idim < ndim; ++idim) {
+        for (unsigned int k = 0; k < nns; ++k) {
+          q[(irow0 + idim) * nns + k] = nullspace[(iblk * ndim + idim) * nns + k];
+        }
+      }
+    }
+    // modified Gram-Schmidt for the columns of "q"
+    T *r = nullspace_coarse.data() + iagg * nns * nns;
+    for (unsigned int k = 0; k < nns; ++k) {
+      T sqnorm0 = 0;
+      for (unsigned int i = 0; i < nrow; ++i) { sqnorm0 += q[i * nns + k] * q[i * nns + k]; }
+      for (unsigned int j = 0; j < k; ++j) {
+        T d = 0;
+        for (unsigned int i = 0; i < nrow; ++i) { d += q[i * nns + j] * q[i * nns + k]; }
+        r[j * nns + k] = d;
+        for (unsigned int i = 0; i < nrow; ++i) { q[i * nns + k] -= d * q[i * nns + j]; }
+      }
+      T sqnorm = 0;
+      for (unsigned int i = 0; i < nrow; ++i) { sqnorm += q[i * nns + k] * q[i * nns + k]; }
+      if (sqnorm <= 1.0e-20 * sqnorm0 || sqnorm < 1.0e-60) {
+        for (unsigned int i = 0; i < nrow; ++i) { q[i * nns + k] = 0; }
+        is_zero_coarse[iagg * nns + k] = 1;
+        continue;
+      }
+      const T norm = std::sqrt(sqnorm);
+      r[k * nns + k] = norm;
+      for (unsigned int i = 0; i < nrow; ++i) { q[i * nns + k] /= norm; }
+    }
+    for (unsigned int ib = agg_ind[iagg]; ib < agg_ind[iagg + 1]; ++ib) {
+      const unsigned int iblk = agg_blk[ib];
+      const unsigned int irow0 = (ib - agg_ind[iagg]) * ndim;
+      p_col[p_ind[iblk]] = iagg;
+      std::copy_n(q.data() + irow0 * nns, ndim * nns, p_val.data() + p_ind[iblk] * ndim * nns);
+    }
+  }
+}
+
+/**
+ * inverse of the diagonal blocks. The singular block is replaced by zero so that the smoother skips it.
+ */
+template<typename T>
+void InverseDiagonalBlock(
+    std::vector<T> &dia_inv,
+    const CMatrixSparse<T> &mat) {
+  const unsigned int ndim = mat.nrowdim_;
+  const unsigned int blksize = ndim * ndim;
+  dia_inv = mat.val_dia_;
+  for (unsigned int iblk = 0; iblk < mat.nrowblk_; ++iblk) {
+    InverseDense(dia_inv.data() + iblk * blksize, ndim);
+  }
+}
+
+/**
+ * {y} = [D^-1]{x} where [D^-1] is the block diagonal matrix
+ */
+template<typename T>
+void MatVec_BlockDiagonal(
+    T *y,
+    const std::vector<T> &dia_inv,
+    unsigned int nblk,
+    unsigned int ndim,
+    const T *x) {
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+    const T *d = dia_inv.data() + iblk * ndim * ndim;
+    for (unsigned int idim = 0; idim < ndim; ++idim) {
+      T s = 0;
+      for (unsigned int jdim = 0; jdim < ndim; ++jdim) { s += d[idim * ndim + jdim] * x[iblk * ndim + jdim]; }
+      y[iblk * ndim + idim] = s;
+    }
+  }
+}
+
+/**
+ * spectral radius of [D^-1][A] estimated by the power iteration
+ */
+template<typename T>
+T SpectralRadius_JacobiMatrix(
+    const CMatrixSparse<T> &mat,
+    const std::vector<T> &dia_inv) {
+  constexpr unsigned int num_iteration = 20;
+  const unsigned int nblk = mat.nrowblk_;
+  const unsigned int ndim = mat.nrowdim_;
+  const unsigned int ndof = nblk * ndim;
+  std::vector<T> x(ndof), ax(ndof);
+  for (unsigned int i = 0; i < ndof; ++i) { x[i] = 1 + static_cast<T>(i % 7) * 0.1; }
+  T rho = 0;
+  for (unsigned int itr = 0; itr < num_iteration; ++itr) {
+    const T sqnorm_x = SquaredNormFrobenius(x.data(), ndof);
+    if (sqnorm_x < 1.0e-60) { break; }
+    mat.MatVec(ax.data(), 1, x.data(), 0);
+    MatVec_BlockDiagonal(x.data(), dia_inv, nblk, ndim, ax.data());
+    const T sqnorm_dax = SquaredNormFrobenius(x.data(), ndof);
+    rho = std::sqrt(sqnorm_dax / sqnorm_x);
+    const T inv_norm = 1 / std::sqrt(std::max(sqnorm_dax, static_cast<T>(1.0e-60)));
+    for (unsigned int i = 0; i < ndof; ++i) { x[i] *= inv_norm; }
+  }
+  return rho;
+}
+
+/**
+ * LU factorization of a dense matrix with the partial pivoting. The singular pivot is replaced by one.
+ */
+template<typename T>
+void FactorizeDenseLU(
+    std::vector<T> &lu,
+    std::vector<unsigned int> &piv,
+    unsigned int n) {
+  piv.resize(n);
+  for (unsigned int k = 0; k < n; ++k) {
+    unsigned int kmax = k;
+    for (unsigned int i = k + 1; i < n; ++i) {
+      if (std::fabs(lu[i * n + k]) > std::fabs(lu[kmax * n + k])) { kmax = i; }
+    }
+    piv[k] = kmax;
+    if (kmax != k) {
+      for (unsigned int j = 0; j < n; ++j) { std::swap(lu[k * n + j], lu[kmax * n + j]); }
+    }
+    if (std::fabs(lu[k * n + k]) < 1.0e-30) {
+      lu[k * n + k] = 1;
+      for (unsigned int i = k + 1; i < n; ++i) { lu[i * n + k] = 0; }
+      continue;
+    }
+    const T inv_pivot = 1 / lu[k * n + k];
+    for (unsigned int i = k + 1; i < n; ++i) {
+      const T f = lu[i * n + k] * inv_pivot;
+      lu[i * n + k] = f;
+      if (f == 0) { continue; }
+      for (unsigned int j = k + 1; j < n; ++j) { lu[i * n + j] -= f * lu[k * n + j]; }
+    }
+  }
+}
+
+template<typename T>
+void SolveDenseLU(
+    T *x,
+    const std::vector<T> &lu,
+    const std::vector<unsigned int> &piv,
+    unsigned int n) {
+  for (unsigned int k = 0; k < n; ++k) {
+    std::swap(x[k], x[piv[k]]);
+    for (unsigned int i = k + 1; i < n; ++i) { x[i] -= lu[i * n + k] * x[k]; }
+  }
+  for (unsigned int k = n; k-- > 0;) {
+    for (unsigned int j = k + 1; j < n; ++j) { x[k] -= lu[k * n + j] * x[j]; }
+    x[k] /= lu[k * n + k];
+  }
+}
+
+} // delfem2::amg
+
+// -----------------------------------------------------------------
+
+DFM2_INLINE unsigned int delfem2::NearNullSpace_RigidBodyMode(
+    std::vector<double> &nullspace,
+    const double *vtx_xyz,
+    size_t num_vtx,
+    unsigned int ndim) {
+  assert(ndim == 2 || ndim == 3);
+  double cnt[3] = {0, 0, 0};
+  for (unsigned int ivtx = 0; ivtx < num_vtx; ++ivtx) {
+    for (unsigned int idim = 0; idim < ndim; ++idim) { cnt[idim] += vtx_xyz[ivtx * ndim + idim]; }
+  }
+  for (unsigned int idim = 0; idim < ndim; ++idim) { cnt[idim] /= static_cast<double>(num_vtx); }
+  const unsigned int nmode = (ndim == 2) ? 3 : 6;
+  nullspace.assign(num_vtx * ndim * nmode, 0.);
+  for (unsigned int ivtx = 0; ivtx < num_vtx; ++ivtx) {
+    double *b = nullspace.data() + ivtx * ndim * nmode;
+    for (unsigned int idim = 0; idim < ndim; ++idim) { b[idim * nmode + idim] = 1.; }  // translation
+    const double x = vtx_xyz[ivtx * ndim + 0] - cnt[0];
+    const double y = vtx_xyz[ivtx * ndim + 1] - cnt[1];
+    if (ndim == 2) {
+      b[0 * nmode + 2] = -y;
+      b[1 * nmode + 2] = +x;
+      continue;
+    }
+    const double z = vtx_xyz[ivtx * ndim + 2] - cnt[2];
+    b[1 * nmode + 3] = -z;  // rotation around x axis
+    b[2 * nmode + 3] = +y;
+    b[0 * nmode + 4] = +z;  // rotation around y axis
+    b[2 * nmode + 4] = -x;
+    b[0 * nmode + 5] = -y;  // rotation around z axis
+    b[1 * nmode + 5] = +x;
+  }
+  return nmode;
+}
+
+// -----------------------------------------------------------------
+
+template<typename T>
+bool delfem2::CPreconditionerAMG<T>::Initialize(
+    const CMatrixSparse<T> &mat,
+    const T *nullspace,
+    unsigned int nnullspace) {
+  assert(mat.nrowblk_ == mat.ncolblk_ && mat.nrowdim_ == mat.ncoldim_);
+  this->Clear();
+  if (mat.val_dia_.empty()) { return false; }
+  std::vector<T> ns;
+  unsigned int nns = nnullspace;
+  if (nullspace != nullptr) {
+    ns.assign(nullspace, nullspace + mat.nrowblk_ * mat.nrowdim_ * nns);
+  } else {  // constant vector for each component
+    nns = mat.nrowdim_;
+    ns.assign(mat.nrowblk_ * nns * nns, 0);
+    for (unsigned int i = 0; i < mat.nrowblk_ * nns; ++i) { ns[i * nns + i % nns] = 1; }
+  }
+  levels.push_back(std::make_unique<CLevel>());
+  levels[0]->mat = &mat;
+  while (true) {
+    const unsigned int ilev = static_cast<unsigned int>(levels.size()) - 1;
+    const CMatrixSparse<T> &a = *levels[ilev]->mat;
+    const unsigned int nblk = a.nrowblk_;
+    const unsigned int ndim = a.nrowdim_;
+    amg::InverseDiagonalBlock(levels[ilev]->dia_inv, a);
+    const T rho = amg::SpectralRadius_JacobiMatrix(a, levels[ilev]->dia_inv);
+    const T omega = (rho > 0) ? static_cast<T>(4. / 3.) / rho : 1;
+    levels[ilev]->omega_smooth = omega;
+    levels[ilev]->vec_b.resize(nblk * ndim);
+    levels[ilev]->vec_x.resize(nblk * ndim);
+    levels[ilev]->vec_r.resize(nblk * ndim);
+    if (nblk <= nblk_coarsest || levels.size() >= num_level_max) { break; }
+    std::vector<unsigned int> blk2agg;
+    const unsigned int nagg = amg::Aggregate(blk2agg, a, strength_threshold);
+    if (nagg == 0 || nagg >= nblk) { break; }
+    // tentative prolongation
+    std::vector<unsigned int> pt_ind, pt_col;
+    std::vector<T> pt_val, ns_coarse;
+    std::vector<int> is_zero_coarse;
+    amg::TentativeProlongation(
+        pt_ind, pt_col, pt_val, ns_coarse, is_zero_coarse,
+        blk2agg, nagg, ns, ndim, nns);
+    // smoothed prolongation [P] = ([I] - omega [D^-1][A]) [P_tent]
+    std::vector<unsigned int> a_ind, a_col;
+    std::vector<T> a_val;
+    amg::BlockCrs_MatrixSparse(a_ind, a_col, a_val, a);
+    CLevel &lev = *levels[ilev];
+    lev.ndim_coarse = nns;
+    amg::MatMat_BlockCrs(
+        lev.prolong_ind, lev.prolong_col, lev.prolong_val,
+        a_ind, a_col, a_val, pt_ind, pt_col, pt_val,
+        nagg, ndim, ndim, nns);
+    {
+      std::vector<T> tmp(ndim * nns);
+      for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+        const T *d = lev.dia_inv.data() + iblk * ndim * ndim;
+        for (unsigned int icrs = lev.prolong_ind[iblk]; icrs < lev.prolong_ind[iblk + 1]; ++icrs) {
+          T *p = lev.prolong_val.data() + icrs * ndim * nns;
+          for (unsigned int i = 0; i < ndim; ++i) {
+            for (unsigned int k = 0; k < nns; ++k) {
+              T s = 0;
+              for (unsigned int j = 0; j < ndim; ++j) { s += d[i * ndim + j] * p[j * nns + k]; }
+              tmp[i * nns + k] = -omega * s;
+            }
+          }
+          if (pt_ind[iblk] != pt_ind[iblk + 1] && pt_col[pt_ind[iblk]] == lev.prolong_col[icrs]) {
+            const T *q = pt_val.data() + pt_ind[iblk] * ndim * nns;
+            for (unsigned int i = 0; i < ndim * nns; ++i) { tmp[i] += q[i]; }
+          }
+          std::copy(tmp.begin(), tmp.end(), p);
+        }
+      }
+    }
+    amg::Transpose_BlockCrs(
+        lev.restrict_ind, lev.restrict_col, lev.restrict_val,
+        lev.prolong_ind, lev.prolong_col, lev.prolong_val,
+        nagg, ndim, nns);
+    // Galerkin product [A_c] = [P^T][A][P]
+    std::vector<unsigned int> ap_ind, ap_col, ac_ind, ac_col;
+    std::vector<T> ap_val, ac_val;
+    amg::MatMat_BlockCrs(
+        ap_ind, ap_col, ap_val,
+        a_ind, a_col, a_val, lev.prolong_ind, lev.prolong_col, lev.prolong_val,
+        nagg, ndim, ndim, nns);
+    amg::MatMat_BlockCrs(
+        ac_ind, ac_col, ac_val,
+        lev.restrict_ind, lev.restrict_col, lev.restrict_val, ap_ind, ap_col, ap_val,
+        nagg, nns, ndim, nns);
+    levels.push_back(std::make_unique<CLevel>());
+    {
+      levels.back()->mat = &levels.back()->mat_coarse;
+      CMatrixSparse<T> &mc = levels.back()->mat_coarse;
+      const unsigned int blksize = nns * nns;
+      mc.Initialize(nagg, nns, true);
+      mc.nthread_matvec_ = nthread;
+      for (unsigned int iagg = 0; iagg < nagg; ++iagg) {
+        for (unsigned int icrs = ac_ind[iagg]; icrs < ac_ind[iagg + 1]; ++icrs) {
+          const unsigned int jagg = ac_col[icrs];
+          const T *v = ac_val.data() + icrs * blksize;
+          if (jagg == iagg) {
+            std::copy_n(v, blksize, mc.val_dia_.data() + iagg * blksize);
+            continue;
+          }
+          mc.row_ptr_.push_back(jagg);
+          mc.val_crs_.insert(mc.val_crs_.end(), v, v + blksize);
+        }
+        mc.col_ind_[iagg + 1] = static_cast<unsigned int>(mc.row_ptr_.size());
+      }
+      for (unsigned int i = 0; i < nagg * nns; ++i) {
+        if (is_zero_coarse[i]) { mc.val_dia_[(i / nns) * blksize + (i % nns) * nns + (i % nns)] = 1; }
+      }
+    }
+    ns.swap(ns_coarse);
+  }
+  // dense LU factorization of the coarsest level
+  const CMatrixSparse<T> &mc = *levels.back()->mat;
+  const unsigned int ndof_c = mc.nrowblk_ * mc.nrowdim_;
+  if (ndof_c <= amg::num_dof_dense_max) {
+    const unsigned int nd = mc.nrowdim_;
+    coarsest_lu.assign(ndof_c * ndof_c, 0);
+    for (unsigned int iblk = 0; iblk < mc.nrowblk_; ++iblk) {
+      for (unsigned int i = 0; i < nd; ++i) {
+        for (unsigned int j = 0; j < nd; ++j) {
+          coarsest_lu[(iblk * nd + i) * ndof_c + iblk * nd + j] = mc.val_dia_[iblk * nd * nd + i * nd + j];
+        }
+        for (unsigned int icrs = mc.col_ind_[iblk]; icrs < mc.col_ind_[iblk + 1]; ++icrs) {
+          const unsigned int jblk = mc.row_ptr_[icrs];
+          for (unsigned int j = 0; j < nd; ++j) {
+            coarsest_lu[(iblk * nd + i) * ndof_c + jblk * nd + j] += mc.val_crs_[icrs * nd * nd + i * nd + j];
+          }
+        }
+      }
+    }
+    amg::FactorizeDenseLU(coarsest_lu, coarsest_piv, ndof_c);
+  }
+  return true;
+}
+
+template<typename T>
+void delfem2::CPreconditionerAMG<T>::Smooth(
+    unsigned int ilev) const {
+  const CLevel &lev = *levels[ilev];
+  const unsigned int nblk = lev.mat->nrowblk_;
+  const unsigned int ndim = lev.mat->nrowdim_;
+  // {r} = {b} - [A]{x}
+  lev.vec_r = lev.vec_b;
+  lev.mat->MatVec(lev.vec_r.data(), -1, lev.vec_x.data(), 1);
+  // {x} += omega [D^-1]{r}
+  parallel_for_range(
+      nblk,
+      [&lev, ndim](unsigned int ib, unsigned int ie) {
+        for (unsigned int iblk = ib; iblk < ie; ++iblk) {
+          const T *d = lev.dia_inv.data() + iblk * ndim * ndim;
+          const T *r = lev.vec_r.data() + iblk * ndim;
+          T *x = lev.vec_x.data() + iblk * ndim;
+          for (unsigned int idim = 0; idim < ndim; ++idim) {
+            T s = 0;
+            for (unsigned int jdim = 0; jdim < ndim; ++jdim) { s += d[idim * ndim + jdim] * r[jdim]; }
+            x[idim] += lev.omega_smooth * s;
+          }
+        }
+      },
+      amg::num_blk_grain, nthread);
+}
+
+template<typename T>
+void delfem2::CPreconditionerAMG<T>::VCycle(
+    unsigned int ilev) const {
+  const CLevel &lev = *levels[ilev];
+  std::fill(lev.vec_x.begin(), lev.vec_x.end(), 0);
+  if (ilev + 1 == levels.size()) {  // coarsest level
+    if (!coarsest_lu.empty()) {
+      lev.vec_x = lev.vec_b;
+      amg::SolveDenseLU(
+          lev.vec_x.data(), coarsest_lu, coarsest_piv,
+          static_cast<unsigned int>(lev.vec_x.size()));
+      return;
+    }
+    for (unsigned int is = 0; is < num_smooth * 4; ++is) { this->Smooth(ilev); }
+    return;
+  }
+  for (unsigned int is = 0; is < num_smooth; ++is) { this->Smooth(ilev); }
+  // restrict the residual
+  lev.vec_r = lev.vec_b;
+  lev.mat->MatVec(lev.vec_r.data(), -1, lev.vec_x.data(), 1);
+  const CLevel &lev_c = *levels[ilev + 1];
+  amg::MatVec_BlockCrs(
+      lev_c.vec_b.data(),
+      lev.restrict_ind, lev.restrict_col, lev.restrict_val,
+      lev.ndim_coarse, lev.mat->nrowdim_,
+      lev.vec_r.data(), static_cast<T>(0), nthread);
+  this->VCycle(ilev + 1);
+  // prolongate the correction
+  amg::MatVec_BlockCrs(
+      lev.vec_x.data(),
+      lev.prolong_ind, lev.prolong_col, lev.prolong_val,
+      lev.mat->nrowdim_, lev.ndim_coarse,
+      lev_c.vec_x.data(), static_cast<T>(1), nthread);
+  for (unsigned int is = 0; is < num_smooth; ++is) { this->Smooth(ilev); }
+}
+
+template<typename T>
+void delfem2::CPreconditionerAMG<T>::SolvePrecond(
+    T *vec) const {
+  if (levels.empty()) { return; }
+  const CLevel &lev = *levels[0];
+  std::copy_n(vec, lev.vec_b.size(), lev.vec_b.begin());
+  this->VCycle(0);
+  std::copy(lev.vec_x.begin(), lev.vec_x.end(), vec);
+}
+
+#ifdef DFM2_STATIC_LIBRARY
+template class delfem2::CPreconditionerAMG<double>;
+#endif
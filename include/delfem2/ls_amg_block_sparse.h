@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * @file smoothed aggregation algebraic multigrid (AMG) preconditioner for the block sparse matrix
+ * @details the blocks of the matrix are aggregated using the strength of connection between the blocks.
+ * The tentative prolongation is computed from the near null space (e.g., rigid body modes) of each aggregate
+ * and smoothed by a damped Jacobi iteration. The coarse matrix is the Galerkin product P^T A P.
+ * The preconditioner is one V-cycle with the damped block Jacobi smoother,
+ * which is symmetric so that it can be used in the PCG.
+ */
+
+#ifndef DFM2_LS_AMG_BLOCK_SPARSE_H
+#define DFM2_LS_AMG_BLOCK_SPARSE_H
+
+#include <vector>
+#include <memory>
+
+#include "delfem2/ls_block_sparse.h"
+#include "delfem2/dfm2_inline.h"
+
+namespace delfem2 {
+
+/**
+ * @brief rigid body modes used as the near null space of the linear elasticity
+ * @param[out] nullspace (ndof x nmode) matrix where ndof=nvtx*ndim. The row of the i-th dof is nullspace[i*nmode...]
+ * @param ndim 2 or 3. The number of the modes "nmode" is 3 for 2D and 6 for 3D
+ * @return nmode
+ */
+DFM2_INLINE unsigned int NearNullSpace_RigidBodyMode(
+    std::vector<double> &nullspace,
+    const double *vtx_xyz,
+    size_t num_vtx,
+    unsigned int ndim);
+
+/**
+ * @brief smoothed aggregation AMG preconditioner class
+ * @details SolvePrecond() has the same interface as CPreconditionerILU,
+ * so this can be used as the "PREC" template parameter of Solve_PCG() and Solve_PBiCGStab().
+ * SolvePrecond() is not re-entrant because it uses the work vectors of the levels.
+ * @tparam T double
+ */
+template<typename T>
+class CPreconditionerAMG {
+ public:
+  class CLevel {
+   public:
+    const CMatrixSparse<T> *mat = nullptr;  // the caller's matrix at the finest level, "mat_coarse" otherwise
+    CMatrixSparse<T> mat_coarse;  // Galerkin product. empty at the finest level
+    std::vector<T> dia_inv;  // inverse of the diagonal blocks for the smoother
+    T omega_smooth = 1;  // damping factor of the Jacobi smoother
+    // prolongation from the next coarser level. block sparse matrix (nblk x nblk_coarse) with (ndim x ndim_coarse) blocks
+    unsigned int ndim_coarse = 0;
+    std::vector<unsigned int> prolong_ind;
+    std::vector<unsigned int> prolong_col;
+    std::vector<T> prolong_val;
+    // transpose of the prolongation (restriction)
+    std::vector<unsigned int> restrict_ind;
+    std::vector<unsigned int> restrict_col;
+    std::vector<T> restrict_val;
+    // work vectors
+    mutable std::vector<T> vec_b, vec_x, vec_r;
+  };
+
+ public:
+  void Clear() {
+    levels.clear();
+    coarsest_lu.clear();
+    coarsest_piv.clear();
+  }
+
+  /**
+   * @brief build the hierarchy of the levels
+   * @details "mat" is not copied but referred to as the finest level. It must be alive and unchanged while this
+   * preconditioner is used. The MatVec() at the finest level follows the threading of "mat" (nthread_matvec_).
+   * @param nullspace (ndof x nnullspace) matrix of the near null space vectors. The row of the i-th dof is
+   * nullspace[i*nnullspace...]. If nullptr, the constant vector for each component of the block is used.
+   * @return false if the setup fails
+   */
+  bool Initialize(
+      const CMatrixSparse<T> &mat,
+      const T *nullspace = nullptr,
+      unsigned int nnullspace = 0);
+
+  /**
+   * @brief {vec} = [M^-1]{vec} where M^-1 is one V-cycle
+   */
+  void SolvePrecond(T *vec) const;
+
+  [[nodiscard]] size_t NumLevel() const { return levels.size(); }
+
+ private:
+  void VCycle(unsigned int ilev) const;
+  void Smooth(unsigned int ilev) const;
+
+ public:
+  /**
+   * threshold of the strength of connection. The blocks i and j are strongly connected
+   * if |A_ij| > strength_threshold * sqrt(|A_ii||A_jj|) in the Frobenius norm
+   */
+  double strength_threshold = 0.08;
+
+  /**
+   * the coarsening stops if the number of the blocks is smaller than this
+   */
+  unsigned int nblk_coarsest = 64;
+
+  unsigned int num_level_max = 10;
+
+  /**
+   * number of the pre- and post-smoothing iterations
+   */
+  unsigned int num_smooth = 2;
+
+  /**
+   * number of threads for the smoothing and the matrix-vector products.
+   * 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+   */
+  unsigned int nthread = 1;
+
+  std::vector<std::unique_ptr<CLevel>> levels;  // held by the pointers so that the matrices are not copied
+  std::vector<T> coarsest_lu;  // dense LU factorization of the matrix of the coarsest level
+  std::vector<unsigned int> coarsest_piv;
+};
+
+} // namespace delfem2
+
+#ifndef DFM2_STATIC_LIBRARY
+#  include "delfem2/ls_amg_block_sparse.cpp"
+#endif
+
+#endif /* DFM2_LS_AMG_BLOCK_SPARSE_H */
@@ -9,9 +9,19 @@
 
 #include <cassert>
 #include <complex>
+#if defined(__AVX__)
+#  include <immintrin.h>
+#endif
+
+#include "delfem2/thread.h"
 
 namespace delfem2::mats {
 
+/**
+ * minimum number of block rows processed by a thread in the parallel matrix-vector product
+ */
+constexpr unsigned int num_blkrow_grain_matvec = 512;
+
 DFM2_INLINE double MatNorm_Assym(
     const double *V0,
     unsigned int n0,
@@ -60,13 +70,14 @@ template<typename T>
 void MatVec_MatSparseCRS_Blk11(
     T *y,
     T alpha,
-    unsigned nrowblk,
+    unsigned int iblk_begin,
+    unsigned int iblk_end,
     const T *vcrs,
     const T *vdia,
     const unsigned int *colind,
     const unsigned int *rowptr,
     const T *x) {
-  for (unsigned int iblk = 0; iblk < nrowblk; iblk++) {
+  for (unsigned int iblk = iblk_begin; iblk < iblk_end; iblk++) {
     const unsigned int colind0 = colind[iblk];
     const unsigned int colind1 = colind[iblk + 1];
     for (unsigned int icrs = colind0; icrs < colind1; icrs++) {
@@ -81,13 +92,14 @@ template<typename T>
 void MatVec_MatSparseCRS_Blk22(
     T *y,
     T alpha,
-    unsigned nrowblk,
+    unsigned int iblk_begin,
+    unsigned int iblk_end,
     const T *vcrs,
     const T *vdia,
     const unsigned int *colind,
     const unsigned int *rowptr,
     const T *x) {
-  for (unsigned int iblk = 0; iblk < nrowblk; iblk++) {
+  for (unsigned int iblk = iblk_begin; iblk < iblk_end; iblk++) {
     const unsigned int icrs0 = colind[iblk];
     const unsigned int icrs1 = colind[iblk + 1];
     for (unsigned int icrs = icrs0; icrs < icrs1; icrs++) {
@@ -104,13 +116,14 @@ template<typename T>
 void MatVec_MatSparseCRS_Blk33(
     T *y,
     T alpha,
-    unsigned nrowblk,
+    unsigned int iblk_begin,
+    unsigned int iblk_end,
     const T *vcrs,
     const T *vdia,
     const unsigned int *colind,
     const unsigned int *rowptr,
     const T *x) {
-  for (unsigned int iblk = 0; iblk < nrowblk; iblk++) {
+  for (unsigned int iblk = iblk_begin; iblk < iblk_end; iblk++) {
     const unsigned int icrs0 = colind[iblk];
     const unsigned int icrs1 = colind[iblk + 1];
     for (unsigned int icrs = icrs0; icrs < icrs1; icrs++) {
@@ -136,13 +149,14 @@ template<typename T>
 void MatVec_MatSparseCRS_Blk44(
     T *y,
     T alpha,
-    unsigned nrowblk,
+    unsigned int iblk_begin,
+    unsigned int iblk_end,
     const T *vcrs,
     const T *vdia,
     const unsigned int *colind,
     const unsigned int *rowptr,
     const T *x) {
-  for (unsigned int iblk = 0; iblk < nrowblk; iblk++) {
+  for (unsigned int iblk = iblk_begin; iblk < iblk_end; iblk++) {
     const unsigned int icrs0 = colind[iblk];
     const unsigned int icrs1 = colind[iblk + 1];
     for (unsigned int icrs = icrs0; icrs < icrs1; icrs++) {
@@ -206,70 +220,273 @@ void MatVec_MatSparseCRS_Blk44(
   }
 }
 
+
+/**
+ * fallback of the vectorized kernel for the types other than float and double
+ */
+template<typename T>
+void MatVec_MatSparseCRS_Blk33_Simd(
+    T *y,
+    T alpha,
+    unsigned int iblk_begin,
+    unsigned int iblk_end,
+    const T *vcrs,
+    const T *vdia,
+    const unsigned int *colind,
+    const unsigned int *rowptr,
+    const T *x) {
+  MatVec_MatSparseCRS_Blk33(
+      y, alpha, iblk_begin, iblk_end,
+      vcrs, vdia, colind, rowptr, x);
 }
 
-// -------------------------------------------------------
+#if defined(__AVX__)
 
-// Calc Matrix Vector Product
-// {y} = alpha*[A]{x} + beta*{y}
+/**
+ * each row of a 3x3 block is loaded into a 4-wide register with the 4th lane masked.
+ * The products are accumulated over the row and summed horizontally only once per block row.
+ */
+DFM2_INLINE void MatVec_MatSparseCRS_Blk33_Simd(
+    double *y,
+    double alpha,
+    unsigned int iblk_begin,
+    unsigned int iblk_end,
+    const double *vcrs,
+    const double *vdia,
+    const unsigned int *colind,
+    const unsigned int *rowptr,
+    const double *x) {
+  const __m256i mask = _mm256_set_epi64x(0, -1, -1, -1);
+  for (unsigned int iblk = iblk_begin; iblk < iblk_end; iblk++) {
+    const __m256d xi = _mm256_maskload_pd(x + iblk * 3, mask);
+    __m256d r0 = _mm256_mul_pd(_mm256_maskload_pd(vdia + iblk * 9 + 0, mask), xi);
+    __m256d r1 = _mm256_mul_pd(_mm256_maskload_pd(vdia + iblk * 9 + 3, mask), xi);
+    __m256d r2 = _mm256_mul_pd(_mm256_maskload_pd(vdia + iblk * 9 + 6, mask), xi);
+    for (unsigned int icrs = colind[iblk]; icrs < colind[iblk + 1]; icrs++) {
+      const __m256d xj = _mm256_maskload_pd(x + rowptr[icrs] * 3, mask);
+      const double *v = vcrs + icrs * 9;
+      r0 = _mm256_add_pd(r0, _mm256_mul_pd(_mm256_maskload_pd(v + 0, mask), xj));
+      r1 = _mm256_add_pd(r1, _mm256_mul_pd(_mm256_maskload_pd(v + 3, mask), xj));
+      r2 = _mm256_add_pd(r2, _mm256_mul_pd(_mm256_maskload_pd(v + 6, mask), xj));
+    }
+    const __m256d h01 = _mm256_hadd_pd(r0, r1);
+    const __m256d h22 = _mm256_hadd_pd(r2, r2);
+    const __m128d s01 = _mm_add_pd(_mm256_castpd256_pd128(h01), _mm256_extractf128_pd(h01, 1));
+    const __m128d s22 = _mm_add_pd(_mm256_castpd256_pd128(h22), _mm256_extractf128_pd(h22, 1));
+    double s[2];
+    _mm_storeu_pd(s, s01);
+    y[iblk * 3 + 0] += alpha * s[0];
+    y[iblk * 3 + 1] += alpha * s[1];
+    y[iblk * 3 + 2] += alpha * _mm_cvtsd_f64(s22);
+  }
+}
+
+DFM2_INLINE void MatVec_MatSparseCRS_Blk33_Simd(
+    float *y,
+    float alpha,
+    unsigned int iblk_begin,
+    unsigned int iblk_end,
+    const float *vcrs,
+    const float *vdia,
+    const unsigned int *colind,
+    const unsigned int *rowptr,
+    const float *x) {
+  const __m128i mask = _mm_set_epi32(0, -1, -1, -1);
+  for (unsigned int iblk = iblk_begin; iblk < iblk_end; iblk++) {
+    const __m128 xi = _mm_maskload_ps(x + iblk * 3, mask);
+    __m128 r0 = _mm_mul_ps(_mm_maskload_ps(vdia + iblk * 9 + 0, mask), xi);
+    __m128 r1 = _mm_mul_ps(_mm_maskload_ps(vdia + iblk * 9 + 3, mask), xi);
+    __m128 r2 = _mm_mul_ps(_mm_maskload_ps(vdia + iblk * 9 + 6, mask), xi);
+    for (unsigned int icrs = colind[iblk]; icrs < colind[iblk + 1]; icrs++) {
+      const __m128 xj = _mm_maskload_ps(x + rowptr[icrs] * 3, mask);
+      const float *v = vcrs + icrs * 9;
+      r0 = _mm_add_ps(r0, _mm_mul_ps(_mm_maskload_ps(v + 0, mask), xj));
+      r1 = _mm_add_ps(r1, _mm_mul_ps(_mm_maskload_ps(v + 3, mask), xj));
+      r2 = _mm_add_ps(r2, _mm_mul_ps(_mm_maskload_ps(v + 6, mask), xj));
+    }
+    const __m128 h = _mm_hadd_ps(_mm_hadd_ps(r0, r1), _mm_hadd_ps(r2, r2));
+    float s[4];
+    _mm_storeu_ps(s, h);
+    y[iblk * 3 + 0] += alpha * s[0];
+    y[iblk * 3 + 1] += alpha * s[1];
+    y[iblk * 3 + 2] += alpha * s[2];
+  }
+}
+
+#endif
+
+/**
+ * {y} = alpha*[A]{x} + beta*{y} for the block rows in [iblk_begin, iblk_end)
+ */
 template<typename T>
-void delfem2::CMatrixSparse<T>::MatVec(
+void MatVec_MatSparseCRS_Rows(
     T *y,
     T alpha,
+    const CMatrixSparse<T> &A,
     const T *x,
-    T beta) const {
-  const unsigned int ndofcol = nrowdim_ * nrowblk_;
-  for (unsigned int i = 0; i < ndofcol; ++i) { y[i] *= beta; }
+    T beta,
+    unsigned int iblk_begin,
+    unsigned int iblk_end) {
+  const unsigned int nrowdim = A.nrowdim_;
+  const unsigned int ncoldim = A.ncoldim_;
+  for (unsigned int i = iblk_begin * nrowdim; i < iblk_end * nrowdim; ++i) { y[i] *= beta; }
   // --------
-  if (nrowdim_ == 1 && ncoldim_ == 1) {
-    mats::MatVec_MatSparseCRS_Blk11(
+  const T *vcrs = A.val_crs_.data();
+  const T *vdia = A.val_dia_.data();
+  const unsigned int *colind = A.col_ind_.data();
+  const unsigned int *rowptr = A.row_ptr_.data();
+  if (nrowdim == 1 && ncoldim == 1) {
+    MatVec_MatSparseCRS_Blk11(
+        y,
+        alpha, iblk_begin, iblk_end, vcrs, vdia,
+        colind, rowptr, x);
+  } else if (nrowdim == 2 && ncoldim == 2) {
+    MatVec_MatSparseCRS_Blk22(
         y,
-        alpha, nrowblk_, val_crs_.data(), val_dia_.data(),
-        col_ind_.data(), row_ptr_.data(), x);
-  } else if (nrowdim_ == 2 && ncoldim_ == 2) {
-    mats::MatVec_MatSparseCRS_Blk22(
+        alpha, iblk_begin, iblk_end, vcrs, vdia,
+        colind, rowptr, x);
+  } else if (nrowdim == 3 && ncoldim == 3 && A.is_simd_matvec_) {
+    MatVec_MatSparseCRS_Blk33_Simd(
         y,
-        alpha, nrowblk_, val_crs_.data(), val_dia_.data(),
-        col_ind_.data(), row_ptr_.data(), x);
-  } else if (nrowdim_ == 3 && ncoldim_ == 3) {
-    mats::MatVec_MatSparseCRS_Blk33(
+        alpha, iblk_begin, iblk_end, vcrs, vdia,
+        colind, rowptr, x);
+  } else if (nrowdim == 3 && ncoldim == 3) {
+    MatVec_MatSparseCRS_Blk33(
         y,
-        alpha, nrowblk_, val_crs_.data(), val_dia_.data(),
-        col_ind_.data(), row_ptr_.data(), x);
-  } else if (nrowdim_ == 4 && ncoldim_ == 4) {
-    mats::MatVec_MatSparseCRS_Blk44(
+        alpha, iblk_begin, iblk_end, vcrs, vdia,
+        colind, rowptr, x);
+  } else if (nrowdim == 4 && ncoldim == 4) {
+    MatVec_MatSparseCRS_Blk44(
         y,
-        alpha, nrowblk_, val_crs_.data(), val_dia_.data(),
-        col_ind_.data(), row_ptr_.data(), x);
+        alpha, iblk_begin, iblk_end, vcrs, vdia,
+        colind, rowptr, x);
   } else {
-    const unsigned int blksize = nrowdim_ * ncoldim_;
-    const T *vcrs = val_crs_.data();
-    const T *vdia = val_dia_.data();
-    const unsigned int *colind = col_ind_.data();
-    const unsigned int *rowptr = row_ptr_.data();
-    //
-    for (unsigned int iblk = 0; iblk < nrowblk_; iblk++) {
+    const unsigned int blksize = nrowdim * ncoldim;
+    for (unsigned int iblk = iblk_begin; iblk < iblk_end; iblk++) {
       const unsigned int colind0 = colind[iblk];
       const unsigned int colind1 = colind[iblk + 1];
       for (unsigned int icrs = colind0; icrs < colind1; icrs++) {
-        assert(icrs < row_ptr_.size());
+        assert(icrs < A.row_ptr_.size());
         const unsigned int jblk0 = rowptr[icrs];
-        assert(jblk0 < ncolblk_);
-        for (unsigned int idof = 0; idof < nrowdim_; idof++) {
-          for (unsigned int jdof = 0; jdof < ncoldim_; jdof++) {
-            y[iblk * nrowdim_ + idof] +=
-                alpha * vcrs[icrs * blksize + idof * ncoldim_ + jdof] * x[jblk0 * ncoldim_ + jdof];
+        assert(jblk0 < A.ncolblk_);
+        for (unsigned int idof = 0; idof < nrowdim; idof++) {
+          for (unsigned int jdof = 0; jdof < ncoldim; jdof++) {
+            y[iblk * nrowdim + idof] +=
+                alpha * vcrs[icrs * blksize + idof * ncoldim + jdof] * x[jblk0 * ncoldim + jdof];
           }
         }
       }
-      for (unsigned int idof = 0; idof < nrowdim_; idof++) {
-        for (unsigned int jdof = 0; jdof < ncoldim_; jdof++) {
-          y[iblk * nrowdim_ + idof] +=
-              alpha * vdia[iblk * blksize + idof * ncoldim_ + jdof] * x[iblk * ncoldim_ + jdof];
+      for (unsigned int idof = 0; idof < nrowdim; idof++) {
+        for (unsigned int jdof = 0; jdof < ncoldim; jdof++) {
+          y[iblk * nrowdim + idof] +=
+              alpha * vdia[iblk * blksize + idof * ncoldim + jdof] * x[iblk * ncoldim + jdof];
+        }
+      }
+    }
+  }
+}
+
+/**
+ * transposed non-zero pattern. For each column block, the row block indexes and the CRS indexes
+ * are stored in the ascending order of the row block
+ */
+template<typename T>
+void MakeTransposePattern(
+    std::vector<unsigned int> &transpose_ind,
+    std::vector<unsigned int> &transpose_row,
+    std::vector<unsigned int> &transpose_crs,
+    const CMatrixSparse<T> &A) {
+  const unsigned int ncrs = static_cast<unsigned int>(A.row_ptr_.size());
+  transpose_ind.assign(A.ncolblk_ + 1, 0);
+  for (unsigned int icrs = 0; icrs < ncrs; ++icrs) {
+    transpose_ind[A.row_ptr_[icrs] + 1] += 1;
+  }
+  for (unsigned int jblk = 0; jblk < A.ncolblk_; ++jblk) {
+    transpose_ind[jblk + 1] += transpose_ind[jblk];
+  }
+  transpose_row.resize(ncrs);
+  transpose_crs.resize(ncrs);
+  for (unsigned int iblk = 0; iblk < A.nrowblk_; ++iblk) {
+    for (unsigned int icrs = A.col_ind_[iblk]; icrs < A.col_ind_[iblk + 1]; ++icrs) {
+      const unsigned int jblk = A.row_ptr_[icrs];
+      const unsigned int itrs = transpose_ind[jblk];
+      transpose_row[itrs] = iblk;
+      transpose_crs[itrs] = icrs;
+      transpose_ind[jblk] += 1;
+    }
+  }
+  for (unsigned int jblk = A.ncolblk_; jblk > 0; --jblk) {
+    transpose_ind[jblk] = transpose_ind[jblk - 1];
+  }
+  transpose_ind[0] = 0;
+}
+
+/**
+ * {y} = alpha*[A]^T{x} + beta*{y} for the block columns in [jblk_begin, jblk_end) using the transposed pattern.
+ * The rows of y are written only once so the column ranges can be processed independently
+ */
+template<typename T>
+void MatTVec_MatSparseCRS_Cols(
+    T *y,
+    T alpha,
+    const CMatrixSparse<T> &A,
+    const T *x,
+    T beta,
+    unsigned int jblk_begin,
+    unsigned int jblk_end) {
+  const unsigned int nrowdim = A.nrowdim_;
+  const unsigned int ncoldim = A.ncoldim_;
+  const unsigned int blksize = nrowdim * ncoldim;
+  const T *vcrs = A.val_crs_.data();
+  const T *vdia = A.val_dia_.data();
+  for (unsigned int jblk = jblk_begin; jblk < jblk_end; ++jblk) {
+    for (unsigned int jdof = 0; jdof < ncoldim; jdof++) { y[jblk * ncoldim + jdof] *= beta; }
+    for (unsigned int itrs = A.transpose_ind_[jblk]; itrs < A.transpose_ind_[jblk + 1]; ++itrs) {
+      const unsigned int iblk = A.transpose_row_[itrs];
+      const unsigned int icrs = A.transpose_crs_[itrs];
+      for (unsigned int idof = 0; idof < nrowdim; idof++) {
+        for (unsigned int jdof = 0; jdof < ncoldim; jdof++) {
+          y[jblk * ncoldim + jdof] +=
+              alpha * vcrs[icrs * blksize + idof * ncoldim + jdof] * x[iblk * nrowdim + idof];
         }
       }
     }
+    if (jblk >= A.nrowblk_) { continue; }
+    for (unsigned int jdof = 0; jdof < ncoldim; jdof++) {
+      for (unsigned int idof = 0; idof < nrowdim; idof++) {
+        y[jblk * ncoldim + jdof] +=
+            alpha * vdia[jblk * blksize + idof * ncoldim + jdof] * x[jblk * nrowdim + idof];
+      }
+    }
+  }
+}
+
+}
+
+// -------------------------------------------------------
+
+// Calc Matrix Vector Product
+// {y} = alpha*[A]{x} + beta*{y}
+template<typename T>
+void delfem2::CMatrixSparse<T>::MatVec(
+    T *y,
+    T alpha,
+    const T *x,
+    T beta) const {
+  if (nthread_matvec_ == 1) {
+    mats::MatVec_MatSparseCRS_Rows(
+        y,
+        alpha, *this, x, beta, 0, nrowblk_);
+    return;
   }
+  parallel_for_range(
+      nrowblk_,
+      [&](unsigned int iblk_begin, unsigned int iblk_end) {
+        mats::MatVec_MatSparseCRS_Rows(
+            y,
+            alpha, *this, x, beta, iblk_begin, iblk_end);
+      },
+      mats::num_blkrow_grain_matvec, nthread_matvec_);
 }
 #ifdef DFM2_STATIC_LIBRARY
 template void delfem2::CMatrixSparse<float>::MatVec(
@@ -350,6 +567,23 @@ void delfem2::CMatrixSparse<T>::MatTVec(
     T alpha,
     const T *x,
     T beta) const {
+  if (nthread_matvec_ != 1) {
+    if (transpose_version_ != pattern_version_ || transpose_ind_.size() != ncolblk_ + 1) {
+      mats::MakeTransposePattern(
+          transpose_ind_, transpose_row_, transpose_crs_,
+          *this);
+      transpose_version_ = pattern_version_;
+    }
+    parallel_for_range(
+        ncolblk_,
+        [&](unsigned int jblk_begin, unsigned int jblk_end) {
+          mats::MatTVec_MatSparseCRS_Cols(
+              y,
+              alpha, *this, x, beta, jblk_begin, jblk_end);
+        },
+        mats::num_blkrow_grain_matvec, nthread_matvec_);
+    return;
+  }
   const unsigned int ndofrow = ncoldim_ * ncolblk_;
   for (unsigned int i = 0; i < ndofrow; ++i) { y[i] *= beta; }
   const unsigned int blksize = nrowdim_ * ncoldim_;
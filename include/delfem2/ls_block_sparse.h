@@ -14,6 +14,7 @@
 #include <climits>
 
 #include "delfem2/dfm2_inline.h"
+#include "delfem2/thread.h"
 
 namespace delfem2 {
 
@@ -36,6 +37,8 @@ class CMatrixSparse {
     row_ptr_.clear();
     val_crs_.clear();
     val_dia_.clear();
+    this->ClearTransposePattern();
+    ++pattern_version_;
     this->nrowblk_ = 0;
     this->nrowdim_ = 0;
     this->ncolblk_ = 0;
@@ -50,6 +53,7 @@ class CMatrixSparse {
     col_ind_.assign(nblk + 1, 0);
     row_ptr_.clear();
     val_crs_.clear();
+    ++pattern_version_;
     if (is_dia) { val_dia_.assign(nblk * len * len, 0.0); }
     else { val_dia_.clear(); }
   }
@@ -69,6 +73,23 @@ class CMatrixSparse {
     val_dia_ = m.valDia; // copy value
   }
 
+  /**
+   * deep copy the non-zero pattern and the values converted from a matrix in another precision
+   * @details used to make a single precision copy of a double precision matrix
+   */
+  template<typename S>
+  void CopyCast(const CMatrixSparse<S> &m) {
+    this->nrowblk_ = m.nrowblk_;
+    this->nrowdim_ = m.nrowdim_;
+    this->ncolblk_ = m.ncolblk_;
+    this->ncoldim_ = m.ncoldim_;
+    col_ind_ = m.col_ind_;
+    row_ptr_ = m.row_ptr_;
+    val_crs_.assign(m.val_crs_.begin(), m.val_crs_.end());
+    val_dia_.assign(m.val_dia_.begin(), m.val_dia_.end());
+    ++pattern_version_;
+  }
+
   void SetPattern(
       const unsigned int *colind,
       [[maybe_unused]] size_t ncolind,
@@ -82,6 +103,16 @@ class CMatrixSparse {
     row_ptr_.resize(ncrs);
     for (unsigned int icrs = 0; icrs < ncrs; icrs++) { row_ptr_[icrs] = rowptr[icrs]; }
     val_crs_.resize(ncrs * nrowdim_ * ncoldim_);
+    ++pattern_version_;
+  }
+
+  /**
+   * @brief free the memory of the cached transposed pattern used in the parallel MatTVec().
+   */
+  void ClearTransposePattern() const {
+    transpose_ind_.clear();
+    transpose_row_.clear();
+    transpose_crs_.clear();
   }
 
   /**
@@ -106,6 +137,8 @@ class CMatrixSparse {
 
   /**
    * @func Matrix vector product as: {y} = alpha * [A]{x} + beta * {y}
+   * @details the rows are distributed over the threads if "nthread_matvec_ != 1".
+   * The 3x3 block kernel is explicitly vectorized if "is_simd_matvec_" is true and compiled with AVX.
    */
   void MatVec(
       T *y,
@@ -124,6 +157,9 @@ class CMatrixSparse {
 
   /**
    * @func Matrix vector product as: {y} = alpha * [A]^T{x} + beta * {y}
+   * @details if "nthread_matvec_ != 1", the transposed non-zero pattern is computed at the first call
+   * after the pattern is changed (see "pattern_version_") and the rows of the transposed matrix are
+   * distributed over the threads. That call is not thread-safe because it writes the cache.
    */
   void MatTVec(
       T *y,
@@ -201,6 +237,34 @@ class CMatrixSparse {
   std::vector<unsigned int> row_ptr_;
   std::vector<T> val_crs_;
   std::vector<T> val_dia_;
+
+  /**
+   * number of threads for MatVec() and MatTVec().
+   * 1 runs the serial reference code. 0 uses all the threads of "delfem2::ThreadPool"
+   */
+  unsigned int nthread_matvec_ = 1;
+
+  /**
+   * use the explicitly vectorized kernel for 3x3 blocks of float and double in MatVec().
+   * The kernel is compiled only with AVX (e.g., "-mavx", or "USE_AVX=ON" for the tests). Otherwise the scalar kernel is used.
+   */
+  bool is_simd_matvec_ = false;
+
+  /**
+   * incremented when the member functions change the non-zero pattern. Increment it after modifying
+   * "col_ind_" or "row_ptr_" directly, so the caches made from the pattern are made again.
+   * The values are not the part of the version since the caches only store the indexes.
+   */
+  unsigned int pattern_version_ = 0;
+
+  /**
+   * cache of the transposed non-zero pattern for the parallel MatTVec() made at "transpose_version_"
+   * "transpose_row_" and "transpose_crs_" store the row block index and the CRS index for each column block
+   */
+  mutable unsigned int transpose_version_ = 0;
+  mutable std::vector<unsigned int> transpose_ind_;
+  mutable std::vector<unsigned int> transpose_row_;
+  mutable std::vector<unsigned int> transpose_crs_;
 };
 
 // ----------------------------------------------
@@ -215,7 +279,7 @@ bool Mearge(
   assert(!A.val_crs_.empty());
   assert(!A.val_dia_.empty());
   assert(blksize == A.nrowdim_ * A.ncoldim_);
-  merge_buffer.resize(A.ncolblk_);
+  merge_buffer.resize(A.ncolblk_, UINT_MAX);
   const unsigned int *colind = A.col_ind_.data();
   const unsigned int *rowptr = A.row_ptr_.data();
   T *vcrs = A.val_crs_.data();
@@ -238,6 +302,9 @@ bool Mearge(
       } else {  // Marge Non-Diagonal
         if (merge_buffer[jblk1] == UINT_MAX) {
           assert(0);
+          for (unsigned int jpsup = colind[iblk1]; jpsup < colind[iblk1 + 1]; jpsup++) {
+            merge_buffer[rowptr[jpsup]] = UINT_MAX;  // leave the buffer clean for the next element
+          }
           return false;
         }
         assert(merge_buffer[jblk1] < A.row_ptr_.size());
@@ -290,6 +357,9 @@ bool Merge(
       } else {  // Marge Non-Diagonal
         if (merge_buffer[jblk1] == UINT_MAX) {
           assert(0);
+          for (unsigned int jpsup = colind[iblk1]; jpsup < colind[iblk1 + 1]; jpsup++) {
+            merge_buffer[rowptr[jpsup]] = UINT_MAX;  // leave the buffer clean for the next element
+          }
           return false;
         }
         assert(merge_buffer[jblk1] < A.row_ptr_.size());
@@ -318,7 +388,7 @@ bool Merge(
     std::vector<unsigned int> &merge_buffer) {
   assert(!A.val_crs_.empty());
   assert(!A.val_dia_.empty());
-  merge_buffer.resize(A.ncolblk_);
+  merge_buffer.resize(A.ncolblk_, UINT_MAX);
   const unsigned int *colind = A.col_ind_.data();
   const unsigned int *rowptr = A.row_ptr_.data();
   T *vcrs = A.val_crs_.data();
@@ -339,6 +409,9 @@ bool Merge(
       } else {  // Marge Non-Diagonal
         if (merge_buffer[jblk1] == UINT_MAX) {
           assert(0);
+          for (unsigned int jpsup = colind[iblk1]; jpsup < colind[iblk1 + 1]; jpsup++) {
+            merge_buffer[rowptr[jpsup]] = UINT_MAX;  // leave the buffer clean for the next element
+          }
           return false;
         }
         assert(merge_buffer[jblk1] < A.row_ptr_.size());
@@ -356,6 +429,128 @@ bool Merge(
   return true;
 }
 
+/**
+ * @brief precomputed destinations of the blocks of the element matrices in the sparse matrix
+ * @details the column-to-CRS lookup in Merge() is done only once in Initialize() for all the elements.
+ * Merge() of this class is then a plain scatter-add. The pattern of the matrix must not change after Initialize().
+ */
+class CMergePlan {
+ public:
+  /**
+   * @param elem_vtx element connectivity. The element matrix is merged to the rows and columns of these vertices
+   * @return false if some pair of the vertices in an element is not in the pattern of the matrix.
+   * Then the plan is left empty and Merge() refuses it.
+   */
+  template<typename T>
+  bool Initialize(
+      const CMatrixSparse<T> &A,
+      const unsigned int *elem_vtx,
+      size_t num_elem,
+      unsigned int num_vtx_par_elem) {
+    num_vtx_par_elem_ = num_vtx_par_elem;
+    num_crs_ = static_cast<unsigned int>(A.row_ptr_.size());
+    const unsigned int nnoel = num_vtx_par_elem;
+    elem_blk_.resize(num_elem * nnoel * nnoel);
+    std::vector<unsigned int> merge_buffer(A.ncolblk_, UINT_MAX);
+    bool is_ok = true;
+    for (unsigned int ielem = 0; ielem < num_elem; ++ielem) {
+      const unsigned int *ip = elem_vtx + ielem * nnoel;
+      unsigned int *dest = elem_blk_.data() + ielem * nnoel * nnoel;
+      for (unsigned int ino = 0; ino < nnoel; ++ino) {
+        const unsigned int iblk = ip[ino];
+        assert(iblk < A.nrowblk_);
+        for (unsigned int icrs = A.col_ind_[iblk]; icrs < A.col_ind_[iblk + 1]; ++icrs) {
+          merge_buffer[A.row_ptr_[icrs]] = icrs;
+        }
+        for (unsigned int jno = 0; jno < nnoel; ++jno) {
+          const unsigned int jblk = ip[jno];
+          if (iblk == jblk) {
+            dest[ino * nnoel + jno] = num_crs_ + iblk;
+            continue;
+          }
+          dest[ino * nnoel + jno] = merge_buffer[jblk];
+          if (merge_buffer[jblk] == UINT_MAX) { is_ok = false; }
+        }
+        for (unsigned int icrs = A.col_ind_[iblk]; icrs < A.col_ind_[iblk + 1]; ++icrs) {
+          merge_buffer[A.row_ptr_[icrs]] = UINT_MAX;
+        }
+      }
+    }
+    if (!is_ok) { elem_blk_.clear(); }  // never scatter through the missing destinations
+    return is_ok;
+  }
+
+  /**
+   * @brief add the element matrix of the element "ielem" to the matrix.
+   * @return false (and nothing is added) if the plan is not made by a successful Initialize() for this pattern
+   */
+  template<int nno, int ndimrow, int ndimcol, typename T>
+  bool Merge(
+      CMatrixSparse<T> &A,
+      unsigned int ielem,
+      const T emat[nno][nno][ndimrow][ndimcol]) const {
+    constexpr unsigned int blksize = ndimrow * ndimcol;
+    assert(A.nrowdim_ == ndimrow && A.ncoldim_ == ndimcol);
+    if (num_vtx_par_elem_ != nno || A.row_ptr_.size() != num_crs_ || (ielem + 1) * nno * nno > elem_blk_.size()) {
+      assert(0);
+      return false;
+    }
+    const unsigned int *dest = elem_blk_.data() + ielem * nno * nno;
+    T *vcrs = A.val_crs_.data();
+    T *vdia = A.val_dia_.data();
+    for (unsigned int ino = 0; ino < nno; ++ino) {
+      for (unsigned int jno = 0; jno < nno; ++jno) {
+        const unsigned int idest = dest[ino * nno + jno];
+        T *pval_out = (idest < num_crs_) ? vcrs + idest * blksize : vdia + (idest - num_crs_) * blksize;
+        const T *pval_in = &emat[ino][jno][0][0];
+        for (unsigned int i = 0; i < blksize; ++i) { pval_out[i] += pval_in[i]; }
+      }
+    }
+    return true;
+  }
+
+ public:
+  unsigned int num_vtx_par_elem_ = 0;
+  unsigned int num_crs_ = 0;
+
+  /**
+   * for each element, the "nno x nno" destination block indexes. The index is the CRS index for the off-diagonal
+   * blocks and "num_crs_ + (block row index)" for the diagonal blocks.
+   */
+  std::vector<unsigned int> elem_blk_;
+};
+
+/**
+ * @brief assemble the element matrices in parallel using the coloring of the elements
+ * @details the elements with the same color do not share a vertex, so they write different block rows
+ * and the colors are merged one after another. Each chunk of the elements has its own merge buffer that lives
+ * only during this call, so nothing is left over for the next call.
+ * The result does not depend on the number of threads.
+ * @tparam FUNC void (unsigned int ielem, std::vector<unsigned int>& merge_buffer)
+ * @param color_ind jagged array index of the colored elements (see JArray_ElemColoring_MeshElem)
+ * @param color_elem jagged array value of the colored elements
+ * @param nthread number of threads. 0 uses all the threads of "delfem2::ThreadPool"
+ */
+template<typename FUNC>
+void MergeParallel_ColoredElem(
+    const std::vector<unsigned int> &color_ind,
+    const std::vector<unsigned int> &color_elem,
+    FUNC &&func,
+    unsigned int nthread = 0) {
+  constexpr unsigned int num_elem_grain = 32;
+  const size_t ncolor = color_ind.empty() ? 0 : color_ind.size() - 1;
+  for (unsigned int icolor = 0; icolor < ncolor; ++icolor) {
+    const unsigned int *elems = color_elem.data() + color_ind[icolor];
+    parallel_for_range(
+        color_ind[icolor + 1] - color_ind[icolor],
+        [&func, elems](unsigned int ib, unsigned int ie) {
+          std::vector<unsigned int> merge_buffer;
+          for (unsigned int i = ib; i < ie; ++i) { func(elems[i], merge_buffer); }
+        },
+        num_elem_grain, nthread);
+  }
+}
+
 DFM2_INLINE double CheckSymmetry(
     const delfem2::CMatrixSparse<double> &mat);
 
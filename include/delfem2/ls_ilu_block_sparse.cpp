@@ -12,6 +12,9 @@
 #include <vector>
 #include <complex>
 #include <algorithm>
+#include <atomic>
+
+#include "delfem2/thread.h"
 
 // ----------------------------------------------------
 
@@ -47,11 +50,12 @@ DFM2_INLINE void CalcSubMatPr(
   }
 }
 
-DFM2_INLINE void CalcInvMat(
-    double *a,
+template<typename T>
+void CalcInvMat(
+    T *a,
     const unsigned int n,
     int &info) {
-  double tmp1;
+  T tmp1;
 
   info = 0;
   unsigned int i, j, k;
@@ -81,11 +85,12 @@ DFM2_INLINE void CalcInvMat(
 }
 
 // t is a tmporary buffer size of 9
-DFM2_INLINE void CalcInvMat3(double a[], double t[]) {
-  const double det =
+template<typename T>
+void CalcInvMat3(T a[], T t[]) {
+  const T det =
       +a[0] * a[4] * a[8] + a[3] * a[7] * a[2] + a[6] * a[1] * a[5]
           - a[0] * a[7] * a[5] - a[6] * a[4] * a[2] - a[3] * a[1] * a[8];
-  const double inv_det = 1.0 / det;
+  const T inv_det = 1 / det;
 
   for (int i = 0; i < 9; i++) { t[i] = a[i]; }
 
@@ -127,6 +132,293 @@ class CRowLevNext {
   unsigned int next;
 };
 
+/**
+ * minimum number of the rows in a level processed by a thread
+ */
+constexpr unsigned int num_blk_grain_level = 64;
+
+/**
+ * compute the levels of the rows of a triangular matrix and store the rows as a jagged array for each level.
+ * @param is_lower if true, the lower part [colind[iblk], diaind[iblk]) is used. Otherwise the upper part
+ * [diaind[iblk], colind[iblk+1]) is used
+ */
+DFM2_INLINE void LevelSchedule_TriangularPart(
+    std::vector<unsigned int> &level_ind,
+    std::vector<unsigned int> &level_blk,
+    const std::vector<unsigned int> &colind,
+    const std::vector<unsigned int> &diaind,
+    const std::vector<unsigned int> &rowptr,
+    unsigned int nblk,
+    bool is_lower) {
+  std::vector<unsigned int> blk2lev(nblk, 0);
+  unsigned int nlev = 0;
+  for (unsigned int i = 0; i < nblk; ++i) {
+    const unsigned int iblk = is_lower ? i : nblk - 1 - i;
+    const unsigned int icrs0 = is_lower ? colind[iblk] : diaind[iblk];
+    const unsigned int icrs1 = is_lower ? diaind[iblk] : colind[iblk + 1];
+    unsigned int ilev = 0;
+    for (unsigned int icrs = icrs0; icrs < icrs1; ++icrs) {
+      const unsigned int jblk = rowptr[icrs];
+      ilev = (blk2lev[jblk] + 1 > ilev) ? blk2lev[jblk] + 1 : ilev;
+    }
+    blk2lev[iblk] = ilev;
+    nlev = (ilev + 1 > nlev) ? ilev + 1 : nlev;
+  }
+  level_ind.assign(nlev + 1, 0);
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) { level_ind[blk2lev[iblk] + 1] += 1; }
+  for (unsigned int ilev = 0; ilev < nlev; ++ilev) { level_ind[ilev + 1] += level_ind[ilev]; }
+  level_blk.resize(nblk);
+  for (unsigned int iblk = 0; iblk < nblk; ++iblk) {
+    const unsigned int ilev = blk2lev[iblk];
+    level_blk[level_ind[ilev]] = iblk;
+    level_ind[ilev] += 1;
+  }
+  for (unsigned int ilev = nlev; ilev > 0; --ilev) { level_ind[ilev] = level_ind[ilev - 1]; }
+  level_ind[0] = 0;
+}
+
+/**
+ * call "func(iblk)" for all the rows level by level. The rows in a level are distributed over the threads
+ */
+template<typename FUNC>
+void ForEachRow_LevelSchedule(
+    const std::vector<unsigned int> &level_ind,
+    const std::vector<unsigned int> &level_blk,
+    unsigned int nthread,
+    FUNC &&func) {
+  const size_t nlev = level_ind.empty() ? 0 : level_ind.size() - 1;
+  for (unsigned int ilev = 0; ilev < nlev; ++ilev) {
+    const unsigned int *blks = level_blk.data() + level_ind[ilev];
+    parallel_for_range(
+        level_ind[ilev + 1] - level_ind[ilev],
+        [&func, blks](unsigned int ib, unsigned int ie) {
+          for (unsigned int i = ib; i < ie; ++i) { func(blks[i]); }
+        },
+        num_blk_grain_level, nthread);
+  }
+}
+
+template<unsigned int NDIM, typename T>
+void ForwardSubstitutionRow(
+    T *vec,
+    unsigned int iblk,
+    const CPreconditionerILU<T> &ilu) {
+  constexpr unsigned int blksize = NDIM * NDIM;
+  T tmp[NDIM];
+  for (unsigned int idof = 0; idof < NDIM; ++idof) { tmp[idof] = vec[iblk * NDIM + idof]; }
+  for (unsigned int ijcrs = ilu.colInd[iblk]; ijcrs < ilu.m_diaInd[iblk]; ++ijcrs) {
+    const unsigned int jblk0 = ilu.rowPtr[ijcrs];
+    assert(jblk0 < iblk);
+    const T *vij = &ilu.valCrs[ijcrs * blksize];
+    for (unsigned int idof = 0; idof < NDIM; ++idof) {
+      for (unsigned int jdof = 0; jdof < NDIM; ++jdof) {
+        tmp[idof] -= vij[idof * NDIM + jdof] * vec[jblk0 * NDIM + jdof];
+      }
+    }
+  }
+  const T *vii = &ilu.valDia[iblk * blksize];
+  for (unsigned int idof = 0; idof < NDIM; ++idof) {
+    T dtmp1 = 0.0;
+    for (unsigned int jdof = 0; jdof < NDIM; ++jdof) { dtmp1 += vii[idof * NDIM + jdof] * tmp[jdof]; }
+    vec[iblk * NDIM + idof] = dtmp1;
+  }
+}
+
+template<unsigned int NDIM, typename T>
+void BackwardSubstitutionRow(
+    T *vec,
+    unsigned int iblk,
+    const CPreconditionerILU<T> &ilu) {
+  constexpr unsigned int blksize = NDIM * NDIM;
+  T tmp[NDIM];
+  for (unsigned int idof = 0; idof < NDIM; ++idof) { tmp[idof] = vec[iblk * NDIM + idof]; }
+  for (unsigned int ijcrs = ilu.m_diaInd[iblk]; ijcrs < ilu.colInd[iblk + 1]; ++ijcrs) {
+    const unsigned int jblk0 = ilu.rowPtr[ijcrs];
+    assert(jblk0 > iblk && jblk0 < ilu.nblk);
+    const T *vij = &ilu.valCrs[ijcrs * blksize];
+    for (unsigned int idof = 0; idof < NDIM; ++idof) {
+      for (unsigned int jdof = 0; jdof < NDIM; ++jdof) {
+        tmp[idof] -= vij[idof * NDIM + jdof] * vec[jblk0 * NDIM + jdof];
+      }
+    }
+  }
+  for (unsigned int idof = 0; idof < NDIM; ++idof) { vec[iblk * NDIM + idof] = tmp[idof]; }
+}
+
+/**
+ * @return false if the block size is not supported by the level-scheduled kernels
+ */
+template<typename T>
+bool Substitution_LevelSchedule(
+    T *vec,
+    const CPreconditionerILU<T> &ilu,
+    bool is_forward) {
+  if (is_forward) {
+    auto run = [&](auto func) { ForEachRow_LevelSchedule(ilu.levelFwdInd, ilu.levelFwdBlk, ilu.nthread, func); };
+    switch (ilu.ndim) {
+      case 1: run([&](unsigned int iblk) { ForwardSubstitutionRow<1>(vec, iblk, ilu); }); return true;
+      case 2: run([&](unsigned int iblk) { ForwardSubstitutionRow<2>(vec, iblk, ilu); }); return true;
+      case 3: run([&](unsigned int iblk) { ForwardSubstitutionRow<3>(vec, iblk, ilu); }); return true;
+      case 4: run([&](unsigned int iblk) { ForwardSubstitutionRow<4>(vec, iblk, ilu); }); return true;
+      default: return false;
+    }
+  }
+  auto run = [&](auto func) { ForEachRow_LevelSchedule(ilu.levelBwdInd, ilu.levelBwdBlk, ilu.nthread, func); };
+  switch (ilu.ndim) {
+    case 1: run([&](unsigned int iblk) { BackwardSubstitutionRow<1>(vec, iblk, ilu); }); return true;
+    case 2: run([&](unsigned int iblk) { BackwardSubstitutionRow<2>(vec, iblk, ilu); }); return true;
+    case 3: run([&](unsigned int iblk) { BackwardSubstitutionRow<3>(vec, iblk, ilu); }); return true;
+    case 4: run([&](unsigned int iblk) { BackwardSubstitutionRow<4>(vec, iblk, ilu); }); return true;
+    default: return false;
+  }
+}
+
+/**
+ * numerical factorization of a row. The rows in the lower part of this row need to be factorized already.
+ * @param row2crs buffer of size nblk filled with -1. It is restored after the call
+ * @return false if the diagonal block is singular
+ */
+template<unsigned int NDIM, typename T>
+bool DecomposeRow(
+    CPreconditionerILU<T> &ilu,
+    unsigned int iblk,
+    std::vector<int> &row2crs) {
+  constexpr unsigned int blksize = NDIM * NDIM;
+  const unsigned int *colind = ilu.colInd.data();
+  const unsigned int *rowptr = ilu.rowPtr.data();
+  const unsigned int *diaind = ilu.m_diaInd.data();
+  T *vcrs = ilu.valCrs.data();
+  T *vdia = ilu.valDia.data();
+  for (unsigned int ijcrs = colind[iblk]; ijcrs < colind[iblk + 1]; ijcrs++) {
+    row2crs[rowptr[ijcrs]] = static_cast<int>(ijcrs);
+  }
+  // [L] * [D^-1*U]
+  for (unsigned int ikcrs = colind[iblk]; ikcrs < diaind[iblk]; ikcrs++) {
+    const unsigned int kblk = rowptr[ikcrs];
+    assert(kblk < iblk);
+    const T *vik = &vcrs[ikcrs * blksize];
+    for (unsigned int kjcrs = diaind[kblk]; kjcrs < colind[kblk + 1]; kjcrs++) {
+      const unsigned int jblk0 = rowptr[kjcrs];
+      const T *vkj = &vcrs[kjcrs * blksize];
+      T *vij = nullptr;
+      if (jblk0 != iblk) {
+        const int ijcrs0 = row2crs[jblk0];
+        if (ijcrs0 == -1) { continue; }
+        vij = &vcrs[ijcrs0 * blksize];
+      } else {
+        vij = &vdia[iblk * blksize];
+      }
+      for (unsigned int i = 0; i < NDIM; i++) {
+        for (unsigned int j = 0; j < NDIM; j++) {
+          T s = 0;
+          for (unsigned int k = 0; k < NDIM; k++) { s += vik[i * NDIM + k] * vkj[k * NDIM + j]; }
+          vij[i * NDIM + j] -= s;
+        }
+      }
+    }
+  }
+  bool is_ok = true;
+  T tmp[blksize];
+  {
+    T *vii = &vdia[iblk * blksize];
+    if (NDIM == 1) {
+      if (fabs(vii[0]) > 1.0e-30) { vii[0] = 1 / vii[0]; } else { is_ok = false; }
+    } else if (NDIM == 2) {  // same closed form as the serial factorization
+      const T det = vii[0] * vii[3] - vii[1] * vii[2];
+      if (fabs(det) > 1.0e-30) {
+        const T inv_det = 1 / det;
+        const T dtmp1 = vii[0];
+        vii[0] = inv_det * vii[3];
+        vii[1] = -inv_det * vii[1];
+        vii[2] = -inv_det * vii[2];
+        vii[3] = inv_det * dtmp1;
+      } else {
+        is_ok = false;
+      }
+    } else if (NDIM == 3) {
+      const T det =
+          +vii[0] * vii[4] * vii[8] + vii[3] * vii[7] * vii[2] + vii[6] * vii[1] * vii[5]
+              - vii[0] * vii[7] * vii[5] - vii[6] * vii[4] * vii[2] - vii[3] * vii[1] * vii[8];
+      if (fabs(det) > 1.0e-30) { CalcInvMat3(vii, tmp); } else { is_ok = false; }
+    } else {
+      int info = 0;
+      CalcInvMat(vii, NDIM, info);
+      if (info == 1) { is_ok = false; }
+    }
+  }
+  // [U] = [1/D][U]
+  const T *vii = &vdia[iblk * blksize];
+  for (unsigned int ijcrs = diaind[iblk]; ijcrs < colind[iblk + 1]; ijcrs++) {
+    T *vij = &vcrs[ijcrs * blksize];
+    for (unsigned int i = 0; i < blksize; i++) { tmp[i] = vij[i]; }
+    for (unsigned int i = 0; i < NDIM; i++) {
+      for (unsigned int j = 0; j < NDIM; j++) {
+        T s = 0;
+        for (unsigned int k = 0; k < NDIM; k++) { s += vii[i * NDIM + k] * tmp[k * NDIM + j]; }
+        vij[i * NDIM + j] = s;
+      }
+    }
+  }
+  for (unsigned int ijcrs = colind[iblk]; ijcrs < colind[iblk + 1]; ijcrs++) {
+    row2crs[rowptr[ijcrs]] = -1;
+  }
+  return is_ok;
+}
+
+/**
+ * numerical factorization where the rows in the same level of the lower part are factorized in parallel.
+ * Each thread has its own "row2crs" buffer.
+ */
+template<unsigned int NDIM, typename T>
+bool Decompose_LevelSchedule(
+    CPreconditionerILU<T> &ilu,
+    int nmax_sing) {
+  std::atomic<int> icnt_sing(0);
+  const std::vector<unsigned int> &level_ind = ilu.levelFwdInd;
+  const size_t nlev = level_ind.empty() ? 0 : level_ind.size() - 1;
+  for (unsigned int ilev = 0; ilev < nlev; ++ilev) {
+    const unsigned int *blks = ilu.levelFwdBlk.data() + level_ind[ilev];
+    parallel_for_range(
+        level_ind[ilev + 1] - level_ind[ilev],
+        [&ilu, &icnt_sing, blks](unsigned int ib, unsigned int ie) {
+          static thread_local std::vector<int> row2crs;
+          if (row2crs.size() != ilu.nblk) { row2crs.assign(ilu.nblk, -1); }
+          for (unsigned int i = ib; i < ie; ++i) {
+            if (DecomposeRow<NDIM, T>(ilu, blks[i], row2crs)) { continue; }
+            std::cout << "frac false " << blks[i] << std::endl;
+            icnt_sing++;
+          }
+        },
+        num_blk_grain_level, ilu.nthread);
+    if (icnt_sing > nmax_sing) {
+      std::cout << "ilu frac false exceeds tolerance" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * numerical factorization of the rows in the ascending order using the row kernel above
+ */
+template<unsigned int NDIM, typename T>
+bool Decompose_RowByRow(
+    CPreconditionerILU<T> &ilu,
+    int nmax_sing) {
+  int icnt_sing = 0;
+  std::vector<int> row2crs(ilu.nblk, -1);
+  for (unsigned int iblk = 0; iblk < ilu.nblk; ++iblk) {
+    if (DecomposeRow<NDIM, T>(ilu, iblk, row2crs)) { continue; }
+    std::cout << "frac false " << iblk << std::endl;
+    icnt_sing++;
+    if (icnt_sing > nmax_sing) {
+      std::cout << "ilu frac false exceeds tolerance" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
 } // delfem2
 
 
@@ -152,6 +444,15 @@ namespace delfem2 {
 template<>
 DFM2_INLINE bool CPreconditionerILU<double>::Decompose() {
   const int nmax_sing = 10;
+  if (nthread != 1 && !levelFwdInd.empty()) {
+    switch (ndim) {
+      case 1: return ilu::Decompose_LevelSchedule<1>(*this, nmax_sing);
+      case 2: return ilu::Decompose_LevelSchedule<2>(*this, nmax_sing);
+      case 3: return ilu::Decompose_LevelSchedule<3>(*this, nmax_sing);
+      case 4: return ilu::Decompose_LevelSchedule<4>(*this, nmax_sing);
+      default: break;
+    }
+  }
   int icnt_sing = 0;
 
   const unsigned int *colind = colInd.data();
@@ -419,6 +720,32 @@ DFM2_INLINE bool CPreconditionerILU<double>::Decompose() {
   return true;
 }
 
+// numerical factorization in single precision
+template<>
+DFM2_INLINE bool CPreconditionerILU<float>::Decompose() {
+  const int nmax_sing = 10;
+  if (nthread != 1 && !levelFwdInd.empty()) {
+    switch (ndim) {
+      case 1: return ilu::Decompose_LevelSchedule<1>(*this, nmax_sing);
+      case 2: return ilu::Decompose_LevelSchedule<2>(*this, nmax_sing);
+      case 3: return ilu::Decompose_LevelSchedule<3>(*this, nmax_sing);
+      case 4: return ilu::Decompose_LevelSchedule<4>(*this, nmax_sing);
+      default: break;
+    }
+  }
+  switch (ndim) {
+    case 1: return ilu::Decompose_RowByRow<1>(*this, nmax_sing);
+    case 2: return ilu::Decompose_RowByRow<2>(*this, nmax_sing);
+    case 3: return ilu::Decompose_RowByRow<3>(*this, nmax_sing);
+    case 4: return ilu::Decompose_RowByRow<4>(*this, nmax_sing);
+    case 5: return ilu::Decompose_RowByRow<5>(*this, nmax_sing);
+    case 6: return ilu::Decompose_RowByRow<6>(*this, nmax_sing);
+    default: break;
+  }
+  std::cout << "ilu in single precision does not support the block size " << ndim << std::endl;
+  return false;
+}
+
 // numerical factorization
 template<>
 DFM2_INLINE bool
@@ -499,6 +826,9 @@ CPreconditionerILU<std::complex<double>>::Decompose() {
 template<typename T>
 void delfem2::CPreconditionerILU<T>::ForwardSubstitution(
     T *vec) const {
+  if (nthread != 1 && !levelFwdInd.empty()) {
+    if (ilu::Substitution_LevelSchedule(vec, *this, true)) { return; }
+  }
   if (ndim == 1) {
     const unsigned int *colind = colInd.data();
     const unsigned int *rowptr = rowPtr.data();
@@ -635,6 +965,8 @@ void delfem2::CPreconditionerILU<T>::ForwardSubstitution(
   }
 }
 #ifdef DFM2_STATIC_LIBRARY
+template void delfem2::CPreconditionerILU<float>::ForwardSubstitution(
+    float *vec) const;
 template void delfem2::CPreconditionerILU<double>::ForwardSubstitution(
     double *vec) const;
 template void delfem2::CPreconditionerILU<std::complex<double>>::ForwardSubstitution(
@@ -677,6 +1009,9 @@ void delfem2::CPreconditionerILU<T>::ForwardSubstitutionDegenerate(
 template<typename T>
 void delfem2::CPreconditionerILU<T>::BackwardSubstitution(
     T *vec) const {
+  if (nthread != 1 && !levelBwdInd.empty()) {
+    if (ilu::Substitution_LevelSchedule(vec, *this, false)) { return; }
+  }
   if (ndim == 1) {
     const unsigned int *colind = colInd.data();
     const unsigned int *rowptr = rowPtr.data();
@@ -806,6 +1141,9 @@ void delfem2::CPreconditionerILU<T>::BackwardSubstitution(
   }
 }
 #ifdef DFM2_STATIC_LIBRARY
+template void
+    delfem2::CPreconditionerILU<float>::BackwardSubstitution(
+    float *vec) const;
 template void
     delfem2::CPreconditionerILU<double>::BackwardSubstitution(
     double *vec) const;
@@ -996,8 +1334,12 @@ void delfem2::CPreconditionerILU<T>::Initialize_ILUk(
     valDia = m.val_dia_;
     //    std::cout<<"ncrs: "<<ncrs<<" "<<m.rowPtr.size()<<std::endl;
   }
+  this->MakeLevelSchedule();
 }
 #ifdef DFM2_STATIC_LIBRARY
+template void
+    delfem2::CPreconditionerILU<float>::Initialize_ILUk(
+    const CMatrixSparse<float> &m, int lev_fill);
 template void
     delfem2::CPreconditionerILU<double>::Initialize_ILUk(
     const CMatrixSparse<double> &m, int lev_fill);
@@ -1046,6 +1388,8 @@ void delfem2::CPreconditionerILU<T>::CopyValue
   for (unsigned int i = 0; i < nblk * blksize; i++) { valDia[i] = rhs.val_dia_[i]; }
 }
 #ifdef DFM2_STATIC_LIBRARY
+template void delfem2::CPreconditionerILU<float>::CopyValue(
+    const CMatrixSparse<float> &rhs);
 template void delfem2::CPreconditionerILU<double>::CopyValue(
     const CMatrixSparse<double> &rhs);
 template void delfem2::CPreconditionerILU<std::complex<double>>::CopyValue(
@@ -1087,11 +1431,30 @@ void delfem2::CPreconditionerILU<T>::SetPattern0(
       }
     }
   }
+  this->MakeLevelSchedule();
 }
 #ifdef DFM2_STATIC_LIBRARY
+template void delfem2::CPreconditionerILU<float>::SetPattern0(
+    const CMatrixSparse<float> &m);
 template void delfem2::CPreconditionerILU<double>::SetPattern0(
     const CMatrixSparse<double> &m);
 template void delfem2::CPreconditionerILU<std::complex<double>>::SetPattern0(
     const CMatrixSparse<std::complex<double>> &m);
 #endif
 
+// ----------------------------
+
+template<typename T>
+void delfem2::CPreconditionerILU<T>::MakeLevelSchedule() {
+  ilu::LevelSchedule_TriangularPart(
+      levelFwdInd, levelFwdBlk,
+      colInd, m_diaInd, rowPtr, nblk, true);
+  ilu::LevelSchedule_TriangularPart(
+      levelBwdInd, levelBwdBlk,
+      colInd, m_diaInd, rowPtr, nblk, false);
+}
+#ifdef DFM2_STATIC_LIBRARY
+template void delfem2::CPreconditionerILU<float>::MakeLevelSchedule();
+template void delfem2::CPreconditionerILU<double>::MakeLevelSchedule();
+template void delfem2::CPreconditionerILU<std::complex<double>>::MakeLevelSchedule();
+#endif
@@ -17,6 +17,7 @@ namespace delfem2 {
 
 /**
  * @brief ILU decomposision preconditioner class
+ * @tparam T float, double and std::complex<double>
  */
 template<typename T>
 class CPreconditionerILU {
@@ -30,10 +31,21 @@ class CPreconditionerILU {
     valCrs.clear();
     valDia.clear();
     m_diaInd.clear();
+    levelFwdInd.clear();
+    levelFwdBlk.clear();
+    levelBwdInd.clear();
+    levelBwdBlk.clear();
   }
   void SetPattern0(const CMatrixSparse<T> &m);
   void Initialize_ILUk(const CMatrixSparse<T> &m, int fill_level);
 
+  /**
+   * @brief level scheduling of the triangular solves and the factorization.
+   * @details the rows in the same level do not depend on each other and can be processed in parallel.
+   * This is called in SetPattern0() and Initialize_ILUk().
+   */
+  void MakeLevelSchedule();
+
   void CopyValue(const CMatrixSparse<T> &m);
   void SolvePrecond(T *vec) const {
     this->ForwardSubstitution(vec);
@@ -57,6 +69,26 @@ class CPreconditionerILU {
   std::vector<unsigned int> m_diaInd;
   std::vector<T> valCrs;
   std::vector<T> valDia;
+
+  /**
+   * number of threads for Decompose(), ForwardSubstitution() and BackwardSubstitution().
+   * 1 runs the serial reference code. 0 uses all the threads of "delfem2::ThreadPool".
+   * The block size larger than 4 always runs serially.
+   */
+  unsigned int nthread = 1;
+
+  /**
+   * jagged array of the row blocks for each level of the lower triangular part.
+   * The rows in the level "ilev" are levelFwdBlk[levelFwdInd[ilev]] ... levelFwdBlk[levelFwdInd[ilev+1]-1]
+   */
+  std::vector<unsigned int> levelFwdInd;
+  std::vector<unsigned int> levelFwdBlk;
+
+  /**
+   * jagged array of the row blocks for each level of the upper triangular part
+   */
+  std::vector<unsigned int> levelBwdInd;
+  std::vector<unsigned int> levelBwdBlk;
 };
 
 } // namespace delfem2
@@ -15,6 +15,65 @@
 
 namespace delfem2 {
 
+/**
+ * @brief ILU preconditioned CG with the mixed-precision iterative refinement.
+ * @details the inner PCG and the ILU preconditioner run in single precision,
+ * which halves the memory traffic of the matrix and the factors.
+ * The outer loop updates the residual in double precision until "conv_ratio_tol" is reached.
+ * @param mat_low single precision copy of "mat" (see CMatrixSparse::CopyCast)
+ * @param ilu_low preconditioner factorized from "mat_low"
+ * @param conv_ratio_inner convergence ratio of the inner PCG. It should be larger than the machine epsilon of float
+ * @return history of the relative residual norm after each refinement
+ */
+template<class MAT, class MAT_LOW, class PREC_LOW>
+std::vector<double> Solve_PCG_MixedPrecision(
+    double *r_vec,
+    double *x_vec,
+    double conv_ratio_tol,
+    unsigned int max_nrefine,
+    unsigned int max_niter_inner,
+    const MAT &mat,
+    const MAT_LOW &mat_low,
+    const PREC_LOW &ilu_low,
+    double conv_ratio_inner = 1.0e-3) {
+  const unsigned int ndof = mat.nrowblk_ * mat.nrowdim_;
+  std::vector<float> tmp0(ndof), tmp1(ndof);
+  return Solve_MixedPrecisionRefinement<float>(
+      r_vec, x_vec, conv_ratio_tol, max_nrefine, mat,
+      [&](float *r_low, float *dx_low) {
+        Solve_PCG(
+            ViewAsVectorXf(r_low, ndof),
+            ViewAsVectorXf(dx_low, ndof),
+            ViewAsVectorXf(tmp0),
+            ViewAsVectorXf(tmp1),
+            conv_ratio_inner, max_niter_inner, mat_low, ilu_low);
+      });
+}
+
+/**
+ * @brief ILU preconditioned BiCGStab with the mixed-precision iterative refinement.
+ * @details see Solve_PCG_MixedPrecision(). This works for the non-symmetric matrix.
+ */
+template<class MAT, class MAT_LOW, class PREC_LOW>
+std::vector<double> Solve_PBiCGStab_MixedPrecision(
+    double *r_vec,
+    double *x_vec,
+    double conv_ratio_tol,
+    unsigned int max_nrefine,
+    unsigned int max_niter_inner,
+    const MAT &mat,
+    const MAT_LOW &mat_low,
+    const PREC_LOW &ilu_low,
+    double conv_ratio_inner = 1.0e-3) {
+  return Solve_MixedPrecisionRefinement<float>(
+      r_vec, x_vec, conv_ratio_tol, max_nrefine, mat,
+      [&](float *r_low, float *dx_low) {
+        Solve_PBiCGStab(
+            r_low, dx_low,
+            conv_ratio_inner, max_niter_inner, mat_low, ilu_low);
+      });
+}
+
 class LinearSystemSolver_BlockSparseILU {
  public:
   void Initialize(
@@ -28,6 +87,7 @@ class LinearSystemSolver_BlockSparseILU {
     dof_bcflag.assign(ndof(), 0);
     // initialize sparse solver
     ilu_sparse.Initialize_ILUk(matrix, 0);
+    ilu_low.Clear(); // the pattern may have changed. it is made again in Solve_PcgIlu_MixedPrecision()
   }
 
   [[nodiscard]] size_t nblk() const { return matrix.nrowblk_; }
@@ -91,6 +151,27 @@ class LinearSystemSolver_BlockSparseILU {
     std::cout << "convergence   nitr:" << conv.size() << "    res:" << conv[conv.size() - 1] << std::endl;
   }
 
+  /**
+   * same as Solve_PcgIlu() but the ILU factorization and the inner PCG run in single precision
+   */
+  void Solve_PcgIlu_MixedPrecision() {
+    namespace dfm2 = delfem2;
+    matrix.SetFixedBC(dof_bcflag.data());
+    dfm2::setRHS_Zero(vec_r, dof_bcflag, 0);
+    //
+    matrix_low.CopyCast(matrix);
+    if (ilu_low.colInd.empty()) {  // cleared in Initialize()
+      ilu_low.Initialize_ILUk(matrix_low, 0);
+    }
+    ilu_low.CopyValue(matrix_low);
+    ilu_low.Decompose();
+    vec_x.resize(ndof());
+    conv_hist = dfm2::Solve_PCG_MixedPrecision(
+        vec_r.data(), vec_x.data(),
+        1.0e-5, 10, 1000,
+        matrix, matrix_low, ilu_low);
+  }
+
  public:
   std::vector<double> vec_r;
   std::vector<double> vec_x;
@@ -100,6 +181,8 @@ class LinearSystemSolver_BlockSparseILU {
   std::vector<unsigned int> merge_buffer;
   CMatrixSparse<double> matrix;
   CPreconditionerILU<double> ilu_sparse;
+  CMatrixSparse<float> matrix_low;  // single precision copy of "matrix" for the mixed-precision solver
+  CPreconditionerILU<float> ilu_low;
 };
 
 }
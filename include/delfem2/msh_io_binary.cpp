@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "delfem2/msh_io_binary.h"
+
+#include <fstream>
+#include <cstring>
+#include <cctype>
+#include <system_error>
+#include <random>
+#include <string>
+
+#if defined(_WIN32)
+#  include <process.h>
+#else
+#  include <unistd.h>
+#endif
+
+#include "delfem2/msh_io_obj.h"
+#include "delfem2/msh_io_ply.h"
+
+// ----------------------------------------------------
+
+namespace delfem2::msh_iobinary {
+
+constexpr char magic[8] = {'D', 'F', 'M', '2', 'M', 'E', 'S', 'H'};
+constexpr std::uint32_t endian_tag = 0x01020304;
+
+/**
+ * fixed size header at the beginning of the file. The table of the arrays follows.
+ */
+struct CHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t endian_tag;
+  std::uint32_t ndim;
+  std::uint32_t num_node_elem;
+  std::uint32_t num_array;
+  std::uint32_t padding;
+  std::uint64_t source_size;
+  std::int64_t source_time;
+  std::uint64_t mesh_hash;
+};
+static_assert(sizeof(CHeader) == 56);
+
+struct CTableEntry {
+  std::uint32_t id;
+  std::uint32_t value_type;
+  std::uint64_t offset;  // offset from the beginning of the file in bytes
+  std::uint64_t size;  // number of the values
+};
+static_assert(sizeof(CTableEntry) == 24);
+
+enum VALUE_TYPE : std::uint32_t {
+  UINT32 = 0,
+  FLOAT32 = 1,
+  FLOAT64 = 2,
+};
+
+template<typename T>
+constexpr std::uint32_t ValueType();
+
+template<>
+constexpr std::uint32_t ValueType<unsigned int>() { return UINT32; }
+
+template<>
+constexpr std::uint32_t ValueType<float>() { return FLOAT32; }
+
+template<>
+constexpr std::uint32_t ValueType<double>() { return FLOAT64; }
+
+inline size_t SizeOfValueType(std::uint32_t value_type) {
+  if (value_type == UINT32) { return 4; }
+  if (value_type == FLOAT32) { return 4; }
+  if (value_type == FLOAT64) { return 8; }
+  return 0;
+}
+
+inline std::uint64_t AlignUp(std::uint64_t n) {
+  return (n + MeshBinary_Alignment - 1) / MeshBinary_Alignment * MeshBinary_Alignment;
+}
+
+struct CArraySource {
+  MESHBIN_ARRAY id;
+  std::uint32_t value_type;
+  const void *data;
+  std::uint64_t size;
+};
+
+template<typename T>
+void AddArraySource(
+    std::vector<CArraySource> &aSrc,
+    MESHBIN_ARRAY id,
+    const std::vector<T> &value,
+    bool is_store_empty) {
+  if (value.empty() && !is_store_empty) { return; }
+  aSrc.push_back({id, ValueType<T>(), value.data(), value.size()});
+}
+
+template<typename TO, typename FROM>
+void CopyCastArray(
+    std::vector<TO> &value,
+    const void *data,
+    size_t size) {
+  value.resize(size);
+  if (size == 0) { return; }
+  const auto *src = static_cast<const FROM *>(data);
+  for (size_t i = 0; i < size; ++i) { value[i] = static_cast<TO>(src[i]); }
+}
+
+inline std::uint64_t HashBytes(
+    std::uint64_t h,
+    const void *data,
+    size_t nbyte) {
+  const auto *p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < nbyte; ++i) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+inline std::int64_t FileTime(
+    const std::filesystem::path &file_path,
+    std::error_code &ec) {
+  const auto t = std::filesystem::last_write_time(file_path, ec);
+  return static_cast<std::int64_t>(t.time_since_epoch().count());
+}
+
+/**
+ * @return unique name of a temporary file in the same directory as "file_path"
+ * so that the processes writing the same file do not share the temporary file
+ */
+inline std::filesystem::path UniqueTemporaryPath(
+    const std::filesystem::path &file_path) {
+#if defined(_WIN32)
+  const auto pid = static_cast<unsigned long>(_getpid());
+#else
+  const auto pid = static_cast<unsigned long>(getpid());
+#endif
+  std::random_device rd;
+  std::filesystem::path tmp_path = file_path;
+  tmp_path += "." + std::to_string(pid) + "." + std::to_string(rd()) + ".tmp";
+  return tmp_path;
+}
+
+inline bool ParseMeshTri3(
+    std::vector<double> &vtx_xyz,
+    std::vector<unsigned int> &tri_vtx,
+    const std::filesystem::path &file_path) {
+  std::string ext = file_path.extension().string();
+  for (auto &c: ext) { c = static_cast<char>(std::tolower(static_cast<unsigned char>(c))); }
+  if (ext == ".obj") {
+    return Read_Obj3_Parallel(vtx_xyz, tri_vtx, file_path);
+  }
+  if (ext == ".ply") {
+    vtx_xyz.clear();
+    tri_vtx.clear();
+    Read_Ply(vtx_xyz, tri_vtx, file_path);
+    return !vtx_xyz.empty();
+  }
+  return false;
+}
+
+}  // namespace delfem2::msh_iobinary
+
+// ----------------------------------------------------
+
+template<typename REAL>
+std::uint64_t delfem2::MeshBinary_Hash(
+    const std::vector<REAL> &vtx_xyz,
+    const std::vector<unsigned int> &elem_vtx) {
+  namespace lcl = delfem2::msh_iobinary;
+  const std::uint64_t size[2] = {vtx_xyz.size(), elem_vtx.size()};
+  std::uint64_t h = 0xcbf29ce484222325ULL;
+  h = lcl::HashBytes(h, size, sizeof(size));
+  h = lcl::HashBytes(h, vtx_xyz.data(), sizeof(REAL) * vtx_xyz.size());
+  h = lcl::HashBytes(h, elem_vtx.data(), sizeof(unsigned int) * elem_vtx.size());
+  return h;
+}
+#ifdef DFM2_STATIC_LIBRARY
+template std::uint64_t delfem2::MeshBinary_Hash(
+    const std::vector<double> &vtx_xyz,
+    const std::vector<unsigned int> &elem_vtx);
+template std::uint64_t delfem2::MeshBinary_Hash(
+    const std::vector<float> &vtx_xyz,
+    const std::vector<unsigned int> &elem_vtx);
+#endif
+
+template<typename REAL>
+bool delfem2::Write_MeshBinary(
+    const std::filesystem::path &file_path,
+    const CMeshBinary<REAL> &mesh) {
+  namespace lcl = delfem2::msh_iobinary;
+  std::vector<lcl::CArraySource> aSrc;
+  // the coordinates and the connectivity are stored even if they are empty
+  lcl::AddArraySource(aSrc, MESHBIN_ARRAY::VTX_XYZ, mesh.vtx_xyz, true);
+  lcl::AddArraySource(aSrc, MESHBIN_ARRAY::ELEM_VTX, mesh.elem_vtx, true);
+  lcl::AddArraySource(aSrc, MESHBIN_ARRAY::VTX_NRM, mesh.vtx_nrm, false);
+  lcl::AddArraySource(aSrc, MESHBIN_ARRAY::VTX_TEX, mesh.vtx_tex, false);
+  lcl::AddArraySource(aSrc, MESHBIN_ARRAY::PSUP_IND, mesh.psup_ind, false);
+  lcl::AddArraySource(aSrc, MESHBIN_ARRAY::PSUP, mesh.psup, false);
+  lcl::AddArraySource(aSrc, MESHBIN_ARRAY::BVH_NODE, mesh.bvh_node, false);
+  lcl::AddArraySource(aSrc, MESHBIN_ARRAY::BVH_AABB, mesh.bvh_aabb, false);
+  //
+  lcl::CHeader header{};
+  std::memcpy(header.magic, lcl::magic, 8);
+  header.version = MeshBinary_Version;
+  header.endian_tag = lcl::endian_tag;
+  header.ndim = mesh.ndim;
+  header.num_node_elem = mesh.num_node_elem;
+  header.num_array = static_cast<std::uint32_t>(aSrc.size());
+  header.source_size = mesh.source_size;
+  header.source_time = mesh.source_time;
+  header.mesh_hash = mesh.mesh_hash;
+  std::vector<lcl::CTableEntry> table(aSrc.size());
+  std::uint64_t offset = lcl::AlignUp(sizeof(lcl::CHeader) + sizeof(lcl::CTableEntry) * aSrc.size());
+  for (unsigned int ia = 0; ia < aSrc.size(); ++ia) {
+    table[ia].id = static_cast<std::uint32_t>(aSrc[ia].id);
+    table[ia].value_type = aSrc[ia].value_type;
+    table[ia].offset = offset;
+    table[ia].size = aSrc[ia].size;
+    offset = lcl::AlignUp(offset + aSrc[ia].size * lcl::SizeOfValueType(aSrc[ia].value_type));
+  }
+  //
+  std::ofstream fout(file_path, std::ios::binary | std::ios::trunc);
+  if (!fout.is_open()) { return false; }
+  fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  fout.write(reinterpret_cast<const char *>(table.data()),
+             static_cast<std::streamsize>(sizeof(lcl::CTableEntry) * table.size()));
+  const char zeros[MeshBinary_Alignment] = {};
+  std::uint64_t pos = sizeof(lcl::CHeader) + sizeof(lcl::CTableEntry) * table.size();
+  for (unsigned int ia = 0; ia < aSrc.size(); ++ia) {
+    fout.write(zeros, static_cast<std::streamsize>(table[ia].offset - pos));
+    const std::uint64_t nbyte = aSrc[ia].size * lcl::SizeOfValueType(aSrc[ia].value_type);
+    fout.write(static_cast<const char *>(aSrc[ia].data), static_cast<std::streamsize>(nbyte));
+    pos = table[ia].offset + nbyte;
+  }
+  return fout.good();
+}
+#ifdef DFM2_STATIC_LIBRARY
+template bool delfem2::Write_MeshBinary(
+    const std::filesystem::path &file_path,
+    const CMeshBinary<double> &mesh);
+template bool delfem2::Write_MeshBinary(
+    const std::filesystem::path &file_path,
+    const CMeshBinary<float> &mesh);
+#endif
+
+// ----------------------------------------------------
+
+DFM2_INLINE bool delfem2::CMeshBinaryView::Open(
+    const std::filesystem::path &file_path) {
+  namespace lcl = delfem2::msh_iobinary;
+  this->Close();
+  if (!file.Open(file_path.string())) { return false; }
+  const size_t nbyte_file = file.size();
+  if (nbyte_file < sizeof(lcl::CHeader)) {
+    file.Close();
+    return false;
+  }
+  lcl::CHeader header{};
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(header.magic, lcl::magic, 8) != 0
+      || header.version != MeshBinary_Version
+      || header.endian_tag != lcl::endian_tag
+      || header.num_array == 0
+      || header.num_array > static_cast<unsigned int>(MESHBIN_ARRAY::NUM_ARRAY)
+      || sizeof(lcl::CHeader) + sizeof(lcl::CTableEntry) * header.num_array > nbyte_file) {
+    file.Close();
+    return false;
+  }
+  for (unsigned int ia = 0; ia < header.num_array; ++ia) {
+    lcl::CTableEntry e{};
+    std::memcpy(&e, file.data() + sizeof(lcl::CHeader) + sizeof(lcl::CTableEntry) * ia, sizeof(e));
+    const size_t nbyte_value = lcl::SizeOfValueType(e.value_type);
+    if (nbyte_value == 0
+        || e.offset % MeshBinary_Alignment != 0
+        || e.offset > nbyte_file
+        || e.size > (nbyte_file - e.offset) / nbyte_value) {
+      file.Close();
+      return false;
+    }
+    table[ia] = {e.id, e.value_type, e.offset, e.size};
+  }
+  num_array = header.num_array;
+  ndim = header.ndim;
+  num_node_elem = header.num_node_elem;
+  source_size = header.source_size;
+  source_time = header.source_time;
+  mesh_hash = header.mesh_hash;
+  return true;
+}
+
+template<typename T>
+const T *delfem2::CMeshBinaryView::Array(
+    MESHBIN_ARRAY id,
+    size_t &size) const {
+  size = 0;
+  for (unsigned int ia = 0; ia < num_array; ++ia) {
+    if (table[ia].id != static_cast<std::uint32_t>(id)) { continue; }
+    if (table[ia].value_type != msh_iobinary::ValueType<T>()) { return nullptr; }
+    size = table[ia].size;
+    return reinterpret_cast<const T *>(file.data() + table[ia].offset);
+  }
+  return nullptr;
+}
+#ifdef DFM2_STATIC_LIBRARY
+template const unsigned int *delfem2::CMeshBinaryView::Array(MESHBIN_ARRAY id, size_t &size) const;
+template const float *delfem2::CMeshBinaryView::Array(MESHBIN_ARRAY id, size_t &size) const;
+template const double *delfem2::CMeshBinaryView::Array(MESHBIN_ARRAY id, size_t &size) const;
+#endif
+
+template<typename T>
+bool delfem2::CMeshBinaryView::CopyArray(
+    std::vector<T> &value,
+    MESHBIN_ARRAY id) const {
+  namespace lcl = delfem2::msh_iobinary;
+  for (unsigned int ia = 0; ia < num_array; ++ia) {
+    if (table[ia].id != static_cast<std::uint32_t>(id)) { continue; }
+    const void *data = file.data() + table[ia].offset;
+    const auto size = static_cast<size_t>(table[ia].size);
+    if (table[ia].value_type == lcl::UINT32) {
+      lcl::CopyCastArray<T, std::uint32_t>(value, data, size);
+    } else if (table[ia].value_type == lcl::FLOAT32) {
+      lcl::CopyCastArray<T, float>(value, data, size);
+    } else {
+      lcl::CopyCastArray<T, double>(value, data, size);
+    }
+    return true;
+  }
+  return false;
+}
+#ifdef DFM2_STATIC_LIBRARY
+template bool delfem2::CMeshBinaryView::CopyArray(std::vector<unsigned int> &value, MESHBIN_ARRAY id) const;
+template bool delfem2::CMeshBinaryView::CopyArray(std::vector<float> &value, MESHBIN_ARRAY id) const;
+template bool delfem2::CMeshBinaryView::CopyArray(std::vector<double> &value, MESHBIN_ARRAY id) const;
+#endif
+
+// ----------------------------------------------------
+
+DFM2_INLINE std::filesystem::path delfem2::MeshBinary_CachePath(
+    const std::filesystem::path &source_path) {
+  std::filesystem::path cache_path = source_path;
+  cache_path += ".dfm2bin";
+  return cache_path;
+}
+
+template<typename REAL>
+bool delfem2::Read_MeshTri3_Cached(
+    std::vector<REAL> &vtx_xyz,
+    std::vector<unsigned int> &tri_vtx,
+    const std::filesystem::path &file_path,
+    bool is_write_cache) {
+  namespace lcl = delfem2::msh_iobinary;
+  std::error_code ec;
+  const std::uint64_t source_size = std::filesystem::file_size(file_path, ec);
+  if (ec) { return false; }
+  const std::int64_t source_time = lcl::FileTime(file_path, ec);
+  if (ec) { return false; }
+  const std::filesystem::path cache_path = MeshBinary_CachePath(file_path);
+  {
+    CMeshBinaryView view;
+    size_t nxyz = 0;
+    if (view.Open(cache_path)
+        && view.source_size == source_size
+        && view.source_time == source_time
+        && view.ndim == 3
+        && view.num_node_elem == 3
+        && view.Array<double>(MESHBIN_ARRAY::VTX_XYZ, nxyz) != nullptr
+        && view.CopyArray(vtx_xyz, MESHBIN_ARRAY::VTX_XYZ)
+        && view.CopyArray(tri_vtx, MESHBIN_ARRAY::ELEM_VTX)) {
+      return true;
+    }
+  }
+  // the cache always stores the coordinates in double precision, so it does not depend on REAL
+  CMeshBinary<double> mesh;
+  if (!lcl::ParseMeshTri3(mesh.vtx_xyz, mesh.elem_vtx, file_path)) { return false; }
+  if (is_write_cache) {
+    mesh.source_size = source_size;
+    mesh.source_time = source_time;
+    // write to a temporary file and rename it so that a reader never sees a partially written cache
+    const std::filesystem::path tmp_path = lcl::UniqueTemporaryPath(cache_path);
+    if (Write_MeshBinary(tmp_path, mesh)) {
+      std::filesystem::rename(tmp_path, cache_path, ec);
+      if (ec) { std::filesystem::remove(tmp_path, ec); }
+    } else {
+      std::filesystem::remove(tmp_path, ec);
+    }
+  }
+  vtx_xyz.assign(mesh.vtx_xyz.begin(), mesh.vtx_xyz.end());
+  tri_vtx.swap(mesh.elem_vtx);
+  return true;
+}
+#ifdef DFM2_STATIC_LIBRARY
+template bool delfem2::Read_MeshTri3_Cached(
+    std::vector<double> &vtx_xyz,
+    std::vector<unsigned int> &tri_vtx,
+    const std::filesystem::path &file_path,
+    bool is_write_cache);
+template bool delfem2::Read_MeshTri3_Cached(
+    std::vector<float> &vtx_xyz,
+    std::vector<unsigned int> &tri_vtx,
+    const std::filesystem::path &file_path,
+    bool is_write_cache);
+#endif
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * @file binary container of the mesh arrays and the cache of the text mesh files
+ * @details the file consists of a fixed size header, a table of the arrays and the raw arrays.
+ * Each array starts at the offset aligned to "MeshBinary_Alignment" bytes,
+ * so the arrays can be used directly from the memory mapped file without parsing.
+ * The byte order is the native one of the machine that wrote the file (the header records it).
+ * The header also records a hash of the mesh, so the derived arrays (e.g., BVH) can be validated against the mesh.
+ */
+
+#ifndef DFM2_MSH_IO_BINARY_H
+#define DFM2_MSH_IO_BINARY_H
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <filesystem>
+
+#include "delfem2/file.h"
+#include "delfem2/dfm2_inline.h"
+
+namespace delfem2 {
+
+constexpr unsigned int MeshBinary_Version = 2;
+constexpr unsigned int MeshBinary_Alignment = 64;
+
+/**
+ * identifier of the arrays stored in the container
+ */
+enum class MESHBIN_ARRAY : std::uint32_t {
+  VTX_XYZ = 0,  //!< vertex coordinates (num_vtx x ndim)
+  ELEM_VTX = 1,  //!< element-vertex index (num_elem x num_node_elem)
+  VTX_NRM = 2,  //!< vertex normals (num_vtx x ndim)
+  VTX_TEX = 3,  //!< texture coordinates (num_vtx x 2)
+  PSUP_IND = 4,  //!< jagged array index of points surrounding point
+  PSUP = 5,  //!< jagged array value of points surrounding point
+  BVH_NODE = 6,  //!< "CNodeBVH2" stored as (iparent, ichild[0], ichild[1]) for each node
+  BVH_AABB = 7,  //!< (bbmin[3], bbmax[3]) of each BVH node. Same layout as "CBV3_AABB"
+  NUM_ARRAY = 8
+};
+
+/**
+ * @brief arrays of a mesh written to the binary container. The empty arrays are not stored.
+ * @tparam REAL float or double
+ */
+template<typename REAL>
+class CMeshBinary {
+ public:
+  unsigned int ndim = 3;
+  unsigned int num_node_elem = 3;  // 3 for triangle, 4 for quad or tetrahedron
+  std::vector<REAL> vtx_xyz;
+  std::vector<unsigned int> elem_vtx;
+  std::vector<REAL> vtx_nrm;
+  std::vector<REAL> vtx_tex;
+  std::vector<unsigned int> psup_ind;
+  std::vector<unsigned int> psup;
+  std::vector<unsigned int> bvh_node;
+  std::vector<REAL> bvh_aabb;
+  /**
+   * size and the modification time of the source text file. Used to judge the freshness of a cache
+   */
+  std::uint64_t source_size = 0;
+  std::int64_t source_time = 0;
+  /**
+   * hash of the mesh from which the arrays are made (see "MeshBinary_Hash"). Zero if not used
+   */
+  std::uint64_t mesh_hash = 0;
+};
+
+/**
+ * @brief 64-bit FNV-1a hash of the coordinates and the connectivity of a mesh
+ * @details the bits of the values are hashed, so the mesh needs to be exactly the same to get the same hash
+ */
+template<typename REAL>
+std::uint64_t MeshBinary_Hash(
+    const std::vector<REAL> &vtx_xyz,
+    const std::vector<unsigned int> &elem_vtx);
+
+/**
+ * @return false if the file cannot be written
+ */
+template<typename REAL>
+bool Write_MeshBinary(
+    const std::filesystem::path &file_path,
+    const CMeshBinary<REAL> &mesh);
+
+/**
+ * @brief read-only view of a binary mesh container mapped to the memory.
+ * @details the pointers returned by the member functions are valid while the view is open.
+ * Nothing is parsed or copied when the file is opened.
+ */
+class CMeshBinaryView {
+ public:
+  /**
+   * @return false if the file does not exist or is not a valid container
+   */
+  DFM2_INLINE bool Open(const std::filesystem::path &file_path);
+  void Close() {
+    file.Close();
+    num_array = 0;
+  }
+  [[nodiscard]] bool IsOpen() const { return file.IsOpen() && num_array > 0; }
+
+  /**
+   * @brief pointer to an array in the mapped file
+   * @tparam T "unsigned int" for the indices. "float" or "double" for the coordinates
+   * @param[out] size number of the values in the array
+   * @return nullptr if the array is not stored or its value type is not T
+   */
+  template<typename T>
+  const T *Array(MESHBIN_ARRAY id, size_t &size) const;
+
+  /**
+   * @brief copy an array in the mapped file converting the value type if necessary
+   * @return false if the array is not stored
+   */
+  template<typename T>
+  bool CopyArray(std::vector<T> &value, MESHBIN_ARRAY id) const;
+
+ public:
+  unsigned int ndim = 0;
+  unsigned int num_node_elem = 0;
+  std::uint64_t source_size = 0;
+  std::int64_t source_time = 0;
+  std::uint64_t mesh_hash = 0;
+ private:
+  struct CEntry {
+    std::uint32_t id;
+    std::uint32_t value_type;
+    std::uint64_t offset;
+    std::uint64_t size;
+  };
+  MemoryMappedFile file;
+  unsigned int num_array = 0;
+  CEntry table[static_cast<unsigned int>(MESHBIN_ARRAY::NUM_ARRAY)] = {};
+};
+
+/**
+ * @return path of the cache file for a source mesh file (the source path with ".dfm2bin" appended)
+ */
+DFM2_INLINE std::filesystem::path MeshBinary_CachePath(
+    const std::filesystem::path &source_path);
+
+/**
+ * @brief read the vertices and the triangles of an ".obj" or ".ply" file through the binary cache.
+ * @details if a cache file whose recorded size and modification time match the source file exists next to it,
+ * the arrays are copied from the memory mapped cache. Otherwise, the text file is parsed and the cache is written
+ * (if "is_write_cache" is true and the directory is writable). The cache stores the coordinates in double precision
+ * regardless of REAL, so the readers of both "float" and "double" share the same cache.
+ * @return false if the source file cannot be read
+ */
+template<typename REAL>
+bool Read_MeshTri3_Cached(
+    std::vector<REAL> &vtx_xyz,
+    std::vector<unsigned int> &tri_vtx,
+    const std::filesystem::path &file_path,
+    bool is_write_cache = true);
+
+} // namespace delfem2
+
+#ifndef DFM2_STATIC_LIBRARY
+#  include "delfem2/msh_io_binary.cpp"
+#endif
+
+#endif // DFM2_MSH_IO_BINARY_H
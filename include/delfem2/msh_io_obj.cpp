@@ -15,8 +15,12 @@
 #include <cassert>
 #include <string>
 #include <cstring>
+#include <cstdlib>
+#include <cstdint>
 
 #include "delfem2/msh_affine_transformation.h"
+#include "delfem2/file.h"
+#include "delfem2/thread.h"
 
 namespace delfem2::msh_ioobj {
 
@@ -58,6 +62,215 @@ DFM2_INLINE void ParseVtxObj_(
   }
 }
 
+
+// ---------------------------------------
+// below: parser for the memory mapped file
+
+/**
+ * size of the chunk of the file parsed by a task.
+ * The number of the chunks does not depend on the number of the threads, so the result is deterministic
+ */
+constexpr size_t nbyte_chunk_parse = 256 * 1024;
+
+/**
+ * range where converting the integer mantissa and the power of 10 is exact (i.e., the result is correctly rounded)
+ */
+template<typename REAL>
+struct FastPathRealParse;
+
+template<>
+struct FastPathRealParse<double> {
+  static constexpr std::uint64_t mantissa_max = (std::uint64_t(1) << 53);
+  static constexpr int exp10_max = 22;
+  static double StrToReal(const char *s) { return std::strtod(s, nullptr); }
+};
+
+template<>
+struct FastPathRealParse<float> {
+  static constexpr std::uint64_t mantissa_max = (std::uint64_t(1) << 24);
+  static constexpr int exp10_max = 10;
+  static float StrToReal(const char *s) { return std::strtof(s, nullptr); }
+};
+
+inline bool IsBlank(char c) { return c == ' ' || c == '\t'; }
+
+inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+/**
+ * parse a real number after the blanks. "p" is moved to the end of the number.
+ * The result is the same as "strtod" (or "strtof" for float).
+ * The slow "strtod" is called only when the fast path cannot round correctly.
+ * @return false if there is no number
+ */
+template<typename REAL>
+bool ParseReal(
+    REAL &v,
+    const char *&p,
+    const char *end) {
+  while (p < end && IsBlank(*p)) { ++p; }
+  const char *p0 = p;
+  bool is_negative = false;
+  if (p < end && (*p == '+' || *p == '-')) {
+    is_negative = (*p == '-');
+    ++p;
+  }
+  std::uint64_t mantissa = 0;
+  int ndigit = 0;  // number of the significant digits in "mantissa"
+  int exp10 = 0;
+  bool is_exact = true;
+  bool is_number = false;
+  for (; p < end && IsDigit(*p); ++p) {
+    is_number = true;
+    if (ndigit < 19) {
+      mantissa = mantissa * 10 + static_cast<unsigned int>(*p - '0');
+      if (mantissa != 0) { ndigit++; }
+    } else {
+      exp10++;
+      if (*p != '0') { is_exact = false; }
+    }
+  }
+  if (p < end && *p == '.') {
+    ++p;
+    for (; p < end && IsDigit(*p); ++p) {
+      is_number = true;
+      if (ndigit < 19) {
+        mantissa = mantissa * 10 + static_cast<unsigned int>(*p - '0');
+        if (mantissa != 0) { ndigit++; }
+        exp10--;
+      } else if (*p != '0') { is_exact = false; }
+    }
+  }
+  if (!is_number) {
+    p = p0;
+    return false;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *pe = p + 1;
+    bool is_negative_exp = false;
+    if (pe < end && (*pe == '+' || *pe == '-')) {
+      is_negative_exp = (*pe == '-');
+      ++pe;
+    }
+    if (pe < end && IsDigit(*pe)) {
+      int e = 0;
+      for (; pe < end && IsDigit(*pe); ++pe) {
+        if (e < 100000) { e = e * 10 + (*pe - '0'); }
+      }
+      exp10 += is_negative_exp ? -e : e;
+      p = pe;
+    }
+  }
+  using FP = FastPathRealParse<REAL>;
+  if (is_exact && mantissa <= FP::mantissa_max && exp10 >= -FP::exp10_max && exp10 <= FP::exp10_max) {
+    static constexpr REAL pow10[23] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const auto m = static_cast<REAL>(mantissa);
+    v = (exp10 >= 0) ? m * pow10[exp10] : m / pow10[-exp10];
+    if (is_negative) { v = -v; }
+    return true;
+  }
+  // slow path
+  const std::string str(p0, p);
+  v = FP::StrToReal(str.c_str());
+  return true;
+}
+
+/**
+ * parse an integer after the blanks. "p" is moved to the end of the number.
+ * @return false if there is no number
+ */
+inline bool ParseInt(
+    int &v,
+    const char *&p,
+    const char *end) {
+  while (p < end && IsBlank(*p)) { ++p; }
+  const char *p0 = p;
+  bool is_negative = false;
+  if (p < end && (*p == '+' || *p == '-')) {
+    is_negative = (*p == '-');
+    ++p;
+  }
+  if (p == end || !IsDigit(*p)) {
+    p = p0;
+    return false;
+  }
+  long long iv = 0;
+  for (; p < end && IsDigit(*p); ++p) { iv = iv * 10 + (*p - '0'); }
+  v = static_cast<int>(is_negative ? -iv : iv);
+  return true;
+}
+
+/**
+ * the first beginning of a line at or after "ipos"
+ */
+inline size_t BeginningOfLine(
+    const char *data,
+    size_t size,
+    size_t ipos) {
+  if (ipos == 0 || ipos >= size) { return std::min(ipos, size); }
+  const void *q = std::memchr(data + ipos - 1, '\n', size - ipos + 1);
+  if (q == nullptr) { return size; }
+  return static_cast<size_t>(static_cast<const char *>(q) - data) + 1;
+}
+
+/**
+ * vertices and the triangles in a chunk of the obj file
+ */
+template<typename REAL>
+class ChunkObj {
+ public:
+  std::vector<REAL> vtx_xyz;
+  std::vector<unsigned int> tri_vtx;  // index of the vertex. relative one is resolved in the stitching
+  std::vector<std::pair<unsigned int, int> > tri_relative;  // (position in "tri_vtx", vertex index local to the chunk)
+};
+
+/**
+ * parse "v" and "f" lines in [ib,ie). A polygon face is split into triangles as a fan.
+ */
+template<typename REAL>
+void ParseChunkObj(
+    ChunkObj<REAL> &chunk,
+    const char *ib,
+    const char *ie) {
+  std::vector<int> face;
+  const char *p = ib;
+  while (p < ie) {
+    const char *eol = static_cast<const char *>(std::memchr(p, '\n', ie - p));
+    if (eol == nullptr) { eol = ie; }
+    while (p < eol && IsBlank(*p)) { ++p; }
+    if (eol - p >= 2 && p[0] == 'v' && IsBlank(p[1])) {
+      p += 2;
+      for (unsigned int idim = 0; idim < 3; ++idim) {
+        REAL v = 0;
+        ParseReal(v, p, eol);
+        chunk.vtx_xyz.push_back(v);
+      }
+    } else if (eol - p >= 2 && p[0] == 'f' && IsBlank(p[1])) {
+      p += 2;
+      face.clear();
+      int iv;
+      while (ParseInt(iv, p, eol)) {
+        face.push_back(iv);
+        while (p < eol && !IsBlank(*p) && *p != '\r') { ++p; }  // skip "/vt/vn"
+      }
+      const auto nvtx_local = static_cast<int>(chunk.vtx_xyz.size() / 3);
+      for (unsigned int ino = 2; ino < face.size(); ++ino) {
+        for (int jv: {face[0], face[ino - 1], face[ino]}) {
+          if (jv < 0) {
+            chunk.tri_relative.emplace_back(
+                static_cast<unsigned int>(chunk.tri_vtx.size()), nvtx_local + jv);
+            chunk.tri_vtx.push_back(0);
+          } else {
+            chunk.tri_vtx.push_back(static_cast<unsigned int>(jv - 1));
+          }
+        }
+      }
+    }
+    p = eol + 1;
+  }
+}
+
 }
 
 template <typename REAL, typename INT>
@@ -473,6 +686,68 @@ template void delfem2::Read_Obj3(
     const std::filesystem::path &file_path);
 #endif
 
+template<typename REAL>
+bool delfem2::Read_Obj3_Parallel(
+    std::vector<REAL> &vtx_xyz,
+    std::vector<unsigned int> &tri_vtx,
+    const std::filesystem::path &file_path,
+    unsigned int nthread) {
+  namespace lcl = delfem2::msh_ioobj;
+  vtx_xyz.clear();
+  tri_vtx.clear();
+  MemoryMappedFile file;
+  if (!file.Open(file_path.string())) {
+    std::cout << "File Read Fail" << std::endl;
+    return false;
+  }
+  const char *data = file.data();
+  const size_t size = file.size();
+  const size_t nchunk = std::max<size_t>(1, (size + lcl::nbyte_chunk_parse - 1) / lcl::nbyte_chunk_parse);
+  std::vector<lcl::ChunkObj<REAL> > chunks(nchunk);
+  parallel_for(
+      nchunk,
+      [&](size_t ichunk) {
+        const size_t ib = lcl::BeginningOfLine(data, size, size / nchunk * ichunk);
+        const size_t ie = lcl::BeginningOfLine(data, size, (ichunk + 1 == nchunk) ? size : size / nchunk * (ichunk + 1));
+        lcl::ParseChunkObj(chunks[ichunk], data + ib, data + ie);
+      },
+      nthread);
+  // stitch the chunks
+  std::vector<size_t> chunk2xyz(nchunk + 1, 0), chunk2tri(nchunk + 1, 0);
+  for (size_t ichunk = 0; ichunk < nchunk; ++ichunk) {
+    chunk2xyz[ichunk + 1] = chunk2xyz[ichunk] + chunks[ichunk].vtx_xyz.size();
+    chunk2tri[ichunk + 1] = chunk2tri[ichunk] + chunks[ichunk].tri_vtx.size();
+  }
+  vtx_xyz.resize(chunk2xyz[nchunk]);
+  tri_vtx.resize(chunk2tri[nchunk]);
+  parallel_for(
+      nchunk,
+      [&](size_t ichunk) {
+        const lcl::ChunkObj<REAL> &chunk = chunks[ichunk];
+        std::copy(chunk.vtx_xyz.begin(), chunk.vtx_xyz.end(), vtx_xyz.begin() + chunk2xyz[ichunk]);
+        unsigned int *tri = tri_vtx.data() + chunk2tri[ichunk];
+        std::copy(chunk.tri_vtx.begin(), chunk.tri_vtx.end(), tri);
+        const auto offset = static_cast<int>(chunk2xyz[ichunk] / 3);
+        for (const auto &rel: chunk.tri_relative) {
+          tri[rel.first] = static_cast<unsigned int>(offset + rel.second);
+        }
+      },
+      nthread);
+  return true;
+}
+#ifdef DFM2_STATIC_LIBRARY
+template bool delfem2::Read_Obj3_Parallel(
+    std::vector<double> &vtx_xyz,
+    std::vector<unsigned int> &tri_vtx,
+    const std::filesystem::path &file_path,
+    unsigned int nthread);
+template bool delfem2::Read_Obj3_Parallel(
+    std::vector<float> &vtx_xyz,
+    std::vector<unsigned int> &tri_vtx,
+    const std::filesystem::path &file_path,
+    unsigned int nthread);
+#endif
+
 // ==========================
 
 template<typename T>
@@ -617,7 +892,7 @@ template bool delfem2::Read_WavefrontObjWithMaterialMixedElem(
     const std::filesystem::path &file_path);
 #endif
 
-void delfem2::Read_WavefrontMaterial(
+DFM2_INLINE void delfem2::Read_WavefrontMaterial(
     const std::filesystem::path &file_path,
     std::vector<MaterialWavefrontObj> &materials) {
   std::ifstream fin;
@@ -104,6 +104,23 @@ void Read_Obj3(
     std::vector<unsigned int> &tri_vtx,
     const std::filesystem::path &file_path);
 
+/**
+ * @brief read the vertices and the triangles of an obj file in parallel
+ * @details the output is the same as "Read_Obj3" but the polygon with more than four vertices is split as a fan
+ * and the negative (relative) vertex index is resolved.
+ * The other readers (e.g., "Read_Obj", "Read_Obj2" and the ones with the surface attributes) still parse the file
+ * line by line with the streams.
+ * The file is mapped to the memory, split into the chunks of lines and each chunk is parsed by a task.
+ * @param nthread number of threads. 0 uses all the threads of "delfem2::ThreadPool"
+ * @return false if the file cannot be opened
+ */
+template <typename REAL>
+bool Read_Obj3_Parallel(
+    std::vector<REAL> &vtx_xyz,
+    std::vector<unsigned int> &tri_vtx,
+    const std::filesystem::path &file_path,
+    unsigned int nthread = 0);
+
 // --------------------------
 // below: obj with surface attributes
 
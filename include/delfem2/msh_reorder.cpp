@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "delfem2/msh_reorder.h"
+
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "delfem2/srch_bvh.h"
+#include "delfem2/msh_topology_uniform.h"
+
+// ------------------------------------------------
+
+namespace delfem2::msh_reorder {
+
+/**
+ * @brief breadth-first search from "iroot"
+ * @param[out] order points of the connected component in the order of the visit
+ * @param[in,out] level level of each visited point. UINT_MAX for the points not visited yet
+ * @return number of the levels
+ */
+DFM2_INLINE unsigned int LevelStructure(
+    std::vector<unsigned int> &order,
+    std::vector<unsigned int> &level,
+    unsigned int iroot,
+    const std::vector<unsigned int> &psup_ind,
+    const std::vector<unsigned int> &psup) {
+  order.assign(1, iroot);
+  level[iroot] = 0;
+  for (unsigned int iorder = 0; iorder < order.size(); ++iorder) {
+    const unsigned int ip = order[iorder];
+    for (unsigned int ipsup = psup_ind[ip]; ipsup < psup_ind[ip + 1]; ++ipsup) {
+      const unsigned int jp = psup[ipsup];
+      if (level[jp] != UINT_MAX) { continue; }
+      level[jp] = level[ip] + 1;
+      order.push_back(jp);
+    }
+  }
+  return level[order.back()] + 1;
+}
+
+/**
+ * @brief pseudo-peripheral point of the connected component including "iroot"
+ * @details "Gibbs, Poole, and Stockmeyer, An algorithm for reducing the bandwidth and profile of a sparse matrix, 1976".
+ * The point of the smallest degree in the deepest level becomes the next root while the depth grows.
+ */
+DFM2_INLINE unsigned int PseudoPeripheralPoint(
+    unsigned int iroot,
+    std::vector<unsigned int> &level,
+    const std::vector<unsigned int> &psup_ind,
+    const std::vector<unsigned int> &psup) {
+  std::vector<unsigned int> order;
+  unsigned int nlevel = LevelStructure(order, level, iroot, psup_ind, psup);
+  for (unsigned int itr = 0; itr < 16; ++itr) {
+    unsigned int icand = UINT_MAX;
+    for (auto it = order.rbegin(); it != order.rend() && level[*it] + 1 == nlevel; ++it) {
+      const unsigned int ip = *it;
+      if (icand == UINT_MAX
+          || psup_ind[ip + 1] - psup_ind[ip] < psup_ind[icand + 1] - psup_ind[icand]) { icand = ip; }
+    }
+    for (unsigned int ip: order) { level[ip] = UINT_MAX; }
+    std::vector<unsigned int> order1;
+    const unsigned int nlevel1 = LevelStructure(order1, level, icand, psup_ind, psup);
+    if (nlevel1 <= nlevel) {
+      for (unsigned int ip: order1) { level[ip] = UINT_MAX; }
+      return iroot;
+    }
+    iroot = icand;
+    nlevel = nlevel1;
+    order.swap(order1);
+  }
+  for (unsigned int ip: order) { level[ip] = UINT_MAX; }
+  return iroot;
+}
+
+}
+
+// ------------------------------------------------
+
+DFM2_INLINE void delfem2::InversePermutation(
+    std::vector<unsigned int> &old2new,
+    const std::vector<unsigned int> &new2old) {
+  old2new.assign(new2old.size(), UINT_MAX);
+  for (unsigned int inew = 0; inew < new2old.size(); ++inew) {
+    assert(new2old[inew] < new2old.size() && old2new[new2old[inew]] == UINT_MAX);
+    old2new[new2old[inew]] = inew;
+  }
+}
+
+DFM2_INLINE void delfem2::Permutation_ReverseCuthillMcKee(
+    std::vector<unsigned int> &new2old,
+    const std::vector<unsigned int> &psup_ind,
+    const std::vector<unsigned int> &psup) {
+  assert(!psup_ind.empty());
+  const auto np = static_cast<unsigned int>(psup_ind.size() - 1);
+  auto degree = [&psup_ind](unsigned int ip) { return psup_ind[ip + 1] - psup_ind[ip]; };
+  auto less_degree = [&degree](unsigned int ip, unsigned int jp) {
+    return degree(ip) < degree(jp) || (degree(ip) == degree(jp) && ip < jp);
+  };
+  std::vector<unsigned int> aIP_degree(np); // candidates of the roots in the ascending order of the degree
+  for (unsigned int ip = 0; ip < np; ++ip) { aIP_degree[ip] = ip; }
+  std::sort(aIP_degree.begin(), aIP_degree.end(), less_degree);
+  //
+  new2old.clear();
+  new2old.reserve(np);
+  std::vector<unsigned int> level(np, UINT_MAX);
+  std::vector<int> aFlg(np, 0);
+  std::vector<unsigned int> aIP_adj;
+  for (unsigned int ip0: aIP_degree) {
+    if (aFlg[ip0] != 0) { continue; }
+    // Cuthill-McKee ordering of the connected component
+    const unsigned int iroot = msh_reorder::PseudoPeripheralPoint(ip0, level, psup_ind, psup);
+    size_t ihead = new2old.size();
+    new2old.push_back(iroot);
+    aFlg[iroot] = 1;
+    for (; ihead < new2old.size(); ++ihead) {
+      const unsigned int ip = new2old[ihead];
+      aIP_adj.clear();
+      for (unsigned int ipsup = psup_ind[ip]; ipsup < psup_ind[ip + 1]; ++ipsup) {
+        const unsigned int jp = psup[ipsup];
+        if (aFlg[jp] != 0) { continue; }
+        aFlg[jp] = 1;
+        aIP_adj.push_back(jp);
+      }
+      std::sort(aIP_adj.begin(), aIP_adj.end(), less_degree);
+      new2old.insert(new2old.end(), aIP_adj.begin(), aIP_adj.end());
+    }
+  }
+  assert(new2old.size() == np);
+  std::reverse(new2old.begin(), new2old.end());
+}
+
+template<typename REAL>
+DFM2_INLINE void delfem2::Permutation_MortonCode_Points3(
+    std::vector<unsigned int> &new2old,
+    const std::vector<REAL> &vtx_xyz) {
+  const size_t np = vtx_xyz.size() / 3;
+  if (np == 0) {
+    new2old.clear();
+    return;
+  }
+  REAL bbmin[3] = {vtx_xyz[0], vtx_xyz[1], vtx_xyz[2]};
+  REAL bbmax[3] = {vtx_xyz[0], vtx_xyz[1], vtx_xyz[2]};
+  for (size_t ip = 0; ip < np; ++ip) {
+    for (unsigned int idim = 0; idim < 3; ++idim) {
+      bbmin[idim] = std::min(bbmin[idim], vtx_xyz[ip * 3 + idim]);
+      bbmax[idim] = std::max(bbmax[idim], vtx_xyz[ip * 3 + idim]);
+    }
+  }
+  // cube enclosing the points, so the curve is not stretched along the short axis
+  const REAL size = std::max({bbmax[0] - bbmin[0], bbmax[1] - bbmin[1], bbmax[2] - bbmin[2], REAL(1.0e-10)});
+  for (unsigned int idim = 0; idim < 3; ++idim) {
+    const REAL c = (bbmin[idim] + bbmax[idim]) / 2;
+    bbmin[idim] = c - size * REAL(0.51);
+    bbmax[idim] = c + size * REAL(0.51);
+  }
+  std::vector<std::uint64_t> aMC;
+  SortedMortenCode_Points3(new2old, aMC, vtx_xyz, bbmin, bbmax);
+}
+
+DFM2_INLINE void delfem2::Permutation_MeshElem_SmallestPoint(
+    std::vector<unsigned int> &elem_new2old,
+    const std::vector<unsigned int> &elem_vtx,
+    unsigned int num_node_elem,
+    unsigned int num_vtx) {
+  const size_t nelem = elem_vtx.size() / num_node_elem;
+  // counting sort of the elements by their smallest point
+  std::vector<unsigned int> aKey(nelem);
+  std::vector<unsigned int> ind(num_vtx + 1, 0);
+  for (unsigned int ielem = 0; ielem < nelem; ++ielem) {
+    const unsigned int *p0 = elem_vtx.data() + ielem * num_node_elem;
+    const unsigned int ip = *std::min_element(p0, p0 + num_node_elem);
+    assert(ip < num_vtx);
+    aKey[ielem] = ip;
+    ind[ip + 1]++;
+  }
+  for (unsigned int ip = 0; ip < num_vtx; ++ip) { ind[ip + 1] += ind[ip]; }
+  elem_new2old.resize(nelem);
+  for (unsigned int ielem = 0; ielem < nelem; ++ielem) {
+    elem_new2old[ind[aKey[ielem]]++] = ielem;
+  }
+}
+
+DFM2_INLINE void delfem2::Renumber_MeshElem(
+    std::vector<unsigned int> &elem_vtx,
+    unsigned int num_node_elem,
+    const std::vector<unsigned int> &vtx_old2new,
+    const std::vector<unsigned int> &elem_new2old) {
+  if (!vtx_old2new.empty()) {
+    for (unsigned int &ip: elem_vtx) {
+      assert(ip < vtx_old2new.size());
+      ip = vtx_old2new[ip];
+    }
+  }
+  if (!elem_new2old.empty()) {
+    assert(elem_new2old.size() * num_node_elem == elem_vtx.size());
+    Permute_Values(elem_vtx, elem_new2old, num_node_elem);
+  }
+}
+
+template<typename REAL>
+DFM2_INLINE void delfem2::Reorder_MeshElem_ReverseCuthillMcKee(
+    std::vector<unsigned int> &vtx_new2old,
+    std::vector<unsigned int> &elem_new2old,
+    std::vector<REAL> &vtx_coords,
+    unsigned int ndim,
+    std::vector<unsigned int> &elem_vtx,
+    unsigned int num_node_elem) {
+  const auto np = static_cast<unsigned int>(vtx_coords.size() / ndim);
+  {
+    std::vector<unsigned int> psup_ind, psup;
+    JArray_PSuP_MeshElem(
+        psup_ind, psup,
+        elem_vtx.data(), elem_vtx.size() / num_node_elem, num_node_elem, np);
+    Permutation_ReverseCuthillMcKee(vtx_new2old, psup_ind, psup);
+  }
+  std::vector<unsigned int> vtx_old2new;
+  InversePermutation(vtx_old2new, vtx_new2old);
+  Permute_Values(vtx_coords, vtx_new2old, ndim);
+  Renumber_MeshElem(elem_vtx, num_node_elem, vtx_old2new, {});
+  Permutation_MeshElem_SmallestPoint(elem_new2old, elem_vtx, num_node_elem, np);
+  Renumber_MeshElem(elem_vtx, num_node_elem, {}, elem_new2old);
+}
+
+#ifdef DFM2_STATIC_LIBRARY
+template void delfem2::Permutation_MortonCode_Points3(
+    std::vector<unsigned int> &,
+    const std::vector<float> &);
+template void delfem2::Permutation_MortonCode_Points3(
+    std::vector<unsigned int> &,
+    const std::vector<double> &);
+template void delfem2::Reorder_MeshElem_ReverseCuthillMcKee(
+    std::vector<unsigned int> &,
+    std::vector<unsigned int> &,
+    std::vector<float> &,
+    unsigned int,
+    std::vector<unsigned int> &,
+    unsigned int);
+template void delfem2::Reorder_MeshElem_ReverseCuthillMcKee(
+    std::vector<unsigned int> &,
+    std::vector<unsigned int> &,
+    std::vector<double> &,
+    unsigned int,
+    std::vector<unsigned int> &,
+    unsigned int);
+#endif
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * @file renumbering of the points and the elements of a mesh for the locality of the memory access
+ * @details a permutation is stored as "new2old" where "new2old[inew]" is the old index of the new index "inew".
+ * A value computed on the reordered mesh is mapped back by "value_old[new2old[inew]] = value_new[inew]".
+ * The reverse Cuthill-McKee ordering reduces the bandwidth of the matrix having the pattern of "psup",
+ * and the Morton ordering puts the points close in the space close in the memory.
+ */
+
+#ifndef DFM2_MSH_REORDER_H
+#define DFM2_MSH_REORDER_H
+
+#include <vector>
+#include <cassert>
+
+#include "delfem2/dfm2_inline.h"
+
+namespace delfem2 {
+
+/**
+ * @brief inverse of a permutation (e.g., "old2new" from "new2old")
+ */
+DFM2_INLINE void InversePermutation(
+    std::vector<unsigned int> &old2new,
+    const std::vector<unsigned int> &new2old);
+
+/**
+ * @brief reverse Cuthill-McKee ordering of the points
+ * @details each connected component starts from a pseudo-peripheral point
+ * found by the repeated breadth-first searches from the point of the smallest degree.
+ * The neighbors are visited in the ascending order of their degrees.
+ * @param psup_ind jagged array of the points surrounding a point (e.g., from "JArray_PSuP_MeshElem")
+ */
+DFM2_INLINE void Permutation_ReverseCuthillMcKee(
+    std::vector<unsigned int> &new2old,
+    const std::vector<unsigned int> &psup_ind,
+    const std::vector<unsigned int> &psup);
+
+/**
+ * @brief ordering of the points along the Morton curve in their bounding box
+ * @details defined for "float" and "double"
+ */
+template<typename REAL>
+DFM2_INLINE void Permutation_MortonCode_Points3(
+    std::vector<unsigned int> &new2old,
+    const std::vector<REAL> &vtx_xyz);
+
+/**
+ * @brief ordering of the elements in the ascending order of their smallest point index
+ * @details the order is stable. Called after the points are renumbered,
+ * the elements sharing the points get close in the memory.
+ */
+DFM2_INLINE void Permutation_MeshElem_SmallestPoint(
+    std::vector<unsigned int> &elem_new2old,
+    const std::vector<unsigned int> &elem_vtx,
+    unsigned int num_node_elem,
+    unsigned int num_vtx);
+
+/**
+ * @brief renumber the points referred by the elements and permute the elements
+ * @param vtx_old2new new index of the points. Nothing is done for the points if this is empty
+ * @param elem_new2old permutation of the elements. Nothing is done for the elements if this is empty
+ */
+DFM2_INLINE void Renumber_MeshElem(
+    std::vector<unsigned int> &elem_vtx,
+    unsigned int num_node_elem,
+    const std::vector<unsigned int> &vtx_old2new,
+    const std::vector<unsigned int> &elem_new2old);
+
+/**
+ * @brief permute the values of the points (or the elements) each having "ndim" values
+ * @details used for the coordinates and any per-point attribute (e.g., velocity, UV, color)
+ */
+template<typename T>
+void Permute_Values(
+    std::vector<T> &values,
+    const std::vector<unsigned int> &new2old,
+    unsigned int ndim) {
+  assert(values.size() == new2old.size() * ndim);
+  std::vector<T> tmp(values.size());
+  for (unsigned int inew = 0; inew < new2old.size(); ++inew) {
+    const unsigned int iold = new2old[inew];
+    for (unsigned int idim = 0; idim < ndim; ++idim) {
+      tmp[inew * ndim + idim] = values[iold * ndim + idim];
+    }
+  }
+  values.swap(tmp);
+}
+
+/**
+ * @brief reorder the points by the reverse Cuthill-McKee ordering and the elements by their smallest point
+ * @details the other values of the points are reordered by "Permute_Values" with "vtx_new2old".
+ * @param[out] vtx_new2old permutation of the points to map the results back
+ * @param[out] elem_new2old permutation of the elements to map the results back
+ */
+template<typename REAL>
+DFM2_INLINE void Reorder_MeshElem_ReverseCuthillMcKee(
+    std::vector<unsigned int> &vtx_new2old,
+    std::vector<unsigned int> &elem_new2old,
+    std::vector<REAL> &vtx_coords,
+    unsigned int ndim,
+    std::vector<unsigned int> &elem_vtx,
+    unsigned int num_node_elem);
+
+} // namespace delfem2
+
+#ifndef DFM2_STATIC_LIBRARY
+#  include "delfem2/msh_reorder.cpp"
+#endif
+
+#endif /* DFM2_MSH_REORDER_H */
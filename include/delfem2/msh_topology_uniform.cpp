@@ -13,6 +13,189 @@
 #include <set>
 #include <climits>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "delfem2/thread.h"
+
+namespace delfem2::msh_topology_uniform {
+
+/**
+ * elem surrounding point by the counting sort with the atomic counters. The elements in a row are sorted
+ * so that the result is the same as the serial one
+ */
+DFM2_INLINE void JArray_ElSuP_MeshElem_Parallel(
+    std::vector<unsigned int> &elsup_ind,
+    std::vector<unsigned int> &elsup,
+    const unsigned int *elem_vtx_idx,
+    unsigned int num_elem,
+    unsigned int num_vtx_par_elem,
+    unsigned int num_vtx,
+    unsigned int nthread) {
+  std::unique_ptr<std::atomic<unsigned int>[]> aCount(new std::atomic<unsigned int>[num_vtx]);
+  for (unsigned int ino = 0; ino < num_vtx; ++ino) {
+    aCount[ino].store(0, std::memory_order_relaxed);
+  }
+  parallel_for(
+      num_elem,
+      [&](unsigned int ielem) {
+        for (unsigned int inoel = 0; inoel < num_vtx_par_elem; inoel++) {
+          const unsigned int ino1 = elem_vtx_idx[ielem * num_vtx_par_elem + inoel];
+          aCount[ino1].fetch_add(1, std::memory_order_relaxed);
+        }
+      },
+      nthread);
+  elsup_ind.resize(num_vtx + 1);
+  elsup_ind[0] = 0;
+  for (unsigned int ino = 0; ino < num_vtx; ++ino) {
+    elsup_ind[ino + 1] = elsup_ind[ino] + aCount[ino].load(std::memory_order_relaxed);
+    aCount[ino].store(elsup_ind[ino], std::memory_order_relaxed);
+  }
+  elsup.resize(elsup_ind[num_vtx]);
+  parallel_for(
+      num_elem,
+      [&](unsigned int ielem) {
+        for (unsigned int inoel = 0; inoel < num_vtx_par_elem; inoel++) {
+          const unsigned int ino1 = elem_vtx_idx[ielem * num_vtx_par_elem + inoel];
+          elsup[aCount[ino1].fetch_add(1, std::memory_order_relaxed)] = ielem;
+        }
+      },
+      nthread);
+  parallel_for(
+      num_vtx,
+      [&](unsigned int ino) {
+        std::sort(elsup.begin() + elsup_ind[ino], elsup.begin() + elsup_ind[ino + 1]);
+      },
+      nthread);
+}
+
+/**
+ * elem surrounding elem made for each element independently. The points of a face are compared directly
+ * instead of the flag array of the points shared by the threads
+ */
+DFM2_INLINE void ElSuEl_MeshElem_Parallel(
+    std::vector<unsigned int> &elsuel,
+    const unsigned int *elem_vtx_idx,
+    unsigned int num_elem,
+    int nNoEl,
+    const std::vector<unsigned int> &elsup_ind,
+    const std::vector<unsigned int> &elsup,
+    const int num_face_par_elem,
+    const int num_vtx_on_face,
+    const int (*vtx_on_elem_face)[4],
+    unsigned int nthread) {
+  assert(!elsup_ind.empty());
+  [[maybe_unused]] const std::size_t np = elsup_ind.size() - 1;
+  assert(num_vtx_on_face <= 4);
+
+  elsuel.assign(
+      num_elem * num_face_par_elem,
+      UINT_MAX);
+
+  parallel_for(
+      num_elem,
+      [&](unsigned int iel) {
+        unsigned int inpofa[4] = {UINT_MAX, UINT_MAX, UINT_MAX, UINT_MAX};
+        for (int ifael = 0; ifael < num_face_par_elem; ifael++) {
+          for (int ipofa = 0; ipofa < num_vtx_on_face; ipofa++) {
+            int int0 = vtx_on_elem_face[ifael][ipofa];
+            const unsigned int ip = elem_vtx_idx[iel * nNoEl + int0];
+            assert(ip < np);
+            inpofa[ipofa] = ip;
+          }
+          const unsigned int ipoin0 = inpofa[0];
+          bool iflg = false;
+          for (unsigned int ielsup = elsup_ind[ipoin0]; ielsup < elsup_ind[ipoin0 + 1]; ielsup++) {
+            const unsigned int jelem0 = elsup[ielsup];
+            if (jelem0 == iel) continue;
+            for (int jfael = 0; jfael < num_face_par_elem; jfael++) {
+              iflg = true;
+              for (int jpofa = 0; jpofa < num_vtx_on_face; jpofa++) {
+                int jnt0 = vtx_on_elem_face[jfael][jpofa];
+                const unsigned int jpoin0 = elem_vtx_idx[jelem0 * nNoEl + jnt0];
+                if (jpoin0 != inpofa[0] && jpoin0 != inpofa[1] && jpoin0 != inpofa[2] && jpoin0 != inpofa[3]) {
+                  iflg = false;
+                  break;
+                }
+              }
+              if (iflg) {
+                elsuel[iel * num_face_par_elem + ifael] = jelem0;
+                break;
+              }
+            }
+            if (iflg) break;
+          }
+          if (!iflg) {
+            elsuel[iel * num_face_par_elem + ifael] = UINT_MAX;
+          }
+        }
+      },
+      nthread);
+}
+
+/**
+ * points surrounding the point "ip" in the order of the appearance in the elements around the point
+ */
+DFM2_INLINE void PointsAroundPoint(
+    std::vector<unsigned int> &row,
+    unsigned int ip,
+    const unsigned int *elem_vtx,
+    const std::vector<unsigned int> &elsup_ind,
+    const std::vector<unsigned int> &elsup,
+    unsigned int num_vtx_par_elem) {
+  row.clear();
+  for (unsigned int ielsup = elsup_ind[ip]; ielsup < elsup_ind[ip + 1]; ielsup++) {
+    const unsigned int jelem = elsup[ielsup];
+    for (unsigned int jnoel = 0; jnoel < num_vtx_par_elem; jnoel++) {
+      const unsigned int jnode = elem_vtx[jelem * num_vtx_par_elem + jnoel];
+      if (jnode == ip) { continue; }
+      if (std::find(row.begin(), row.end(), jnode) != row.end()) { continue; }
+      row.push_back(jnode);
+    }
+  }
+}
+
+/**
+ * point surrounding point made for each point independently.
+ * The rows are computed twice (count and fill) to avoid the flag array shared by the threads.
+ */
+DFM2_INLINE void JArrayPointSurPoint_MeshOneRingNeighborhood_Parallel(
+    std::vector<unsigned int> &psup_ind,
+    std::vector<unsigned int> &psup,
+    const unsigned int *elem_vtx,
+    const std::vector<unsigned int> &elsup_ind,
+    const std::vector<unsigned int> &elsup,
+    unsigned int num_vtx_par_elem,
+    unsigned int num_vtx,
+    unsigned int nthread) {
+  psup_ind.assign(num_vtx + 1, 0);
+  parallel_for_range(
+      num_vtx,
+      [&](unsigned int ib, unsigned int ie) {
+        std::vector<unsigned int> row;
+        for (unsigned int ip = ib; ip < ie; ++ip) {
+          PointsAroundPoint(row, ip, elem_vtx, elsup_ind, elsup, num_vtx_par_elem);
+          psup_ind[ip + 1] = static_cast<unsigned int>(row.size());
+        }
+      },
+      0u, nthread);
+  for (unsigned int ip = 0; ip < num_vtx; ++ip) {
+    psup_ind[ip + 1] += psup_ind[ip];
+  }
+  psup.resize(psup_ind[num_vtx]);
+  parallel_for_range(
+      num_vtx,
+      [&](unsigned int ib, unsigned int ie) {
+        std::vector<unsigned int> row;
+        for (unsigned int ip = ib; ip < ie; ++ip) {
+          PointsAroundPoint(row, ip, elem_vtx, elsup_ind, elsup, num_vtx_par_elem);
+          std::copy(row.begin(), row.end(), psup.begin() + psup_ind[ip]);
+        }
+      },
+      0u, nthread);
+}
+
+}
 
 // ---------------------------------------------
 
@@ -23,7 +206,15 @@ DFM2_INLINE void delfem2::JArray_ElSuP_MeshElem(
     const unsigned int *elem_vtx_idx,
     size_t num_elem,
     unsigned int num_vtx_par_elem,
-    size_t num_vtx) {
+    size_t num_vtx,
+    unsigned int nthread) {
+  if (nthread != 1) {
+    msh_topology_uniform::JArray_ElSuP_MeshElem_Parallel(
+        elsup_ind, elsup,
+        elem_vtx_idx, static_cast<unsigned int>(num_elem), num_vtx_par_elem, static_cast<unsigned int>(num_vtx),
+        nthread);
+    return;
+  }
   elsup_ind.assign(num_vtx + 1, 0);
   for (unsigned int ielem = 0; ielem < num_elem; ielem++) {
     for (unsigned int inoel = 0; inoel < num_vtx_par_elem; inoel++) {
@@ -154,7 +345,16 @@ DFM2_INLINE void delfem2::ElSuEl_MeshElem(
     const std::vector<unsigned int> &elsup,
     const int num_face_par_elem,
     const int num_vtx_on_face,
-    const int (*vtx_on_elem_face)[4]) {
+    const int (*vtx_on_elem_face)[4],
+    unsigned int nthread) {
+  if (nthread != 1) {
+    msh_topology_uniform::ElSuEl_MeshElem_Parallel(
+        elsuel,
+        elem_vtx_idx, static_cast<unsigned int>(num_elem), nNoEl, elsup_ind, elsup,
+        num_face_par_elem, num_vtx_on_face, vtx_on_elem_face,
+        nthread);
+    return;
+  }
   assert(!elsup_ind.empty());
   const std::size_t np = elsup_ind.size() - 1;
 
@@ -228,19 +428,20 @@ DFM2_INLINE void delfem2::ElSuEl_MeshElem(
     const unsigned int *elem_vtx_idx,
     size_t num_elem,
     MESHELEM_TYPE type,
-    const size_t num_vtx) {
+    const size_t num_vtx,
+    unsigned int nthread) {
   const int nNoEl = nNodeElem(type);
   std::vector<unsigned int> elsup_ind, elsup;
   JArray_ElSuP_MeshElem(
       elsup_ind, elsup,
-      elem_vtx_idx, num_elem, nNoEl, num_vtx);
+      elem_vtx_idx, num_elem, nNoEl, num_vtx, nthread);
   const int nfael = nFaceElem(type);
   const int nnofa = nNodeElemFace(type, 0);
   ElSuEl_MeshElem(
       aElSuEl,
       elem_vtx_idx, num_elem, nNoEl,
       elsup_ind, elsup,
-      nfael, nnofa, noelElemFace(type));
+      nfael, nnofa, noelElemFace(type), nthread);
   assert(aElSuEl.size() == num_elem * nfael);
 }
 
@@ -255,7 +456,15 @@ DFM2_INLINE void delfem2::JArrayPointSurPoint_MeshOneRingNeighborhood(
     const std::vector<unsigned int> &elsup_ind,
     const std::vector<unsigned int> &elsup,
     unsigned int num_vtx_par_elem,
-    size_t num_vtx) {
+    size_t num_vtx,
+    unsigned int nthread) {
+  if (nthread != 1) {
+    msh_topology_uniform::JArrayPointSurPoint_MeshOneRingNeighborhood_Parallel(
+        psup_ind, psup,
+        elem_vtx, elsup_ind, elsup, num_vtx_par_elem, static_cast<unsigned int>(num_vtx),
+        nthread);
+    return;
+  }
   std::vector<unsigned int> aflg(num_vtx, UINT_MAX);
   psup_ind.assign(num_vtx + 1, 0);
   for (unsigned int ipoint = 0; ipoint < num_vtx; ipoint++) {
@@ -305,14 +514,15 @@ DFM2_INLINE void delfem2::JArray_PSuP_MeshElem(
     const unsigned int *elem_vtx,
     size_t num_elm,
     unsigned int num_vtx_par_elem,
-    size_t num_vtx) {
+    size_t num_vtx,
+    unsigned int nthread) {
   std::vector<unsigned int> elsup_ind, elsup;
   JArray_ElSuP_MeshElem(
       elsup_ind, elsup,
-      elem_vtx, num_elm, num_vtx_par_elem, num_vtx);
+      elem_vtx, num_elm, num_vtx_par_elem, num_vtx, nthread);
   JArrayPointSurPoint_MeshOneRingNeighborhood(
       psup_ind, psup,
-      elem_vtx, elsup_ind, elsup, num_vtx_par_elem, num_vtx);
+      elem_vtx, elsup_ind, elsup, num_vtx_par_elem, num_vtx, nthread);
 }
 
 DFM2_INLINE void delfem2::makeOneRingNeighborhood_TriFan(
@@ -366,15 +576,15 @@ DFM2_INLINE void delfem2::JArrayEdge_MeshElem(
     MESHELEM_TYPE elem_type,
     const std::vector<unsigned int> &elsup_ind,
     const std::vector<unsigned int> &elsup,
-    bool is_bidirectional) {
+    bool is_bidirectional,
+    unsigned int nthread) {
   const int neElm = mapMeshElemType2NEdgeElem[elem_type];
   const int nnoelElm = mapMeshElemType2NNodeElem[elem_type];
   const int (*aNoelEdge)[2] = noelElemEdge(elem_type);
-  const std::size_t nPoint0 = elsup_ind.size() - 1;
-  edge_ind.resize(nPoint0 + 1);
-  edge_ind[0] = 0;
-  for (unsigned int ip = 0; ip < nPoint0; ++ip) {
-    std::set<unsigned int> setIP;
+  const auto nPoint0 = static_cast<unsigned int>(elsup_ind.size() - 1);
+  // sorted points connected to the point "ip" by the edges
+  auto points_around_point = [&](std::vector<unsigned int> &row, unsigned int ip) {
+    row.clear();
     for (unsigned int ielsup = elsup_ind[ip]; ielsup < elsup_ind[ip + 1]; ++ielsup) {
       const unsigned int iq0 = elsup[ielsup];
       for (int ie = 0; ie < neElm; ++ie) {
@@ -384,17 +594,40 @@ DFM2_INLINE void delfem2::JArrayEdge_MeshElem(
         unsigned int ip1 = elem_vtx[iq0 * nnoelElm + inoel1];
         if (ip0 != ip && ip1 != ip) continue;
         if (ip0 == ip) {
-          if (is_bidirectional || ip1 > ip) { setIP.insert(ip1); }
+          if (is_bidirectional || ip1 > ip) { row.push_back(ip1); }
         } else {
-          if (is_bidirectional || ip0 > ip) { setIP.insert(ip0); }
+          if (is_bidirectional || ip0 > ip) { row.push_back(ip0); }
         }
       }
     }
-    for (unsigned int itr : setIP) {
-      edge.push_back(itr);
-    }
-    edge_ind[ip + 1] = edge_ind[ip] + static_cast<unsigned int>(setIP.size());
+    std::sort(row.begin(), row.end());
+    row.erase(std::unique(row.begin(), row.end()), row.end());
+  };
+  edge_ind.assign(nPoint0 + 1, 0);
+  parallel_for_range(
+      nPoint0,
+      [&](unsigned int ib, unsigned int ie) {
+        std::vector<unsigned int> row;
+        for (unsigned int ip = ib; ip < ie; ++ip) {
+          points_around_point(row, ip);
+          edge_ind[ip + 1] = static_cast<unsigned int>(row.size());
+        }
+      },
+      0u, nthread);
+  for (unsigned int ip = 0; ip < nPoint0; ++ip) {
+    edge_ind[ip + 1] += edge_ind[ip];
   }
+  edge.resize(edge_ind[nPoint0]);
+  parallel_for_range(
+      nPoint0,
+      [&](unsigned int ib, unsigned int ie) {
+        std::vector<unsigned int> row;
+        for (unsigned int ip = ib; ip < ie; ++ip) {
+          points_around_point(row, ip);
+          std::copy(row.begin(), row.end(), edge.begin() + edge_ind[ip]);
+        }
+      },
+      0u, nthread);
 }
 
 DFM2_INLINE void delfem2::MeshLine_JArrayEdge(
@@ -586,3 +819,53 @@ DFM2_INLINE void delfem2::JArray_PSuP_Hair(
       psup_ind, psup,
       aElemRod.data(), aElemRod.size() / 3, 3, np);
 }
+
+DFM2_INLINE void delfem2::JArray_ElemColoring_MeshElem(
+    std::vector<unsigned int> &color_ind,
+    std::vector<unsigned int> &color_elem,
+    //
+    const unsigned int *elem_vtx,
+    size_t num_elem,
+    unsigned int num_vtx_par_elem,
+    size_t num_vtx) {
+  std::vector<unsigned int> elsup_ind, elsup;
+  JArray_ElSuP_MeshElem(
+      elsup_ind, elsup,
+      elem_vtx, num_elem, num_vtx_par_elem, num_vtx);
+  std::vector<unsigned int> elem_color(num_elem, UINT_MAX);
+  std::vector<unsigned int> color_flag; // color_flag[icolor] == ielem if a neighbour of ielem has icolor
+  for (unsigned int ielem = 0; ielem < num_elem; ++ielem) {
+    for (unsigned int inoel = 0; inoel < num_vtx_par_elem; ++inoel) {
+      const unsigned int ivtx = elem_vtx[ielem * num_vtx_par_elem + inoel];
+      for (unsigned int ielsup = elsup_ind[ivtx]; ielsup < elsup_ind[ivtx + 1]; ++ielsup) {
+        const unsigned int icolor = elem_color[elsup[ielsup]];
+        if (icolor == UINT_MAX) { continue; }
+        color_flag[icolor] = ielem;
+      }
+    }
+    unsigned int icolor = 0;
+    for (; icolor < color_flag.size(); ++icolor) {
+      if (color_flag[icolor] != ielem) { break; }
+    }
+    if (icolor == color_flag.size()) { color_flag.push_back(UINT_MAX); }
+    elem_color[ielem] = icolor;
+  }
+  const auto num_color = static_cast<unsigned int>(color_flag.size());
+  color_ind.assign(num_color + 1, 0);
+  for (unsigned int ielem = 0; ielem < num_elem; ++ielem) {
+    color_ind[elem_color[ielem] + 1] += 1;
+  }
+  for (unsigned int icolor = 0; icolor < num_color; ++icolor) {
+    color_ind[icolor + 1] += color_ind[icolor];
+  }
+  color_elem.resize(num_elem);
+  for (unsigned int ielem = 0; ielem < num_elem; ++ielem) {
+    const unsigned int icolor = elem_color[ielem];
+    color_elem[color_ind[icolor]] = ielem;
+    color_ind[icolor] += 1;
+  }
+  for (unsigned int icolor = num_color; icolor > 0; --icolor) {
+    color_ind[icolor] = color_ind[icolor - 1];
+  }
+  color_ind[0] = 0;
+}
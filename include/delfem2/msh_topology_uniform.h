@@ -58,6 +58,9 @@ DFM2_INLINE void FlipElement_Tri(
 
 /**
  * make elem surrounding point
+ * @details the elements around a point are in the ascending order
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ * The result is the same for any number of threads
  */
 DFM2_INLINE void JArray_ElSuP_MeshElem(
     std::vector<unsigned int> &elsup_ind,
@@ -66,7 +69,8 @@ DFM2_INLINE void JArray_ElSuP_MeshElem(
     const unsigned int *elem_vtx_idx,
     size_t num_elem,
     unsigned int num_vtx_par_elem,
-    size_t num_vtx);
+    size_t num_vtx,
+    unsigned int nthread = 1);
 
 /**
  * @brief make elem surrounding point for triangle mesh
@@ -93,6 +97,8 @@ DFM2_INLINE void JArray_ElSuP_MeshTri(
  * @param[in] num_face_par_elem number of neibouring elements
  * @param[in] num_vtx_on_face how many nodes are shared with a nighbouring element
  * @param vtx_on_elem_face
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ * The result is the same for any number of threads
  */
 DFM2_INLINE void ElSuEl_MeshElem(
     std::vector<unsigned int> &elsuel,
@@ -103,7 +109,8 @@ DFM2_INLINE void ElSuEl_MeshElem(
     const std::vector<unsigned int> &elsup,
     const int num_face_par_elem,
     const int num_vtx_on_face,
-    const int (*vtx_on_elem_face)[4]);
+    const int (*vtx_on_elem_face)[4],
+    unsigned int nthread = 1);
 
 /**
  * @brief compute adjacent element index for mesh element
@@ -112,19 +119,24 @@ DFM2_INLINE void ElSuEl_MeshElem(
  * @param[in] num_elem number of elements
  * @param[in] type type of element
  * @param[in] num_vtx number of points
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ * The result is the same for any number of threads
  */
 DFM2_INLINE void ElSuEl_MeshElem(
     std::vector<unsigned int> &aElSuEl,
     const unsigned int *elem_vtx_idx,
     size_t num_elem,
     delfem2::MESHELEM_TYPE type,
-    const size_t num_vtx);
+    const size_t num_vtx,
+    unsigned int nthread = 1);
 
 /**
  * @brief make point surrounding point
  * @details psup -> edge bidirectional
  * edge unidir (ip0<ip1)
  * line (array of 2)
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ * The result is the same for any number of threads
  */
 DFM2_INLINE void JArrayPointSurPoint_MeshOneRingNeighborhood(
     std::vector<unsigned int> &psup_ind,
@@ -134,11 +146,14 @@ DFM2_INLINE void JArrayPointSurPoint_MeshOneRingNeighborhood(
     const std::vector<unsigned int> &elsup_ind,
     const std::vector<unsigned int> &elsup,
     unsigned int num_vtx_par_elem,
-    size_t num_vtx);
+    size_t num_vtx,
+    unsigned int nthread = 1);
 
 /**
  * @brief compute indexes of points surrounding a point as a jagged array
  * @param num_vtx_par_elem number of nodes in an element
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ * The result is the same for any number of threads
  */
 DFM2_INLINE void JArray_PSuP_MeshElem(
     std::vector<unsigned int> &psup_ind,
@@ -147,7 +162,8 @@ DFM2_INLINE void JArray_PSuP_MeshElem(
     const unsigned int *elem_vtx,
     size_t num_elm,
     unsigned int num_vtx_par_elem,
-    size_t num_vtx);
+    size_t num_vtx,
+    unsigned int nthread = 1);
 
 DFM2_INLINE void makeOneRingNeighborhood_TriFan(
     std::vector<int> &psup_ind,
@@ -159,6 +175,13 @@ DFM2_INLINE void makeOneRingNeighborhood_TriFan(
     const std::vector<int> &elsup,
     int np);
 
+/**
+ * @brief compute the points connected to a point by the edges of the elements as a jagged array
+ * @details the points around a point are in the ascending order
+ * @param is_bidirectional if false, only the edges to the larger point indexes are stored
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ * The result is the same for any number of threads
+ */
 DFM2_INLINE void JArrayEdge_MeshElem(
     std::vector<unsigned int> &edge_ind,
     std::vector<unsigned int> &edge,
@@ -167,7 +190,8 @@ DFM2_INLINE void JArrayEdge_MeshElem(
     delfem2::MESHELEM_TYPE elem_type,
     const std::vector<unsigned int> &elsup_ind,
     const std::vector<unsigned int> &elsup,
-    bool is_bidirectional);
+    bool is_bidirectional,
+    unsigned int nthread = 1);
 
 DFM2_INLINE void MeshLine_JArrayEdge(
     std::vector<unsigned int> &line_vtx,
@@ -248,6 +272,21 @@ DFM2_INLINE void MakeGroupElem(
     int num_face_par_elem,
     int num_vtx_par_elem);
 
+/**
+ * @brief greedy coloring of the elements such that the elements sharing a vertex have different colors
+ * @param[out] color_ind jagged array index. The number of colors is color_ind.size()-1
+ * @param[out] color_elem jagged array value. The elements with the color "icolor" are
+ * color_elem[color_ind[icolor]] ... color_elem[color_ind[icolor+1]-1] in the ascending order
+ */
+DFM2_INLINE void JArray_ElemColoring_MeshElem(
+    std::vector<unsigned int> &color_ind,
+    std::vector<unsigned int> &color_elem,
+    //
+    const unsigned int *elem_vtx,
+    size_t num_elem,
+    unsigned int num_vtx_par_elem,
+    size_t num_vtx);
+
 } // end namespace delfem2
 
 #ifndef DFM2_STATIC_LIBRARY
@@ -10,8 +10,89 @@
 #include <vector>
 #include <cassert>
 #include <climits>
+#include <algorithm>
+#include <utility>
 
 #include "delfem2/msh_topology_uniform.h"
+#include "delfem2/thread.h"
+
+// ----------------------------------------------------
+
+namespace delfem2::mshsubdiv {
+
+/**
+ * @brief terms of a row of a stencil sorted by the point. The terms of the same point are summed up
+ * @details the buffer is as small as the row, so the memory does not grow with the number of the points
+ */
+template<typename FUNC>
+void StencilRow(
+    std::vector<std::pair<unsigned int, double>> &row,
+    unsigned int irow,
+    FUNC &&add_row) {
+  row.clear();
+  add_row(irow, [&row](unsigned int ivtx, double w) { row.emplace_back(ivtx, w); });
+  std::sort(
+      row.begin(), row.end(),
+      [](const std::pair<unsigned int, double> &a, const std::pair<unsigned int, double> &b) {
+        return a.first < b.first;
+      });
+  size_t n = 0;
+  for (size_t i = 0; i < row.size(); ++i) {
+    if (n != 0 && row[n - 1].first == row[i].first) {
+      row[n - 1].second += row[i].second;
+      continue;
+    }
+    row[n++] = row[i];
+  }
+  row.resize(n);
+}
+
+/**
+ * @brief make a stencil row by row. The rows are made in parallel
+ * @param add_row "add_row(irow, add)" calls "add(ivtx, weight)" for the terms of the row.
+ * The terms of the same point are summed up
+ */
+template<typename FUNC>
+void MakeStencil(
+    std::vector<unsigned int> &stencil_ind,
+    std::vector<unsigned int> &stencil_vtx,
+    std::vector<double> &stencil_weight,
+    unsigned int nrow,
+    FUNC &&add_row,
+    unsigned int nthread) {
+  stencil_ind.assign(nrow + 1, 0);
+  parallel_for_range(
+      nrow,
+      [&](unsigned int irow_begin, unsigned int irow_end) {
+        std::vector<std::pair<unsigned int, double>> row;
+        for (unsigned int irow = irow_begin; irow < irow_end; ++irow) {
+          StencilRow(row, irow, add_row);
+          stencil_ind[irow + 1] = static_cast<unsigned int>(row.size());
+        }
+      },
+      0u, nthread);
+  for (unsigned int irow = 0; irow < nrow; ++irow) {
+    stencil_ind[irow + 1] += stencil_ind[irow];
+  }
+  stencil_vtx.resize(stencil_ind[nrow]);
+  stencil_weight.resize(stencil_ind[nrow]);
+  parallel_for_range(
+      nrow,
+      [&](unsigned int irow_begin, unsigned int irow_end) {
+        std::vector<std::pair<unsigned int, double>> row;
+        for (unsigned int irow = irow_begin; irow < irow_end; ++irow) {
+          StencilRow(row, irow, add_row);
+          assert(stencil_ind[irow] + row.size() == stencil_ind[irow + 1]);
+          for (unsigned int i = 0; i < row.size(); ++i) {
+            stencil_vtx[stencil_ind[irow] + i] = row[i].first;
+            stencil_weight[stencil_ind[irow] + i] = row[i].second;
+          }
+        }
+      },
+      0u, nthread);
+}
+
+}
 
 // ----------------------------------------------------
 
@@ -680,6 +761,246 @@ void delfem2::SubdivisionPoints_QuadCatmullClark(
   }
 }
 
+DFM2_INLINE void delfem2::SubdivStencil_QuadCatmullClark(
+    std::vector<unsigned int> &stencil_ind,
+    std::vector<unsigned int> &stencil_vtx,
+    std::vector<double> &stencil_weight,
+    //
+    const std::vector<unsigned int> &aEdgeFace0,
+    const unsigned int *quad_vtx0,
+    size_t num_quad0,
+    size_t num_vtx0,
+    unsigned int nthread) {
+  const auto nv0 = static_cast<unsigned int>(num_vtx0);
+  const auto ne0 = static_cast<unsigned int>(aEdgeFace0.size() / 4);
+  const auto nq0 = static_cast<unsigned int>(num_quad0);
+  std::vector<unsigned int> elsup_ind, elsup;
+  JArray_ElSuP_MeshElem(
+      elsup_ind, elsup,
+      quad_vtx0, num_quad0, 4, num_vtx0, nthread);
+  std::vector<unsigned int> edsup_ind(nv0 + 1, 0), edsup; // edges surrounding point
+  std::vector<int> aFlgBoundary(nv0, 0);
+  for (unsigned int ie = 0; ie < ne0; ++ie) {
+    edsup_ind[aEdgeFace0[ie * 4 + 0] + 1]++;
+    edsup_ind[aEdgeFace0[ie * 4 + 1] + 1]++;
+    if (aEdgeFace0[ie * 4 + 3] != UINT_MAX) { continue; }
+    aFlgBoundary[aEdgeFace0[ie * 4 + 0]] = 1;
+    aFlgBoundary[aEdgeFace0[ie * 4 + 1]] = 1;
+  }
+  for (unsigned int iv = 0; iv < nv0; ++iv) { edsup_ind[iv + 1] += edsup_ind[iv]; }
+  edsup.resize(edsup_ind[nv0]);
+  for (unsigned int ie = 0; ie < ne0; ++ie) {
+    edsup[edsup_ind[aEdgeFace0[ie * 4 + 0]]++] = ie;
+    edsup[edsup_ind[aEdgeFace0[ie * 4 + 1]]++] = ie;
+  }
+  for (unsigned int iv = nv0; iv > 0; --iv) { edsup_ind[iv] = edsup_ind[iv - 1]; }
+  edsup_ind[0] = 0;
+  //
+  auto add_face = [quad_vtx0](unsigned int iq, double w, auto &add) {
+    for (unsigned int inoq = 0; inoq < 4; ++inoq) { add(quad_vtx0[iq * 4 + inoq], w * 0.25); }
+  };
+  auto add_row = [&](unsigned int iv1, auto &&add) {
+    if (iv1 < nv0) { // vertex
+      const unsigned int iv = iv1;
+      if (aFlgBoundary[iv] != 0) {
+        add(iv, 1.0);
+        return;
+      }
+      const unsigned int nf = elsup_ind[iv + 1] - elsup_ind[iv];
+      if (nf == 0) { return; }
+      const double tmp0 = 1.0 / (nf * nf);
+      for (unsigned int ielsup = elsup_ind[iv]; ielsup < elsup_ind[iv + 1]; ++ielsup) {
+        add_face(elsup[ielsup], tmp0, add);
+      }
+      for (unsigned int iedsup = edsup_ind[iv]; iedsup < edsup_ind[iv + 1]; ++iedsup) {
+        const unsigned int ie = edsup[iedsup];
+        add(aEdgeFace0[ie * 4 + 0], tmp0);
+        add(aEdgeFace0[ie * 4 + 1], tmp0);
+      }
+      add(iv, (nf - 3.0) / nf);
+    } else if (iv1 < nv0 + ne0) { // edge
+      const unsigned int ie = iv1 - nv0;
+      const unsigned int iq1 = aEdgeFace0[ie * 4 + 3];
+      if (iq1 != UINT_MAX) {
+        add(aEdgeFace0[ie * 4 + 0], 0.25);
+        add(aEdgeFace0[ie * 4 + 1], 0.25);
+        add_face(aEdgeFace0[ie * 4 + 2], 0.25, add);
+        add_face(iq1, 0.25, add);
+      } else {
+        add(aEdgeFace0[ie * 4 + 0], 0.5);
+        add(aEdgeFace0[ie * 4 + 1], 0.5);
+      }
+    } else { // face
+      add_face(iv1 - nv0 - ne0, 1.0, add);
+    }
+  };
+  mshsubdiv::MakeStencil(
+      stencil_ind, stencil_vtx, stencil_weight,
+      nv0 + ne0 + nq0, add_row, nthread);
+}
+
+DFM2_INLINE void delfem2::LimitStencil_QuadCatmullClark(
+    std::vector<unsigned int> &stencil_ind,
+    std::vector<unsigned int> &stencil_vtx,
+    std::vector<double> &stencil_weight,
+    //
+    const unsigned int *quad_vtx,
+    size_t num_quad,
+    size_t num_vtx,
+    unsigned int nthread) {
+  std::vector<unsigned int> elsup_ind, elsup;
+  JArray_ElSuP_MeshElem(
+      elsup_ind, elsup,
+      quad_vtx, num_quad, 4, num_vtx, nthread);
+  auto add_row = [&](unsigned int iv, auto &&add) {
+    const unsigned int nf = elsup_ind[iv + 1] - elsup_ind[iv];
+    if (nf < 3) {
+      add(iv, 1.0);
+      return;
+    }
+    { // the quads around an interior point make a closed fan: the next points are the previous points
+      unsigned int aNext[16], aPrev[16];
+      if (nf > 16) {
+        add(iv, 1.0);
+        return;
+      }
+      for (unsigned int ielsup = elsup_ind[iv]; ielsup < elsup_ind[iv + 1]; ++ielsup) {
+        const unsigned int iq = elsup[ielsup];
+        unsigned int inoq = 0;
+        for (; inoq < 4; ++inoq) { if (quad_vtx[iq * 4 + inoq] == iv) { break; }}
+        assert(inoq < 4);
+        aNext[ielsup - elsup_ind[iv]] = quad_vtx[iq * 4 + (inoq + 1) % 4];
+        aPrev[ielsup - elsup_ind[iv]] = quad_vtx[iq * 4 + (inoq + 3) % 4];
+      }
+      std::sort(aNext, aNext + nf);
+      std::sort(aPrev, aPrev + nf);
+      if (!std::equal(aNext, aNext + nf, aPrev)) {
+        add(iv, 1.0);
+        return;
+      }
+    }
+    const double tmp = 1.0 / (nf * (nf + 5.0));
+    add(iv, nf * nf * tmp);
+    for (unsigned int ielsup = elsup_ind[iv]; ielsup < elsup_ind[iv + 1]; ++ielsup) {
+      const unsigned int iq = elsup[ielsup];
+      unsigned int inoq = 0;
+      for (; inoq < 4; ++inoq) { if (quad_vtx[iq * 4 + inoq] == iv) { break; }}
+      add(quad_vtx[iq * 4 + (inoq + 1) % 4], 4.0 * tmp);
+      add(quad_vtx[iq * 4 + (inoq + 2) % 4], tmp);
+    }
+  };
+  mshsubdiv::MakeStencil(
+      stencil_ind, stencil_vtx, stencil_weight,
+      static_cast<unsigned int>(num_vtx), add_row, nthread);
+}
+
+DFM2_INLINE void delfem2::Stencil_Compose(
+    std::vector<unsigned int> &stencil_ind,
+    std::vector<unsigned int> &stencil_vtx,
+    std::vector<double> &stencil_weight,
+    //
+    const std::vector<unsigned int> &stencil1_ind,
+    const std::vector<unsigned int> &stencil1_vtx,
+    const std::vector<double> &stencil1_weight,
+    const std::vector<unsigned int> &stencil0_ind,
+    const std::vector<unsigned int> &stencil0_vtx,
+    const std::vector<double> &stencil0_weight,
+    unsigned int nthread) {
+  auto add_row = [&](unsigned int irow, auto &&add) {
+    for (unsigned int ist1 = stencil1_ind[irow]; ist1 < stencil1_ind[irow + 1]; ++ist1) {
+      const unsigned int jrow = stencil1_vtx[ist1];
+      const double w1 = stencil1_weight[ist1];
+      for (unsigned int ist0 = stencil0_ind[jrow]; ist0 < stencil0_ind[jrow + 1]; ++ist0) {
+        add(stencil0_vtx[ist0], w1 * stencil0_weight[ist0]);
+      }
+    }
+  };
+  mshsubdiv::MakeStencil(
+      stencil_ind, stencil_vtx, stencil_weight,
+      static_cast<unsigned int>(stencil1_ind.size() - 1), add_row, nthread);
+}
+
+DFM2_INLINE void delfem2::SubdivStencil_MeshQuadCatmullClark(
+    std::vector<unsigned int> &quad_vtx1,
+    std::vector<unsigned int> &stencil_ind,
+    std::vector<unsigned int> &stencil_vtx,
+    std::vector<double> &stencil_weight,
+    //
+    const unsigned int *quad_vtx0,
+    size_t num_quad0,
+    size_t num_vtx0,
+    unsigned int nlevel,
+    bool is_limit,
+    unsigned int nthread) {
+  quad_vtx1.assign(quad_vtx0, quad_vtx0 + num_quad0 * 4);
+  stencil_ind.resize(num_vtx0 + 1);
+  stencil_vtx.resize(num_vtx0);
+  stencil_weight.assign(num_vtx0, 1.0);
+  for (unsigned int iv = 0; iv < num_vtx0; ++iv) {
+    stencil_ind[iv] = iv;
+    stencil_vtx[iv] = iv;
+  }
+  stencil_ind[num_vtx0] = static_cast<unsigned int>(num_vtx0);
+  std::vector<unsigned int> st0_ind, st0_vtx, st1_ind, st1_vtx;
+  std::vector<double> st0_weight, st1_weight;
+  for (unsigned int ilevel = 0; ilevel < nlevel; ++ilevel) {
+    std::vector<unsigned int> quad_vtx;
+    quad_vtx.swap(quad_vtx1);
+    const size_t nv = stencil_ind.size() - 1;
+    std::vector<unsigned int> psup_ind, psup, aEdgeFace;
+    SubdivTopo_MeshQuad(
+        quad_vtx1, psup_ind, psup, aEdgeFace,
+        quad_vtx.data(), quad_vtx.size() / 4, nv);
+    SubdivStencil_QuadCatmullClark(
+        st1_ind, st1_vtx, st1_weight,
+        aEdgeFace, quad_vtx.data(), quad_vtx.size() / 4, nv, nthread);
+    st0_ind.swap(stencil_ind);
+    st0_vtx.swap(stencil_vtx);
+    st0_weight.swap(stencil_weight);
+    Stencil_Compose(
+        stencil_ind, stencil_vtx, stencil_weight,
+        st1_ind, st1_vtx, st1_weight,
+        st0_ind, st0_vtx, st0_weight, nthread);
+  }
+  if (is_limit) {
+    LimitStencil_QuadCatmullClark(
+        st1_ind, st1_vtx, st1_weight,
+        quad_vtx1.data(), quad_vtx1.size() / 4, stencil_ind.size() - 1, nthread);
+    st0_ind.swap(stencil_ind);
+    st0_vtx.swap(stencil_vtx);
+    st0_weight.swap(stencil_weight);
+    Stencil_Compose(
+        stencil_ind, stencil_vtx, stencil_weight,
+        st1_ind, st1_vtx, st1_weight,
+        st0_ind, st0_vtx, st0_weight, nthread);
+  }
+}
+
+DFM2_INLINE void delfem2::Points_Stencil(
+    std::vector<double> &vtx_val1,
+    //
+    const std::vector<unsigned int> &stencil_ind,
+    const std::vector<unsigned int> &stencil_vtx,
+    const std::vector<double> &stencil_weight,
+    const double *vtx_val0,
+    unsigned int ndim,
+    unsigned int nthread) {
+  const auto nv1 = static_cast<unsigned int>(stencil_ind.size() - 1);
+  vtx_val1.resize(nv1 * ndim);
+  parallel_for(
+      nv1,
+      [&](unsigned int iv1) {
+        double *p1 = vtx_val1.data() + iv1 * ndim;
+        for (unsigned int idim = 0; idim < ndim; ++idim) { p1[idim] = 0.0; }
+        for (unsigned int ist = stencil_ind[iv1]; ist < stencil_ind[iv1 + 1]; ++ist) {
+          const double *p0 = vtx_val0 + stencil_vtx[ist] * ndim;
+          const double w = stencil_weight[ist];
+          for (unsigned int idim = 0; idim < ndim; ++idim) { p1[idim] += w * p0[idim]; }
+        }
+      },
+      nthread);
+}
+
 void delfem2::SubdivPoints3_MeshQuad(
     std::vector<double> &vtx_xyz1,
     //
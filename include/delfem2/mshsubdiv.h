@@ -85,6 +85,92 @@ DFM2_INLINE void SubdivisionPoints_QuadCatmullClark(
     const double *vtx_xyz0,
     size_t num_vtx0);
 
+/**
+ * @brief stencil of a Catmull-Clark subdivision. The subdivided points are the weighted sums of the input points
+ * @details the weights are the same as "SubdivisionPoints_QuadCatmullClark".
+ * The stencil is a jagged array: the "i"-th subdivided point is the sum of "stencil_weight[j] * point[stencil_vtx[j]]"
+ * for "j" in [stencil_ind[i], stencil_ind[i+1]).
+ * @param aEdgeFace0 two points on a edge and two quads touching the edge made by "SubdivTopo_MeshQuad"
+ */
+DFM2_INLINE void SubdivStencil_QuadCatmullClark(
+    std::vector<unsigned int> &stencil_ind,
+    std::vector<unsigned int> &stencil_vtx,
+    std::vector<double> &stencil_weight,
+    //
+    const std::vector<unsigned int> &aEdgeFace0,
+    const unsigned int *quad_vtx0,
+    size_t num_quad0,
+    size_t num_vtx0,
+    unsigned int nthread = 1);
+
+/**
+ * @brief stencil of the limit positions of the Catmull-Clark subdivision surface of a quad mesh
+ * @details the interior point of valence "n" moves to "(n^2 p + 4 sum e_i + sum f_i) / (n (n+5))"
+ * where "e_i" are the points sharing an edge and "f_i" are the diagonal points of the quads.
+ * The points on the boundary are not moved, as "SubdivisionPoints_QuadCatmullClark" does not move them.
+ */
+DFM2_INLINE void LimitStencil_QuadCatmullClark(
+    std::vector<unsigned int> &stencil_ind,
+    std::vector<unsigned int> &stencil_vtx,
+    std::vector<double> &stencil_weight,
+    //
+    const unsigned int *quad_vtx,
+    size_t num_quad,
+    size_t num_vtx,
+    unsigned int nthread = 1);
+
+/**
+ * @brief composition of two stencils. The stencil "1" is applied after the stencil "0"
+ */
+DFM2_INLINE void Stencil_Compose(
+    std::vector<unsigned int> &stencil_ind,
+    std::vector<unsigned int> &stencil_vtx,
+    std::vector<double> &stencil_weight,
+    //
+    const std::vector<unsigned int> &stencil1_ind,
+    const std::vector<unsigned int> &stencil1_vtx,
+    const std::vector<double> &stencil1_weight,
+    const std::vector<unsigned int> &stencil0_ind,
+    const std::vector<unsigned int> &stencil0_vtx,
+    const std::vector<double> &stencil0_weight,
+    unsigned int nthread = 1);
+
+/**
+ * @brief topology and stencil of the Catmull-Clark subdivision of "nlevel" times
+ * @details the stencils of the levels are composed into one stencil mapping the input points to the finest points,
+ * so the subdivided points for the moved input points are computed by "Points_Stencil" without the topology computation.
+ * @param quad_vtx1 (out) quads of the finest level
+ * @param is_limit the finest points are projected to the limit surface
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool"
+ */
+DFM2_INLINE void SubdivStencil_MeshQuadCatmullClark(
+    std::vector<unsigned int> &quad_vtx1,
+    std::vector<unsigned int> &stencil_ind,
+    std::vector<unsigned int> &stencil_vtx,
+    std::vector<double> &stencil_weight,
+    //
+    const unsigned int *quad_vtx0,
+    size_t num_quad0,
+    size_t num_vtx0,
+    unsigned int nlevel,
+    bool is_limit,
+    unsigned int nthread = 1);
+
+/**
+ * @brief evaluate the points as the sparse matrix-vector product of the stencil.
+ * @details each point has "ndim" values (e.g., 3 for the coordinates, 2 for the texture coordinates)
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool"
+ */
+DFM2_INLINE void Points_Stencil(
+    std::vector<double> &vtx_val1,
+    //
+    const std::vector<unsigned int> &stencil_ind,
+    const std::vector<unsigned int> &stencil_vtx,
+    const std::vector<double> &stencil_weight,
+    const double *vtx_val0,
+    unsigned int ndim,
+    unsigned int nthread = 1);
+
 DFM2_INLINE void SubdivPoints3_MeshQuad(
     std::vector<double> &vtx_xyz1,
     //
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "delfem2/sph_fluid.h"
+
+#include <cmath>
+#include <random>
+
+#include "delfem2/thread.h"
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+DFM2_INLINE void delfem2::CSphFluid3::AddParticlesInBox(
+    const double box_min[3],
+    const double box_max[3],
+    double jitter,
+    unsigned int seed) {
+  std::mt19937 rndeng(seed);
+  std::uniform_real_distribution<double> dist_m1p1(-1., +1.);
+  const double d = std::pow(mass / rest_density, 1 / 3.0) * 0.87;
+  const auto ndivx = static_cast<unsigned int>(std::ceil((box_max[0] - box_min[0]) / d));
+  const auto ndivy = static_cast<unsigned int>(std::ceil((box_max[1] - box_min[1]) / d));
+  const auto ndivz = static_cast<unsigned int>(std::ceil((box_max[2] - box_min[2]) / d));
+  for (unsigned int idivx = 0; idivx < ndivx; ++idivx) {
+    for (unsigned int idivy = 0; idivy < ndivy; ++idivy) {
+      for (unsigned int idivz = 0; idivz < ndivz; ++idivz) {
+        const double p[3] = {
+            box_min[0] + d * (idivx + 0.5 + dist_m1p1(rndeng) * jitter),
+            box_min[1] + d * (idivy + 0.5 + dist_m1p1(rndeng) * jitter),
+            box_min[2] + d * (idivz + 0.5 + dist_m1p1(rndeng) * jitter)};
+        // rejection sampling
+        if (p[0] < box_min[0] || p[0] > box_max[0]) { continue; }
+        if (p[1] < box_min[1] || p[1] > box_max[1]) { continue; }
+        if (p[2] < box_min[2] || p[2] > box_max[2]) { continue; }
+        xyz.insert(xyz.end(), p, p + 3);
+      }
+    }
+  }
+  const size_t np = xyz.size() / 3;
+  velo.resize(np * 3, 0.0);
+  force.resize(np * 3, 0.0);
+  rho_inv.resize(np, 0.0);
+  pressure.resize(np, 0.0);
+}
+
+DFM2_INLINE void delfem2::CSphFluid3::UpdateNeighborGrid(
+    unsigned int nthread) {
+  const unsigned int np = NumParticle();
+  if (grid.radius != radius_cutoff
+      || grid.domain != CCellList3::DOMAIN_TYPE::BOUNDED
+      || grid.cell_morton.empty()
+      || !std::equal(bbmin, bbmin + 3, grid.bbmin)
+      || !std::equal(bbmax, bbmax + 3, grid.bbmax)) {
+    grid.Initialize(bbmin, bbmax, radius_cutoff, CCellList3::DOMAIN_TYPE::BOUNDED);
+  }
+  grid.Build(xyz.data(), np, nthread);
+  if (reorder_interval != 0 && num_update_grid % reorder_interval == 0) {
+    // the particles close in the space get close in the memory
+    grid.Reorder(xyz, 3);
+    grid.Reorder(velo, 3);
+    grid.Reorder(force, 3);
+    grid.Reorder(rho_inv, 1);
+    grid.Reorder(pressure, 1);
+    grid.Build(xyz.data(), np, nthread);
+  }
+  num_update_grid++;
+}
+
+DFM2_INLINE void delfem2::CSphFluid3::DensityPressure(
+    unsigned int nthread) {
+  const double poly6_kern = 315.0 / (64.0 * M_PI * std::pow(radius_cutoff, 9));
+  const double sqr = radius_cutoff * radius_cutoff;
+  parallel_for(
+      NumParticle(),
+      [&](unsigned int ip) {
+        double sum = 0.0;
+        grid.ForEachNeighbor(
+            xyz.data() + ip * 3,
+            [&](unsigned int jp, const double *, double sqdist) {
+              if (ip == jp) { return; }
+              const double c = sqr - sqdist;
+              sum += c * c * c;
+            });
+        const double rho = sum * mass * poly6_kern;
+        pressure[ip] = (rho - rest_density) * stiff_int;
+        rho_inv[ip] = 1.0 / rho;
+      },
+      nthread);
+}
+
+DFM2_INLINE void delfem2::CSphFluid3::AccumulateForce(
+    unsigned int nthread) {
+  const double spiky_kern = -45.0 / (M_PI * std::pow(radius_cutoff, 6));
+  const double lap_kern = 45.0 / (M_PI * std::pow(radius_cutoff, 6));
+  const double vterm = lap_kern * viscosity;
+  parallel_for(
+      NumParticle(),
+      [&](unsigned int ip) {
+        double f[3] = {0, 0, 0};
+        const double *v0 = velo.data() + ip * 3;
+        grid.ForEachNeighbor(
+            xyz.data() + ip * 3,
+            [&](unsigned int jp, const double *dr, double sqdist) {
+              if (ip == jp) { return; }
+              const double r = std::sqrt(sqdist);
+              if (r == 0.0) { return; } // the direction of the pressure is undefined
+              const double *v1 = velo.data() + jp * 3;
+              const double c = radius_cutoff - r;
+              const double pterm = -0.5 * c * spiky_kern * (pressure[ip] + pressure[jp]) / r;
+              const double w = c * rho_inv[ip] * rho_inv[jp];
+              f[0] += (pterm * dr[0] + vterm * (v1[0] - v0[0])) * w;
+              f[1] += (pterm * dr[1] + vterm * (v1[1] - v0[1])) * w;
+              f[2] += (pterm * dr[2] + vterm * (v1[2] - v0[2])) * w;
+            });
+        force[ip * 3 + 0] = f[0];
+        force[ip * 3 + 1] = f[1];
+        force[ip * 3 + 2] = f[2];
+      },
+      nthread);
+}
+
+DFM2_INLINE void delfem2::CSphFluid3::UpdatePosition(
+    unsigned int nthread) {
+  parallel_for(
+      NumParticle(),
+      [&](unsigned int ip) {
+        double *p = xyz.data() + ip * 3;
+        double *v = velo.data() + ip * 3;
+        double accel[3] = {
+            force[ip * 3 + 0] * mass,
+            force[ip * 3 + 1] * mass,
+            force[ip * 3 + 2] * mass};
+        const double sq_accel = accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2];
+        if (sq_accel > limit_accel * limit_accel) {
+          const double s = limit_accel / std::sqrt(sq_accel);
+          accel[0] *= s;
+          accel[1] *= s;
+          accel[2] *= s;
+        }
+        for (unsigned int idim = 0; idim < 3; idim++) {
+          { // wall at the minimum side
+            const double diff = 2.0 * radius_particle - (p[idim] - bbmin[idim]);
+            if (diff > epsilon) { accel[idim] += stiff_ext * diff - damp_ext * v[idim]; }
+          }
+          { // wall at the maximum side
+            const double diff = 2.0 * radius_particle - (bbmax[idim] - p[idim]);
+            if (diff > epsilon) { accel[idim] -= stiff_ext * diff + damp_ext * v[idim]; }
+          }
+        }
+        for (unsigned int idim = 0; idim < 3; idim++) {
+          v[idim] += (accel[idim] + gravity[idim]) * dt;
+          p[idim] += v[idim] * dt;
+        }
+      },
+      nthread);
+}
+
+DFM2_INLINE void delfem2::CSphFluid3::Step(
+    unsigned int nthread) {
+  UpdateNeighborGrid(nthread);
+  DensityPressure(nthread);
+  AccumulateForce(nthread);
+  UpdatePosition(nthread);
+}
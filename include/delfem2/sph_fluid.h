@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * @file smoothed particle hydrodynamics (SPH) of the fluid in a box
+ * @details implementation based on
+ * "Müller et al., Particle-based fluid simulation for interactive applications. SCA 2003".
+ * The values of the particles are stored in the structure of arrays (SoA).
+ * The density and the force of each particle are gathered from its neighbors found by "CCellList3",
+ * so each particle is computed independently in parallel.
+ */
+
+#ifndef DFM2_SPH_FLUID_H
+#define DFM2_SPH_FLUID_H
+
+#include <vector>
+
+#include "delfem2/srchgrid.h"
+#include "delfem2/dfm2_inline.h"
+
+namespace delfem2 {
+
+class CSphFluid3 {
+ public:
+  /**
+   * @brief put the particles on the jittered lattice in a box. The spacing is set from the mass and the rest density
+   * @param jitter amplitude of the random displacement relative to the spacing
+   */
+  DFM2_INLINE void AddParticlesInBox(
+      const double box_min[3],
+      const double box_max[3],
+      double jitter = 0.3,
+      unsigned int seed = 0);
+
+  [[nodiscard]] unsigned int NumParticle() const {
+    return static_cast<unsigned int>(xyz.size() / 3);
+  }
+
+  /**
+   * @brief advance a time step ("DensityPressure", "AccumulateForce" and "UpdatePosition")
+   * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+   */
+  DFM2_INLINE void Step(unsigned int nthread = 0);
+
+  /**
+   * @brief bin the particles to the cells. The particles are reordered by the cells every "reorder_interval" calls
+   */
+  DFM2_INLINE void UpdateNeighborGrid(unsigned int nthread = 0);
+
+  /**
+   * @brief compute "rho_inv" and "pressure" from the neighbors
+   */
+  DFM2_INLINE void DensityPressure(unsigned int nthread = 0);
+
+  /**
+   * @brief compute "force" of the pressure and the viscosity from the neighbors
+   */
+  DFM2_INLINE void AccumulateForce(unsigned int nthread = 0);
+
+  /**
+   * @brief add the gravity and the penalty force of the walls and integrate the velocity and the position
+   */
+  DFM2_INLINE void UpdatePosition(unsigned int nthread = 0);
+
+ public:
+  // particles
+  std::vector<double> xyz;  // position
+  std::vector<double> velo;  // velocity
+  std::vector<double> force;  // force of the pressure and the viscosity
+  std::vector<double> rho_inv;  // inverse of the mass-density
+  std::vector<double> pressure;
+
+  // parameters
+  double dt = 0.001;
+  double radius_cutoff = 0.01;  // radius of influence
+  double radius_particle = 0.001;  // radius of particle for the collision to the walls
+  double mass = 0.0001;  // particle mass (kg)
+  double rest_density = 600.0;  // kg / m^3
+  double stiff_int = 1.0;  // coefficient between the density and the pressure
+  double stiff_ext = 50000.0;  // penalty coefficient of the wall repulsion force
+  double damp_ext = 256.0;  // damping of the wall repulsion force
+  double viscosity = 0.2;  // pascal-second (Pa.s) = 1 kg m^-1 s^-1
+  double limit_accel = 200.0;  // maximum acceleration
+  double epsilon = 1.0e-5;
+  double gravity[3] = {0.0, -9.8, 0.0};
+  double bbmin[3] = {0.0, 0.0, 0.0};  // walls
+  double bbmax[3] = {0.1, 0.1, 0.05};
+  unsigned int reorder_interval = 10;  // 0 means no reordering
+
+  CCellList3 grid;
+ private:
+  unsigned int num_update_grid = 0;
+};
+
+}
+
+#ifndef DFM2_STATIC_LIBRARY
+#  include "delfem2/sph_fluid.cpp"
+#endif
+
+#endif /* DFM2_SPH_FLUID_H */
@@ -576,7 +576,7 @@ template double delfem2::DistanceToTri(
 
 // ---------------------------------
 
-std::vector<unsigned int> delfem2::IndexesOfConnectedTriangleInSphere(
+DFM2_INLINE std::vector<unsigned int> delfem2::IndexesOfConnectedTriangleInSphere(
   const std::array<double, 3> pos,
   double rad,
   unsigned int itri0,
@@ -614,7 +614,7 @@ std::vector<unsigned int> delfem2::IndexesOfConnectedTriangleInSphere(
   return res;
 }
 
-bool delfem2::IsTherePointOnMeshInsideSphere(
+DFM2_INLINE bool delfem2::IsTherePointOnMeshInsideSphere(
   const std::tuple<unsigned int, double, double> &smpli,
   double rad,
   const std::vector<std::tuple<unsigned int, double, double> > &samples,
@@ -170,7 +170,7 @@ double DistanceToTri(
     const unsigned int *aTri,
     size_t nTri);
 
-std::vector<unsigned int> IndexesOfConnectedTriangleInSphere(
+DFM2_INLINE std::vector<unsigned int> IndexesOfConnectedTriangleInSphere(
   const std::array<double, 3> pos,
   double rad,
   unsigned int itri0,
@@ -178,7 +178,7 @@ std::vector<unsigned int> IndexesOfConnectedTriangleInSphere(
   const std::vector<unsigned int> &tri_vtx,
   const std::vector<unsigned int> &tri_adjtri);
 
-bool IsTherePointOnMeshInsideSphere(
+DFM2_INLINE bool IsTherePointOnMeshInsideSphere(
   const std::tuple<unsigned int, double, double>& smpli,
   double rad,
   const std::vector<std::tuple<unsigned int, double, double> > &samples,
@@ -14,6 +14,8 @@
 #include <vector>
 #include <iostream>
 #include <sstream>
+#include <limits>
+#include <utility>
 
 namespace delfem2 {
 
@@ -57,6 +59,16 @@ class CBV3_AABB {
     else if (y0 > x0 && y0 > z0) { return y0; }
     return z0;
   }
+  /**
+   * surface area used in the surface area heuristic (SAH). Zero if inactive
+   */
+  REAL SurfaceArea() const {
+    if (!IsActive()) { return 0; }
+    REAL x0 = bbmax[0] - bbmin[0];
+    REAL y0 = bbmax[1] - bbmin[1];
+    REAL z0 = bbmax[2] - bbmin[2];
+    return 2 * (x0 * y0 + y0 * z0 + z0 * x0);
+  }
   void SetCenterWidth(REAL cx, REAL cy, REAL cz,
                       REAL wx, REAL wy, REAL wz) {
     bbmin[0] = cx - wx * 0.5;
@@ -192,6 +204,43 @@ class CBV3_AABB {
     else { z0 = bbmax[2]; }
     return sqrt((x0 - x) * (x0 - x) + (y0 - y) * (y0 - y) + (z0 - z) * (z0 - z));
   }
+  /**
+   * @brief range of the distance from a point to the points in this box. Nothing is set if this box is inactive
+   */
+  void Range_DistToPoint(REAL &min0, REAL &max0,
+                         REAL x, REAL y, REAL z) const {
+    if (!IsActive()) { return; }
+    min0 = MinimumDistance(x, y, z);
+    const REAL dx = (x - bbmin[0] > bbmax[0] - x) ? x - bbmin[0] : bbmax[0] - x;
+    const REAL dy = (y - bbmin[1] > bbmax[1] - y) ? y - bbmin[1] : bbmax[1] - y;
+    const REAL dz = (z - bbmin[2] > bbmax[2] - z) ? z - bbmin[2] : bbmax[2] - z;
+    max0 = sqrt(dx * dx + dy * dy + dz * dz);
+  }
+  /**
+   * @brief range of the parameter "t" where the line "src+t*dir" is inside this box
+   * @return false if the line does not intersect this box or this box is inactive
+   */
+  bool Range_RayParameter(double &tmin, double &tmax,
+                          const double src[3], const double dir[3]) const {
+    if (!IsActive()) return false;
+    double t0 = -std::numeric_limits<double>::max();
+    double t1 = +std::numeric_limits<double>::max();
+    for (int i = 0; i < 3; ++i) {
+      if (dir[i] == 0) {
+        if (src[i] < bbmin[i] || src[i] > bbmax[i]) { return false; }
+        continue;
+      }
+      double ta = (bbmin[i] - src[i]) / dir[i];
+      double tb = (bbmax[i] - src[i]) / dir[i];
+      if (ta > tb) { std::swap(ta, tb); }
+      t0 = (ta > t0) ? ta : t0;
+      t1 = (tb < t1) ? tb : t1;
+      if (t0 > t1) { return false; }
+    }
+    tmin = t0;
+    tmax = t1;
+    return true;
+  }
   bool isInclude_Point(REAL x, REAL y, REAL z) const {
     if (!IsActive()) return false;
     if (x >= bbmin[0] && x <= bbmax[0]
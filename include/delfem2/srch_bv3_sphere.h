@@ -65,6 +65,13 @@ public:
   bool IsActive() const {
     return r >= 0;
   }
+  /**
+   * surface area used in the surface area heuristic (SAH). Zero if inactive
+   */
+  REAL SurfaceArea() const {
+    if( !IsActive() ){ return 0; }
+    return 4*3.14159265358979323846*r*r;
+  }
   template <typename REAL1>
   bool IsIntersectLine(const REAL1 src[3], const REAL1 dir[3]) const {
     REAL ratio = dir[0]*(c[0]-src[0]) + dir[1]*(c[1]-src[1]) + dir[2]*(c[2]-src[2]);
@@ -91,6 +98,24 @@ public:
     if( L <= r ){ return true; }
     return false;
   }
+  /**
+   * @brief range of the parameter "t" where the line "src+t*dir" is inside this sphere
+   * @return false if the line does not intersect this sphere or this sphere is inactive
+   */
+  bool Range_RayParameter(double& tmin, double& tmax,
+                          const double src[3], const double dir[3]) const {
+    if( r < 0 ){ return false; }
+    const double d[3] = {src[0]-c[0], src[1]-c[1], src[2]-c[2]};
+    const double a = dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2];
+    const double b = dir[0]*d[0] + dir[1]*d[1] + dir[2]*d[2];
+    const double cc = d[0]*d[0] + d[1]*d[1] + d[2]*d[2] - r*r;
+    const double disc = b*b - a*cc;
+    if( a == 0 || disc < 0 ){ return false; }
+    const double sqrt_disc = sqrt(disc);
+    tmin = (-b - sqrt_disc)/a;
+    tmax = (-b + sqrt_disc)/a;
+    return true;
+  }
   CBV3_Sphere& operator+=(const CBV3_Sphere& bb)
   {
     this->AddPoint(bb.c, bb.r);
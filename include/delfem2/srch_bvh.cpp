@@ -10,6 +10,9 @@
 #include <cmath>
 #include <algorithm>
 #include <climits> // UNINT_MAX
+#include <array>
+
+#include "delfem2/thread.h"
 
 // ------------------------------------
 
@@ -189,10 +192,21 @@ DFM2_INLINE void DevideElemAryConnex(
   }
 }
 
-DFM2_INLINE int delta(
+DFM2_INLINE unsigned int nbits_leading_zero(std::uint64_t x) {
+  const auto hi = static_cast<std::uint32_t>(x >> 32);
+  if (hi != 0) { return delfem2::nbits_leading_zero(hi); }
+  return 32 + delfem2::nbits_leading_zero(static_cast<std::uint32_t>(x));
+}
+
+DFM2_INLINE unsigned int nbits_leading_zero(std::uint32_t x) {
+  return delfem2::nbits_leading_zero(x);
+}
+
+template<typename CODE>
+int delta(
     int i,
     int j,
-    const unsigned int *sorted_morton_code,
+    const CODE *sorted_morton_code,
     size_t length) {
   if (j < 0 || j >= (int) length) {
     return -1;
@@ -213,15 +227,17 @@ DFM2_INLINE std::uint32_t expandBits(std::uint32_t v) {
   return v;
 }
 
-class CPairMtcInd {
- public:
-  std::uint32_t imtc;
-  unsigned int iobj;
- public:
-  bool operator<(const CPairMtcInd &rhs) const {
-    return (this->imtc < rhs.imtc);
-  }
-};
+// Expands a 21-bit integer into 63 bits
+// by puting two zeros before each bit
+DFM2_INLINE std::uint64_t expandBits(std::uint64_t v) {
+  v &= 0x1fffffu;
+  v = (v | v << 32) & 0x1f00000000ffffu;
+  v = (v | v << 16) & 0x1f0000ff0000ffu;
+  v = (v | v << 8) & 0x100f00f00f00f00fu;
+  v = (v | v << 4) & 0x10c30c30c30c30c3u;
+  v = (v | v << 2) & 0x1249249249249249u;
+  return v;
+}
 
 DFM2_INLINE void mark_child(
     std::vector<int> &aFlg,
@@ -240,70 +256,9 @@ DFM2_INLINE void mark_child(
   mark_child(aFlg, in1, aNode);
 }
 
-}
-
-// ===========================================================
-
-/**
- * @brief compute number of leading zeros
- * @function compute number of leading zeros
- * @param x input
- * @details clz(0) needs to be 32 to run BVH
- */
-DFM2_INLINE unsigned int delfem2::nbits_leading_zero(
-    uint32_t x) {
-  // avoid using buit-in functions such as "__builtin_clz(x)",
-  // becuase application to 0 is typically undefiend.
-  auto y = static_cast<int32_t>(x);
-  unsigned int n = 0;
-  if (y == 0) { return sizeof(y) * 8; }
-  while (true) {
-    if (y < 0) { break; }
-    n++;
-    y <<= 1;
-  }
-  return n;
-}
-
-DFM2_INLINE int delfem2::BVHTopology_TopDown_MeshElem(
-    std::vector<CNodeBVH2> &aNodeBVH,
-    const unsigned int nfael,
-    const std::vector<unsigned int> &aElSuEl,
-    const std::vector<double> &aElemCenter) {
-  aNodeBVH.clear();
-  const size_t nelem = aElemCenter.size() / 3;
-  std::vector<unsigned int> list(nelem);
-  for (unsigned int ielem = 0; ielem < nelem; ielem++) { list[ielem] = ielem; }
-  std::vector<unsigned int> aElem2Node;
-  aElem2Node.resize(nelem, 0);
-  aNodeBVH.resize(1);
-  aNodeBVH[0].iparent = UINT_MAX;
-  bvh::DevideElemAryConnex(
-      0, aElem2Node, aNodeBVH,
-      list, static_cast<int>(nfael), aElSuEl, aElemCenter);
-  return 0;
-}
-
-template<typename REAL>
-DFM2_INLINE std::uint32_t delfem2::MortonCode(REAL x, REAL y, REAL z) {
-  auto ix = (std::uint32_t) fmin(fmax(x * 1024.0f, 0.0f), 1023.0f);
-  auto iy = (std::uint32_t) fmin(fmax(y * 1024.0f, 0.0f), 1023.0f);
-  auto iz = (std::uint32_t) fmin(fmax(z * 1024.0f, 0.0f), 1023.0f);
-  //  std::cout << std::bitset<10>(ix) << " " << std::bitset<10>(iy) << " " << std::bitset<10>(iz) << std::endl;
-  ix = bvh::expandBits(ix);
-  iy = bvh::expandBits(iy);
-  iz = bvh::expandBits(iz);
-  //  std::cout << std::bitset<30>(ix) << " " << std::bitset<30>(iy) << " " << std::bitset<30>(iz) << std::endl;
-  std::uint32_t ixyz = ix * 4 + iy * 2 + iz;
-  return ixyz;
-}
-#ifdef DFM2_STATIC_LIBRARY
-template std::uint32_t delfem2::MortonCode(float x, float y, float z);
-template std::uint32_t delfem2::MortonCode(double x, double y, double z);
-#endif
-
-DFM2_INLINE std::pair<unsigned int, unsigned int> delfem2::MortonCode_DeterminRange(
-    const std::uint32_t *sortedMC,
+template<typename CODE>
+std::pair<unsigned int, unsigned int> MortonCode_DeterminRange(
+    const CODE *sortedMC,
     size_t nMC,
     unsigned int imc) {
   assert(nMC > 0);
@@ -318,9 +273,9 @@ DFM2_INLINE std::pair<unsigned int, unsigned int> delfem2::MortonCode_DeterminRa
         static_cast<unsigned int>(nMC - 1));
   }
   // ----------------------
-  const std::uint32_t mc0 = sortedMC[imc - 1];
-  const std::uint32_t mc1 = sortedMC[imc + 0];
-  const std::uint32_t mc2 = sortedMC[imc + 1];
+  const CODE mc0 = sortedMC[imc - 1];
+  const CODE mc1 = sortedMC[imc + 0];
+  const CODE mc2 = sortedMC[imc + 1];
   if (mc0 == mc1 && mc1 == mc2) { // for hash value collision
     unsigned int jmc = imc + 1;
     for (; jmc < nMC; ++jmc) {
@@ -331,20 +286,20 @@ DFM2_INLINE std::pair<unsigned int, unsigned int> delfem2::MortonCode_DeterminRa
   // get direction
   // (d==+1) -> imc is left-end, move forward
   // (d==-1) -> imc is right-end, move backward
-  int d = bvh::delta(imc, imc + 1, sortedMC, nMC) - bvh::delta(imc, imc - 1, sortedMC, nMC);
+  int d = delta(imc, imc + 1, sortedMC, nMC) - delta(imc, imc - 1, sortedMC, nMC);
   d = d > 0 ? 1 : -1;
 
   //compute the upper bound for the length of the range
-  const int delta_min = bvh::delta(imc, imc - d, sortedMC, nMC);
+  const int delta_min = delta(imc, imc - d, sortedMC, nMC);
   int lmax = 2;
-  while (bvh::delta(imc, imc + lmax * d, sortedMC, nMC) > delta_min) {
+  while (delta(imc, imc + lmax * d, sortedMC, nMC) > delta_min) {
     lmax = lmax * 2;
   }
 
   //find the other end using binary search
   int l = 0;
   for (int t = lmax / 2; t >= 1; t /= 2) {
-    if (bvh::delta(imc, imc + (l + t) * d, sortedMC, nMC) > delta_min) {
+    if (delta(imc, imc + (l + t) * d, sortedMC, nMC) > delta_min) {
       l = l + t;
     }
   }
@@ -362,18 +317,19 @@ DFM2_INLINE std::pair<unsigned int, unsigned int> delfem2::MortonCode_DeterminRa
   return range;
 }
 
-DFM2_INLINE unsigned int delfem2::MortonCode_FindSplit(
-    const std::uint32_t *aMC,
+template<typename CODE>
+unsigned int MortonCode_FindSplit(
+    const CODE *aMC,
     unsigned int iMC_start,
     unsigned int iMC_last) {
   if (iMC_start == iMC_last) { return UINT_MAX; }
 
-  const std::uint32_t mcStart = aMC[iMC_start];
+  const CODE mcStart = aMC[iMC_start];
 
   const unsigned int nbitcommon0 = nbits_leading_zero(mcStart ^ aMC[iMC_last]);
 
   // handle duplicated morton code
-  if (nbitcommon0 == 32) { return iMC_start; } // sizeof(std::uint32_t)*8
+  if (nbitcommon0 == sizeof(CODE) * 8) { return iMC_start; }
 
   // Use binary search to find where the next bit differs.
   // Specifically, we are looking for the highest object that
@@ -392,36 +348,259 @@ DFM2_INLINE unsigned int delfem2::MortonCode_FindSplit(
   return iMC_split;
 }
 
-template<typename REAL>
-DFM2_INLINE void delfem2::SortedMortenCode_Points3(
+/**
+ * stable LSD radix sort of the codes with 8-bit digits. The digits that are the same for all the codes are skipped.
+ * Each pass counts the digits of the chunks in parallel and scatters the chunks in parallel.
+ */
+template<typename CODE>
+void RadixSort(
+    std::vector<CODE> &codes,
+    std::vector<unsigned int> &indexes,
+    unsigned int nthread) {
+  constexpr unsigned int nbin = 256;
+  const auto n = static_cast<unsigned int>(codes.size());
+  const unsigned int nthread_used = thread::NumThreadsForLoop(nthread);
+  const unsigned int nchunk = (nthread_used <= 1) ? 1 : thread::NumChunks(n, 4096u, nthread_used);
+  if (nchunk == 0) { return; }
+  const auto chunk_range = [n, nchunk](unsigned int ichunk) {
+    return std::make_pair(
+        n / nchunk * ichunk + std::min(ichunk, n % nchunk),
+        n / nchunk * (ichunk + 1) + std::min(ichunk + 1, n % nchunk));
+  };
+  std::vector<CODE> codes1(n);
+  std::vector<unsigned int> indexes1(n);
+  std::vector<std::array<unsigned int, nbin> > hist(nchunk);
+  for (unsigned int ishift = 0; ishift < sizeof(CODE) * 8; ishift += 8) {
+    parallel_for(
+        nchunk,
+        [&](unsigned int ichunk) {
+          auto &h = hist[ichunk];
+          h.fill(0);
+          const auto r = chunk_range(ichunk);
+          for (unsigned int i = r.first; i < r.second; ++i) { h[(codes[i] >> ishift) & 0xff]++; }
+        },
+        nthread);
+    { // exclusive prefix sum in the order of (digit, chunk)
+      unsigned int nbin_used = 0;
+      unsigned int sum = 0;
+      for (unsigned int ibin = 0; ibin < nbin; ++ibin) {
+        bool is_used = false;
+        for (unsigned int ichunk = 0; ichunk < nchunk; ++ichunk) {
+          const unsigned int cnt = hist[ichunk][ibin];
+          is_used = is_used || (cnt != 0);
+          hist[ichunk][ibin] = sum;
+          sum += cnt;
+        }
+        if (is_used) { nbin_used++; }
+      }
+      if (nbin_used <= 1) { continue; }  // all the codes have the same digit
+    }
+    parallel_for(
+        nchunk,
+        [&](unsigned int ichunk) {
+          auto &h = hist[ichunk];
+          const auto r = chunk_range(ichunk);
+          for (unsigned int i = r.first; i < r.second; ++i) {
+            const unsigned int j = h[(codes[i] >> ishift) & 0xff]++;
+            codes1[j] = codes[i];
+            indexes1[j] = indexes[i];
+          }
+        },
+        nthread);
+    codes.swap(codes1);
+    indexes.swap(indexes1);
+  }
+}
+
+template<typename CODE, typename REAL>
+void SortedMortonCode_Points3(
     std::vector<unsigned int> &sorted_object_indexes,
-    std::vector<std::uint32_t> &sorted_morton_codes,
+    std::vector<CODE> &sorted_morton_codes,
     const std::vector<REAL> &vtx_xyz,
     const REAL aabb_min_xyz[3],
-    const REAL aabb_max_xyz[3]) {
-  std::vector<bvh::CPairMtcInd> aNodeBVH0; // array of BVH node
-  const std::size_t np = vtx_xyz.size() / 3;
-  aNodeBVH0.resize(np);
+    const REAL aabb_max_xyz[3],
+    unsigned int nthread) {
+  const auto np = static_cast<unsigned int>(vtx_xyz.size() / 3);
+  sorted_object_indexes.resize(np);
+  sorted_morton_codes.resize(np);
   const REAL x_min = aabb_min_xyz[0];
   const REAL y_min = aabb_min_xyz[1];
   const REAL z_min = aabb_min_xyz[2];
   const REAL x_max = aabb_max_xyz[0];
   const REAL y_max = aabb_max_xyz[1];
   const REAL z_max = aabb_max_xyz[2];
-  for (unsigned ip = 0; ip < np; ++ip) {
-    const REAL x = (vtx_xyz[ip * 3 + 0] - x_min) / (x_max - x_min);
-    const REAL y = (vtx_xyz[ip * 3 + 1] - y_min) / (y_max - y_min);
-    const REAL z = (vtx_xyz[ip * 3 + 2] - z_min) / (z_max - z_min);
-    aNodeBVH0[ip].imtc = MortonCode(x, y, z);
-    aNodeBVH0[ip].iobj = ip;
+  parallel_for(
+      np,
+      [&](unsigned int ip) {
+        const REAL x = (vtx_xyz[ip * 3 + 0] - x_min) / (x_max - x_min);
+        const REAL y = (vtx_xyz[ip * 3 + 1] - y_min) / (y_max - y_min);
+        const REAL z = (vtx_xyz[ip * 3 + 2] - z_min) / (z_max - z_min);
+        if constexpr (sizeof(CODE) == 4) {
+          sorted_morton_codes[ip] = MortonCode(x, y, z);
+        } else {
+          sorted_morton_codes[ip] = MortonCode64(x, y, z);
+        }
+        sorted_object_indexes[ip] = ip;
+      },
+      nthread);
+  RadixSort(sorted_morton_codes, sorted_object_indexes, nthread);
+}
+
+/**
+ * each internal node finds its range and split independently
+ */
+template<typename CODE>
+void BVHTopology_Morton(
+    std::vector<CNodeBVH2> &bvh_nodes,
+    const std::vector<unsigned int> &sorted_object_indexes,
+    const std::vector<CODE> &sorted_morton_codes,
+    unsigned int nthread) {
+  assert(sorted_object_indexes.size() == sorted_morton_codes.size());
+  assert(!sorted_morton_codes.empty());
+  bvh_nodes.resize(sorted_morton_codes.size() * 2 - 1);
+  bvh_nodes[0].iparent = UINT_MAX;
+  if (sorted_morton_codes.size() == 1) {  // the root is a leaf
+    bvh_nodes[0].ichild[0] = sorted_object_indexes[0];
+    bvh_nodes[0].ichild[1] = UINT_MAX;
+    return;
   }
-  std::sort(aNodeBVH0.begin(), aNodeBVH0.end());
-  sorted_object_indexes.resize(aNodeBVH0.size());
-  sorted_morton_codes.resize(aNodeBVH0.size());
-  for (size_t ino = 0; ino < aNodeBVH0.size(); ++ino) {
-    sorted_morton_codes[ino] = aNodeBVH0[ino].imtc;
-    sorted_object_indexes[ino] = aNodeBVH0[ino].iobj;
+  const auto nni = static_cast<unsigned int>(sorted_morton_codes.size() - 1); // number of internal node
+  parallel_for(
+      nni,
+      [&](unsigned int ini) {
+        const std::pair<unsigned int, unsigned int>
+            range = MortonCode_DeterminRange(sorted_morton_codes.data(), sorted_morton_codes.size(), ini);
+        unsigned int isplit = MortonCode_FindSplit(sorted_morton_codes.data(), range.first, range.second);
+        assert(isplit != UINT_MAX);
+        if (range.first == isplit) {
+          const unsigned int inlA = nni + isplit;
+          bvh_nodes[ini].ichild[0] = inlA;
+          bvh_nodes[inlA].iparent = ini;
+          bvh_nodes[inlA].ichild[0] = sorted_object_indexes[isplit];
+          bvh_nodes[inlA].ichild[1] = UINT_MAX;
+        } else {
+          const unsigned int iniA = isplit;
+          bvh_nodes[ini].ichild[0] = iniA;
+          bvh_nodes[iniA].iparent = ini;
+        }
+        // ----
+        if (range.second == isplit + 1) {
+          const unsigned int inlB = nni + isplit + 1;
+          bvh_nodes[ini].ichild[1] = inlB;
+          bvh_nodes[inlB].iparent = ini;
+          bvh_nodes[inlB].ichild[0] = sorted_object_indexes[isplit + 1];
+          bvh_nodes[inlB].ichild[1] = UINT_MAX;
+        } else {
+          const unsigned int iniB = isplit + 1;
+          bvh_nodes[ini].ichild[1] = iniB;
+          bvh_nodes[iniB].iparent = ini;
+        }
+      },
+      nthread);
+}
+
+}
+
+// ===========================================================
+
+/**
+ * @brief compute number of leading zeros
+ * @function compute number of leading zeros
+ * @param x input
+ * @details clz(0) needs to be 32 to run BVH
+ */
+DFM2_INLINE unsigned int delfem2::nbits_leading_zero(
+    uint32_t x) {
+  // avoid using buit-in functions such as "__builtin_clz(x)",
+  // becuase application to 0 is typically undefiend.
+  auto y = static_cast<int32_t>(x);
+  unsigned int n = 0;
+  if (y == 0) { return sizeof(y) * 8; }
+  while (true) {
+    if (y < 0) { break; }
+    n++;
+    y <<= 1;
   }
+  return n;
+}
+
+DFM2_INLINE int delfem2::BVHTopology_TopDown_MeshElem(
+    std::vector<CNodeBVH2> &aNodeBVH,
+    const unsigned int nfael,
+    const std::vector<unsigned int> &aElSuEl,
+    const std::vector<double> &aElemCenter) {
+  aNodeBVH.clear();
+  const size_t nelem = aElemCenter.size() / 3;
+  std::vector<unsigned int> list(nelem);
+  for (unsigned int ielem = 0; ielem < nelem; ielem++) { list[ielem] = ielem; }
+  std::vector<unsigned int> aElem2Node;
+  aElem2Node.resize(nelem, 0);
+  aNodeBVH.resize(1);
+  aNodeBVH[0].iparent = UINT_MAX;
+  bvh::DevideElemAryConnex(
+      0, aElem2Node, aNodeBVH,
+      list, static_cast<int>(nfael), aElSuEl, aElemCenter);
+  return 0;
+}
+
+template<typename REAL>
+DFM2_INLINE std::uint32_t delfem2::MortonCode(REAL x, REAL y, REAL z) {
+  auto ix = (std::uint32_t) fmin(fmax(x * 1024.0f, 0.0f), 1023.0f);
+  auto iy = (std::uint32_t) fmin(fmax(y * 1024.0f, 0.0f), 1023.0f);
+  auto iz = (std::uint32_t) fmin(fmax(z * 1024.0f, 0.0f), 1023.0f);
+  //  std::cout << std::bitset<10>(ix) << " " << std::bitset<10>(iy) << " " << std::bitset<10>(iz) << std::endl;
+  ix = bvh::expandBits(ix);
+  iy = bvh::expandBits(iy);
+  iz = bvh::expandBits(iz);
+  //  std::cout << std::bitset<30>(ix) << " " << std::bitset<30>(iy) << " " << std::bitset<30>(iz) << std::endl;
+  std::uint32_t ixyz = ix * 4 + iy * 2 + iz;
+  return ixyz;
+}
+#ifdef DFM2_STATIC_LIBRARY
+template std::uint32_t delfem2::MortonCode(float x, float y, float z);
+template std::uint32_t delfem2::MortonCode(double x, double y, double z);
+#endif
+
+template<typename REAL>
+DFM2_INLINE std::uint64_t delfem2::MortonCode64(REAL x, REAL y, REAL z) {
+  auto ix = static_cast<std::uint64_t>(std::fmin(std::fmax(x * 2097152.0, 0.0), 2097151.0));
+  auto iy = static_cast<std::uint64_t>(std::fmin(std::fmax(y * 2097152.0, 0.0), 2097151.0));
+  auto iz = static_cast<std::uint64_t>(std::fmin(std::fmax(z * 2097152.0, 0.0), 2097151.0));
+  ix = bvh::expandBits(ix);
+  iy = bvh::expandBits(iy);
+  iz = bvh::expandBits(iz);
+  return ix * 4 + iy * 2 + iz;
+}
+#ifdef DFM2_STATIC_LIBRARY
+template std::uint64_t delfem2::MortonCode64(float x, float y, float z);
+template std::uint64_t delfem2::MortonCode64(double x, double y, double z);
+#endif
+
+DFM2_INLINE std::pair<unsigned int, unsigned int> delfem2::MortonCode_DeterminRange(
+    const std::uint32_t *sortedMC,
+    size_t nMC,
+    unsigned int imc) {
+  return bvh::MortonCode_DeterminRange(sortedMC, nMC, imc);
+}
+
+DFM2_INLINE unsigned int delfem2::MortonCode_FindSplit(
+    const std::uint32_t *aMC,
+    unsigned int iMC_start,
+    unsigned int iMC_last) {
+  return bvh::MortonCode_FindSplit(aMC, iMC_start, iMC_last);
+}
+
+template<typename REAL>
+DFM2_INLINE void delfem2::SortedMortenCode_Points3(
+    std::vector<unsigned int> &sorted_object_indexes,
+    std::vector<std::uint32_t> &sorted_morton_codes,
+    const std::vector<REAL> &vtx_xyz,
+    const REAL aabb_min_xyz[3],
+    const REAL aabb_max_xyz[3],
+    unsigned int nthread) {
+  bvh::SortedMortonCode_Points3(
+      sorted_object_indexes, sorted_morton_codes,
+      vtx_xyz, aabb_min_xyz, aabb_max_xyz, nthread);
 }
 #ifdef DFM2_STATIC_LIBRARY
 template void delfem2::SortedMortenCode_Points3(
@@ -429,13 +608,44 @@ template void delfem2::SortedMortenCode_Points3(
     std::vector<std::uint32_t> &aSortedMc,
     const std::vector<float> &aXYZ,
     const float min_xyz[3],
-    const float max_xyz[3]);
+    const float max_xyz[3],
+    unsigned int nthread);
 template void delfem2::SortedMortenCode_Points3(
     std::vector<unsigned int> &aSortedId,
     std::vector<std::uint32_t> &aSortedMc,
     const std::vector<double> &aXYZ,
     const double min_xyz[3],
-    const double max_xyz[3]);
+    const double max_xyz[3],
+    unsigned int nthread);
+#endif
+
+template<typename REAL>
+DFM2_INLINE void delfem2::SortedMortenCode_Points3(
+    std::vector<unsigned int> &sorted_object_indexes,
+    std::vector<std::uint64_t> &sorted_morton_codes,
+    const std::vector<REAL> &vtx_xyz,
+    const REAL aabb_min_xyz[3],
+    const REAL aabb_max_xyz[3],
+    unsigned int nthread) {
+  bvh::SortedMortonCode_Points3(
+      sorted_object_indexes, sorted_morton_codes,
+      vtx_xyz, aabb_min_xyz, aabb_max_xyz, nthread);
+}
+#ifdef DFM2_STATIC_LIBRARY
+template void delfem2::SortedMortenCode_Points3(
+    std::vector<unsigned int> &aSortedId,
+    std::vector<std::uint64_t> &aSortedMc,
+    const std::vector<float> &aXYZ,
+    const float min_xyz[3],
+    const float max_xyz[3],
+    unsigned int nthread);
+template void delfem2::SortedMortenCode_Points3(
+    std::vector<unsigned int> &aSortedId,
+    std::vector<std::uint64_t> &aSortedMc,
+    const std::vector<double> &aXYZ,
+    const double min_xyz[3],
+    const double max_xyz[3],
+    unsigned int nthread);
 #endif
 
 // ----------------------------------
@@ -443,41 +653,17 @@ template void delfem2::SortedMortenCode_Points3(
 DFM2_INLINE void delfem2::BVHTopology_Morton(
     std::vector<CNodeBVH2> &bvh_nodes,
     const std::vector<unsigned int> &sorted_object_indexes,
-    const std::vector<std::uint32_t> &sorted_morton_codes) {
-  assert(sorted_object_indexes.size() == sorted_morton_codes.size());
-  assert(!sorted_morton_codes.empty());
-  bvh_nodes.resize(sorted_morton_codes.size() * 2 - 1);
-  bvh_nodes[0].iparent = UINT_MAX;
-  const auto nni = static_cast<unsigned int>(sorted_morton_codes.size() - 1); // number of internal node
-  for (unsigned int ini = 0; ini < nni; ++ini) {
-    const std::pair<unsigned int, unsigned int>
-        range = MortonCode_DeterminRange(sorted_morton_codes.data(), sorted_morton_codes.size(), ini);
-    unsigned int isplit = MortonCode_FindSplit(sorted_morton_codes.data(), range.first, range.second);
-    assert(isplit != UINT_MAX);
-    if (range.first == isplit) {
-      const unsigned int inlA = nni + isplit;
-      bvh_nodes[ini].ichild[0] = inlA;
-      bvh_nodes[inlA].iparent = ini;
-      bvh_nodes[inlA].ichild[0] = sorted_object_indexes[isplit];
-      bvh_nodes[inlA].ichild[1] = UINT_MAX;
-    } else {
-      const unsigned int iniA = isplit;
-      bvh_nodes[ini].ichild[0] = iniA;
-      bvh_nodes[iniA].iparent = ini;
-    }
-    // ----
-    if (range.second == isplit + 1) {
-      const unsigned int inlB = nni + isplit + 1;
-      bvh_nodes[ini].ichild[1] = inlB;
-      bvh_nodes[inlB].iparent = ini;
-      bvh_nodes[inlB].ichild[0] = sorted_object_indexes[isplit + 1];
-      bvh_nodes[inlB].ichild[1] = UINT_MAX;
-    } else {
-      const unsigned int iniB = isplit + 1;
-      bvh_nodes[ini].ichild[1] = iniB;
-      bvh_nodes[iniB].iparent = ini;
-    }
-  }
+    const std::vector<std::uint32_t> &sorted_morton_codes,
+    unsigned int nthread) {
+  bvh::BVHTopology_Morton(bvh_nodes, sorted_object_indexes, sorted_morton_codes, nthread);
+}
+
+DFM2_INLINE void delfem2::BVHTopology_Morton(
+    std::vector<CNodeBVH2> &bvh_nodes,
+    const std::vector<unsigned int> &sorted_object_indexes,
+    const std::vector<std::uint64_t> &sorted_morton_codes,
+    unsigned int nthread) {
+  bvh::BVHTopology_Morton(bvh_nodes, sorted_object_indexes, sorted_morton_codes, nthread);
 }
 
 DFM2_INLINE void delfem2::Check_MortonCode_Sort(
@@ -540,6 +726,19 @@ DFM2_INLINE void delfem2::Check_MortonCode_RangeSplit(
 #endif
 }
 
+DFM2_INLINE void delfem2::BVH_LeafNodeOfElement(
+    std::vector<unsigned int> &elem2leaf,
+    size_t num_elem,
+    const std::vector<CNodeBVH2> &aNodeBVH) {
+  elem2leaf.assign(num_elem, UINT_MAX);
+  for (unsigned int ibvh = 0; ibvh < aNodeBVH.size(); ++ibvh) {
+    if (aNodeBVH[ibvh].ichild[1] != UINT_MAX) { continue; }
+    const unsigned int ielem = aNodeBVH[ibvh].ichild[0];
+    assert(ielem < num_elem);
+    elem2leaf[ielem] = ibvh;
+  }
+}
+
 DFM2_INLINE void delfem2::Check_BVH(
     const std::vector<CNodeBVH2> &bvh_nodes,
     size_t num_object) {
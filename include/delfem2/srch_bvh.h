@@ -7,7 +7,7 @@
 
 
 /**
- * @details this file is independent from any other delfem codes
+ * @details this file is independent from any other delfem codes except for "thread.h"
  */
 
 #ifndef DFM2_BVH_H
@@ -18,9 +18,14 @@
 #include <set>
 #include <cassert>
 #include <climits>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <utility>
 #include <iostream>
 
 #include "delfem2/dfm2_inline.h"
+#include "delfem2/thread.h"
 
 namespace delfem2 {
 
@@ -89,22 +94,57 @@ std::pair<unsigned int,unsigned int> MortonCode_DeterminRange(
 template <typename REAL>
 DFM2_INLINE std::uint32_t MortonCode(REAL x, REAL y, REAL z);
 
-
 /**
+ * @brief 63-bit morton code (21 bits for each axis) for 3d coordinates within the range of [0,1]
  * @details defined for "float" and "double"
  */
 template <typename REAL>
+DFM2_INLINE std::uint64_t MortonCode64(REAL x, REAL y, REAL z);
+
+/**
+ * @brief compute the morton codes of the points and sort them
+ * @details defined for "float" and "double". The codes are sorted by the stable radix sort,
+ * so the points with the same code are ordered by their indexes.
+ * @param nthread number of threads. 0 uses all the threads of "delfem2::ThreadPool"
+ */
+template <typename REAL>
+void SortedMortenCode_Points3(
+    std::vector<unsigned int> &sorted_object_indexes,
+    std::vector<std::uint32_t> &sorted_morton_codes,
+    const std::vector<REAL> &vtx_xyz,
+    const REAL aabb_min_xyz[3],
+    const REAL aabb_max_xyz[3],
+    unsigned int nthread = 1);
+
+/**
+ * @brief 63-bit morton code version. The codes are less likely to collide for dense points
+ */
+template <typename REAL>
 void SortedMortenCode_Points3(
     std::vector<unsigned int> &sorted_object_indexes,
-    std::vector<unsigned int> &sorted_morton_codes,
+    std::vector<std::uint64_t> &sorted_morton_codes,
     const std::vector<REAL> &vtx_xyz,
     const REAL aabb_min_xyz[3],
-    const REAL aabb_max_xyz[3]);
+    const REAL aabb_max_xyz[3],
+    unsigned int nthread = 1);
 
+/**
+ * @brief build the BVH topology from the sorted morton codes
+ * @details each internal node is made independently, so the nodes are made in parallel.
+ * The internal nodes are [0,N-1) and the leaves are [N-1,2N-1) where N is the number of the objects.
+ * @param nthread number of threads. 0 uses all the threads of "delfem2::ThreadPool"
+ */
 void BVHTopology_Morton(
     std::vector<CNodeBVH2>& bvh_nodes,
     const std::vector<unsigned int>& sorted_object_indexes,
-    const std::vector<std::uint32_t>& sorted_morton_codes);
+    const std::vector<std::uint32_t>& sorted_morton_codes,
+    unsigned int nthread = 1);
+
+void BVHTopology_Morton(
+    std::vector<CNodeBVH2>& bvh_nodes,
+    const std::vector<unsigned int>& sorted_object_indexes,
+    const std::vector<std::uint64_t>& sorted_morton_codes,
+    unsigned int nthread = 1);
 
 void Check_MortonCode_RangeSplit(
     const std::vector<std::uint32_t>& sorted_morton_codes);
@@ -130,6 +170,62 @@ void BVH_BuildBVHGeometry(
     const std::vector<CNodeBVH2>& aNodeBVH,
     const LEAF_VOLUME_MAKER& leafvolume);
 
+/**
+ * @brief build the bounding volumes from the leaves to the root in parallel
+ * @details the result is the same as "BVH_BuildBVHGeometry" from the root.
+ * Each leaf is processed by a task that climbs the tree. The second task that arrives at a node
+ * (counted by an atomic counter) merges the children and continues to the parent.
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool"
+ */
+template <typename BBOX, typename LEAF_VOLUME_MAKER>
+void BVH_BuildBVHGeometry_BottomUp(
+    std::vector<BBOX>& aBB,
+    const std::vector<CNodeBVH2>& aNodeBVH,
+    const LEAF_VOLUME_MAKER& leafvolume,
+    unsigned int nthread = 1);
+
+/**
+ * @brief index of the leaf node for each element
+ * @param[out] elem2leaf UINT_MAX if the element is not in the tree
+ */
+DFM2_INLINE void BVH_LeafNodeOfElement(
+    std::vector<unsigned int>& elem2leaf,
+    size_t num_elem,
+    const std::vector<CNodeBVH2>& aNodeBVH);
+
+/**
+ * @brief refit the bounding volumes of the leaves of the given elements and of their ancestors.
+ * @details the other volumes are not touched. This is much cheaper than "BVH_BuildBVHGeometry" if only a few
+ * elements moved. The volume of a node is recomputed after the volumes of its children.
+ * @param[in,out] flg_node_dirty work array with the size of "aNodeBVH". All zero at the input and the output
+ * @param[in,out] sum_area if not nullptr, the sum of "SurfaceArea()" of the nodes except the root is updated
+ * incrementally (see "BVH_SumSurfaceArea")
+ * @return number of the nodes refitted
+ */
+template <typename BBOX, typename LEAF_VOLUME_MAKER>
+unsigned int BVH_RefitElements(
+    std::vector<BBOX>& aBB,
+    std::vector<unsigned char>& flg_node_dirty,
+    double* sum_area,
+    const unsigned int* elem_dirty,
+    size_t num_elem_dirty,
+    const std::vector<unsigned int>& elem2leaf,
+    unsigned int ibvh_root,
+    const std::vector<CNodeBVH2>& aNodeBVH,
+    const LEAF_VOLUME_MAKER& leafvolume);
+
+/**
+ * @brief sum of the surface areas of the nodes except the root
+ * @details divided by the area of the root, this is the cost of the tree in the surface area heuristic (SAH)
+ * when the costs of the traversal and the intersection are the same. The cost grows as the tree degrades
+ * after the elements moved, since the volumes of the nodes overlap more.
+ */
+template <typename BBOX>
+double BVH_SumSurfaceArea(
+    unsigned int ibvh_root,
+    const std::vector<CNodeBVH2>& aNodeBVH,
+    const std::vector<BBOX>& aBB);
+
 template <typename BBOX, typename REAL>
 class CLeafVolumeMaker_Mesh{
 public:
@@ -243,6 +339,110 @@ void BVH_GetIndElem_Predicate(
   BVH_GetIndElem_Predicate(aIndElem, pred, ichild1,aBVH,aBB);
 }
 
+/**
+ * @brief LIFO stack of the BVH traversal. The first "N" entries are stored in the fixed size array
+ * so the traversal of a balanced tree does not allocate the heap memory.
+ * The entries over the capacity are spilled to the std::vector
+ */
+template <typename T, unsigned int N = 64>
+class CStackBVH {
+ public:
+  void push(const T& v){
+    if( n < N ){ buf[n++] = v; }
+    else{ spill.push_back(v); }
+  }
+  T pop(){
+    if( !spill.empty() ){ // spilled entries are always above the fixed size array
+      const T v = spill.back();
+      spill.pop_back();
+      return v;
+    }
+    assert( n > 0 );
+    return buf[--n];
+  }
+  [[nodiscard]] bool empty() const { return n == 0; }
+ private:
+  T buf[N];
+  unsigned int n = 0;
+  std::vector<T> spill;
+};
+
+/**
+ * @brief depth first traversal of the BVH without the recursion. The nodes to visit are kept in "CStackBVH"
+ * @param is_visit "bool is_visit(unsigned int ibvh)" returns false to cull the node "ibvh"
+ * @param on_leaf "bool on_leaf(unsigned int ielem)" called for the element of the visited leaf.
+ * Return false to terminate the traversal
+ * @return false if the traversal was terminated by "on_leaf"
+ */
+template <typename FUNC_VISIT, typename FUNC_LEAF>
+bool BVH_Traverse(
+    unsigned int ibvh_root,
+    const std::vector<delfem2::CNodeBVH2>& aBVH,
+    FUNC_VISIT&& is_visit,
+    FUNC_LEAF&& on_leaf)
+{
+  CStackBVH<unsigned int> stack;
+  stack.push(ibvh_root);
+  while( !stack.empty() ){
+    const unsigned int ibvh = stack.pop();
+    assert( ibvh < aBVH.size() );
+    if( !is_visit(ibvh) ){ continue; }
+    const unsigned int ichild0 = aBVH[ibvh].ichild[0];
+    const unsigned int ichild1 = aBVH[ibvh].ichild[1];
+    if( ichild1 == UINT_MAX ){ // leaf
+      if( !on_leaf(ichild0) ){ return false; }
+      continue;
+    }
+    stack.push(ichild1);
+    stack.push(ichild0); // visit "ichild0" first like BVH_GetIndElem_Predicate
+  }
+  return true;
+}
+
+/**
+ * @brief nearer first traversal of the BVH for the queries minimizing a value (closest hit, nearest point)
+ * @details the nodes whose lower bound is larger than "bound" are culled.
+ * "bound" shrinks as the leaves are processed so the farther nodes are skipped.
+ * @param bound current minimum value (e.g., std::numeric_limits<double>::max() for no hit)
+ * @param lower_bound "double lower_bound(unsigned int ibvh)" lower bound of the value in the node.
+ * Return +infinity to cull the node
+ * @param on_leaf "void on_leaf(unsigned int ielem, double& bound)" updates "bound" if the element is nearer
+ * @param aBVH "std::vector<CNodeBVH2>" or the pointer to the nodes (e.g., mapped from a file)
+ */
+template <typename NODES, typename FUNC_BOUND, typename FUNC_LEAF>
+void BVH_TraverseOrdered(
+    double& bound,
+    unsigned int ibvh_root,
+    const NODES& aBVH,
+    FUNC_BOUND&& lower_bound,
+    FUNC_LEAF&& on_leaf)
+{
+  const double d_root = lower_bound(ibvh_root);
+  if( d_root > bound ){ return; }
+  CStackBVH<std::pair<unsigned int,double> > stack;
+  stack.push(std::make_pair(ibvh_root,d_root));
+  while( !stack.empty() ){
+    const std::pair<unsigned int,double> node = stack.pop();
+    if( node.second > bound ){ continue; } // the bound got smaller after this node was pushed
+    const unsigned int ichild0 = aBVH[node.first].ichild[0];
+    const unsigned int ichild1 = aBVH[node.first].ichild[1];
+    if( ichild1 == UINT_MAX ){ // leaf
+      on_leaf(ichild0, bound);
+      continue;
+    }
+    const double d0 = lower_bound(ichild0);
+    const double d1 = lower_bound(ichild1);
+    if( d0 <= d1 ){ // push the farther child first so the nearer one is popped first
+      if( d1 <= bound ){ stack.push(std::make_pair(ichild1,d1)); }
+      if( d0 <= bound ){ stack.push(std::make_pair(ichild0,d0)); }
+    }
+    else{
+      if( d0 <= bound ){ stack.push(std::make_pair(ichild0,d0)); }
+      if( d1 <= bound ){ stack.push(std::make_pair(ichild1,d1)); }
+    }
+  }
+}
+
 template <class BV,typename REAL>
 class CIsBV_IntersectLine
 {
@@ -381,6 +581,112 @@ void delfem2::BVH_BuildBVHGeometry(
   return;
 }
 
+template <typename BBOX, typename LEAF_VOLUME_MAKER>
+void delfem2::BVH_BuildBVHGeometry_BottomUp(
+    std::vector<BBOX>& aBB,
+    const std::vector<delfem2::CNodeBVH2>& aNodeBVH,
+    const LEAF_VOLUME_MAKER& lvm,
+    unsigned int nthread)
+{
+  const auto nnode = static_cast<unsigned int>(aNodeBVH.size());
+  aBB.resize(nnode);
+  std::unique_ptr<std::atomic<unsigned int>[]> aNVisit(new std::atomic<unsigned int>[nnode]);
+  for(unsigned int inode=0;inode<nnode;++inode){ aNVisit[inode].store(0, std::memory_order_relaxed); }
+  parallel_for(
+      nnode,
+      [&](unsigned int ileaf){
+        if( aNodeBVH[ileaf].ichild[1] != UINT_MAX ){ return; } // not a leaf
+        lvm.SetVolume(aBB[ileaf],
+                      aNodeBVH[ileaf].ichild[0]);
+        unsigned int ibvh = aNodeBVH[ileaf].iparent;
+        while( ibvh != UINT_MAX ){
+          // the first visitor leaves. the second one sees the volumes of both children
+          if( aNVisit[ibvh].fetch_add(1, std::memory_order_acq_rel) == 0 ){ return; }
+          const unsigned int ichild0 = aNodeBVH[ibvh].ichild[0];
+          const unsigned int ichild1 = aNodeBVH[ibvh].ichild[1];
+          BBOX& bb = aBB[ibvh];
+          bb  = aBB[ichild0];
+          bb += aBB[ichild1];
+          ibvh = aNodeBVH[ibvh].iparent;
+        }
+      },
+      nthread);
+}
+
+template <typename BBOX, typename LEAF_VOLUME_MAKER>
+unsigned int delfem2::BVH_RefitElements(
+    std::vector<BBOX>& aBB,
+    std::vector<unsigned char>& flg_node_dirty,
+    double* sum_area,
+    const unsigned int* elem_dirty,
+    size_t num_elem_dirty,
+    const std::vector<unsigned int>& elem2leaf,
+    unsigned int ibvh_root,
+    const std::vector<delfem2::CNodeBVH2>& aNodeBVH,
+    const LEAF_VOLUME_MAKER& lvm)
+{
+  assert( aBB.size() == aNodeBVH.size() );
+  assert( flg_node_dirty.size() == aNodeBVH.size() );
+  // mark the path from the leaves to the root. stop at the node already marked
+  for(unsigned int iie=0;iie<num_elem_dirty;++iie){
+    unsigned int ibvh = elem2leaf[elem_dirty[iie]];
+    while( ibvh != UINT_MAX && flg_node_dirty[ibvh] == 0 ){
+      flg_node_dirty[ibvh] = 1;
+      ibvh = aNodeBVH[ibvh].iparent;
+    }
+  }
+  if( flg_node_dirty[ibvh_root] == 0 ){ return 0; }
+  // visit the marked nodes in the post order. flag 2 means the children are already pushed
+  unsigned int nrefit = 0;
+  std::vector<unsigned int> stack(1,ibvh_root);
+  while( !stack.empty() ){
+    const unsigned int ibvh = stack.back();
+    const unsigned int ichild0 = aNodeBVH[ibvh].ichild[0];
+    const unsigned int ichild1 = aNodeBVH[ibvh].ichild[1];
+    if( ichild1 != UINT_MAX && flg_node_dirty[ibvh] == 1 ){
+      flg_node_dirty[ibvh] = 2;
+      if( flg_node_dirty[ichild0] == 1 ){ stack.push_back(ichild0); }
+      if( flg_node_dirty[ichild1] == 1 ){ stack.push_back(ichild1); }
+      continue;
+    }
+    stack.pop_back();
+    flg_node_dirty[ibvh] = 0;
+    if( sum_area != nullptr && ibvh != ibvh_root ){ *sum_area -= aBB[ibvh].SurfaceArea(); }
+    if( ichild1 == UINT_MAX ){ // leaf
+      aBB[ibvh].Set_Inactive();
+      lvm.SetVolume(aBB[ibvh],
+                    ichild0);
+    }
+    else{
+      BBOX& bb = aBB[ibvh];
+      bb  = aBB[ichild0];
+      bb += aBB[ichild1];
+    }
+    if( sum_area != nullptr && ibvh != ibvh_root ){ *sum_area += aBB[ibvh].SurfaceArea(); }
+    nrefit++;
+  }
+  return nrefit;
+}
+
+template <typename BBOX>
+double delfem2::BVH_SumSurfaceArea(
+    unsigned int ibvh_root,
+    const std::vector<delfem2::CNodeBVH2>& aNodeBVH,
+    const std::vector<BBOX>& aBB)
+{
+  double sum = 0.0;
+  std::vector<unsigned int> stack(1,ibvh_root);
+  while( !stack.empty() ){
+    const unsigned int ibvh = stack.back();
+    stack.pop_back();
+    if( ibvh != ibvh_root ){ sum += aBB[ibvh].SurfaceArea(); }
+    if( aNodeBVH[ibvh].ichild[1] == UINT_MAX ){ continue; }
+    stack.push_back(aNodeBVH[ibvh].ichild[0]);
+    stack.push_back(aNodeBVH[ibvh].ichild[1]);
+  }
+  return sum;
+}
+
 // ------------------------------------------------------------------------
 
 
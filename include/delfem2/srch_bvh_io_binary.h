@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * @file BVH of a static mesh stored in the binary mesh container (see "msh_io_binary.h")
+ * @details the nodes and the bounding boxes are written with the layouts of "CNodeBVH2" and "CBV3_AABB",
+ * so a process maps the file and uses the arrays without copying. As the mapping is read-only,
+ * the pages are shared by all the processes mapping the same file.
+ * The hash of the mesh is recorded to detect the BVH made for a different mesh.
+ */
+
+#ifndef DFM2_SRCH_BVH_IO_BINARY_H
+#define DFM2_SRCH_BVH_IO_BINARY_H
+
+#include <cstdint>
+#include <vector>
+#include <filesystem>
+#include <type_traits>
+
+#include "delfem2/msh_io_binary.h"
+#include "delfem2/srch_bvh.h"
+#include "delfem2/srch_bv3_aabb.h"
+
+namespace delfem2 {
+
+/**
+ * @brief write the BVH of a mesh to the binary container
+ * @param mesh_hash hash of the mesh (see "MeshBinary_Hash") checked when the file is opened
+ * @return false if the file cannot be written
+ */
+template<typename REAL>
+bool Write_BVH_MeshBinary(
+    const std::filesystem::path &file_path,
+    const std::vector<CNodeBVH2> &bvh_nodes,
+    const std::vector<CBV3_AABB<REAL>> &bvh_aabbs,
+    std::uint64_t mesh_hash) {
+  static_assert(sizeof(CNodeBVH2) == sizeof(unsigned int) * 3);
+  static_assert(sizeof(CBV3_AABB<REAL>) == sizeof(REAL) * 6);
+  if (bvh_nodes.size() != bvh_aabbs.size()) { return false; }
+  CMeshBinary<REAL> bin;
+  bin.mesh_hash = mesh_hash;
+  bin.bvh_node.resize(bvh_nodes.size() * 3);
+  for (size_t ibvh = 0; ibvh < bvh_nodes.size(); ++ibvh) {
+    bin.bvh_node[ibvh * 3 + 0] = bvh_nodes[ibvh].iparent;
+    bin.bvh_node[ibvh * 3 + 1] = bvh_nodes[ibvh].ichild[0];
+    bin.bvh_node[ibvh * 3 + 2] = bvh_nodes[ibvh].ichild[1];
+  }
+  bin.bvh_aabb.resize(bvh_aabbs.size() * 6);
+  for (size_t ibvh = 0; ibvh < bvh_aabbs.size(); ++ibvh) {
+    for (unsigned int idim = 0; idim < 3; ++idim) {
+      bin.bvh_aabb[ibvh * 6 + idim] = bvh_aabbs[ibvh].bbmin[idim];
+      bin.bvh_aabb[ibvh * 6 + 3 + idim] = bvh_aabbs[ibvh].bbmax[idim];
+    }
+  }
+  return Write_MeshBinary(file_path, bin);
+}
+
+/**
+ * @brief read-only BVH mapped from the binary container
+ * @details "nodes" and "aabbs" point into the mapped file and are valid while the view is open.
+ * They can be passed to the functions taking the pointers of the BVH arrays
+ * (e.g., "Intersection_Ray3_Tri3_Bvh" and "BVH_TraverseOrdered").
+ */
+template<typename REAL>
+class CBVH_MeshBinaryView {
+ public:
+  /**
+   * @param mesh_hash hash of the mesh for which the BVH is used
+   * @return false if the file is not a valid BVH or the BVH is made for the other mesh
+   */
+  bool Open(
+      const std::filesystem::path &file_path,
+      std::uint64_t mesh_hash) {
+    static_assert(std::is_standard_layout_v<CNodeBVH2> && sizeof(CNodeBVH2) == sizeof(unsigned int) * 3);
+    static_assert(std::is_standard_layout_v<CBV3_AABB<REAL>> && sizeof(CBV3_AABB<REAL>) == sizeof(REAL) * 6);
+    this->Close();
+    if (!view.Open(file_path) || view.mesh_hash != mesh_hash) {
+      this->Close();
+      return false;
+    }
+    size_t nnode = 0, naabb = 0;
+    const unsigned int *pnode = view.Array<unsigned int>(MESHBIN_ARRAY::BVH_NODE, nnode);
+    const REAL *paabb = view.Array<REAL>(MESHBIN_ARRAY::BVH_AABB, naabb);
+    if (pnode == nullptr || paabb == nullptr || nnode % 3 != 0 || nnode / 3 != naabb / 6 || naabb % 6 != 0) {
+      this->Close();
+      return false;
+    }
+    nodes = reinterpret_cast<const CNodeBVH2 *>(pnode);
+    aabbs = reinterpret_cast<const CBV3_AABB<REAL> *>(paabb);
+    num_node = nnode / 3;
+    return true;
+  }
+
+  void Close() {
+    view.Close();
+    nodes = nullptr;
+    aabbs = nullptr;
+    num_node = 0;
+  }
+
+  [[nodiscard]] bool IsOpen() const { return nodes != nullptr; }
+
+ public:
+  const CNodeBVH2 *nodes = nullptr;
+  const CBV3_AABB<REAL> *aabbs = nullptr;
+  size_t num_node = 0;
+ private:
+  CMeshBinaryView view;
+};
+
+} // namespace delfem2
+
+#endif // DFM2_SRCH_BVH_IO_BINARY_H
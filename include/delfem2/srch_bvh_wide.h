@@ -0,0 +1,494 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * @file wide (4-ary or 8-ary) BVH of a triangle mesh for the ray casting
+ * @details the tree is collapsed from the binary BVH (e.g., the one made by "BuildBVH_MeshTri3D_Morton").
+ * The bounding boxes of the children of a node are stored in the SoA layout in single precision,
+ * so that a ray is tested against all the children at once with SSE (4-wide) or AVX (8-wide).
+ * The leaves store up to "N" triangles in the SoA layout and they are tested with the lane loop.
+ * Without SSE/AVX, the same lane loops are used for the boxes.
+ */
+
+#ifndef DFM2_SRCH_BVH_WIDE_H
+#define DFM2_SRCH_BVH_WIDE_H
+
+#include <cassert>
+#include <cmath>
+#include <climits>
+#include <vector>
+#include <array>
+#include <limits>
+#include <utility>
+#include <algorithm>
+#if defined(__SSE2__) || defined(__AVX__)
+#  include <immintrin.h>
+#endif
+
+#include "delfem2/srch_bvh.h"
+#include "delfem2/srch_bv3_aabb.h"
+#include "delfem2/point_on_surface_mesh.h"
+#include "delfem2/mat4.h"
+#include "delfem2/thread.h"
+
+namespace delfem2 {
+
+namespace bvh_wide {
+
+/**
+ * @brief test a ray against the "N" boxes in the SoA layout
+ * @param[out] tnear parameter of the ray entering each box
+ * @param pad the boxes are enlarged by this (e.g., rounding error of the origin of the ray)
+ * @param tmax the boxes farther than this are culled
+ * @return bit mask of the boxes hit by the ray
+ */
+template <unsigned int N>
+unsigned int IntersectRay_BoxesSoA(
+    float tnear[N],
+    const float bbmin[3][N],
+    const float bbmax[3][N],
+    const float org[3],
+    const float inv_dir[3],
+    float pad,
+    float tmax) {
+  // enlarge the far parameter for the rounding errors of the single precision
+  constexpr float robust = 1.f + 4.f * std::numeric_limits<float>::epsilon();
+  unsigned int mask = 0;
+  for (unsigned int k = 0; k < N; ++k) {
+    float tn = 0.f, tf = tmax;
+    for (unsigned int i = 0; i < 3; ++i) {
+      const float t0 = (bbmin[i][k] - org[i] - pad) * inv_dir[i];
+      const float t1 = (bbmax[i][k] - org[i] + pad) * inv_dir[i];
+      tn = std::max(tn, std::min(t0, t1));
+      tf = std::min(tf, std::max(t0, t1));
+    }
+    tnear[k] = tn;
+    mask |= (tn <= tf * robust) ? (1u << k) : 0u;
+  }
+  return mask;
+}
+
+#if defined(__SSE2__)
+template <>
+inline unsigned int IntersectRay_BoxesSoA<4>(
+    float tnear[4],
+    const float bbmin[3][4],
+    const float bbmax[3][4],
+    const float org[3],
+    const float inv_dir[3],
+    float pad,
+    float tmax) {
+  constexpr float robust = 1.f + 4.f * std::numeric_limits<float>::epsilon();
+  __m128 tn = _mm_setzero_ps();
+  __m128 tf = _mm_set1_ps(tmax);
+  const __m128 p = _mm_set1_ps(pad);
+  for (unsigned int i = 0; i < 3; ++i) {
+    const __m128 o = _mm_set1_ps(org[i]);
+    const __m128 id = _mm_set1_ps(inv_dir[i]);
+    const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(bbmin[i]), o), p), id);
+    const __m128 t1 = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_loadu_ps(bbmax[i]), o), p), id);
+    tn = _mm_max_ps(tn, _mm_min_ps(t0, t1));
+    tf = _mm_min_ps(tf, _mm_max_ps(t0, t1));
+  }
+  _mm_storeu_ps(tnear, tn);
+  tf = _mm_mul_ps(tf, _mm_set1_ps(robust));
+  return static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(tn, tf)));
+}
+#endif
+
+#if defined(__AVX__)
+template <>
+inline unsigned int IntersectRay_BoxesSoA<8>(
+    float tnear[8],
+    const float bbmin[3][8],
+    const float bbmax[3][8],
+    const float org[3],
+    const float inv_dir[3],
+    float pad,
+    float tmax) {
+  constexpr float robust = 1.f + 4.f * std::numeric_limits<float>::epsilon();
+  __m256 tn = _mm256_setzero_ps();
+  __m256 tf = _mm256_set1_ps(tmax);
+  const __m256 p = _mm256_set1_ps(pad);
+  for (unsigned int i = 0; i < 3; ++i) {
+    const __m256 o = _mm256_set1_ps(org[i]);
+    const __m256 id = _mm256_set1_ps(inv_dir[i]);
+    const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(bbmin[i]), o), p), id);
+    const __m256 t1 = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_loadu_ps(bbmax[i]), o), p), id);
+    tn = _mm256_max_ps(tn, _mm256_min_ps(t0, t1));
+    tf = _mm256_min_ps(tf, _mm256_max_ps(t0, t1));
+  }
+  _mm256_storeu_ps(tnear, tn);
+  tf = _mm256_mul_ps(tf, _mm256_set1_ps(robust));
+  return static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ)));
+}
+#endif
+
+/**
+ * single precision value not larger (or smaller if "is_up") than the double precision value
+ */
+inline float RoundFloat(double v, bool is_up) {
+  float f = static_cast<float>(v);
+  if (is_up && static_cast<double>(f) < v) { f = std::nextafter(f, +std::numeric_limits<float>::infinity()); }
+  if (!is_up && static_cast<double>(f) > v) { f = std::nextafter(f, -std::numeric_limits<float>::infinity()); }
+  return f;
+}
+
+} // namespace bvh_wide
+
+/**
+ * @brief wide BVH of a triangle mesh for the ray casting
+ * @details the triangles are copied into the leaves, so the tree needs to be built again when the mesh moves.
+ * @tparam N number of the children of a node. 4 (SSE) or 8 (AVX)
+ */
+template <unsigned int N>
+class CBVHWide_MeshTri3D {
+  static_assert(N >= 2 && N <= 32, "the children are indexed by the bits of \"unsigned int\"");
+ public:
+  class CNode {
+   public:
+    alignas(sizeof(float) * N) float bbmin[3][N];  // bounding boxes of the children. x of all the children first
+    alignas(sizeof(float) * N) float bbmax[3][N];
+    unsigned int ichild[N];  // index of the node, or the index of the leaf if the bit of "mask_leaf" is set
+    unsigned int mask_valid = 0;  // bit mask of the used children
+    unsigned int mask_leaf = 0;
+  };
+  /**
+   * up to "N" triangles in the SoA layout
+   */
+  class CLeaf {
+   public:
+    double p0[3][N];  // first vertex
+    double e1[3][N];  // p1-p0
+    double e2[3][N];  // p2-p0
+    unsigned int itri[N];  // UINT_MAX for the unused lane
+  };
+
+ public:
+  /**
+   * @brief collapse a binary BVH of a triangle mesh
+   * @details the subtree with "N" or fewer triangles becomes a leaf.
+   * A node is made of the "N" largest (in the surface area) nodes of the binary subtree.
+   */
+  void Build(
+      unsigned int ibvh_root,
+      const std::vector<CNodeBVH2> &aNodeBVH,
+      const std::vector<CBV3_AABB<double>> &aAABB,
+      const double *vtx_xyz,
+      const unsigned int *tri_vtx);
+
+  /**
+   * @brief the closest intersection of a ray and the triangles
+   * @param[out] depth the intersection point is at "src+depth*dir"
+   * @return false if there is no intersection
+   */
+  bool IntersectionRay(
+      PointOnSurfaceMesh<double> &pes,
+      double &depth,
+      const double src[3],
+      const double dir[3]) const;
+
+  /**
+   * @param[out] aPes the intersection of each ray. "itri==UINT_MAX" if the ray does not hit
+   * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+   */
+  void IntersectionRays(
+      std::vector<PointOnSurfaceMesh<double> > &aPes,
+      const double *ray_src,
+      const double *ray_dir,
+      size_t num_ray,
+      unsigned int nthread = 0) const;
+
+ private:
+  void SetChild(
+      CNode &node,
+      unsigned int islot,
+      unsigned int ibvh,
+      const std::vector<CNodeBVH2> &aNodeBVH,
+      const std::vector<CBV3_AABB<double>> &aAABB,
+      const double *vtx_xyz,
+      const unsigned int *tri_vtx);
+
+ public:
+  std::vector<CNode> nodes;  // nodes[0] is the root
+  std::vector<CLeaf> leaves;
+  std::vector<unsigned int> num_tri_sub;  // number of the triangles in the subtree of each binary node
+  double padding = 0;  // the boxes are enlarged by this to absorb the rounding in single precision in the scale of the mesh
+};
+
+/**
+ * @brief closest intersection of the ray of each pixel of an image and a triangle mesh using the wide BVH
+ * @param[out] aPointElemSurf (nheight x nwidth) array. "itri==UINT_MAX" for the pixels whose ray does not hit
+ */
+template <unsigned int N>
+void Intersection_ImageRay_TriMesh3(
+    std::vector<PointOnSurfaceMesh<double> > &aPointElemSurf,
+    unsigned int nheight,
+    unsigned int nwidth,
+    const double mMVPd[16],
+    const CBVHWide_MeshTri3D<N> &bvh,
+    bool is_parallel);
+
+} // namespace delfem2
+
+// ----------------------------------------------------------------
+
+template <unsigned int N>
+void delfem2::CBVHWide_MeshTri3D<N>::SetChild(
+    CNode &node,
+    unsigned int islot,
+    unsigned int ibvh,
+    const std::vector<CNodeBVH2> &aNodeBVH,
+    const std::vector<CBV3_AABB<double>> &aAABB,
+    const double *vtx_xyz,
+    const unsigned int *tri_vtx) {
+  const CBV3_AABB<double> &bb = aAABB[ibvh];
+  for (unsigned int i = 0; i < 3; ++i) {
+    node.bbmin[i][islot] = bvh_wide::RoundFloat(bb.bbmin[i] - padding, false);
+    node.bbmax[i][islot] = bvh_wide::RoundFloat(bb.bbmax[i] + padding, true);
+  }
+  node.mask_valid |= (1u << islot);
+  if (num_tri_sub[ibvh] > N) {  // this becomes a node later
+    node.ichild[islot] = ibvh;
+    return;
+  }
+  // collect the triangles of the subtree into a leaf
+  CLeaf leaf;
+  unsigned int ntri = 0;
+  BVH_Traverse(
+      ibvh, aNodeBVH,
+      [](unsigned int) { return true; },
+      [&](unsigned int itri) {
+        assert(ntri < N);
+        const unsigned int *tri = tri_vtx + itri * 3;
+        for (unsigned int i = 0; i < 3; ++i) {
+          const double p0 = vtx_xyz[tri[0] * 3 + i];
+          leaf.p0[i][ntri] = p0;
+          leaf.e1[i][ntri] = vtx_xyz[tri[1] * 3 + i] - p0;
+          leaf.e2[i][ntri] = vtx_xyz[tri[2] * 3 + i] - p0;
+        }
+        leaf.itri[ntri] = itri;
+        ntri++;
+        return true;
+      });
+  for (; ntri < N; ++ntri) {  // degenerated triangles are never hit
+    for (unsigned int i = 0; i < 3; ++i) {
+      leaf.p0[i][ntri] = leaf.e1[i][ntri] = leaf.e2[i][ntri] = 0.;
+    }
+    leaf.itri[ntri] = UINT_MAX;
+  }
+  node.ichild[islot] = static_cast<unsigned int>(leaves.size());
+  node.mask_leaf |= (1u << islot);
+  leaves.push_back(leaf);
+}
+
+template <unsigned int N>
+void delfem2::CBVHWide_MeshTri3D<N>::Build(
+    unsigned int ibvh_root,
+    const std::vector<CNodeBVH2> &aNodeBVH,
+    const std::vector<CBV3_AABB<double>> &aAABB,
+    const double *vtx_xyz,
+    const unsigned int *tri_vtx) {
+  assert(aNodeBVH.size() == aAABB.size());
+  nodes.clear();
+  leaves.clear();
+  if (aNodeBVH.empty()) { return; }
+  const unsigned int nnode = static_cast<unsigned int>(aNodeBVH.size());
+  num_tri_sub.assign(nnode, 0);
+  for (unsigned int ibvh = 0; ibvh < nnode; ++ibvh) {
+    if (aNodeBVH[ibvh].ichild[1] != UINT_MAX) { continue; }
+    for (unsigned int jbvh = ibvh; jbvh != UINT_MAX; jbvh = aNodeBVH[jbvh].iparent) {
+      num_tri_sub[jbvh]++;
+      if (jbvh == ibvh_root) { break; }
+    }
+  }
+  {
+    const CBV3_AABB<double> &bb = aAABB[ibvh_root];
+    const double len = bb.MaxLength();
+    double lmax = 0.;
+    for (unsigned int i = 0; i < 3; ++i) {
+      lmax = std::max(lmax, std::max(std::fabs(bb.bbmin[i]), std::fabs(bb.bbmax[i])));
+    }
+    padding = 1.0e-6 * (len + lmax);
+  }
+  nodes.emplace_back();
+  if (num_tri_sub[ibvh_root] <= N) {  // single leaf
+    SetChild(nodes[0], 0, ibvh_root, aNodeBVH, aAABB, vtx_xyz, tri_vtx);
+    return;
+  }
+  std::vector<std::pair<unsigned int, unsigned int> > stack(1, {ibvh_root, 0});  // binary node, wide node
+  while (!stack.empty()) {
+    const std::pair<unsigned int, unsigned int> item = stack.back();
+    stack.pop_back();
+    unsigned int cand[N];
+    unsigned int ncand = 2;
+    cand[0] = aNodeBVH[item.first].ichild[0];
+    cand[1] = aNodeBVH[item.first].ichild[1];
+    while (ncand < N) {  // open the largest subtree which cannot be a leaf
+      unsigned int jcand = UINT_MAX;
+      double area_max = -1;
+      for (unsigned int icand = 0; icand < ncand; ++icand) {
+        if (num_tri_sub[cand[icand]] <= N) { continue; }
+        const double area = aAABB[cand[icand]].SurfaceArea();
+        if (area > area_max) {
+          area_max = area;
+          jcand = icand;
+        }
+      }
+      if (jcand == UINT_MAX) { break; }
+      const unsigned int ibvh = cand[jcand];
+      cand[jcand] = aNodeBVH[ibvh].ichild[0];
+      cand[ncand++] = aNodeBVH[ibvh].ichild[1];
+    }
+    CNode node;
+    for (unsigned int icand = 0; icand < N; ++icand) {
+      node.ichild[icand] = UINT_MAX;
+      for (unsigned int i = 0; i < 3; ++i) {  // the unused slots are never hit
+        node.bbmin[i][icand] = node.bbmax[i][icand] = std::numeric_limits<float>::max();
+      }
+    }
+    for (unsigned int icand = 0; icand < ncand; ++icand) {
+      SetChild(node, icand, cand[icand], aNodeBVH, aAABB, vtx_xyz, tri_vtx);
+      if ((node.mask_leaf >> icand) & 1u) { continue; }
+      const auto iwide = static_cast<unsigned int>(nodes.size());
+      stack.emplace_back(node.ichild[icand], iwide);
+      node.ichild[icand] = iwide;
+      nodes.emplace_back();
+    }
+    nodes[item.second] = node;
+  }
+}
+
+template <unsigned int N>
+bool delfem2::CBVHWide_MeshTri3D<N>::IntersectionRay(
+    PointOnSurfaceMesh<double> &pes,
+    double &depth,
+    const double src[3],
+    const double dir[3]) const {
+  if (nodes.empty()) { return false; }
+  float org[3], inv_dir[3];
+  double org_max = 0.;
+  for (unsigned int i = 0; i < 3; ++i) {
+    org[i] = static_cast<float>(src[i]);
+    org_max = std::max(org_max, std::fabs(src[i]));
+    const double d = (std::fabs(dir[i]) > 1.0e-30) ? dir[i] : 1.0e-30;
+    inv_dir[i] = static_cast<float>(1.0 / d);
+  }
+  // the rounding of the origin and of "bbmin-org" in single precision is absorbed by the boxes enlarged by this.
+  // the rounding in the scale of the boxes is absorbed by "padding"
+  const float pad_org = bvh_wide::RoundFloat(4. * std::numeric_limits<float>::epsilon() * org_max, true);
+  constexpr double eps = 1.0e-10;  // same tolerance as "Intersection_Ray3_Tri3_Bvh"
+  double depth_min = std::numeric_limits<double>::max();
+  float tmax = std::numeric_limits<float>::max();
+  unsigned int itri_hit = UINT_MAX;
+  double r0_hit = 0, r1_hit = 0;
+  // the leaves are marked with the top bit
+  constexpr unsigned int flg_leaf = 1u << 31;
+  CStackBVH<std::pair<unsigned int, float> > stack;
+  stack.push({0u, 0.f});
+  while (!stack.empty()) {
+    const std::pair<unsigned int, float> item = stack.pop();
+    if (item.second > tmax) { continue; }
+    if (item.first & flg_leaf) {  // Moller-Trumbore test of the triangles in the lanes
+      const CLeaf &leaf = leaves[item.first & ~flg_leaf];
+      double t[N], u[N], v[N];
+      for (unsigned int k = 0; k < N; ++k) {
+        const double px = dir[1] * leaf.e2[2][k] - dir[2] * leaf.e2[1][k];
+        const double py = dir[2] * leaf.e2[0][k] - dir[0] * leaf.e2[2][k];
+        const double pz = dir[0] * leaf.e2[1][k] - dir[1] * leaf.e2[0][k];
+        const double det = leaf.e1[0][k] * px + leaf.e1[1][k] * py + leaf.e1[2][k] * pz;
+        const double inv_det = (det != 0.) ? 1. / det : 0.;
+        const double sx = src[0] - leaf.p0[0][k];
+        const double sy = src[1] - leaf.p0[1][k];
+        const double sz = src[2] - leaf.p0[2][k];
+        const double qx = sy * leaf.e1[2][k] - sz * leaf.e1[1][k];
+        const double qy = sz * leaf.e1[0][k] - sx * leaf.e1[2][k];
+        const double qz = sx * leaf.e1[1][k] - sy * leaf.e1[0][k];
+        u[k] = (sx * px + sy * py + sz * pz) * inv_det;
+        v[k] = (dir[0] * qx + dir[1] * qy + dir[2] * qz) * inv_det;
+        const double tk = (leaf.e2[0][k] * qx + leaf.e2[1][k] * qy + leaf.e2[2][k] * qz) * inv_det;
+        const bool is_hit = det != 0. && u[k] >= -eps && v[k] >= -eps && 1. - u[k] - v[k] >= -eps && tk >= 0.;
+        t[k] = is_hit ? tk : std::numeric_limits<double>::max();
+      }
+      for (unsigned int k = 0; k < N; ++k) {
+        if (t[k] >= depth_min) { continue; }
+        depth_min = t[k];
+        itri_hit = leaf.itri[k];
+        r0_hit = 1. - u[k] - v[k];
+        r1_hit = u[k];
+      }
+      if (depth_min < std::numeric_limits<float>::max()) { tmax = bvh_wide::RoundFloat(depth_min, true); }
+      continue;
+    }
+    const CNode &node = nodes[item.first];
+    float tnear[N];
+    const unsigned int mask = bvh_wide::IntersectRay_BoxesSoA<N>(
+        tnear, node.bbmin, node.bbmax, org, inv_dir, pad_org, tmax) & node.mask_valid;
+    // push the hit children in the order of the distance. the nearest one is popped first
+    unsigned int order[N];
+    unsigned int nhit = 0;
+    for (unsigned int k = 0; k < N; ++k) {
+      if (((mask >> k) & 1u) == 0) { continue; }
+      unsigned int j = nhit++;
+      for (; j > 0 && tnear[order[j - 1]] < tnear[k]; --j) { order[j] = order[j - 1]; }
+      order[j] = k;
+    }
+    for (unsigned int j = 0; j < nhit; ++j) {
+      const unsigned int k = order[j];
+      const unsigned int flg = ((node.mask_leaf >> k) & 1u) ? flg_leaf : 0u;
+      stack.push({node.ichild[k] | flg, tnear[k]});
+    }
+  }
+  if (itri_hit == UINT_MAX) { return false; }
+  pes = PointOnSurfaceMesh<double>(itri_hit, r0_hit, r1_hit);
+  depth = depth_min;
+  return true;
+}
+
+template <unsigned int N>
+void delfem2::CBVHWide_MeshTri3D<N>::IntersectionRays(
+    std::vector<PointOnSurfaceMesh<double> > &aPes,
+    const double *ray_src,
+    const double *ray_dir,
+    size_t num_ray,
+    unsigned int nthread) const {
+  aPes.assign(num_ray, PointOnSurfaceMesh<double>());
+  parallel_for_range(
+      num_ray,
+      [&](size_t ib, size_t ie) {
+        for (size_t iray = ib; iray < ie; ++iray) {
+          double depth;
+          IntersectionRay(aPes[iray], depth, ray_src + iray * 3, ray_dir + iray * 3);
+        }
+      },
+      static_cast<size_t>(64), nthread);
+}
+
+template <unsigned int N>
+void delfem2::Intersection_ImageRay_TriMesh3(
+    std::vector<PointOnSurfaceMesh<double> > &aPointElemSurf,
+    unsigned int nheight,
+    unsigned int nwidth,
+    const double mMVPd[16],
+    const CBVHWide_MeshTri3D<N> &bvh,
+    bool is_parallel) {
+  aPointElemSurf.assign(nheight * nwidth, PointOnSurfaceMesh<double>());
+  const std::array<double, 16> mMVPd_inv = Inverse_Mat4(mMVPd);
+  parallel_for_tile(
+      nwidth, nheight, 8u,
+      [&](unsigned int iw, unsigned int ih) {
+        const std::pair<std::array<double, 3>, std::array<double, 3> > ray = RayFromInverseMvpMatrix(
+            mMVPd_inv.data(), iw, ih, nwidth, nheight);
+        double depth;
+        bvh.IntersectionRay(
+            aPointElemSurf[ih * nwidth + iw], depth,
+            ray.first.data(), ray.second.data());
+      },
+      is_parallel ? 0u : 1u);
+}
+
+#endif /* DFM2_SRCH_BVH_WIDE_H */
@@ -4,6 +4,10 @@
 #include <cassert>
 #include <vector>
 #include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "delfem2/thread.h"
 
 namespace delfem2 {
 
@@ -16,7 +20,7 @@ struct KDTNodePoint {
 };
 
 template <typename VEC, typename SCALAR = typename VEC::Scalar>
-void ConstructNode(KDTNodePoint<VEC>* currentRoot, std::vector<VEC> pointList, const int beginInd, const int endInd, const int depth = 0)
+void ConstructNode(KDTNodePoint<VEC>* currentRoot, std::vector<VEC>& pointList, const int beginInd, const int endInd, const int depth = 0)
 {
 
 	if ((endInd - beginInd) == 1) {
@@ -24,7 +28,9 @@ void ConstructNode(KDTNodePoint<VEC>* currentRoot, std::vector<VEC> pointList, c
 		return;
 	}
 
-	//sort
+	int midInd	       = (endInd - beginInd) / 2 + beginInd;
+
+	// partition around the median (the elements larger than the median come first)
 	{
 		auto begin = pointList.begin();
 		std::advance(begin, beginInd);
@@ -32,19 +38,21 @@ void ConstructNode(KDTNodePoint<VEC>* currentRoot, std::vector<VEC> pointList, c
 		auto end = pointList.begin();
 		std::advance(end, endInd);
 
+		auto mid = pointList.begin();
+		std::advance(mid, midInd);
+
 		if (depth % 3 == 0) {
-			std::sort(begin, end,
-			    [](VEC a, VEC b) -> bool { return a[0] > b[0]; });
+			std::nth_element(begin, mid, end,
+			    [](const VEC& a, const VEC& b) -> bool { return a[0] > b[0]; });
 		} else if (depth % 3 == 1) {
-			std::sort(begin, end,
-			    [](VEC a, VEC b) -> bool { return a[1] > b[1]; });
+			std::nth_element(begin, mid, end,
+			    [](const VEC& a, const VEC& b) -> bool { return a[1] > b[1]; });
 		} else {
-			std::sort(begin, end,
-			    [](VEC a, VEC b) -> bool { return a[2] > b[2]; });
+			std::nth_element(begin, mid, end,
+			    [](const VEC& a, const VEC& b) -> bool { return a[2] > b[2]; });
 		}
 	}
 
-	int midInd	       = (endInd - beginInd) / 2 + beginInd;
 	currentRoot->separator = pointList[midInd];
 
 	if (beginInd != midInd) {
@@ -148,6 +156,284 @@ VEC SearchNearstPoint(const KDTNodePoint<VEC>* const root, const VEC Q)
 	return SearchNearstPoint(root, Q, 0, temp);
 }
 
+// ------------------------------------------------------------
+// flattened kd-tree
+
+/**
+ * @brief kd-tree of 3D points stored in the flat arrays
+ * @details the tree is implicit: the node for the index range [ib,ie) of the reordered points has the median
+ * im=(ib+ie)/2 as the splitting point and the children [ib,im) and [im+1,ie).
+ * The ranges smaller than or equal to "num_point_leaf" are leaves that are scanned linearly.
+ * Only the splitting axis of each median is stored, and the coordinates are copied in the tree order
+ * so that a query touches contiguous memory.
+ * The tree does not depend on the number of threads used for the construction.
+ * @tparam VEC 3D vector class with "operator[]" (e.g., CVec3 or Eigen::Vector3)
+ */
+template <typename VEC, typename SCALAR = typename VEC::Scalar>
+class KDTreePoint {
+public:
+	KDTreePoint() = default;
+	explicit KDTreePoint(const std::vector<VEC>& points, unsigned int nthread = 1) { this->Construct(points, nthread); }
+
+	/**
+	 * @param nthread number of threads for the construction. 0 uses all the threads of "delfem2::ThreadPool"
+	 */
+	void Construct(const std::vector<VEC>& points, unsigned int nthread = 1);
+
+	[[nodiscard]] size_t Size() const { return point_index.size(); }
+
+	/**
+	 * @return index of the nearest point in the input of "Construct()". UINT_MAX if the tree is empty
+	 * @param[out] dist_sq squared distance to the nearest point
+	 */
+	unsigned int NearestPoint(SCALAR& dist_sq, const VEC& q) const;
+
+	/**
+	 * @param[out] neighbors k nearest points as (squared distance, index) pairs sorted by the distance
+	 */
+	void KNearestPoints(std::vector<std::pair<SCALAR, unsigned int> >& neighbors, const VEC& q, unsigned int k) const;
+
+	/**
+	 * @param[out] indices indices of the points whose distance to "q" is smaller than or equal to "radius".
+	 * The order is not specified.
+	 */
+	void PointsInSphere(std::vector<unsigned int>& indices, const VEC& q, SCALAR radius) const;
+
+	/**
+	 * @brief nearest points of many query points in parallel
+	 * @param[out] indices index of the nearest point for each query
+	 * @param[out] dist_sq squared distance for each query
+	 * @param nthread number of threads. 0 uses all the threads of "delfem2::ThreadPool"
+	 */
+	void NearestPoints(
+	    std::vector<unsigned int>& indices,
+	    std::vector<SCALAR>& dist_sq,
+	    const std::vector<VEC>& queries,
+	    unsigned int nthread = 0) const;
+
+private:
+	struct CRange {
+		unsigned int ib;
+		unsigned int ie;
+		SCALAR dist_sq;  // lower bound of the squared distance from the query to the points in the range
+	};
+	// the height of the balanced tree is smaller than 64
+	static constexpr unsigned int stack_size = 128;
+
+	void ConstructRange(std::vector<unsigned int>& perm, const std::vector<VEC>& points, unsigned int ib, unsigned int ie);
+
+	SCALAR DistanceSquare(unsigned int i, const VEC& q) const
+	{
+		const SCALAR* p = point_xyz.data() + i * 3;
+		const SCALAR d0 = p[0] - q[0], d1 = p[1] - q[1], d2 = p[2] - q[2];
+		return d0 * d0 + d1 * d1 + d2 * d2;
+	}
+
+	/**
+	 * visit the points whose squared distance may be smaller than "bound()".
+	 * "visit(i,dist_sq)" is called for the candidate point "i" in the tree order.
+	 */
+	template <typename BOUND, typename VISIT>
+	void Traverse(const VEC& q, BOUND&& bound, VISIT&& visit) const;
+
+public:
+	unsigned int num_point_leaf = 8;
+	std::vector<SCALAR> point_xyz;  // coordinates in the tree order
+	std::vector<unsigned int> point_index;  // index in the input for each point in the tree order
+	std::vector<unsigned char> split_axis;  // splitting axis of the median point. unused for the leaf
+};
+
+template <typename VEC, typename SCALAR>
+void KDTreePoint<VEC, SCALAR>::ConstructRange(
+    std::vector<unsigned int>& perm,
+    const std::vector<VEC>& points,
+    unsigned int ib,
+    unsigned int ie)
+{
+	if (ie - ib <= num_point_leaf) { return; }
+	SCALAR bbmin[3], bbmax[3];
+	for (unsigned int idim = 0; idim < 3; ++idim) { bbmin[idim] = bbmax[idim] = points[perm[ib]][idim]; }
+	for (unsigned int i = ib + 1; i < ie; ++i) {
+		for (unsigned int idim = 0; idim < 3; ++idim) {
+			const SCALAR c = points[perm[i]][idim];
+			bbmin[idim] = (c < bbmin[idim]) ? c : bbmin[idim];
+			bbmax[idim] = (c > bbmax[idim]) ? c : bbmax[idim];
+		}
+	}
+	unsigned int axis = 0;
+	for (unsigned int idim = 1; idim < 3; ++idim) {
+		if (bbmax[idim] - bbmin[idim] > bbmax[axis] - bbmin[axis]) { axis = idim; }
+	}
+	const unsigned int im = (ib + ie) / 2;
+	std::nth_element(
+	    perm.begin() + ib, perm.begin() + im, perm.begin() + ie,
+	    [&points, axis](unsigned int i0, unsigned int i1) { return points[i0][axis] < points[i1][axis]; });
+	split_axis[im] = static_cast<unsigned char>(axis);
+}
+
+template <typename VEC, typename SCALAR>
+void KDTreePoint<VEC, SCALAR>::Construct(
+    const std::vector<VEC>& points,
+    unsigned int nthread)
+{
+	const auto np = static_cast<unsigned int>(points.size());
+	std::vector<unsigned int> perm(np);
+	for (unsigned int ip = 0; ip < np; ++ip) { perm[ip] = ip; }
+	split_axis.assign(np, 0);
+	// the top levels are split serially until there are enough subtrees for the threads
+	const unsigned int nthread_used = thread::NumThreadsForLoop(nthread);
+	std::vector<std::pair<unsigned int, unsigned int> > ranges(1, {0u, np});
+	while (nthread_used > 1 && ranges.size() < nthread_used * 8) {
+		std::vector<std::pair<unsigned int, unsigned int> > ranges_child;
+		for (const auto& r : ranges) {
+			if (r.second - r.first <= num_point_leaf) {
+				ranges_child.push_back(r);
+				continue;
+			}
+			this->ConstructRange(perm, points, r.first, r.second);
+			const unsigned int im = (r.first + r.second) / 2;
+			ranges_child.emplace_back(r.first, im);
+			ranges_child.emplace_back(im + 1, r.second);
+		}
+		if (ranges_child.size() == ranges.size()) { break; }
+		ranges.swap(ranges_child);
+	}
+	// the subtrees are independent
+	parallel_for(
+	    static_cast<unsigned int>(ranges.size()),
+	    [&](unsigned int ir) {
+		    std::vector<std::pair<unsigned int, unsigned int> > stack(1, ranges[ir]);
+		    while (!stack.empty()) {
+			    const auto r = stack.back();
+			    stack.pop_back();
+			    if (r.second - r.first <= num_point_leaf) { continue; }
+			    this->ConstructRange(perm, points, r.first, r.second);
+			    const unsigned int im = (r.first + r.second) / 2;
+			    stack.emplace_back(r.first, im);
+			    stack.emplace_back(im + 1, r.second);
+		    }
+	    },
+	    nthread);
+	point_index = perm;
+	point_xyz.resize(np * 3);
+	for (unsigned int ip = 0; ip < np; ++ip) {
+		for (unsigned int idim = 0; idim < 3; ++idim) { point_xyz[ip * 3 + idim] = points[perm[ip]][idim]; }
+	}
+}
+
+template <typename VEC, typename SCALAR>
+template <typename BOUND, typename VISIT>
+void KDTreePoint<VEC, SCALAR>::Traverse(
+    const VEC& q,
+    BOUND&& bound,
+    VISIT&& visit) const
+{
+	CRange stack[stack_size];
+	unsigned int nstack = 0;
+	stack[nstack++] = { 0u, static_cast<unsigned int>(point_index.size()), 0 };
+	while (nstack > 0) {
+		const CRange r = stack[--nstack];
+		if (r.dist_sq > bound()) { continue; }
+		if (r.ie - r.ib <= num_point_leaf) {
+			for (unsigned int i = r.ib; i < r.ie; ++i) { visit(i, DistanceSquare(i, q)); }
+			continue;
+		}
+		const unsigned int im = (r.ib + r.ie) / 2;
+		const unsigned int axis = split_axis[im];
+		const SCALAR diff = q[axis] - point_xyz[im * 3 + axis];
+		visit(im, DistanceSquare(im, q));
+		const SCALAR dist_sq_far = std::max(r.dist_sq, diff * diff);
+		// the far side is pushed first so that the near side is visited first
+		if (diff < 0) {
+			stack[nstack++] = { im + 1, r.ie, dist_sq_far };
+			stack[nstack++] = { r.ib, im, r.dist_sq };
+		} else {
+			stack[nstack++] = { r.ib, im, dist_sq_far };
+			stack[nstack++] = { im + 1, r.ie, r.dist_sq };
+		}
+	}
+}
+
+template <typename VEC, typename SCALAR>
+unsigned int KDTreePoint<VEC, SCALAR>::NearestPoint(
+    SCALAR& dist_sq,
+    const VEC& q) const
+{
+	unsigned int i_nearest = std::numeric_limits<unsigned int>::max();
+	dist_sq = std::numeric_limits<SCALAR>::max();
+	this->Traverse(
+	    q,
+	    [&dist_sq]() { return dist_sq; },
+	    [&dist_sq, &i_nearest](unsigned int i, SCALAR d) {
+		    if (d < dist_sq) {
+			    dist_sq = d;
+			    i_nearest = i;
+		    }
+	    });
+	if (i_nearest == std::numeric_limits<unsigned int>::max()) { return i_nearest; }
+	return point_index[i_nearest];
+}
+
+template <typename VEC, typename SCALAR>
+void KDTreePoint<VEC, SCALAR>::KNearestPoints(
+    std::vector<std::pair<SCALAR, unsigned int> >& neighbors,
+    const VEC& q,
+    unsigned int k) const
+{
+	neighbors.clear();
+	if (k == 0) { return; }
+	// max heap of the candidates
+	this->Traverse(
+	    q,
+	    [&neighbors, k]() {
+		    return (neighbors.size() < k) ? std::numeric_limits<SCALAR>::max() : neighbors.front().first;
+	    },
+	    [&neighbors, k](unsigned int i, SCALAR d) {
+		    if (neighbors.size() < k) {
+			    neighbors.emplace_back(d, i);
+			    std::push_heap(neighbors.begin(), neighbors.end());
+		    } else if (d < neighbors.front().first) {
+			    std::pop_heap(neighbors.begin(), neighbors.end());
+			    neighbors.back() = { d, i };
+			    std::push_heap(neighbors.begin(), neighbors.end());
+		    }
+	    });
+	std::sort_heap(neighbors.begin(), neighbors.end());
+	for (auto& n : neighbors) { n.second = point_index[n.second]; }
+}
+
+template <typename VEC, typename SCALAR>
+void KDTreePoint<VEC, SCALAR>::PointsInSphere(
+    std::vector<unsigned int>& indices,
+    const VEC& q,
+    SCALAR radius) const
+{
+	indices.clear();
+	const SCALAR radius_sq = radius * radius;
+	this->Traverse(
+	    q,
+	    [radius_sq]() { return radius_sq; },
+	    [this, &indices, radius_sq](unsigned int i, SCALAR d) {
+		    if (d <= radius_sq) { indices.push_back(point_index[i]); }
+	    });
+}
+
+template <typename VEC, typename SCALAR>
+void KDTreePoint<VEC, SCALAR>::NearestPoints(
+    std::vector<unsigned int>& indices,
+    std::vector<SCALAR>& dist_sq,
+    const std::vector<VEC>& queries,
+    unsigned int nthread) const
+{
+	const auto nq = static_cast<unsigned int>(queries.size());
+	indices.resize(nq);
+	dist_sq.resize(nq);
+	parallel_for(
+	    nq,
+	    [&](unsigned int iq) { indices[iq] = this->NearestPoint(dist_sq[iq], queries[iq]); },
+	    nthread);
+}
+
 }
 
 #endif //DFM2_KDT_H
@@ -6,21 +6,26 @@
  */
 
 /**
- * @details bilatial search (elemnet-to-element) using bvh
+ * @details bilatial search (elemnet-to-element) using bvh or spatial hash
  */
 
 #ifndef DFM2_SRCHBI_V3BVH_H
 #define DFM2_SRCHBI_V3BVH_H
 
 #include <stdio.h>
+#include <set>
+#include <algorithm>
+#include <mutex>
 
 #include "delfem2/srch_bvh.h"
+#include "delfem2/srch_spatialhash.h"
 #include "delfem2/vec3.h"
 #include "delfem2/vec3_funcs.h"
 #include "delfem2/geo_plane.h"
 #include "delfem2/geo_tri.h"
 #include "delfem2/geo_tet.h"
 #include "delfem2/geo_ccd.h"
+#include "delfem2/geo_ccd_batch.h"
 #include "delfem2/geo_edge.h"
 #include "delfem2/geosolidelm_v3.h"
 
@@ -55,6 +60,53 @@ bool IsContact_FV_CCD(
 // -------------
 class CContactElement;
 
+/**
+ * @brief contact elements (vertex-face and edge-edge) between two triangles within the distance "delta"
+ * @param add "add(const CContactElement&)" called for each contact element
+ * @param bb_i bounding box of the triangle "itri"
+ */
+template <typename BBOX, typename FUNC>
+void ContactElement_Proximity_TriPair(
+    FUNC&& add,
+    double delta,
+    const std::vector<double>& aXYZ,
+    const std::vector<unsigned int>& aTri,
+    unsigned int itri, unsigned int jtri,
+    const BBOX& bb_i, const BBOX& bb_j);
+
+/**
+ * @brief contact elements between two triangles moving with the velocity "aUVW" in the time step "dt"
+ * @param add "add(const CContactElement&)" called for each contact element
+ * @details the pair is tested in the order of the smaller triangle index first,
+ * so the result does not depend on the order of "itri" and "jtri" found by the broad phase
+ * @param bb_i bounding box of the triangle "itri" swept in the time step
+ */
+template <typename BBOX, typename FUNC>
+void ContactElement_CCD_TriPair(
+    FUNC&& add,
+    double dt,
+    const std::vector<double>& aXYZ,
+    const std::vector<double>& aUVW,
+    const std::vector<unsigned int>& aTri,
+    unsigned int itri, unsigned int jtri,
+    const BBOX& bb_i, const BBOX& bb_j);
+
+/**
+ * @brief same output as "ContactElement_CCD_TriPair" for all the pairs but the vertex-face and edge-edge pairs
+ * surviving the culling by the boxes are gathered and tested in the batch (see "geo_ccd_batch.h")
+ * @param aTriPair pairs of the triangles (itri,jtri) found by the broad phase
+ * @param aBBTri bounding box of each triangle swept in the time step
+ */
+template <typename BBOX, typename FUNC>
+void ContactElement_CCD_TriPairs(
+    FUNC&& add,
+    double dt,
+    const std::vector<double>& aXYZ,
+    const std::vector<double>& aUVW,
+    const std::vector<unsigned int>& aTri,
+    const std::vector< std::pair<unsigned int,unsigned int> >& aTriPair,
+    const std::vector<BBOX>& aBBTri);
+
 template <typename BBOX>
 void GetContactElement_Proximity(
     std::set<CContactElement>& aContactElem,
@@ -103,6 +155,73 @@ void GetContactElement_CCD(
     const std::vector<CNodeBVH2>& aBVH,
     const std::vector<BBOX>& aBB);
 
+/**
+ * @brief same output as the serial version but the pairs of the sub-trees are traversed in parallel
+ * @details the top of the tree is expanded to the independent pairs of the sub-trees.
+ * Each chunk of the pairs collects the elements in its local set and they are merged at the end
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ */
+template <typename BBOX>
+void GetContactElement_Proximity(
+    std::set<CContactElement>& aContactElem,
+    // ----------
+    double delta,
+    const std::vector<double>& aXYZ,
+    const std::vector<unsigned int>& aTri,
+    int ibvh,
+    const std::vector<CNodeBVH2>& aBVH,
+    const std::vector<BBOX>& aBB,
+    unsigned int nthread);
+
+/**
+ * @brief same output as the serial version but the pairs of the sub-trees are traversed in parallel
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ */
+template <typename BBOX>
+void GetContactElement_CCD(
+    std::set<CContactElement>& aContactElem,
+    // ------------
+    double dt,
+    double delta,
+    const std::vector<double>& aXYZ,
+    const std::vector<double>& aUVW,
+    const std::vector<unsigned int>& aTri,
+    int ibvh,
+    const std::vector<CNodeBVH2>& aBVH,
+    const std::vector<BBOX>& aBB,
+    unsigned int nthread);
+
+/**
+ * @brief same output as the BVH version but the broad phase is the spatial hash.
+ * @details the boxes of the triangles are enlarged by "delta*0.5" like the leaves of the BVH used in the cloth
+ * @param hash the boxes of the triangles are registered to this. Reuse this to keep the memory allocated
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ */
+inline void GetContactElement_Proximity(
+    std::set<CContactElement>& aContactElem,
+    // ----------
+    double delta,
+    const std::vector<double>& aXYZ,
+    const std::vector<unsigned int>& aTri,
+    CSpatialHash& hash,
+    unsigned int nthread = 0);
+
+/**
+ * @brief same output as the BVH version but the broad phase is the spatial hash of the swept triangles
+ * @param hash the boxes of the triangles are registered to this. Reuse this to keep the memory allocated
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ */
+inline void GetContactElement_CCD(
+    std::set<CContactElement>& aContactElem,
+    // --------------
+    double dt,
+    double delta,
+    const std::vector<double>& aXYZ,
+    const std::vector<double>& aUVW,
+    const std::vector<unsigned int>& aTri,
+    CSpatialHash& hash,
+    unsigned int nthread = 0);
+
 // ------------------------
 template <typename REAL>
 class CIntersectTriPair;
@@ -246,6 +365,228 @@ public:
   
 }
 
+template <typename BBOX, typename FUNC>
+void delfem2::ContactElement_Proximity_TriPair
+(FUNC&& add,
+ double delta,
+ const std::vector<double>& aXYZ,
+ const std::vector<unsigned int>& aTri,
+ unsigned int itri, unsigned int jtri,
+ const BBOX& bb_i, const BBOX& bb_j)
+{
+  const int in0 = aTri[itri*3+0];
+  const int in1 = aTri[itri*3+1];
+  const int in2 = aTri[itri*3+2];
+  const int jn0 = aTri[jtri*3+0];
+  const int jn1 = aTri[jtri*3+1];
+  const int jn2 = aTri[jtri*3+2];
+  const CVec3d p0(aXYZ[in0*3+0], aXYZ[in0*3+1], aXYZ[in0*3+2]);
+  const CVec3d p1(aXYZ[in1*3+0], aXYZ[in1*3+1], aXYZ[in1*3+2]);
+  const CVec3d p2(aXYZ[in2*3+0], aXYZ[in2*3+1], aXYZ[in2*3+2]);
+  const CVec3d q0(aXYZ[jn0*3+0], aXYZ[jn0*3+1], aXYZ[jn0*3+2]);
+  const CVec3d q1(aXYZ[jn1*3+0], aXYZ[jn1*3+1], aXYZ[jn1*3+2]);
+  const CVec3d q2(aXYZ[jn2*3+0], aXYZ[jn2*3+1], aXYZ[jn2*3+2]);
+  if( IsContact_FV_Proximity(   in0,in1,in2,jn0, p0,p1,p2,q0, bb_i, delta) ){
+    add( CContactElement(true,    in0,in1,in2,jn0) );
+  }
+  if( IsContact_FV_Proximity(   in0,in1,in2,jn1, p0,p1,p2,q1, bb_i, delta) ){
+    add( CContactElement(true,    in0,in1,in2,jn1) );
+  }
+  if( IsContact_FV_Proximity(   in0,in1,in2,jn2, p0,p1,p2,q2, bb_i, delta) ){
+    add( CContactElement(true,    in0,in1,in2,jn2) );
+  }
+  if( IsContact_FV_Proximity(   jn0,jn1,jn2,in0, q0,q1,q2,p0, bb_j, delta) ){
+    add( CContactElement(true,    jn0,jn1,jn2,in0) );
+  }
+  if( IsContact_FV_Proximity(   jn0,jn1,jn2,in1, q0,q1,q2,p1, bb_j, delta) ){
+    add( CContactElement(true,    jn0,jn1,jn2,in1) );
+  }
+  if( IsContact_FV_Proximity(   jn0,jn1,jn2,in2, q0,q1,q2,p2, bb_j, delta) ){
+    add( CContactElement(true,    jn0,jn1,jn2,in2) );
+  }
+  ////
+  if( IsContact_Edge3_Edge3_Proximity(      in0,in1,jn0,jn1, p0,p1,q0,q1, delta) ){
+    add( CContactElement(false,    in0,in1,jn0,jn1) );
+  }
+  if( IsContact_Edge3_Edge3_Proximity(      in0,in1,jn1,jn2, p0,p1,q1,q2, delta) ){
+    add( CContactElement(false,    in0,in1,jn1,jn2) );
+  }
+  if( IsContact_Edge3_Edge3_Proximity(      in0,in1,jn2,jn0, p0,p1,q2,q0, delta) ){
+    add( CContactElement(false,    in0,in1,jn2,jn0) );
+  }
+  if( IsContact_Edge3_Edge3_Proximity(      in1,in2,jn0,jn1, p1,p2,q0,q1, delta) ){
+    add( CContactElement(false,    in1,in2,jn0,jn1) );
+  }
+  if( IsContact_Edge3_Edge3_Proximity(      in1,in2,jn1,jn2, p1,p2,q1,q2, delta) ){
+    add( CContactElement(false,    in1,in2,jn1,jn2) );
+  }
+  if( IsContact_Edge3_Edge3_Proximity(      in1,in2,jn2,jn0, p1,p2,q2,q0, delta) ){
+    add( CContactElement(false,    in1,in2,jn2,jn0) );
+  }
+  if( IsContact_Edge3_Edge3_Proximity(      in2,in0,jn0,jn1, p2,p0,q0,q1, delta) ){
+    add( CContactElement(false,    in2,in0,jn0,jn1) );
+  }
+  if( IsContact_Edge3_Edge3_Proximity(      in2,in0,jn1,jn2, p2,p0,q1,q2, delta) ){
+    add( CContactElement(false,    in2,in0,jn1,jn2) );
+  }
+  if( IsContact_Edge3_Edge3_Proximity(      in2,in0,jn2,jn0, p2,p0,q2,q0, delta) ){
+    add( CContactElement(false,    in2,in0,jn2,jn0) );
+  }
+}
+
+template <typename BBOX, typename FUNC>
+void delfem2::ContactElement_CCD_TriPair
+(FUNC&& add,
+ double dt,
+ const std::vector<double>& aXYZ,
+ const std::vector<double>& aUVW,
+ const std::vector<unsigned int>& aTri,
+ unsigned int itri, unsigned int jtri,
+ const BBOX& bb_i, const BBOX& bb_j)
+{
+  if( itri > jtri ){ // the edge-edge test depends on the order of the edges. the smaller triangle comes first
+    ContactElement_CCD_TriPair(add, dt, aXYZ, aUVW, aTri, jtri, itri, bb_j, bb_i);
+    return;
+  }
+  int in0 = aTri[itri*3+0];
+  int in1 = aTri[itri*3+1];
+  int in2 = aTri[itri*3+2];
+  int jn0 = aTri[jtri*3+0];
+  int jn1 = aTri[jtri*3+1];
+  int jn2 = aTri[jtri*3+2];
+  const CVec3d p0s(aXYZ[in0*3+0],                  aXYZ[in0*3+1],                  aXYZ[in0*3+2]);
+  const CVec3d p1s(aXYZ[in1*3+0],                  aXYZ[in1*3+1],                  aXYZ[in1*3+2]);
+  const CVec3d p2s(aXYZ[in2*3+0],                  aXYZ[in2*3+1],                  aXYZ[in2*3+2]);
+  const CVec3d q0s(aXYZ[jn0*3+0],                  aXYZ[jn0*3+1],                  aXYZ[jn0*3+2]);
+  const CVec3d q1s(aXYZ[jn1*3+0],                  aXYZ[jn1*3+1],                  aXYZ[jn1*3+2]);
+  const CVec3d q2s(aXYZ[jn2*3+0],                  aXYZ[jn2*3+1],                  aXYZ[jn2*3+2]);
+  const CVec3d p0e(aXYZ[in0*3+0]+dt*aUVW[in0*3+0], aXYZ[in0*3+1]+dt*aUVW[in0*3+1], aXYZ[in0*3+2]+dt*aUVW[in0*3+2]);
+  const CVec3d p1e(aXYZ[in1*3+0]+dt*aUVW[in1*3+0], aXYZ[in1*3+1]+dt*aUVW[in1*3+1], aXYZ[in1*3+2]+dt*aUVW[in1*3+2]);
+  const CVec3d p2e(aXYZ[in2*3+0]+dt*aUVW[in2*3+0], aXYZ[in2*3+1]+dt*aUVW[in2*3+1], aXYZ[in2*3+2]+dt*aUVW[in2*3+2]);
+  const CVec3d q0e(aXYZ[jn0*3+0]+dt*aUVW[jn0*3+0], aXYZ[jn0*3+1]+dt*aUVW[jn0*3+1], aXYZ[jn0*3+2]+dt*aUVW[jn0*3+2]);
+  const CVec3d q1e(aXYZ[jn1*3+0]+dt*aUVW[jn1*3+0], aXYZ[jn1*3+1]+dt*aUVW[jn1*3+1], aXYZ[jn1*3+2]+dt*aUVW[jn1*3+2]);
+  const CVec3d q2e(aXYZ[jn2*3+0]+dt*aUVW[jn2*3+0], aXYZ[jn2*3+1]+dt*aUVW[jn2*3+1], aXYZ[jn2*3+2]+dt*aUVW[jn2*3+2]);
+  
+  if( IsContact_FV_CCD(      in0,in1,in2,jn0, p0s,p1s,p2s,q0s, p0e,p1e,p2e,q0e, bb_i) ){
+    add( CContactElement(true, in0,in1,in2,jn0) );
+  }
+  if( IsContact_FV_CCD(      in0,in1,in2,jn1, p0s,p1s,p2s,q1s, p0e,p1e,p2e,q1e, bb_i) ){
+    add( CContactElement(true, in0,in1,in2,jn1) );
+  }
+  if( IsContact_FV_CCD(      in0,in1,in2,jn2, p0s,p1s,p2s,q2s, p0e,p1e,p2e,q2e, bb_i) ){
+    add( CContactElement(true, in0,in1,in2,jn2) );
+  }
+  if( IsContact_FV_CCD(      jn0,jn1,jn2,in0, q0s,q1s,q2s,p0s, q0e,q1e,q2e,p0e, bb_j) ){
+    add( CContactElement(true, jn0,jn1,jn2,in0) );
+  }
+  if( IsContact_FV_CCD(      jn0,jn1,jn2,in1, q0s,q1s,q2s,p1s, q0e,q1e,q2e,p1e, bb_j) ){
+    add( CContactElement(true, jn0,jn1,jn2,in1) );
+  }
+  if( IsContact_FV_CCD(      jn0,jn1,jn2,in2, q0s,q1s,q2s,p2s, q0e,q1e,q2e,p2e, bb_j) ){
+    add( CContactElement(true, jn0,jn1,jn2,in2) );
+  }
+  ////
+  if( IsContact_EE_CCD<BBOX>(          in0,in1,jn0,jn1, p0s,p1s,q0s,q1s,  p0e,p1e,q0e,q1e) ){
+    add( CContactElement(false,  in0,in1,jn0,jn1) );
+  }
+  if( IsContact_EE_CCD<BBOX>(          in0,in1,jn1,jn2, p0s,p1s,q1s,q2s,  p0e,p1e,q1e,q2e) ){
+    add( CContactElement(false,  in0,in1,jn1,jn2) );
+  }
+  if( IsContact_EE_CCD<BBOX>(          in0,in1,jn2,jn0, p0s,p1s,q2s,q0s,  p0e,p1e,q2e,q0e) ){
+    add( CContactElement(false,  in0,in1,jn2,jn0) );
+  }
+  if( IsContact_EE_CCD<BBOX>(          in1,in2,jn0,jn1, p1s,p2s,q0s,q1s,  p1e,p2e,q0e,q1e) ){
+    add( CContactElement(false,  in1,in2,jn0,jn1) );
+  }
+  if( IsContact_EE_CCD<BBOX>(          in1,in2,jn1,jn2, p1s,p2s,q1s,q2s,  p1e,p2e,q1e,q2e) ){
+    add( CContactElement(false,  in1,in2,jn1,jn2) );
+  }
+  if( IsContact_EE_CCD<BBOX>(          in1,in2,jn2,jn0, p1s,p2s,q2s,q0s,  p1e,p2e,q2e,q0e) ){
+    add( CContactElement(false,  in1,in2,jn2,jn0) );
+  }
+  if( IsContact_EE_CCD<BBOX>(          in2,in0,jn0,jn1, p2s,p0s,q0s,q1s,  p2e,p0e,q0e,q1e) ){
+    add( CContactElement(false,  in2,in0,jn0,jn1) );
+  }
+  if( IsContact_EE_CCD<BBOX>(          in2,in0,jn1,jn2, p2s,p0s,q1s,q2s,  p2e,p0e,q1e,q2e) ){
+    add( CContactElement(false,  in2,in0,jn1,jn2) );
+  }
+  if( IsContact_EE_CCD<BBOX>(          in2,in0,jn2,jn0, p2s,p0s,q2s,q0s,  p2e,p0e,q2e,q0e) ){
+    add( CContactElement(false,  in2,in0,jn2,jn0) );
+  }
+}
+
+template <typename BBOX, typename FUNC>
+void delfem2::ContactElement_CCD_TriPairs(
+    FUNC&& add,
+    double dt,
+    const std::vector<double>& aXYZ,
+    const std::vector<double>& aUVW,
+    const std::vector<unsigned int>& aTri,
+    const std::vector< std::pair<unsigned int,unsigned int> >& aTriPair,
+    const std::vector<BBOX>& aBBTri)
+{
+  const double eps = 1.0e-10;
+  CPairsCCD<double> aPairFV, aPairEE;
+  std::vector<CContactElement> aCandFV, aCandEE;
+  for(const auto& tri_pair : aTriPair){
+    const unsigned int aItri[2] = { // the smaller triangle comes first as in "ContactElement_CCD_TriPair"
+        std::min(tri_pair.first, tri_pair.second),
+        std::max(tri_pair.first, tri_pair.second) };
+    int in[2][3];
+    CVec3d ps[2][3], pe[2][3];
+    BBOX bb_vtx[2][3];
+    for(unsigned int i=0;i<2;++i){
+      for(unsigned int inode=0;inode<3;++inode){
+        const int ip = aTri[aItri[i]*3+inode];
+        in[i][inode] = ip;
+        ps[i][inode] = CVec3d(aXYZ[ip*3+0], aXYZ[ip*3+1], aXYZ[ip*3+2]);
+        pe[i][inode] = CVec3d(aXYZ[ip*3+0]+dt*aUVW[ip*3+0], aXYZ[ip*3+1]+dt*aUVW[ip*3+1], aXYZ[ip*3+2]+dt*aUVW[ip*3+2]);
+        bb_vtx[i][inode].AddPoint(ps[i][inode].data(), eps);
+        bb_vtx[i][inode].AddPoint(pe[i][inode].data(), eps);
+      }
+    }
+    // vertex-face. the culling of "IsContact_FV_CCD"
+    for(unsigned int i=0;i<2;++i){
+      const unsigned int j = 1-i;
+      for(unsigned int jnode=0;jnode<3;++jnode){
+        const int jp = in[j][jnode];
+        if( jp == in[i][0] || jp == in[i][1] || jp == in[i][2] ){ continue; }
+        if( !aBBTri[aItri[i]].IsIntersect(bb_vtx[j][jnode]) ){ continue; }
+        aPairFV.PushBack(
+            ps[i][0], ps[i][1], ps[i][2], ps[j][jnode],
+            pe[i][0], pe[i][1], pe[i][2], pe[j][jnode]);
+        aCandFV.emplace_back(true, in[i][0], in[i][1], in[i][2], jp);
+      }
+    }
+    // edge-edge. the culling of "IsContact_EE_CCD"
+    for(unsigned int iedge=0;iedge<3;++iedge){
+      const unsigned int i0 = iedge, i1 = (iedge+1)%3;
+      BBOX bbp = bb_vtx[0][i0];
+      bbp += bb_vtx[0][i1];
+      for(unsigned int jedge=0;jedge<3;++jedge){
+        const unsigned int j0 = jedge, j1 = (jedge+1)%3;
+        if( in[0][i0] == in[1][j0] || in[0][i0] == in[1][j1] || in[0][i1] == in[1][j0] || in[0][i1] == in[1][j1] ){ continue; }
+        BBOX bbq = bb_vtx[1][j0];
+        bbq += bb_vtx[1][j1];
+        if( !bbp.IsIntersect(bbq) ){ continue; }
+        aPairEE.PushBack(
+            ps[0][i0], ps[0][i1], ps[1][j0], ps[1][j1],
+            pe[0][i0], pe[0][i1], pe[1][j0], pe[1][j1]);
+        aCandEE.emplace_back(false, in[0][i0], in[0][i1], in[1][j0], in[1][j1]);
+      }
+    }
+  }
+  std::vector<unsigned char> aFlg;
+  IsContact_FV_CCD_Batch(aFlg, aPairFV);
+  for(unsigned int icand=0;icand<aCandFV.size();++icand){
+    if( aFlg[icand] ){ add(aCandFV[icand]); }
+  }
+  IsContact_EE_CCD_Batch(aFlg, aPairEE, 1.0e-2);
+  for(unsigned int icand=0;icand<aCandEE.size();++icand){
+    if( aFlg[icand] ){ add(aCandEE[icand]); }
+  }
+}
+
 template <typename BBOX>
 void delfem2::GetContactElement_Proximity
 (std::set<CContactElement>& aContactElem,
@@ -281,66 +622,10 @@ void delfem2::GetContactElement_Proximity
     GetContactElement_Proximity(aContactElem, delta,aXYZ,aTri, ibvh0,ichild1_1,aBVH,aBB);
   }
   else if(  is_leaf0 &&  is_leaf1 ){
-    const int itri = ichild0_0;
-    const int jtri = ichild1_0;
-    const int in0 = aTri[itri*3+0];
-    const int in1 = aTri[itri*3+1];
-    const int in2 = aTri[itri*3+2];
-    const int jn0 = aTri[jtri*3+0];
-    const int jn1 = aTri[jtri*3+1];
-    const int jn2 = aTri[jtri*3+2];
-    const CVec3d p0(aXYZ[in0*3+0], aXYZ[in0*3+1], aXYZ[in0*3+2]);
-    const CVec3d p1(aXYZ[in1*3+0], aXYZ[in1*3+1], aXYZ[in1*3+2]);
-    const CVec3d p2(aXYZ[in2*3+0], aXYZ[in2*3+1], aXYZ[in2*3+2]);
-    const CVec3d q0(aXYZ[jn0*3+0], aXYZ[jn0*3+1], aXYZ[jn0*3+2]);
-    const CVec3d q1(aXYZ[jn1*3+0], aXYZ[jn1*3+1], aXYZ[jn1*3+2]);
-    const CVec3d q2(aXYZ[jn2*3+0], aXYZ[jn2*3+1], aXYZ[jn2*3+2]);
-    if( IsContact_FV_Proximity(   in0,in1,in2,jn0, p0,p1,p2,q0, aBB[ichild0_0], delta) ){
-      aContactElem.insert( CContactElement(true,    in0,in1,in2,jn0) );
-    }
-    if( IsContact_FV_Proximity(   in0,in1,in2,jn1, p0,p1,p2,q1, aBB[ichild0_0], delta) ){
-      aContactElem.insert( CContactElement(true,    in0,in1,in2,jn1) );
-    }
-    if( IsContact_FV_Proximity(   in0,in1,in2,jn2, p0,p1,p2,q2, aBB[ichild0_0], delta) ){
-      aContactElem.insert( CContactElement(true,    in0,in1,in2,jn2) );
-    }
-    if( IsContact_FV_Proximity(   jn0,jn1,jn2,in0, q0,q1,q2,p0, aBB[ichild1_0], delta) ){
-      aContactElem.insert( CContactElement(true,    jn0,jn1,jn2,in0) );
-    }
-    if( IsContact_FV_Proximity(   jn0,jn1,jn2,in1, q0,q1,q2,p1, aBB[ichild1_0], delta) ){
-      aContactElem.insert( CContactElement(true,    jn0,jn1,jn2,in1) );
-    }
-    if( IsContact_FV_Proximity(   jn0,jn1,jn2,in2, q0,q1,q2,p2, aBB[ichild1_0], delta) ){
-      aContactElem.insert( CContactElement(true,    jn0,jn1,jn2,in2) );
-    }
-    ////
-    if( IsContact_Edge3_Edge3_Proximity(      in0,in1,jn0,jn1, p0,p1,q0,q1, delta) ){
-      aContactElem.insert( CContactElement(false,    in0,in1,jn0,jn1) );
-    }
-    if( IsContact_Edge3_Edge3_Proximity(      in0,in1,jn1,jn2, p0,p1,q1,q2, delta) ){
-      aContactElem.insert( CContactElement(false,    in0,in1,jn1,jn2) );
-    }
-    if( IsContact_Edge3_Edge3_Proximity(      in0,in1,jn2,jn0, p0,p1,q2,q0, delta) ){
-      aContactElem.insert( CContactElement(false,    in0,in1,jn2,jn0) );
-    }
-    if( IsContact_Edge3_Edge3_Proximity(      in1,in2,jn0,jn1, p1,p2,q0,q1, delta) ){
-      aContactElem.insert( CContactElement(false,    in1,in2,jn0,jn1) );
-    }
-    if( IsContact_Edge3_Edge3_Proximity(      in1,in2,jn1,jn2, p1,p2,q1,q2, delta) ){
-      aContactElem.insert( CContactElement(false,    in1,in2,jn1,jn2) );
-    }
-    if( IsContact_Edge3_Edge3_Proximity(      in1,in2,jn2,jn0, p1,p2,q2,q0, delta) ){
-      aContactElem.insert( CContactElement(false,    in1,in2,jn2,jn0) );
-    }
-    if( IsContact_Edge3_Edge3_Proximity(      in2,in0,jn0,jn1, p2,p0,q0,q1, delta) ){
-      aContactElem.insert( CContactElement(false,    in2,in0,jn0,jn1) );
-    }
-    if( IsContact_Edge3_Edge3_Proximity(      in2,in0,jn1,jn2, p2,p0,q1,q2, delta) ){
-      aContactElem.insert( CContactElement(false,    in2,in0,jn1,jn2) );
-    }
-    if( IsContact_Edge3_Edge3_Proximity(      in2,in0,jn2,jn0, p2,p0,q2,q0, delta) ){
-      aContactElem.insert( CContactElement(false,    in2,in0,jn2,jn0) );
-    }
+    ContactElement_Proximity_TriPair(
+        [&aContactElem](const CContactElement& ce){ aContactElem.insert(ce); },
+        delta, aXYZ, aTri,
+        ichild0_0, ichild1_0, aBB[ibvh0], aBB[ibvh1]);
   }
 }
 
@@ -422,73 +707,10 @@ void delfem2::GetContactElement_CCD
     GetContactElement_CCD(aContactElem, dt,delta, aXYZ,aUVW,aTri, ibvh0,    ichild1_1, aBVH,aBB);
   }
   else if(  is_leaf0 &&  is_leaf1 ){
-    const int itri = ichild0_0;
-    const int jtri = ichild1_0;
-    int in0 = aTri[itri*3+0];
-    int in1 = aTri[itri*3+1];
-    int in2 = aTri[itri*3+2];
-    int jn0 = aTri[jtri*3+0];
-    int jn1 = aTri[jtri*3+1];
-    int jn2 = aTri[jtri*3+2];
-    const CVec3d p0s(aXYZ[in0*3+0],                  aXYZ[in0*3+1],                  aXYZ[in0*3+2]);
-    const CVec3d p1s(aXYZ[in1*3+0],                  aXYZ[in1*3+1],                  aXYZ[in1*3+2]);
-    const CVec3d p2s(aXYZ[in2*3+0],                  aXYZ[in2*3+1],                  aXYZ[in2*3+2]);
-    const CVec3d q0s(aXYZ[jn0*3+0],                  aXYZ[jn0*3+1],                  aXYZ[jn0*3+2]);
-    const CVec3d q1s(aXYZ[jn1*3+0],                  aXYZ[jn1*3+1],                  aXYZ[jn1*3+2]);
-    const CVec3d q2s(aXYZ[jn2*3+0],                  aXYZ[jn2*3+1],                  aXYZ[jn2*3+2]);
-    const CVec3d p0e(aXYZ[in0*3+0]+dt*aUVW[in0*3+0], aXYZ[in0*3+1]+dt*aUVW[in0*3+1], aXYZ[in0*3+2]+dt*aUVW[in0*3+2]);
-    const CVec3d p1e(aXYZ[in1*3+0]+dt*aUVW[in1*3+0], aXYZ[in1*3+1]+dt*aUVW[in1*3+1], aXYZ[in1*3+2]+dt*aUVW[in1*3+2]);
-    const CVec3d p2e(aXYZ[in2*3+0]+dt*aUVW[in2*3+0], aXYZ[in2*3+1]+dt*aUVW[in2*3+1], aXYZ[in2*3+2]+dt*aUVW[in2*3+2]);
-    const CVec3d q0e(aXYZ[jn0*3+0]+dt*aUVW[jn0*3+0], aXYZ[jn0*3+1]+dt*aUVW[jn0*3+1], aXYZ[jn0*3+2]+dt*aUVW[jn0*3+2]);
-    const CVec3d q1e(aXYZ[jn1*3+0]+dt*aUVW[jn1*3+0], aXYZ[jn1*3+1]+dt*aUVW[jn1*3+1], aXYZ[jn1*3+2]+dt*aUVW[jn1*3+2]);
-    const CVec3d q2e(aXYZ[jn2*3+0]+dt*aUVW[jn2*3+0], aXYZ[jn2*3+1]+dt*aUVW[jn2*3+1], aXYZ[jn2*3+2]+dt*aUVW[jn2*3+2]);
-    
-    if( IsContact_FV_CCD(      in0,in1,in2,jn0, p0s,p1s,p2s,q0s, p0e,p1e,p2e,q0e, aBB[ibvh0]) ){
-      aContactElem.insert( CContactElement(true, in0,in1,in2,jn0) );
-    }
-    if( IsContact_FV_CCD(      in0,in1,in2,jn1, p0s,p1s,p2s,q1s, p0e,p1e,p2e,q1e, aBB[ibvh0]) ){
-      aContactElem.insert( CContactElement(true, in0,in1,in2,jn1) );
-    }
-    if( IsContact_FV_CCD(      in0,in1,in2,jn2, p0s,p1s,p2s,q2s, p0e,p1e,p2e,q2e, aBB[ibvh0]) ){
-      aContactElem.insert( CContactElement(true, in0,in1,in2,jn2) );
-    }
-    if( IsContact_FV_CCD(      jn0,jn1,jn2,in0, q0s,q1s,q2s,p0s, q0e,q1e,q2e,p0e, aBB[ibvh1]) ){
-      aContactElem.insert( CContactElement(true, jn0,jn1,jn2,in0) );
-    }
-    if( IsContact_FV_CCD(      jn0,jn1,jn2,in1, q0s,q1s,q2s,p1s, q0e,q1e,q2e,p1e, aBB[ibvh1]) ){
-      aContactElem.insert( CContactElement(true, jn0,jn1,jn2,in1) );
-    }
-    if( IsContact_FV_CCD(      jn0,jn1,jn2,in2, q0s,q1s,q2s,p2s, q0e,q1e,q2e,p2e, aBB[ibvh1]) ){
-      aContactElem.insert( CContactElement(true, jn0,jn1,jn2,in2) );
-    }
-    ////
-    if( IsContact_EE_CCD<BBOX>(          in0,in1,jn0,jn1, p0s,p1s,q0s,q1s,  p0e,p1e,q0e,q1e) ){
-      aContactElem.insert( CContactElement(false,  in0,in1,jn0,jn1) );
-    }
-    if( IsContact_EE_CCD<BBOX>(          in0,in1,jn1,jn2, p0s,p1s,q1s,q2s,  p0e,p1e,q1e,q2e) ){
-      aContactElem.insert( CContactElement(false,  in0,in1,jn1,jn2) );
-    }
-    if( IsContact_EE_CCD<BBOX>(          in0,in1,jn2,jn0, p0s,p1s,q2s,q0s,  p0e,p1e,q2e,q0e) ){
-      aContactElem.insert( CContactElement(false,  in0,in1,jn2,jn0) );
-    }
-    if( IsContact_EE_CCD<BBOX>(          in1,in2,jn0,jn1, p1s,p2s,q0s,q1s,  p1e,p2e,q0e,q1e) ){
-      aContactElem.insert( CContactElement(false,  in1,in2,jn0,jn1) );
-    }
-    if( IsContact_EE_CCD<BBOX>(          in1,in2,jn1,jn2, p1s,p2s,q1s,q2s,  p1e,p2e,q1e,q2e) ){
-      aContactElem.insert( CContactElement(false,  in1,in2,jn1,jn2) );
-    }
-    if( IsContact_EE_CCD<BBOX>(          in1,in2,jn2,jn0, p1s,p2s,q2s,q0s,  p1e,p2e,q2e,q0e) ){
-      aContactElem.insert( CContactElement(false,  in1,in2,jn2,jn0) );
-    }
-    if( IsContact_EE_CCD<BBOX>(          in2,in0,jn0,jn1, p2s,p0s,q0s,q1s,  p2e,p0e,q0e,q1e) ){
-      aContactElem.insert( CContactElement(false,  in2,in0,jn0,jn1) );
-    }
-    if( IsContact_EE_CCD<BBOX>(          in2,in0,jn1,jn2, p2s,p0s,q1s,q2s,  p2e,p0e,q1e,q2e) ){
-      aContactElem.insert( CContactElement(false,  in2,in0,jn1,jn2) );
-    }
-    if( IsContact_EE_CCD<BBOX>(          in2,in0,jn2,jn0, p2s,p0s,q2s,q0s,  p2e,p0e,q2e,q0e) ){
-      aContactElem.insert( CContactElement(false,  in2,in0,jn2,jn0) );
-    }
+    ContactElement_CCD_TriPair(
+        [&aContactElem](const CContactElement& ce){ aContactElem.insert(ce); },
+        dt, aXYZ, aUVW, aTri,
+        ichild0_0, ichild1_0, aBB[ibvh0], aBB[ibvh1]);
   }
 }
 
@@ -514,6 +736,251 @@ void delfem2::GetContactElement_CCD(
   GetContactElement_CCD(aContactElem, dt,delta, aXYZ,aUVW,aTri, ichild1,        aBVH,aBB);
 }
 
+namespace delfem2::srchselfintersection {
+
+/**
+ * expand the self-traversal of the sub-tree "ibvh" to the pairs of the sub-trees until there are enough
+ * tasks for the threads, then call "func_task(set, ibvh0, ibvh1)" for the tasks in parallel.
+ * "ibvh1 == -1" means the pairs inside the sub-tree "ibvh0".
+ */
+template <typename BBOX, typename FUNC_TASK>
+void ContactElement_BVH(
+    std::set<CContactElement>& aContactElem,
+    int ibvh,
+    const std::vector<CNodeBVH2>& aBVH,
+    const std::vector<BBOX>& aBB,
+    FUNC_TASK&& func_task,
+    unsigned int nthread)
+{
+  std::vector< std::pair<int,int> > aTask(1, {ibvh,-1});
+  const unsigned int nthread_loop = thread::NumThreadsForLoop(nthread);
+  const size_t ntask_min = nthread_loop*16;
+  for(unsigned int idepth=0;idepth<16 && nthread_loop > 1 && aTask.size() < ntask_min;++idepth){
+    std::vector< std::pair<int,int> > aTask1;
+    bool is_expanded = false;
+    for(const auto& task : aTask){
+      const int ibvh0 = task.first;
+      const int ibvh1 = task.second;
+      const int ichild0_0 = aBVH[ibvh0].ichild[0];
+      const int ichild0_1 = aBVH[ibvh0].ichild[1];
+      const bool is_leaf0 = (ichild0_1 == -1);
+      if( ibvh1 == -1 ){
+        if( is_leaf0 ){ continue; }
+        aTask1.emplace_back(ichild0_0,ichild0_1);
+        aTask1.emplace_back(ichild0_0,-1);
+        aTask1.emplace_back(ichild0_1,-1);
+        is_expanded = true;
+        continue;
+      }
+      if( !aBB[ibvh0].IsIntersect(aBB[ibvh1]) ){ continue; }
+      const int ichild1_0 = aBVH[ibvh1].ichild[0];
+      const int ichild1_1 = aBVH[ibvh1].ichild[1];
+      const bool is_leaf1 = (ichild1_1 == -1);
+      if( is_leaf0 && is_leaf1 ){
+        aTask1.push_back(task);
+        continue;
+      }
+      if( !is_leaf0 && !is_leaf1 ){
+        aTask1.emplace_back(ichild0_0,ichild1_0);
+        aTask1.emplace_back(ichild0_1,ichild1_0);
+        aTask1.emplace_back(ichild0_0,ichild1_1);
+        aTask1.emplace_back(ichild0_1,ichild1_1);
+      }
+      else if( !is_leaf0 ){
+        aTask1.emplace_back(ichild0_0,ibvh1);
+        aTask1.emplace_back(ichild0_1,ibvh1);
+      }
+      else{
+        aTask1.emplace_back(ibvh0,ichild1_0);
+        aTask1.emplace_back(ibvh0,ichild1_1);
+      }
+      is_expanded = true;
+    }
+    aTask.swap(aTask1);
+    if( !is_expanded ){ break; }
+  }
+  std::mutex mtx;
+  parallel_for_range(
+      static_cast<unsigned int>(aTask.size()),
+      [&](unsigned int itask0, unsigned int itask1){
+        std::set<CContactElement> aCE;
+        for(unsigned int itask=itask0;itask<itask1;++itask){
+          func_task(aCE, aTask[itask].first, aTask[itask].second);
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        aContactElem.insert(aCE.begin(), aCE.end());
+      },
+      1u, nthread);
+}
+
+}
+
+template <typename BBOX>
+void delfem2::GetContactElement_Proximity(
+    std::set<CContactElement>& aContactElem,
+    // ----------
+    double delta,
+    const std::vector<double>& aXYZ,
+    const std::vector<unsigned int>& aTri,
+    int ibvh,
+    const std::vector<CNodeBVH2>& aBVH,
+    const std::vector<BBOX>& aBB,
+    unsigned int nthread)
+{
+  srchselfintersection::ContactElement_BVH(
+      aContactElem, ibvh, aBVH, aBB,
+      [&](std::set<CContactElement>& aCE, int ibvh0, int ibvh1){
+        if( ibvh1 == -1 ){
+          GetContactElement_Proximity(aCE, delta,aXYZ,aTri, ibvh0, aBVH,aBB);
+        }
+        else{
+          GetContactElement_Proximity(aCE, delta,aXYZ,aTri, ibvh0,ibvh1, aBVH,aBB);
+        }
+      },
+      nthread);
+}
+
+template <typename BBOX>
+void delfem2::GetContactElement_CCD(
+    std::set<CContactElement>& aContactElem,
+    // ------------
+    double dt,
+    double delta,
+    const std::vector<double>& aXYZ,
+    const std::vector<double>& aUVW,
+    const std::vector<unsigned int>& aTri,
+    int ibvh,
+    const std::vector<CNodeBVH2>& aBVH,
+    const std::vector<BBOX>& aBB,
+    unsigned int nthread)
+{
+  srchselfintersection::ContactElement_BVH(
+      aContactElem, ibvh, aBVH, aBB,
+      [&](std::set<CContactElement>& aCE, int ibvh0, int ibvh1){
+        if( ibvh1 == -1 ){
+          GetContactElement_CCD(aCE, dt,delta, aXYZ,aUVW,aTri, ibvh0, aBVH,aBB);
+        }
+        else{
+          GetContactElement_CCD(aCE, dt,delta, aXYZ,aUVW,aTri, ibvh0,ibvh1, aBVH,aBB);
+        }
+      },
+      nthread);
+}
+
+// ---------------------------------------------------------------------------
+// below: spatial hash
+
+namespace delfem2::srchselfintersection {
+
+/**
+ * collect the contact elements of the pairs of the triangles in the hash.
+ * Each chunk of the triangles gathers its pairs and passes them to "func_pairs(add, pairs)" at once.
+ * The elements are accumulated locally and they are merged to the set at the end
+ */
+template <typename FUNC_PAIRS>
+void ContactElement_SpatialHash(
+    std::set<CContactElement>& aContactElem,
+    const CSpatialHash& hash,
+    FUNC_PAIRS&& func_pairs,
+    unsigned int nthread)
+{
+  std::mutex mtx;
+  parallel_for_range(
+      static_cast<unsigned int>(hash.aabb.size()),
+      [&](unsigned int itri0, unsigned int itri1){
+        std::vector< std::pair<unsigned int,unsigned int> > aTriPair;
+        for(unsigned int itri=itri0;itri<itri1;++itri){
+          hash.PairsOfElement(
+              itri,
+              [&aTriPair](unsigned int i, unsigned int j){ aTriPair.emplace_back(i,j); });
+        }
+        std::vector<CContactElement> aCE;
+        func_pairs(
+            [&aCE](const CContactElement& ce){ aCE.push_back(ce); },
+            aTriPair);
+        std::lock_guard<std::mutex> lock(mtx);
+        aContactElem.insert(aCE.begin(), aCE.end());
+      },
+      64u, nthread);
+}
+
+}
+
+inline void delfem2::GetContactElement_Proximity(
+    std::set<CContactElement>& aContactElem,
+    // ----------
+    double delta,
+    const std::vector<double>& aXYZ,
+    const std::vector<unsigned int>& aTri,
+    CSpatialHash& hash,
+    unsigned int nthread)
+{
+  const auto ntri = static_cast<unsigned int>(aTri.size()/3);
+  hash.aabb.resize(ntri);
+  parallel_for(
+      ntri,
+      [&](unsigned int itri){
+        CBV3_AABB<double>& bb = hash.aabb[itri];
+        bb.Set_Inactive();
+        for(unsigned int inode=0;inode<3;++inode){
+          bb.AddPoint(aXYZ.data()+aTri[itri*3+inode]*3, delta*0.5);
+        }
+      },
+      nthread);
+  hash.Build(0, nthread);
+  srchselfintersection::ContactElement_SpatialHash(
+      aContactElem, hash,
+      [&](const auto& add, const std::vector< std::pair<unsigned int,unsigned int> >& aTriPair){
+        for(const auto& tri_pair : aTriPair){
+          const unsigned int itri = tri_pair.first;
+          const unsigned int jtri = tri_pair.second;
+          ContactElement_Proximity_TriPair(
+              add,
+              delta, aXYZ, aTri,
+              itri, jtri, hash.aabb[itri], hash.aabb[jtri]);
+        }
+      },
+      nthread);
+}
+
+inline void delfem2::GetContactElement_CCD(
+    std::set<CContactElement>& aContactElem,
+    // --------------
+    double dt,
+    [[maybe_unused]] double delta,
+    const std::vector<double>& aXYZ,
+    const std::vector<double>& aUVW,
+    const std::vector<unsigned int>& aTri,
+    CSpatialHash& hash,
+    unsigned int nthread)
+{
+  const auto ntri = static_cast<unsigned int>(aTri.size()/3);
+  hash.aabb.resize(ntri);
+  parallel_for(
+      ntri,
+      [&](unsigned int itri){
+        CBV3_AABB<double>& bb = hash.aabb[itri];
+        bb.Set_Inactive();
+        for(unsigned int inode=0;inode<3;++inode){
+          const unsigned int ip = aTri[itri*3+inode];
+          const double pe[3] = {aXYZ[ip*3+0]+dt*aUVW[ip*3+0], aXYZ[ip*3+1]+dt*aUVW[ip*3+1], aXYZ[ip*3+2]+dt*aUVW[ip*3+2]};
+          bb.AddPoint(aXYZ.data()+ip*3, 1.0e-10);
+          bb.AddPoint(pe, 1.0e-10);
+        }
+      },
+      nthread);
+  hash.Build(0, nthread);
+  srchselfintersection::ContactElement_SpatialHash(
+      aContactElem, hash,
+      [&](const auto& add, const std::vector< std::pair<unsigned int,unsigned int> >& aTriPair){
+        ContactElement_CCD_TriPairs(
+            add,
+            dt, aXYZ, aUVW, aTri,
+            aTriPair, hash.aabb);
+      },
+      nthread);
+}
+
 // ---------------------------------------------------------------------------
 
 namespace delfem2 {
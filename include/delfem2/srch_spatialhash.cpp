@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "delfem2/srch_spatialhash.h"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <utility>
+
+namespace delfem2::spatialhash {
+
+/**
+ * upper limit of the number of the cells a box is registered to. The cells are enlarged if a box overlaps more
+ */
+constexpr double num_cell_per_elem_max = 64;
+
+/**
+ * upper limit of the number of the buckets. The cells are enlarged if the registrations need more
+ */
+constexpr std::uint64_t num_bucket_max = std::uint64_t(1) << 30;
+
+/**
+ * number of the cells overlapped by a box. Computed in floating point so that it never overflows
+ */
+DFM2_INLINE double NumCell(
+    const CBV3_AABB<double> &bb,
+    double cell_size) {
+  double n = 1;
+  for (unsigned int idim = 0; idim < 3; ++idim) {
+    n *= std::floor(bb.bbmax[idim] / cell_size) - std::floor(bb.bbmin[idim] / cell_size) + 1;
+  }
+  return n;
+}
+
+}
+
+DFM2_INLINE void delfem2::CSpatialHash::Build(
+    double cell_size_,
+    unsigned int nthread) {
+  const auto nelem = static_cast<unsigned int>(aabb.size());
+  if (cell_size_ > 0) {
+    cell_size = cell_size_;
+  } else {
+    double sum = 0.0;
+    unsigned int nactive = 0;
+    for (const auto &bb: aabb) {
+      if (!bb.IsActive()) { continue; }
+      sum += bb.MaxLength();
+      nactive++;
+    }
+    cell_size = (nactive > 0 && sum > 0) ? sum / nactive : 1.0;
+  }
+  { // enlarge the cells if a box is too large for them (e.g., a huge box or a too small "cell_size_")
+    auto count_cell = [&]() {  // (maximum number of the cells of a box, total number of the cells)
+      return parallel_reduce(
+          nelem, std::make_pair(0., 0.),
+          [&](unsigned int ib, unsigned int ie, std::pair<double, double> n) {
+            for (unsigned int ielem = ib; ielem < ie; ++ielem) {
+              if (!aabb[ielem].IsActive()) { continue; }
+              const double ncell = spatialhash::NumCell(aabb[ielem], cell_size);
+              n.first = std::max(n.first, ncell);
+              n.second += ncell;
+            }
+            return n;
+          },
+          [](const std::pair<double, double> &a, const std::pair<double, double> &b) {
+            return std::make_pair(std::max(a.first, b.first), a.second + b.second);
+          },
+          0u, nthread);
+    };
+    const double nentry_max = static_cast<double>(spatialhash::num_bucket_max / 2);
+    for (auto n = count_cell();
+         n.first > spatialhash::num_cell_per_elem_max || n.second > nentry_max;
+         n = count_cell()) {
+      cell_size *= 2;
+    }
+  }
+  // number of the cells overlapped by each element
+  elem_ind.assign(nelem + 1, 0);
+  parallel_for(
+      nelem,
+      [&](unsigned int ielem) {
+        const CBV3_AABB<double> &bb = aabb[ielem];
+        if (!bb.IsActive()) { return; }
+        std::int64_t n = 1;
+        for (unsigned int idim = 0; idim < 3; ++idim) {
+          n *= CellIndex(bb.bbmax[idim]) - CellIndex(bb.bbmin[idim]) + 1;
+        }
+        elem_ind[ielem + 1] = static_cast<unsigned int>(n);
+      },
+      nthread);
+  for (unsigned int ielem = 0; ielem < nelem; ++ielem) {
+    elem_ind[ielem + 1] += elem_ind[ielem];
+  }
+  const unsigned int nentry = elem_ind[nelem];
+  {  // in 64 bit. "nentry" is at most half of "num_bucket_max" above
+    std::uint64_t nb = 1;
+    while (nb < std::uint64_t(nentry) * 2 && nb < spatialhash::num_bucket_max) { nb *= 2; }
+    num_bucket = static_cast<unsigned int>(nb);
+  }
+  elem_bucket.resize(nentry);
+  std::unique_ptr<std::atomic<unsigned int>[]> aCount(new std::atomic<unsigned int>[num_bucket + 1]);
+  for (unsigned int ibucket = 0; ibucket < num_bucket + 1; ++ibucket) {
+    aCount[ibucket].store(0, std::memory_order_relaxed);
+  }
+  parallel_for(
+      nelem,
+      [&](unsigned int ielem) {
+        const CBV3_AABB<double> &bb = aabb[ielem];
+        if (!bb.IsActive()) { return; }
+        const std::int64_t i0[3] = {CellIndex(bb.bbmin[0]), CellIndex(bb.bbmin[1]), CellIndex(bb.bbmin[2])};
+        const std::int64_t i1[3] = {CellIndex(bb.bbmax[0]), CellIndex(bb.bbmax[1]), CellIndex(bb.bbmax[2])};
+        unsigned int ie = elem_ind[ielem];
+        for (std::int64_t iz = i0[2]; iz <= i1[2]; ++iz) {
+          for (std::int64_t iy = i0[1]; iy <= i1[1]; ++iy) {
+            for (std::int64_t ix = i0[0]; ix <= i1[0]; ++ix) {
+              const unsigned int ibucket = Bucket(ix, iy, iz);
+              elem_bucket[ie++] = ibucket;
+              aCount[ibucket + 1].fetch_add(1, std::memory_order_relaxed);
+            }
+          }
+        }
+      },
+      nthread);
+  // counting sort of the registrations by the bucket
+  bucket_ind.resize(num_bucket + 1);
+  bucket_ind[0] = 0;
+  for (unsigned int ibucket = 0; ibucket < num_bucket; ++ibucket) {
+    bucket_ind[ibucket + 1] = bucket_ind[ibucket] + aCount[ibucket + 1].load(std::memory_order_relaxed);
+    aCount[ibucket].store(bucket_ind[ibucket], std::memory_order_relaxed);
+  }
+  bucket_elem.resize(nentry);
+  parallel_for(
+      nelem,
+      [&](unsigned int ielem) {
+        for (unsigned int ie = elem_ind[ielem]; ie < elem_ind[ielem + 1]; ++ie) {
+          const unsigned int ipos = aCount[elem_bucket[ie]].fetch_add(1, std::memory_order_relaxed);
+          bucket_elem[ipos] = ielem;
+        }
+      },
+      nthread);
+  // the order in a bucket depends on the threads. sort for the deterministic result
+  parallel_for(
+      num_bucket,
+      [&](unsigned int ibucket) {
+        std::sort(bucket_elem.begin() + bucket_ind[ibucket],
+                  bucket_elem.begin() + bucket_ind[ibucket + 1]);
+      },
+      nthread);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * @file spatial hash of axis aligned bounding boxes for the broad phase of the collision detection
+ * @details each box is registered to all the cells of the uniform grid it overlaps.
+ * The cells are hashed to a table whose size is proportional to the number of the registrations,
+ * so that the memory does not depend on the extent of the scene.
+ * The table is built with the counting sort in O(n). This works well if the sizes of the boxes are similar
+ * (e.g., cloth with near uniform triangles), otherwise the BVH is better.
+ */
+
+#ifndef DFM2_SRCH_SPATIALHASH_H
+#define DFM2_SRCH_SPATIALHASH_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+#include "delfem2/srch_bv3_aabb.h"
+#include "delfem2/thread.h"
+#include "delfem2/dfm2_inline.h"
+
+namespace delfem2 {
+
+class CSpatialHash {
+ public:
+  /**
+   * @brief register the boxes in "aabb" to the table
+   * @param cell_size_ size of the cells. If zero or negative, the average of the largest sides of the boxes.
+   * The cells are enlarged (doubled) until every box overlaps at most 64 cells, so a few huge boxes make the cells
+   * coarse and the broad phase slow but the memory stays bounded. Use the BVH for such scenes.
+   * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+   */
+  DFM2_INLINE void Build(
+      double cell_size_ = 0,
+      unsigned int nthread = 0);
+
+  /**
+   * @brief call "func(ielem,j)" for each box "j" (ielem<j) intersecting the box "ielem". Each pair is reported once
+   */
+  template<typename FUNC>
+  void PairsOfElement(
+      unsigned int ielem,
+      FUNC &&func) const;
+
+  /**
+   * @brief call "func(i,j)" once for each pair (i<j) of the intersecting boxes
+   * @details "func" is called concurrently from the threads if "nthread" is not 1.
+   * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+   */
+  template<typename FUNC>
+  void ForEachPair(
+      FUNC &&func,
+      unsigned int nthread = 0) const {
+    parallel_for(
+        static_cast<unsigned int>(aabb.size()),
+        [&](unsigned int ielem) { PairsOfElement(ielem, func); },
+        nthread);
+  }
+
+  /**
+   * @return index of the bucket of a cell
+   */
+  [[nodiscard]] unsigned int Bucket(std::int64_t ix, std::int64_t iy, std::int64_t iz) const {
+    const std::uint64_t h = (static_cast<std::uint64_t>(ix) * 73856093u)
+        ^ (static_cast<std::uint64_t>(iy) * 19349663u)
+        ^ (static_cast<std::uint64_t>(iz) * 83492791u);
+    return static_cast<unsigned int>(h & (num_bucket - 1));
+  }
+
+  [[nodiscard]] std::int64_t CellIndex(double x) const {
+    return static_cast<std::int64_t>(std::floor(x / cell_size));
+  }
+
+ public:
+  /**
+   * bounding box of each element. Set this before calling "Build()". Inactive boxes are not registered
+   */
+  std::vector<CBV3_AABB<double>> aabb;
+  double cell_size = 1;
+  unsigned int num_bucket = 1;  // power of two
+  /**
+   * jagged array of the elements registered to each bucket. The elements in a bucket are sorted
+   */
+  std::vector<unsigned int> bucket_ind;
+  std::vector<unsigned int> bucket_elem;
+  std::vector<unsigned int> elem_ind;  // registrations of each element start at this
+  std::vector<unsigned int> elem_bucket;  // bucket of each registration
+};
+
+} // namespace delfem2
+
+// -------------------------------------------
+
+template<typename FUNC>
+void delfem2::CSpatialHash::PairsOfElement(
+    unsigned int ielem,
+    FUNC &&func) const {
+  if (elem_ind.size() != aabb.size() + 1) { return; } // not built
+  const CBV3_AABB<double> &bbi = aabb[ielem];
+  if (!bbi.IsActive()) { return; }
+  const std::int64_t i0[3] = {CellIndex(bbi.bbmin[0]), CellIndex(bbi.bbmin[1]), CellIndex(bbi.bbmin[2])};
+  const std::int64_t i1[3] = {CellIndex(bbi.bbmax[0]), CellIndex(bbi.bbmax[1]), CellIndex(bbi.bbmax[2])};
+  for (std::int64_t iz = i0[2]; iz <= i1[2]; ++iz) {
+    for (std::int64_t iy = i0[1]; iy <= i1[1]; ++iy) {
+      for (std::int64_t ix = i0[0]; ix <= i1[0]; ++ix) {
+        const unsigned int ibucket = Bucket(ix, iy, iz);
+        for (unsigned int ie = bucket_ind[ibucket]; ie < bucket_ind[ibucket + 1]; ++ie) {
+          const unsigned int jelem = bucket_elem[ie];
+          if (jelem <= ielem) { continue; }
+          if (ie > bucket_ind[ibucket] && bucket_elem[ie - 1] == jelem) { continue; } // registered twice
+          const CBV3_AABB<double> &bbj = aabb[jelem];
+          if (!bbi.IsIntersect(bbj)) { continue; }
+          // report the pair only in the cell of the minimum corner of the intersection.
+          // this also removes the elements in the same bucket by the hash collision
+          const double cx = (bbi.bbmin[0] > bbj.bbmin[0]) ? bbi.bbmin[0] : bbj.bbmin[0];
+          const double cy = (bbi.bbmin[1] > bbj.bbmin[1]) ? bbi.bbmin[1] : bbj.bbmin[1];
+          const double cz = (bbi.bbmin[2] > bbj.bbmin[2]) ? bbi.bbmin[2] : bbj.bbmin[2];
+          if (CellIndex(cx) != ix || CellIndex(cy) != iy || CellIndex(cz) != iz) { continue; }
+          func(ielem, jelem);
+        }
+      }
+    }
+  }
+}
+
+#ifndef DFM2_STATIC_LIBRARY
+#  include "delfem2/srch_spatialhash.cpp"
+#endif
+
+#endif /* DFM2_SRCH_SPATIALHASH_H */
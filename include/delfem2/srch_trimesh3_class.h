@@ -14,6 +14,8 @@
 
 #include <cmath>
 #include <vector>
+#include <limits>
+#include <algorithm>
 
 #include "delfem2/srch_bruteforce.h" // CPointElemSurf
 #include "delfem2/srch_bvh.h"
@@ -29,12 +31,16 @@
 
 namespace delfem2 {
 
+/**
+ * @param nthread number of threads for the linear BVH. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool"
+ */
 template<class BV>
 void ConstructBVHTriangleMeshMortonCode(
     std::vector<delfem2::CNodeBVH2> &aNodeBVH,
     std::vector<BV> &aAABB,
     const std::vector<double> &aXYZ,
-    const std::vector<unsigned int> &aTri) {
+    const std::vector<unsigned int> &aTri,
+    unsigned int nthread = 1) {
   namespace dfm2 = delfem2;
   assert(!aTri.empty());
   std::vector<double> vec_center_of_tri;
@@ -50,11 +56,11 @@ void ConstructBVHTriangleMeshMortonCode(
   std::vector<std::uint32_t> aSortedMc;
   dfm2::SortedMortenCode_Points3(
       aSortedId, aSortedMc,
-      vec_center_of_tri, min_xyz, max_xyz);
+      vec_center_of_tri, min_xyz, max_xyz, nthread);
   assert(!aSortedMc.empty() && !aSortedId.empty());
   dfm2::BVHTopology_Morton(
       aNodeBVH,
-      aSortedId, aSortedMc);
+      aSortedId, aSortedMc, nthread);
 #ifndef NDEBUG
   dfm2::Check_MortonCode_Sort(
       aSortedId, aSortedMc, vec_center_of_tri,
@@ -66,10 +72,16 @@ void ConstructBVHTriangleMeshMortonCode(
       1.0e-10,
       aXYZ.data(), aXYZ.size() / 3,
       aTri.data(), aTri.size() / 3, 3);
-  dfm2::BVH_BuildBVHGeometry(
-      aAABB,
-      0, aNodeBVH,
-      lvm);
+  if (nthread == 1) {
+    dfm2::BVH_BuildBVHGeometry(
+        aAABB,
+        0, aNodeBVH,
+        lvm);
+  } else {
+    dfm2::BVH_BuildBVHGeometry_BottomUp(
+        aAABB,
+        aNodeBVH, lvm, nthread);
+  }
 #ifndef NDEBUG
   dfm2::Check_BVH(aNodeBVH, vec_center_of_tri.size() / 3);
 #endif
@@ -177,13 +189,20 @@ class CBVH_MeshTri3D {
  public:
   CBVH_MeshTri3D() :
       iroot_bvh(0) {}
+  /**
+   * @param nthread if not 1, the linear BVH is made from the morton codes in parallel and the volumes are
+   * fitted from the leaves. 0 uses all the threads of "delfem2::ThreadPool". If 1, the tree is made top-down
+   * serially. The number is kept for the updates and the rebuilds
+   */
   void Init(
       const double *pXYZ,
       size_t nXYZ,
       const unsigned int *pTri,
       size_t nTri,
-      double margin) {
+      double margin,
+      unsigned int nthread = 1) {
     assert(margin >= 0);
+    nthread_build = nthread;
     { // make BVH topology
       std::vector<double> aElemCenter(nTri * 3);
       for (unsigned int itri = 0; itri < nTri; ++itri) {
@@ -197,7 +216,7 @@ class CBVH_MeshTri3D {
         aElemCenter[itri * 3 + 1] = y0;
         aElemCenter[itri * 3 + 2] = z0;
       }
-      {
+      if (nthread_build == 1) {
         std::vector<unsigned int> aTriSuTri;
         ElSuEl_MeshElem(aTriSuTri,
                         pTri, nTri,
@@ -205,12 +224,39 @@ class CBVH_MeshTri3D {
         iroot_bvh = BVHTopology_TopDown_MeshElem(aNodeBVH,
                                                  3, aTriSuTri,
                                                  aElemCenter);
+      } else {
+        double min_xyz[3] = {0, 0, 0}, max_xyz[3] = {0, 0, 0};
+        BoundingBox3_Points3(min_xyz, max_xyz,
+                             aElemCenter.data(), nTri);
+        const double eps = 1.0e-3 * std::max({max_xyz[0] - min_xyz[0], max_xyz[1] - min_xyz[1],
+                                              max_xyz[2] - min_xyz[2], 1.0e-10});
+        for (int idim = 0; idim < 3; ++idim) {  // the codes are not defined for the flat box
+          min_xyz[idim] -= eps;
+          max_xyz[idim] += eps;
+        }
+        std::vector<unsigned int> aSortedId;
+        std::vector<std::uint32_t> aSortedMc;
+        SortedMortenCode_Points3(aSortedId, aSortedMc,
+                                 aElemCenter, min_xyz, max_xyz, nthread_build);
+        BVHTopology_Morton(aNodeBVH,
+                           aSortedId, aSortedMc, nthread_build);
+        iroot_bvh = 0;
       }
     }
     this->UpdateGeometry(pXYZ, nXYZ,
                          pTri, nTri,
                          margin);
     assert(aBB_BVH.size() == aNodeBVH.size());
+    BVH_LeafNodeOfElement(
+        aElem2Leaf,
+        nTri, aNodeBVH);
+    JArray_ElSuP_MeshElem(
+        elsup_ind, elsup,
+        pTri, nTri, 3, nXYZ);
+    aFlgNodeDirty.assign(aNodeBVH.size(), 0);
+    sum_area = BVH_SumSurfaceArea(iroot_bvh, aNodeBVH, aBB_BVH);
+    sah_cost_rebuild = this->SAHCost();
+    num_update_unchecked = 0;
   }
   void UpdateGeometry(
       const double *pXYZ,
@@ -223,12 +269,73 @@ class CBVH_MeshTri3D {
         margin,
         pXYZ, nXYZ,
         pTri, nTri, 3);
-    BVH_BuildBVHGeometry(
-        aBB_BVH,
-        //
-        iroot_bvh, aNodeBVH,
-        lvm);
+    if (nthread_build == 1) {
+      BVH_BuildBVHGeometry(
+          aBB_BVH,
+          //
+          iroot_bvh, aNodeBVH,
+          lvm);
+    } else {
+      BVH_BuildBVHGeometry_BottomUp(
+          aBB_BVH,
+          aNodeBVH, lvm, nthread_build);
+    }
     assert(aBB_BVH.size() == aNodeBVH.size());
+    sum_area = -1;  // computed on request
+  }
+  /**
+   * @brief incremental update of the bounding volumes for a deforming mesh
+   * @details only the volumes of the triangles around the moved vertices and their ancestors are refitted.
+   * Once every "num_update_check_rebuild" calls, the SAH cost is checked and the topology is rebuilt by "Init()"
+   * when the cost is larger than "ratio_rebuild" times the cost right after the last "Init()".
+   * The mesh connectivity must be the same as the one given to "Init()".
+   * @param aIndVtxMoved indexes of the vertices that moved since the last update
+   * @return true if the topology is rebuilt
+   */
+  bool UpdateGeometry_MovedVertices(
+      const double *pXYZ,
+      size_t nXYZ,
+      const unsigned int *pTri,
+      size_t nTri,
+      double margin,
+      const unsigned int *aIndVtxMoved,
+      size_t nIndVtxMoved) {
+    assert(margin >= 0);
+    assert(elsup_ind.size() == nXYZ + 1);
+    aIndTriDirty.clear();
+    for (unsigned int iiv = 0; iiv < nIndVtxMoved; ++iiv) {
+      const unsigned int ivtx = aIndVtxMoved[iiv];
+      aIndTriDirty.insert(aIndTriDirty.end(),
+                          elsup.begin() + elsup_ind[ivtx],
+                          elsup.begin() + elsup_ind[ivtx + 1]);
+    }
+    CLeafVolumeMaker_Mesh<BV, REAL> lvm(
+        margin,
+        pXYZ, nXYZ,
+        pTri, nTri, 3);
+    BVH_RefitElements(
+        aBB_BVH, aFlgNodeDirty, sum_area >= 0 ? &sum_area : nullptr,
+        aIndTriDirty.data(), aIndTriDirty.size(), aElem2Leaf,
+        iroot_bvh, aNodeBVH, lvm);
+    if (++num_update_unchecked < num_update_check_rebuild) { return false; }
+    num_update_unchecked = 0;
+    if (sum_area < 0) { sum_area = BVH_SumSurfaceArea(iroot_bvh, aNodeBVH, aBB_BVH); }
+    if (this->SAHCost() <= ratio_rebuild * sah_cost_rebuild) { return false; }
+    this->Init(pXYZ, nXYZ,
+               pTri, nTri,
+               margin, nthread_build);
+    return true;
+  }
+  /**
+   * @brief cost of the tree in the surface area heuristic. The sum of the surface areas of the nodes
+   * divided by the one of the root
+   * @details the whole tree is traversed if the sum is not kept up to date since the last "UpdateGeometry()"
+   */
+  [[nodiscard]] double SAHCost() const {
+    const double area_root = aBB_BVH[iroot_bvh].SurfaceArea();
+    if (area_root <= 0) { return 0; }
+    if (sum_area < 0) { return BVH_SumSurfaceArea(iroot_bvh, aNodeBVH, aBB_BVH) / area_root; }
+    return sum_area / area_root;
   }
   double Nearest_Point_IncludedInBVH(
       PointOnSurfaceMesh<REAL> &pes,
@@ -312,6 +419,17 @@ class CBVH_MeshTri3D {
   int iroot_bvh;
   std::vector<delfem2::CNodeBVH2> aNodeBVH; // array of BVH node
   std::vector<BV> aBB_BVH;
+  unsigned int nthread_build = 1;  // number of threads given to "Init()"
+  // below: for the incremental update
+  double ratio_rebuild = 1.5;
+  unsigned int num_update_check_rebuild = 8;  // the SAH cost is checked once every this number of updates
+  unsigned int num_update_unchecked = 0;
+  double sum_area = -1;  // sum of the surface areas of the nodes except the root. negative if not computed
+  double sah_cost_rebuild = 0;  // SAH cost right after the last rebuild
+  std::vector<unsigned int> aElem2Leaf;
+  std::vector<unsigned int> elsup_ind, elsup;
+  std::vector<unsigned char> aFlgNodeDirty;
+  std::vector<unsigned int> aIndTriDirty;
 };
 
 template<typename T, typename REAL>
@@ -423,6 +541,72 @@ void Project_PointsIncludedInBVH_Outside_Cache(
   }
 }
 
+/**
+ * @brief the closest intersection of a ray and a triangle mesh
+ * @details the nodes are visited nearer first and the nodes farther than the current closest hit are culled.
+ * No heap memory is allocated unless the tree is extremely unbalanced
+ * @param[out] pos_mesh intersection point. not changed if there is no intersection
+ * @param[out] depth_hit the intersection point is at "src1+depth_hit*dir1"
+ * @param bvh_nodes pointer to the BVH nodes (e.g., mapped from a file by "CBVH_MeshBinaryView"). nullptr if empty
+ * @return false if there is no intersection
+ */
+template<typename BV>
+bool Intersection_Ray3_Tri3_Bvh(
+    PointOnSurfaceMesh<double> &pos_mesh,
+    double &depth_hit,
+    const CVec3d &src1,
+    const CVec3d &dir1,
+    const std::vector<double> &vec_xyz,
+    const std::vector<unsigned int> &vec_tri,
+    const CNodeBVH2 *bvh_nodes,
+    const BV *bvh_volumes) {
+  if (bvh_nodes == nullptr) { return false; }
+  const double dir_sqnorm = dir1.squaredNorm();
+  double depth_min = std::numeric_limits<double>::max();
+  bool is_hit = false;
+  BVH_TraverseOrdered(
+      depth_min, 0, bvh_nodes,
+      [&](unsigned int ibvh) {
+        double tmin, tmax;
+        if (!bvh_volumes[ibvh].Range_RayParameter(tmin, tmax, src1.p, dir1.p) || tmax < 0) {
+          return std::numeric_limits<double>::infinity();
+        }
+        return (tmin > 0) ? tmin : 0.0;
+      },
+      [&](unsigned int itri, double &depth_cur) {
+        const unsigned int *tri = vec_tri.data() + itri * 3;
+        const CVec3d p0(vec_xyz.data() + tri[0] * 3);
+        const CVec3d p1(vec_xyz.data() + tri[1] * 3);
+        const CVec3d p2(vec_xyz.data() + tri[2] * 3);
+        double r0, r1;
+        if (!IntersectRay_Tri3(r0, r1, src1, dir1, p0, p1, p2, 1.0e-10)) { return; }
+        const CVec3d q0 = p0 * r0 + p1 * r1 + p2 * (1 - r0 - r1);
+        const double depth = (q0 - src1).dot(dir1) / dir_sqnorm;
+        if (depth < 0 || depth >= depth_cur) { return; }
+        depth_cur = depth;
+        pos_mesh = PointOnSurfaceMesh<double>(itri, r0, r1);
+        is_hit = true;
+      });
+  if (is_hit) { depth_hit = depth_min; }
+  return is_hit;
+}
+
+template<typename BV>
+bool Intersection_Ray3_Tri3_Bvh(
+    PointOnSurfaceMesh<double> &pos_mesh,
+    double &depth_hit,
+    const CVec3d &src1,
+    const CVec3d &dir1,
+    const std::vector<double> &vec_xyz,
+    const std::vector<unsigned int> &vec_tri,
+    const std::vector<CNodeBVH2> &bvh_nodes,
+    const std::vector<BV> &bvh_volumes) {
+  if (bvh_nodes.empty()) { return false; }
+  return Intersection_Ray3_Tri3_Bvh(
+      pos_mesh, depth_hit,
+      src1, dir1, vec_xyz, vec_tri, bvh_nodes.data(), bvh_volumes.data());
+}
+
 template<typename BV>
 bool Intersection_Ray3_Tri3_Bvh(
     PointOnSurfaceMesh<double> &pos_mesh,
@@ -432,22 +616,95 @@ bool Intersection_Ray3_Tri3_Bvh(
     const std::vector<unsigned int> &vec_tri,
     const std::vector<CNodeBVH2> &bvh_nodes,
     const std::vector<BV> &bvh_volumes) {
-  std::vector<unsigned int> aIndElem;
-  BVH_GetIndElem_Predicate(
-      aIndElem,
-      CIsBV_IntersectLine<BV, double>(src1.p, dir1.p),
-      0, bvh_nodes, bvh_volumes);
-  if (aIndElem.empty()) { return false; } // no bv hit the ray
-  std::map<double, PointOnSurfaceMesh<double>> mapDepthPES;
-  IntersectionRay_MeshTri3DPart(
-      mapDepthPES,
-      src1, dir1,
-      vec_tri, vec_xyz, aIndElem, 1.0e-10);
-  if (mapDepthPES.empty()) { return false; }
-  pos_mesh = mapDepthPES.begin()->second;
-  return true;
+  double depth;
+  return Intersection_Ray3_Tri3_Bvh(
+      pos_mesh, depth,
+      src1, dir1, vec_xyz, vec_tri, bvh_nodes, bvh_volumes);
 }
 
+/**
+ * @brief closest intersections of many rays and a triangle mesh
+ * @details the rays are distributed over the threads in the given order.
+ * Neighbouring rays should be coherent (e.g., the pixels in a tile) for the cache efficiency.
+ * @param[out] aPosMesh intersection point of each ray. "itri==UINT_MAX" if the ray does not hit
+ * @param ray_src (num_ray x 3) array of the ray origins
+ * @param ray_dir (num_ray x 3) array of the ray directions
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ */
+template<typename BV>
+void Intersection_Rays3_Tri3_Bvh(
+    std::vector<PointOnSurfaceMesh<double> > &aPosMesh,
+    const double *ray_src,
+    const double *ray_dir,
+    size_t num_ray,
+    const std::vector<double> &vec_xyz,
+    const std::vector<unsigned int> &vec_tri,
+    const std::vector<CNodeBVH2> &bvh_nodes,
+    const std::vector<BV> &bvh_volumes,
+    unsigned int nthread = 0) {
+  aPosMesh.assign(num_ray, PointOnSurfaceMesh<double>());
+  parallel_for_range(
+      num_ray,
+      [&](size_t ib, size_t ie) {
+        for (size_t iray = ib; iray < ie; ++iray) {
+          Intersection_Ray3_Tri3_Bvh(
+              aPosMesh[iray],
+              CVec3d(ray_src + iray * 3), CVec3d(ray_dir + iray * 3),
+              vec_xyz, vec_tri, bvh_nodes, bvh_volumes);
+        }
+      },
+      static_cast<size_t>(64), nthread);
+}
+
+/**
+ * @brief nearest points on a triangle mesh for many query points
+ * @details same result as "BVH_NearestPoint_MeshTri3D" but the traversal is nearer first without the recursion
+ * @param[out] aPes nearest point on the mesh for each query point
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ */
+template<typename BV>
+void Nearest_Points3_Tri3_Bvh(
+    std::vector<PointOnSurfaceMesh<double> > &aPes,
+    const double *points,
+    size_t num_point,
+    const std::vector<double> &vec_xyz,
+    const std::vector<unsigned int> &vec_tri,
+    const std::vector<CNodeBVH2> &bvh_nodes,
+    const std::vector<BV> &bvh_volumes,
+    unsigned int nthread = 0) {
+  aPes.assign(num_point, PointOnSurfaceMesh<double>());
+  if (bvh_nodes.empty()) { return; }
+  parallel_for_range(
+      num_point,
+      [&](size_t ib, size_t ie) {
+        for (size_t ip = ib; ip < ie; ++ip) {
+          const CVec3d p0(points + ip * 3);
+          double dist_min = std::numeric_limits<double>::max();
+          BVH_TraverseOrdered(
+              dist_min, 0, bvh_nodes,
+              [&](unsigned int ibvh) {
+                double min0 = +1.0, max0 = -1.0;
+                bvh_volumes[ibvh].Range_DistToPoint(min0, max0, p0.x, p0.y, p0.z);
+                if (max0 < min0) { return std::numeric_limits<double>::infinity(); }  // inactive
+                return min0;
+              },
+              [&](unsigned int itri, double &dist_cur) {
+                PointOnSurfaceMesh<double> pes_tmp;
+                const double dist = DistanceToTri(pes_tmp, p0, itri, vec_xyz, vec_tri);
+                if (dist >= dist_cur) { return; }
+                dist_cur = dist;
+                aPes[ip] = pes_tmp;
+              });
+        }
+      },
+      static_cast<size_t>(64), nthread);
+}
+
+/**
+ * @brief closest intersection of the ray of each pixel of an image and a triangle mesh
+ * @details the image is processed in square tiles of pixels so the rays traversed by a thread are coherent
+ * @param[out] aPointElemSurf (nheight x nwidth) array. "itri==UINT_MAX" for the pixels whose ray does not hit
+ */
 template<typename BV>
 void Intersection_ImageRay_TriMesh3(
     std::vector<delfem2::PointOnSurfaceMesh<double> > &aPointElemSurf,
@@ -459,36 +716,33 @@ void Intersection_ImageRay_TriMesh3(
     const std::vector<double> &aXYZ, // 3d points
     const std::vector<unsigned int> &aTri,
     bool is_parallel) {
-  aPointElemSurf.resize(nheight * nwidth);
+  aPointElemSurf.assign(nheight * nwidth, PointOnSurfaceMesh<double>());
   const std::array<double, 16> mMVPd_inv = Inverse_Mat4(mMVPd);
-  auto func = [&](int ih, int iw) {
-    const std::pair<CVec3d, CVec3d> ray = RayFromInverseMvpMatrix(mMVPd_inv.data(), iw, ih, nwidth, nheight);
-    PointOnSurfaceMesh<double> pos_mesh;
-    bool is_hit = Intersection_Ray3_Tri3_Bvh(
-        pos_mesh,
-        ray.first, ray.second,
-        aXYZ, aTri, aNodeBVH, aAABB);
-    if (!is_hit) { return; }
-    aPointElemSurf[ih * nwidth + iw] = pos_mesh;
-  };
-  if( is_parallel ) {
-    parallel_for(nwidth, nheight, func);
-  }
-  else {
-    for (unsigned int ih = 0; ih < nheight; ++ih) {
-      for (unsigned int iw = 0; iw < nwidth; ++iw) {
-        func(ih, iw);
-      }
-    }
-  }
+  parallel_for_tile(
+      nwidth, nheight, 8u,
+      [&](unsigned int iw, unsigned int ih) {
+        const std::pair<CVec3d, CVec3d> ray = RayFromInverseMvpMatrix(
+            mMVPd_inv.data(), iw, ih, nwidth, nheight);
+        Intersection_Ray3_Tri3_Bvh(
+            aPointElemSurf[ih * nwidth + iw],
+            ray.first, ray.second,
+            aXYZ, aTri, aNodeBVH, aAABB);
+      },
+      is_parallel ? 0u : 1u);
 }
 
+/**
+ * @brief build the linear BVH of a triangle mesh from the morton codes of the triangle centers
+ * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+ * The tree does not depend on the number of threads.
+ */
 template<typename BV>
 void BuildBVH_MeshTri3D_Morton(
     std::vector<CNodeBVH2> &aNodeBVH,
     std::vector<BV> &aAABB,
     const std::vector<double> &aXYZ, // 3d points
-    const std::vector<unsigned int> &aTri) {
+    const std::vector<unsigned int> &aTri,
+    unsigned int nthread = 1) {
   std::vector<double> aCent;
   double rad = CentsMaxRad_MeshTri3(
       aCent,
@@ -505,13 +759,13 @@ void BuildBVH_MeshTri3D_Morton(
   std::vector<unsigned int> aSortedId;
   std::vector<std::uint32_t> aSortedMc;
   SortedMortenCode_Points3(aSortedId, aSortedMc,
-                           aCent, min_xyz, max_xyz);
+                           aCent, min_xyz, max_xyz, nthread);
 #ifndef NDEBUG
   Check_MortonCode_Sort(aSortedId, aSortedMc, aCent, min_xyz, max_xyz);
   Check_MortonCode_RangeSplit(aSortedMc);
 #endif
   BVHTopology_Morton(aNodeBVH,
-                     aSortedId, aSortedMc);
+                     aSortedId, aSortedMc, nthread);
 #ifndef NDEBUG
   Check_BVH(aNodeBVH, aCent.size() / 3);
 #endif
@@ -519,9 +773,14 @@ void BuildBVH_MeshTri3D_Morton(
       1.0e-10,
       aXYZ.data(), aXYZ.size() / 3,
       aTri.data(), aTri.size() / 3, 3);
-  BVH_BuildBVHGeometry(aAABB,
-                       0, aNodeBVH,
-                       lvm);
+  if (nthread == 1) {
+    BVH_BuildBVHGeometry(aAABB,
+                         0, aNodeBVH,
+                         lvm);
+  } else {
+    BVH_BuildBVHGeometry_BottomUp(aAABB,
+                                  aNodeBVH, lvm, nthread);
+  }
 }
 
 } // namespace delfem2
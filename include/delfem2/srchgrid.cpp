@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "delfem2/srchgrid.h"
+
+#include <atomic>
+#include <memory>
+
+namespace delfem2::srchgrid {
+
+// spread the lower 21 bits to every third bit
+DFM2_INLINE std::uint64_t SpreadBits3(std::uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8) & 0x100f00f00f00f00fULL;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2) & 0x1249249249249249ULL;
+  return v;
+}
+
+}  // namespace delfem2::srchgrid
+
+// -------------------------------------------
+
+DFM2_INLINE void delfem2::CCellList3::Initialize(
+    const double bbmin_[3],
+    const double bbmax_[3],
+    double radius_,
+    DOMAIN_TYPE domain_) {
+  namespace lcl = delfem2::srchgrid;
+  domain = domain_;
+  radius = radius_;
+  cell_ind.clear();
+  cell_morton.clear();
+  if (domain == DOMAIN_TYPE::UNBOUNDED) {
+    for (unsigned int idim = 0; idim < 3; ++idim) {
+      bbmin[idim] = 0;
+      bbmax[idim] = 0;
+      cell_size[idim] = radius;
+      ndiv[idim] = 1;
+    }
+    num_cell = 1;  // set in "Build" from the number of the points
+    return;
+  }
+  for (unsigned int idim = 0; idim < 3; ++idim) {
+    bbmin[idim] = bbmin_[idim];
+    bbmax[idim] = bbmax_[idim];
+    const double len = bbmax[idim] - bbmin[idim];
+    // the periodic cells need to be as large as the radius. The bounded cells may be smaller at the end
+    const double n = (domain == DOMAIN_TYPE::PERIODIC) ? std::floor(len / radius) : std::ceil(len / radius);
+    ndiv[idim] = (n < 1) ? 1 : static_cast<unsigned int>(n);
+    cell_size[idim] = (domain == DOMAIN_TYPE::PERIODIC) ? len / ndiv[idim] : radius;
+  }
+  num_cell = ndiv[0] * ndiv[1] * ndiv[2];
+  // order the cells along the Morton curve
+  std::vector<std::pair<std::uint64_t, unsigned int>> aKey(num_cell);
+  for (unsigned int iz = 0; iz < ndiv[2]; ++iz) {
+    for (unsigned int iy = 0; iy < ndiv[1]; ++iy) {
+      for (unsigned int ix = 0; ix < ndiv[0]; ++ix) {
+        const unsigned int icell = ix + ndiv[0] * (iy + ndiv[1] * iz);
+        const std::uint64_t key = lcl::SpreadBits3(ix) | (lcl::SpreadBits3(iy) << 1) | (lcl::SpreadBits3(iz) << 2);
+        aKey[icell] = {key, icell};
+      }
+    }
+  }
+  std::sort(aKey.begin(), aKey.end());
+  cell_morton.resize(num_cell);
+  for (unsigned int i = 0; i < num_cell; ++i) {
+    cell_morton[aKey[i].second] = i;
+  }
+}
+
+DFM2_INLINE unsigned int delfem2::CCellList3::CellIndex(
+    std::int64_t ix,
+    std::int64_t iy,
+    std::int64_t iz) const {
+  if (domain == DOMAIN_TYPE::UNBOUNDED) {
+    const std::uint64_t h = (static_cast<std::uint64_t>(ix) * 73856093u)
+        ^ (static_cast<std::uint64_t>(iy) * 19349663u)
+        ^ (static_cast<std::uint64_t>(iz) * 83492791u);
+    return static_cast<unsigned int>(h & (num_cell - 1));
+  }
+  std::int64_t i[3] = {ix, iy, iz};
+  for (unsigned int idim = 0; idim < 3; ++idim) {
+    const auto n = static_cast<std::int64_t>(ndiv[idim]);
+    if (domain == DOMAIN_TYPE::PERIODIC) {
+      i[idim] = ((i[idim] % n) + n) % n;
+    } else {
+      i[idim] = std::clamp<std::int64_t>(i[idim], 0, n - 1);
+    }
+  }
+  return cell_morton[i[0] + ndiv[0] * (i[1] + ndiv[1] * i[2])];
+}
+
+DFM2_INLINE void delfem2::CCellList3::Build(
+    const double *vtx_xyz,
+    unsigned int num_vtx,
+    unsigned int nthread) {
+  if (domain == DOMAIN_TYPE::UNBOUNDED) {
+    num_cell = 1;
+    while (num_cell < num_vtx * 2) { num_cell *= 2; }
+  }
+  vtx_cell.resize(num_vtx);
+  std::unique_ptr<std::atomic<unsigned int>[]> aCount(new std::atomic<unsigned int>[num_cell + 1]);
+  for (unsigned int icell = 0; icell < num_cell + 1; ++icell) {
+    aCount[icell].store(0, std::memory_order_relaxed);
+  }
+  parallel_for(
+      num_vtx,
+      [&](unsigned int ivtx) {
+        const double *p = vtx_xyz + ivtx * 3;
+        const unsigned int icell = CellIndex(CellCoord(p[0], 0), CellCoord(p[1], 1), CellCoord(p[2], 2));
+        vtx_cell[ivtx] = icell;
+        aCount[icell + 1].fetch_add(1, std::memory_order_relaxed);
+      },
+      nthread);
+  // counting sort of the points by the cell
+  cell_ind.resize(num_cell + 1);
+  cell_ind[0] = 0;
+  for (unsigned int icell = 0; icell < num_cell; ++icell) {
+    cell_ind[icell + 1] = cell_ind[icell] + aCount[icell + 1].load(std::memory_order_relaxed);
+    aCount[icell].store(cell_ind[icell], std::memory_order_relaxed);
+  }
+  cell_vtx.resize(num_vtx);
+  parallel_for(
+      num_vtx,
+      [&](unsigned int ivtx) {
+        const unsigned int ipos = aCount[vtx_cell[ivtx]].fetch_add(1, std::memory_order_relaxed);
+        cell_vtx[ipos] = ivtx;
+      },
+      nthread);
+  // the order in a cell depends on the threads. sort for the deterministic result
+  cell_xyz.resize(num_vtx * 3);
+  parallel_for(
+      num_cell,
+      [&](unsigned int icell) {
+        std::sort(cell_vtx.begin() + cell_ind[icell],
+                  cell_vtx.begin() + cell_ind[icell + 1]);
+        for (unsigned int ii = cell_ind[icell]; ii < cell_ind[icell + 1]; ++ii) {
+          const unsigned int ivtx = cell_vtx[ii];
+          cell_xyz[ii * 3 + 0] = vtx_xyz[ivtx * 3 + 0];
+          cell_xyz[ii * 3 + 1] = vtx_xyz[ivtx * 3 + 1];
+          cell_xyz[ii * 3 + 2] = vtx_xyz[ivtx * 3 + 2];
+        }
+      },
+      nthread);
+}
@@ -1,8 +1,29 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * @file uniform grids for the fixed radius neighbor search of points (e.g., particles of SPH)
+ * @details "SearchGrid" is the simple grid sorted by the comparison sort.
+ * "CCellList3" is the cell-linked-list built by the parallel counting sort.
+ * Its cells are ordered along the Morton curve so the neighboring cells are close in the memory,
+ * and the hashed cells support the unbounded domain.
+ */
+
 #ifndef DFM2_SRCHGRID_H
 #define DFM2_SRCHGRID_H
 
 #include <vector>
 #include <algorithm> // for sort
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#include "delfem2/thread.h"
+#include "delfem2/dfm2_inline.h"
 
 namespace delfem2 {
 
@@ -135,6 +156,195 @@ public:
   }
 };
 
+/**
+ * @brief cell-linked-list for the neighbor search of the points within a fixed radius
+ * @details the points are binned to the cells whose size is at least the radius, so the neighbors of a point are
+ * in the 27 cells around it. The cells are made by the counting sort in O(n) in parallel.
+ * The coordinates are copied in the order of the cells, which makes the neighbor search cache friendly.
+ * To make also the other arrays of the points cache friendly, reorder them with "Reorder" from time to time.
+ */
+class CCellList3 {
+ public:
+  enum class DOMAIN_TYPE {
+    BOUNDED,  //!< the box is divided into the cells. The points outside the box are put in the cells on the boundary
+    PERIODIC,  //!< the box is repeated periodically. The distance is measured to the nearest image of each point,
+               //!< so a point is reported at most once. If the box is smaller than twice the radius, the other images
+               //!< within the radius are not reported. Any box size works since all the cells of an axis are searched
+               //!< if it has less than three cells
+    UNBOUNDED,  //!< the cells of the infinite space are hashed to the buckets
+  };
+
+  /**
+   * @param bbmin_ minimum corner of the domain. Not used for "DOMAIN_TYPE::UNBOUNDED"
+   * @param bbmax_ maximum corner of the domain. Not used for "DOMAIN_TYPE::UNBOUNDED"
+   * @param radius_ radius of the neighbor search
+   */
+  DFM2_INLINE void Initialize(
+      const double bbmin_[3],
+      const double bbmax_[3],
+      double radius_,
+      DOMAIN_TYPE domain_);
+
+  /**
+   * @brief bin the points to the cells
+   * @param nthread number of threads. 1 runs serially. 0 uses all the threads of "delfem2::ThreadPool".
+   */
+  DFM2_INLINE void Build(
+      const double *vtx_xyz,
+      unsigned int num_vtx,
+      unsigned int nthread = 0);
+
+  /**
+   * @brief call "func(j,d,sqdist)" for each point "j" whose distance to "p" is not larger than the radius
+   * @details "d" is the vector from the point "j" to "p" (the nearest image for "DOMAIN_TYPE::PERIODIC")
+   * and "sqdist" is its squared length. If "p" is a point in the list, "func" is called also for that point.
+   * This function can be called concurrently from the threads.
+   */
+  template<typename FUNC>
+  void ForEachNeighbor(
+      const double p[3],
+      FUNC &&func) const;
+
+  /**
+   * @brief reorder the values of the points in the order of the cells. "Build" again after the reordering
+   * @param num_value_per_point e.g., 3 for the coordinates
+   */
+  template<typename T>
+  void Reorder(
+      std::vector<T> &value,
+      unsigned int num_value_per_point) const;
+
+  /**
+   * @return the cell index (before the Morton ordering) of the coordinates in each axis.
+   * Not wrapped or clamped.
+   */
+  [[nodiscard]] std::int64_t CellCoord(double x, unsigned int idim) const {
+    return static_cast<std::int64_t>(std::floor((x - bbmin[idim]) / cell_size[idim]));
+  }
+
+  /**
+   * @return index of the cell (or the bucket) of the integer coordinates of a cell
+   */
+  [[nodiscard]] DFM2_INLINE unsigned int CellIndex(
+      std::int64_t ix,
+      std::int64_t iy,
+      std::int64_t iz) const;
+
+ public:
+  DOMAIN_TYPE domain = DOMAIN_TYPE::BOUNDED;
+  double radius = 1;
+  double bbmin[3] = {0, 0, 0};
+  double bbmax[3] = {1, 1, 1};
+  double cell_size[3] = {1, 1, 1};
+  unsigned int ndiv[3] = {1, 1, 1};  // number of the cells in each axis. Not used for "DOMAIN_TYPE::UNBOUNDED"
+  unsigned int num_cell = 1;  // number of the buckets (power of two) for "DOMAIN_TYPE::UNBOUNDED"
+  /**
+   * index of each cell in the Morton order. The cell at (ix,iy,iz) is "cell_morton[ix+nx*(iy+ny*iz)]"
+   */
+  std::vector<unsigned int> cell_morton;
+  /**
+   * jagged array of the points in each cell. The points in a cell are sorted
+   */
+  std::vector<unsigned int> cell_ind;
+  std::vector<unsigned int> cell_vtx;
+  std::vector<double> cell_xyz;  // coordinates of the points in the order of "cell_vtx"
+  std::vector<unsigned int> vtx_cell;  // cell of each point
+ private:
+  template<typename FUNC>
+  void ForEachPointInCell(
+      unsigned int icell,
+      const double p[3],
+      FUNC &&func) const;
+};
+
+}
+
+// -------------------------------------------
+
+template<typename FUNC>
+void delfem2::CCellList3::ForEachPointInCell(
+    unsigned int icell,
+    const double p[3],
+    FUNC &&func) const {
+  const double sqr = radius * radius;
+  const double period[3] = {bbmax[0] - bbmin[0], bbmax[1] - bbmin[1], bbmax[2] - bbmin[2]};
+  for (unsigned int ii = cell_ind[icell]; ii < cell_ind[icell + 1]; ++ii) {
+    double d[3] = {
+        p[0] - cell_xyz[ii * 3 + 0],
+        p[1] - cell_xyz[ii * 3 + 1],
+        p[2] - cell_xyz[ii * 3 + 2]};
+    if (domain == DOMAIN_TYPE::PERIODIC) {
+      for (unsigned int idim = 0; idim < 3; ++idim) {
+        d[idim] -= period[idim] * std::round(d[idim] / period[idim]);
+      }
+    }
+    const double sqdist = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    if (sqdist > sqr) { continue; }
+    func(cell_vtx[ii], d, sqdist);
+  }
+}
+
+template<typename FUNC>
+void delfem2::CCellList3::ForEachNeighbor(
+    const double p[3],
+    FUNC &&func) const {
+  if (cell_ind.empty()) { return; } // not built
+  const std::int64_t ic[3] = {CellCoord(p[0], 0), CellCoord(p[1], 1), CellCoord(p[2], 2)};
+  if (domain == DOMAIN_TYPE::UNBOUNDED) {
+    // the neighboring cells may be hashed to the same bucket. visit each bucket once
+    unsigned int aBucket[27];
+    unsigned int nbucket = 0;
+    for (std::int64_t iz = ic[2] - 1; iz <= ic[2] + 1; ++iz) {
+      for (std::int64_t iy = ic[1] - 1; iy <= ic[1] + 1; ++iy) {
+        for (std::int64_t ix = ic[0] - 1; ix <= ic[0] + 1; ++ix) {
+          const unsigned int ibucket = CellIndex(ix, iy, iz);
+          if (std::find(aBucket, aBucket + nbucket, ibucket) != aBucket + nbucket) { continue; }
+          aBucket[nbucket++] = ibucket;
+          ForEachPointInCell(ibucket, p, func);
+        }
+      }
+    }
+    return;
+  }
+  // range of the cells in each axis. all the cells if there are less than three cells in the periodic axis
+  std::int64_t i0[3], i1[3];
+  for (unsigned int idim = 0; idim < 3; ++idim) {
+    const auto n = static_cast<std::int64_t>(ndiv[idim]);
+    if (domain == DOMAIN_TYPE::PERIODIC) {
+      i0[idim] = (n < 3) ? 0 : ic[idim] - 1;
+      i1[idim] = (n < 3) ? n - 1 : ic[idim] + 1;
+    } else {
+      const std::int64_t j = std::clamp<std::int64_t>(ic[idim], 0, n - 1);
+      i0[idim] = std::max<std::int64_t>(j - 1, 0);
+      i1[idim] = std::min<std::int64_t>(j + 1, n - 1);
+    }
+  }
+  for (std::int64_t iz = i0[2]; iz <= i1[2]; ++iz) {
+    for (std::int64_t iy = i0[1]; iy <= i1[1]; ++iy) {
+      for (std::int64_t ix = i0[0]; ix <= i1[0]; ++ix) {
+        ForEachPointInCell(CellIndex(ix, iy, iz), p, func);
+      }
+    }
+  }
 }
 
+template<typename T>
+void delfem2::CCellList3::Reorder(
+    std::vector<T> &value,
+    unsigned int num_value_per_point) const {
+  assert(value.size() == cell_vtx.size() * num_value_per_point);
+  std::vector<T> tmp(value.size());
+  for (unsigned int ii = 0; ii < cell_vtx.size(); ++ii) {
+    const unsigned int ivtx = cell_vtx[ii];
+    for (unsigned int k = 0; k < num_value_per_point; ++k) {
+      tmp[ii * num_value_per_point + k] = value[ivtx * num_value_per_point + k];
+    }
+  }
+  value.swap(tmp);
+}
+
+#ifndef DFM2_STATIC_LIBRARY
+#  include "delfem2/srchgrid.cpp"
+#endif
+
 #endif
\ No newline at end of file
@@ -5,79 +5,384 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+/**
+ * @file persistent work-stealing thread pool and the parallel loops on top of it.
+ * @details the pool is created lazily at the first parallel call and reused afterwards.
+ * Each worker owns a deque. The owner pops from the back (LIFO) and idle threads steal from the front (FIFO).
+ * The thread waiting for a loop executes queued tasks while waiting,
+ * so a parallel loop can be nested inside another one without dead-lock.
+ */
+
 #ifndef DFM2_THREAD_H
 #define DFM2_THREAD_H
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <functional>
-#include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <vector>
 
 #include "delfem2/dfm2_inline.h"
 
 namespace delfem2 {
 
+class ThreadPool {
+ public:
+  /**
+   * set of tasks that a caller waits for
+   */
+  class TaskGroup {
+   public:
+    std::atomic<std::size_t> num_pending{0};
+    std::atomic<bool> has_error{false};
+    std::exception_ptr error = nullptr;
+    std::mutex mtx_error;
+  };
+
+  /**
+   * @param num_worker number of the worker threads. The thread calling Wait() also works, so the
+   * number of threads executing tasks is num_worker+1
+   */
+  explicit ThreadPool(unsigned int num_worker)
+      : num_worker_(num_worker) {
+    queues_.resize(num_worker + 1); // the last one is for the threads outside the pool
+    for (auto &q: queues_) { q = std::make_unique<Queue>(); }
+    workers_.reserve(num_worker);
+    for (unsigned int iw = 0; iw < num_worker; ++iw) {
+      workers_.emplace_back([this, iw]() { this->WorkerLoop(iw); });
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lk(mtx_sleep_);
+      is_stop_ = true;
+    }
+    cv_sleep_.notify_all();
+    for (auto &w: workers_) { w.join(); }
+  }
+
+  /**
+   * the pool shared by the parallel loops in this file.
+   * It has "hardware_concurrency()-1" workers because the calling thread also works.
+   */
+  static ThreadPool &Instance() {
+    static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return pool;
+  }
+
+  /**
+   * number of the threads that can execute tasks simultaneously including the caller
+   */
+  [[nodiscard]] unsigned int NumThreads() const { return num_worker_ + 1; }
+
+  void Submit(TaskGroup &group, std::function<void()> func) {
+    group.num_pending.fetch_add(1, std::memory_order_relaxed);
+    {  // count before push so that the counter never goes below the number of the queued tasks
+      std::lock_guard<std::mutex> lk(mtx_sleep_);
+      num_queued_.fetch_add(1, std::memory_order_release);
+    }
+    const unsigned int iq = this->IndexCurrentQueue();
+    {
+      std::lock_guard<std::mutex> lk(queues_[iq]->mtx);
+      queues_[iq]->tasks.push_back(Task{std::move(func), &group});
+    }
+    cv_sleep_.notify_one();
+  }
+
+  /**
+   * wait until all the tasks in the group finish. The caller executes the queued tasks meanwhile.
+   * The first exception thrown in the tasks is re-thrown here.
+   */
+  void Wait(TaskGroup &group) {
+    while (group.num_pending.load(std::memory_order_acquire) != 0) {
+      if (this->RunOne(this->IndexCurrentQueue())) { continue; }
+      std::this_thread::yield();
+    }
+    if (group.error) { std::rethrow_exception(group.error); }
+  }
+
+ private:
+  struct Task {
+    std::function<void()> func;
+    TaskGroup *group;
+  };
+
+  struct Queue {
+    std::mutex mtx;
+    std::deque<Task> tasks;
+  };
+
+  struct WorkerId {
+    const ThreadPool *pool = nullptr;
+    unsigned int index = 0;
+  };
+
+  static WorkerId &CurrentWorker() {
+    static thread_local WorkerId id;
+    return id;
+  }
+
+  /**
+   * index of the queue of the current thread. The threads outside the pool share the last queue.
+   */
+  [[nodiscard]] unsigned int IndexCurrentQueue() const {
+    const WorkerId &id = CurrentWorker();
+    return (id.pool == this) ? id.index : num_worker_;
+  }
+
+  bool PopBack(Task &task, unsigned int iq) {
+    Queue &q = *queues_[iq];
+    std::lock_guard<std::mutex> lk(q.mtx);
+    if (q.tasks.empty()) { return false; }
+    task = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    return true;
+  }
+
+  bool StealFront(Task &task, unsigned int iq) {
+    Queue &q = *queues_[iq];
+    std::unique_lock<std::mutex> lk(q.mtx, std::try_to_lock);
+    if (!lk.owns_lock() || q.tasks.empty()) { return false; }
+    task = std::move(q.tasks.front());
+    q.tasks.pop_front();
+    return true;
+  }
+
+  /**
+   * execute one task taken from the own queue or stolen from the others
+   * @return false if no task is found
+   */
+  bool RunOne(unsigned int iq_own) {
+    if (num_queued_.load(std::memory_order_acquire) == 0) { return false; }
+    Task task;
+    bool is_found = this->PopBack(task, iq_own);
+    const auto nq = static_cast<unsigned int>(queues_.size());
+    for (unsigned int i = 1; i < nq && !is_found; ++i) {
+      is_found = this->StealFront(task, (iq_own + i) % nq);
+    }
+    if (!is_found) { return false; }
+    num_queued_.fetch_sub(1, std::memory_order_relaxed);
+    TaskGroup &group = *task.group;
+    if (!group.has_error.load(std::memory_order_relaxed)) {
+      try {
+        task.func();
+      } catch (...) {
+        std::lock_guard<std::mutex> lk(group.mtx_error);
+        if (!group.error) { group.error = std::current_exception(); }
+        group.has_error = true;
+      }
+    }
+    group.num_pending.fetch_sub(1, std::memory_order_release);
+    return true;
+  }
+
+  void WorkerLoop(unsigned int iw) {
+    CurrentWorker() = WorkerId{this, iw};
+    while (true) {
+      if (this->RunOne(iw)) { continue; }
+      std::unique_lock<std::mutex> lk(mtx_sleep_);
+      cv_sleep_.wait(lk, [this]() {
+        return is_stop_ || num_queued_.load(std::memory_order_acquire) != 0;
+      });
+      if (is_stop_) { return; }
+    }
+  }
+
+ private:
+  const unsigned int num_worker_;
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<std::size_t> num_queued_{0};
+  std::mutex mtx_sleep_;
+  std::condition_variable cv_sleep_;
+  bool is_stop_ = false;
+};
+
+namespace thread {
+
+/**
+ * number of threads used for a loop
+ * @param target_concurrency requested number of threads. 0 means all the threads in the pool
+ */
+inline unsigned int NumThreadsForLoop(unsigned int target_concurrency) {
+  const unsigned int nthread_pool = ThreadPool::Instance().NumThreads();
+  if (target_concurrency == 0) { return nthread_pool; }
+  return std::min(target_concurrency, nthread_pool);
+}
+
+/**
+ * split [0,num) into chunks. A few chunks per thread are made so that the idle threads can steal.
+ * @param grain_size minimum number of the indexes in a chunk. 0 means automatic
+ */
+template<typename T>
+T NumChunks(
+    T num,
+    T grain_size,
+    unsigned int nthread) {
+  constexpr unsigned int num_chunk_per_thread = 4;
+  if (num <= 0) { return 0; }
+  const T nchunk_max = static_cast<T>(nthread * num_chunk_per_thread);
+  if (grain_size <= 0) { return std::min(num, nchunk_max); }
+  const T nchunk = (num + grain_size - 1) / grain_size;
+  return std::max(static_cast<T>(1), std::min(nchunk, nchunk_max));
+}
+
+}
+
+/**
+ * call "func(ib,ie)" for the chunks that covers [0,num) in parallel
+ * @details the caller and "target_concurrency-1" tasks in the pool take the chunks one by one,
+ * so at most "target_concurrency" threads execute "func" at the same time.
+ * @tparam Func void (T ib, T ie)
+ * @param grain_size minimum size of a chunk. 0 means automatic
+ * @param target_concurrency maximum number of the threads used. 0 means all the threads in the pool
+ */
 template<typename T, typename Func>
-inline void parallel_for(
+void parallel_for_range(
     T num,
     Func &&func,
-    [[maybe_unused]] unsigned int target_concurrency = 0) {
-  auto futures = std::vector<std::future<void>>{};
-
-  const unsigned int nthreads = (target_concurrency == 0) ?
-                                std::thread::hardware_concurrency() : target_concurrency;
-  std::atomic<T> next_idx(0);
-  std::atomic<bool> has_error(false);
-  for (auto thread_id = 0; thread_id < (int) nthreads; thread_id++) {
-    futures.emplace_back(
-        std::async(std::launch::async, [&func, &next_idx, &has_error, num]() {
-          try {
-            while (true) {
-              auto idx = next_idx.fetch_add(1);
-              if (idx >= num) break;
-              if (has_error) break;
-              func(idx);
-            }
-          } catch (...) {
-            has_error = true;
-            throw;
-          }
-        }));
+    T grain_size = 0,
+    unsigned int target_concurrency = 0) {
+  if (num <= 0) { return; }
+  const unsigned int nthread = thread::NumThreadsForLoop(target_concurrency);
+  const T nchunk = (nthread <= 1) ? 1 : thread::NumChunks(num, grain_size, nthread);
+  if (nchunk == 1) {
+    func(static_cast<T>(0), num);
+    return;
   }
-  for (auto &f: futures) f.get();
+  ThreadPool &pool = ThreadPool::Instance();
+  ThreadPool::TaskGroup group;
+  std::atomic<T> ichunk_next{0};
+  auto run_chunks = [&func, &group, &ichunk_next, num, nchunk]() {
+    while (!group.has_error.load(std::memory_order_relaxed)) {
+      const T ichunk = ichunk_next.fetch_add(1, std::memory_order_relaxed);
+      if (ichunk >= nchunk) { return; }
+      const T ib = num / nchunk * ichunk + std::min(ichunk, num % nchunk);
+      const T ie = num / nchunk * (ichunk + 1) + std::min(ichunk + 1, num % nchunk);
+      func(ib, ie);
+    }
+  };
+  const unsigned int ntask = std::min(nthread, static_cast<unsigned int>(nchunk)) - 1;
+  for (unsigned int itask = 0; itask < ntask; ++itask) {
+    pool.Submit(group, run_chunks);
+  }
+  try {
+    run_chunks();
+  } catch (...) {  // the tasks refer to the local variables, so wait for them before leaving
+    {
+      std::lock_guard<std::mutex> lk(group.mtx_error);
+      if (!group.error) { group.error = std::current_exception(); }
+      group.has_error = true;
+    }
+  }
+  pool.Wait(group);
+}
+
+template<typename T, typename Func>
+inline void parallel_for(
+    T num,
+    Func &&func,
+    unsigned int target_concurrency = 0) {
+  parallel_for_range(
+      num,
+      [&func](T ib, T ie) { for (T i = ib; i < ie; ++i) { func(i); }},
+      static_cast<T>(0),
+      target_concurrency);
 }
 
+/**
+ * call "func(i,j)" for "i" in [0,num1) and "j" in [0,num2). "j" is distributed over the threads
+ */
 template<typename T, typename Func>
 inline void parallel_for(
     T num1,
     T num2,
     Func &&func,
     unsigned int target_concurrency = 0) {
-  auto futures = std::vector<std::future<void>>{};
-  const unsigned int nthreads = (target_concurrency == 0) ?
-                                std::thread::hardware_concurrency() : target_concurrency;
-  std::atomic<T> next_idx(0);
-  std::atomic<bool> has_error(false);
-  for (auto thread_id = 0; thread_id < (int) nthreads; thread_id++) {
-    futures.emplace_back(std::async(
-        std::launch::async, [&func, &next_idx, &has_error, num1, num2]() {
-          try {
-            while (true) {
-              auto j = next_idx.fetch_add(1);
-              if (j >= num2) break;
-              if (has_error) break;
-              for (auto i = (T) 0; i < num1; i++) func(i, j);
-            }
-          } catch (...) {
-            has_error = true;
-            throw;
-          }
-        }));
-  }
-  for (auto &f: futures) f.get();
+  parallel_for_range(
+      num2,
+      [&func, num1](T jb, T je) {
+        for (T j = jb; j < je; ++j) {
+          for (T i = static_cast<T>(0); i < num1; ++i) { func(i, j); }
+        }
+      },
+      static_cast<T>(0),
+      target_concurrency);
+}
+
+/**
+ * call "func(i,j)" for "i" in [0,num1) and "j" in [0,num2). The range is split into the square tiles of "ntile x ntile"
+ * and the tiles are distributed over the threads (e.g., the rays of the close pixels of an image traverse the same nodes)
+ */
+template<typename T, typename Func>
+inline void parallel_for_tile(
+    T num1,
+    T num2,
+    T ntile,
+    Func &&func,
+    unsigned int target_concurrency = 0) {
+  if (num1 <= 0 || num2 <= 0) { return; }
+  const T ntile1 = (num1 + ntile - 1) / ntile;
+  const T ntile2 = (num2 + ntile - 1) / ntile;
+  parallel_for(
+      ntile1 * ntile2,
+      [&func, num1, num2, ntile, ntile1](T itile) {
+        const T i0 = (itile % ntile1) * ntile;
+        const T j0 = (itile / ntile1) * ntile;
+        const T i1 = std::min(i0 + ntile, num1);
+        const T j1 = std::min(j0 + ntile, num2);
+        for (T j = j0; j < j1; ++j) {
+          for (T i = i0; i < i1; ++i) { func(i, j); }
+        }
+      },
+      target_concurrency);
+}
+
+/**
+ * reduction over [0,num). The result is deterministic for the same number of threads
+ * because the partial results of the chunks are combined in the order of the chunks.
+ * @tparam Func V (T ib, T ie, V init) returns "init" accumulated with the values in [ib,ie)
+ * @tparam Reduce V (const V& a, const V& b)
+ * @param identity identity element of the reduction
+ */
+template<typename T, typename V, typename Func, typename Reduce>
+V parallel_reduce(
+    T num,
+    const V &identity,
+    Func &&func,
+    Reduce &&reduce,
+    T grain_size = 0,
+    unsigned int target_concurrency = 0) {
+  if (num <= 0) { return identity; }
+  const unsigned int nthread = thread::NumThreadsForLoop(target_concurrency);
+  const T nchunk = (nthread <= 1) ? 1 : thread::NumChunks(num, grain_size, nthread);
+  if (nchunk == 1) { return func(static_cast<T>(0), num, identity); }
+  std::vector<V> partial(nchunk, identity);
+  parallel_for_range(
+      nchunk,
+      [&](T cb, T ce) {
+        for (T ichunk = cb; ichunk < ce; ++ichunk) {
+          const T ib = num / nchunk * ichunk + std::min(ichunk, num % nchunk);
+          const T ie = num / nchunk * (ichunk + 1) + std::min(ichunk + 1, num % nchunk);
+          partial[ichunk] = func(ib, ie, identity);
+        }
+      },
+      static_cast<T>(1),
+      target_concurrency);
+  V res = identity;
+  for (const V &v: partial) { res = reduce(res, v); }
+  return res;
 }
 
 }
 
-#endif /* DFM2_THREAD_H */
\ No newline at end of file
+#endif /* DFM2_THREAD_H */
@@ -377,14 +377,14 @@ std::vector<double> Solve_PBiCGStab(
   
   //    std::cout << "SqIniRes : " << ls.DOT(ir,ir) << std::endl;
   
-  std::vector<double> s_vec(ndof);
-  std::vector<double> Ms_vec(ndof);
-  std::vector<double> AMs_vec(ndof);
-  std::vector<double> Mp_vec(ndof);
-  std::vector<double> AMp_vec(ndof);
+  std::vector<REAL> s_vec(ndof);
+  std::vector<REAL> Ms_vec(ndof);
+  std::vector<REAL> AMs_vec(ndof);
+  std::vector<REAL> Mp_vec(ndof);
+  std::vector<REAL> AMp_vec(ndof);
   
-  const std::vector<double> r0_vec(r_vec,r_vec+ndof);   // {r2} = {r}
-  std::vector<double> p_vec(r_vec,r_vec+ndof);  // {p} = {r}
+  const std::vector<REAL> r0_vec(r_vec,r_vec+ndof);   // {r2} = {r}
+  std::vector<REAL> p_vec(r_vec,r_vec+ndof);  // {p} = {r}
   
   for(unsigned int iitr=1;iitr<max_niter;iitr++){
     // {Mp_vec} = [M^-1]*{p}
@@ -399,7 +399,7 @@ std::vector<double> Solve_PBiCGStab(
     const double alpha = r_r2 / Dot(AMp_vec,r0_vec);
     // calc s_vector
     s_vec.assign(r_vec,r_vec+ndof);
-    AXPY(-alpha,AMp_vec,s_vec);
+    AXPY<REAL>(-alpha,AMp_vec,s_vec);
     // {Ms_vec} = [M^-1]*{s}
     Ms_vec = s_vec;
     ilu.SolvePrecond(Ms_vec.data());
@@ -412,10 +412,10 @@ std::vector<double> Solve_PBiCGStab(
       const double numerator = Dot(s_vec,AMs_vec);
       omega = numerator / denominator;
     }
-    AXPY(alpha,Mp_vec.data(),x_vec,ndof);
-    AXPY(omega,Ms_vec.data(),x_vec,ndof);
+    AXPY<REAL>(alpha,Mp_vec.data(),x_vec,ndof);
+    AXPY<REAL>(omega,Ms_vec.data(),x_vec,ndof);
     for(unsigned int i=0;i<ndof;++i){ r_vec[i] = s_vec[i]; } // update residual
-    AXPY(-omega,AMs_vec.data(),r_vec,ndof);
+    AXPY<REAL>(-omega,AMs_vec.data(),r_vec,ndof);
     {
       const double sq_norm_res = DotX(r_vec,r_vec,ndof);
       const double conv_ratio = sqrt(sq_norm_res * sq_inv_norm_res_ini);
@@ -429,13 +429,67 @@ std::vector<double> Solve_PBiCGStab(
     }
     // update p_vector
     for(unsigned int i=0;i<ndof;++i){ p_vec[i] *= beta; }
-    AXPY(1.0,r_vec,p_vec.data(),ndof);
-    AXPY(-beta*omega,AMp_vec,p_vec);
+    AXPY<REAL>(1,r_vec,p_vec.data(),ndof);
+    AXPY<REAL>(-beta*omega,AMp_vec,p_vec);
   }
   
   return aResHistry;
 }
 
+/**
+ * @brief mixed-precision iterative refinement
+ * @details the correction equation [A]{dx}={r} is solved approximately in the low precision by "solve_low",
+ * while the solution {x} and the residual {r}={b}-[A]{x} are updated in double precision.
+ * The residual is normalized before it is passed to "solve_low".
+ * @tparam LOW type of the low precision (e.g., float)
+ * @tparam MAT double precision matrix having "MatVec"
+ * @tparam SOLVER_LOW void (LOW* r, LOW* dx). solve [A]{dx}={r} in low precision. {r} can be overwritten
+ * @param r_vec right-hand side as input. residual as output
+ * @param max_nrefine maximum number of the refinements (calls of "solve_low")
+ * @return history of the relative residual norm computed in double precision after each refinement
+ */
+template <typename LOW, class MAT, class SOLVER_LOW>
+std::vector<double> Solve_MixedPrecisionRefinement(
+ double* r_vec,
+ double* x_vec,
+ double conv_ratio_tol,
+ unsigned int max_nrefine,
+ const MAT& mat,
+ SOLVER_LOW&& solve_low)
+{
+  assert( mat.nrowblk_ == mat.ncolblk_ );
+  assert( mat.nrowdim_ == mat.ncoldim_ );
+  const unsigned int ndof = mat.nrowblk_*mat.nrowdim_;
+  std::vector<double> aResHistry;
+
+  for(unsigned int i=0;i<ndof;++i){ x_vec[i] = 0.0; }
+
+  double norm_res = sqrt(DotX(r_vec,r_vec,ndof));
+  if( norm_res < 1.0e-30 ){
+    aResHistry.push_back(norm_res);
+    return aResHistry;
+  }
+  const double inv_norm_res_ini = 1.0 / norm_res;
+
+  const std::vector<double> b_vec(r_vec,r_vec+ndof);
+  std::vector<LOW> r_low(ndof), dx_low(ndof);
+  for(unsigned int iref=0;iref<max_nrefine;++iref){
+    const double inv_norm_res = 1.0 / norm_res;
+    for(unsigned int i=0;i<ndof;++i){ r_low[i] = static_cast<LOW>(r_vec[i]*inv_norm_res); }
+    solve_low(r_low.data(), dx_low.data());
+    for(unsigned int i=0;i<ndof;++i){ x_vec[i] += norm_res * static_cast<double>(dx_low[i]); }
+    // {r} = {b} - [A]{x}
+    for(unsigned int i=0;i<ndof;++i){ r_vec[i] = b_vec[i]; }
+    mat.MatVec(r_vec,
+               -1.0, x_vec, 1.0);
+    norm_res = sqrt(DotX(r_vec,r_vec,ndof));
+    const double conv_ratio = norm_res * inv_norm_res_ini;
+    aResHistry.push_back( conv_ratio );
+    if( conv_ratio < conv_ratio_tol ){ return aResHistry; }
+  }
+  return aResHistry;
+}
+
 template <typename REAL, class MAT, class PREC>
 std::vector<double> Solve_PBiCGStab_Complex(
     std::complex<REAL>* r_vec,
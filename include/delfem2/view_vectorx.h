@@ -73,25 +73,25 @@ void AddScaledVec(
 template<typename REAL>
 void ScaleAndAddVec(
     ViewAsVectorX<REAL> &y,
-    REAL beta,
+    double beta,
     const ViewAsVectorX<REAL> &x) {
   assert(y.n == x.n);
   const std::size_t n = x.n;
   for (unsigned int i = 0; i < n; i++) {
-    y.p[i] = beta * y.p[i] + x.p[i];
+    y.p[i] = static_cast<REAL>(beta) * y.p[i] + x.p[i];
   }
 }
 
 template<typename REAL, class MAT>
 void AddMatVec(
     ViewAsVectorX<REAL> &lhs,
-    REAL scale_lhs,
-    REAL scale_rhs,
+    double scale_lhs,
+    double scale_rhs,
     const MAT &mat,
     const ViewAsVectorX<REAL> &rhs) {
   assert(lhs.n == rhs.n);
   mat.MatVec(lhs.p,
-             scale_rhs, rhs.p, scale_lhs);
+             static_cast<REAL>(scale_rhs), rhs.p, static_cast<REAL>(scale_lhs));
 }
 
 template<typename REAL, class PREC>
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * @file headless benchmark of the SPH fluid.
+ * usage: sph_fluid_benchmark [number of particles (approximate)] [number of steps] [number of threads]
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "delfem2/sph_fluid.h"
+#include "delfem2/thread.h"
+
+int main(int argc, char *argv[]) {
+  const double num_particle = (argc > 1) ? std::atof(argv[1]) : 1.0e+5;
+  const unsigned int num_step = (argc > 2) ? static_cast<unsigned int>(std::atoi(argv[2])) : 100;
+  const unsigned int nthread = (argc > 3) ? static_cast<unsigned int>(std::atoi(argv[3])) : 0;
+  delfem2::CSphFluid3 sph;
+  // the fluid block fills the lower half of the box. Scale the box to get the number of the particles
+  const double spacing = std::pow(sph.mass / sph.rest_density, 1 / 3.0) * 0.87;
+  const double len = std::cbrt(num_particle * 2) * spacing;
+  for (int idim = 0; idim < 3; ++idim) {
+    sph.bbmin[idim] = 0;
+    sph.bbmax[idim] = len;
+  }
+  const double box_max[3] = {len, len * 0.5, len};
+  sph.AddParticlesInBox(sph.bbmin, box_max);
+  std::cout << "particles: " << sph.NumParticle() << std::endl;
+  std::cout << "threads: " << delfem2::thread::NumThreadsForLoop(nthread) << std::endl;
+  double time_grid = 0, time_density = 0, time_force = 0, time_update = 0;
+  for (unsigned int istep = 0; istep < num_step; ++istep) {
+    const auto t0 = std::chrono::steady_clock::now();
+    sph.UpdateNeighborGrid(nthread);
+    const auto t1 = std::chrono::steady_clock::now();
+    sph.DensityPressure(nthread);
+    const auto t2 = std::chrono::steady_clock::now();
+    sph.AccumulateForce(nthread);
+    const auto t3 = std::chrono::steady_clock::now();
+    sph.UpdatePosition(nthread);
+    const auto t4 = std::chrono::steady_clock::now();
+    time_grid += std::chrono::duration<double>(t1 - t0).count();
+    time_density += std::chrono::duration<double>(t2 - t1).count();
+    time_force += std::chrono::duration<double>(t3 - t2).count();
+    time_update += std::chrono::duration<double>(t4 - t3).count();
+  }
+  const double time_total = time_grid + time_density + time_force + time_update;
+  std::cout << "steps: " << num_step << std::endl;
+  std::cout << "grid    [s/step]: " << time_grid / num_step << std::endl;
+  std::cout << "density [s/step]: " << time_density / num_step << std::endl;
+  std::cout << "force   [s/step]: " << time_force / num_step << std::endl;
+  std::cout << "update  [s/step]: " << time_update / num_step << std::endl;
+  std::cout << "particle-steps/s: " << sph.NumParticle() * num_step / time_total << std::endl;
+  return 0;
+}
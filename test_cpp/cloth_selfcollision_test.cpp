@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <set>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h" // need to be defined in the beginning
+#include "delfem2/cloth_selfcollision.h"
+#include "delfem2/srch_selfintersection_bvh.h"
+#include "delfem2/srch_trimesh3_class.h"
+#include "delfem2/srch_bv3_aabb.h"
+#include "delfem2/srch_bvh.h"
+#include "delfem2/msh_topology_uniform.h"
+#include "delfem2/msh_primitive.h"
+
+namespace dfm2 = delfem2;
+
+namespace {
+
+// the linear search over the RIZs before the union-find was introduced
+void MakeRigidImpactZone_LinearSearch(
+    std::vector< std::set<int> >& aRIZ,
+    const std::vector<dfm2::CContactElement>& aContactElem,
+    const std::vector<unsigned int> &psup_ind,
+    const std::vector<unsigned int> &psup)
+{
+  for(const auto & ce : aContactElem){
+    const int n[4] = {ce.ino0, ce.ino1, ce.ino2, ce.ino3};
+    std::set<int> ind_inc;
+    for(int ino : n){
+      for(unsigned int iriz=0;iriz<aRIZ.size();iriz++){
+        if( aRIZ[iriz].find(ino) != aRIZ[iriz].end() ){
+          ind_inc.insert(iriz);
+        }
+        else{
+          for(unsigned int iedge=psup_ind[ino];iedge<psup_ind[ino+1];iedge++){
+            int jno = psup[iedge];
+            if( aRIZ[iriz].find(jno) != aRIZ[iriz].end() ){
+              ind_inc.insert(iriz);  break;
+            }
+          }
+        }
+      }
+    }
+    if( ind_inc.empty() ){
+      aRIZ.emplace_back(n, n+4);
+    }
+    else if( ind_inc.size() == 1 ){
+      aRIZ[*ind_inc.begin()].insert(n, n+4);
+    }
+    else{
+      std::vector< std::set<int> > aRIZ1;
+      for(unsigned int iriz=0;iriz<aRIZ.size();iriz++){
+        if( ind_inc.find(iriz) != ind_inc.end() ) continue;
+        aRIZ1.push_back( aRIZ[iriz] );
+      }
+      std::set<int> riz(n, n+4);
+      for(auto ind1 : ind_inc){
+        riz.insert(aRIZ[ind1].begin(), aRIZ[ind1].end());
+      }
+      aRIZ1.push_back(riz);
+      aRIZ = aRIZ1;
+    }
+  }
+}
+
+}
+
+TEST(cloth_selfcollision, rigid_impact_zone)
+{
+  std::vector<double> aXYZ;
+  std::vector<unsigned int> aTri;
+  dfm2::MeshTri3D_Sphere(aXYZ, aTri, 1.0, 16, 32);
+  for(unsigned int ip=0;ip<aXYZ.size()/3;++ip){ aXYZ[ip*3+2] *= 0.03; } // flat pancake
+  std::vector<double> aUVW(aXYZ.size(), 0.0);
+  for(unsigned int ip=0;ip<aXYZ.size()/3;++ip){ // top and bottom swap at the both ends
+    if( std::fabs(aXYZ[ip*3+0]) < 0.6 ){ continue; }
+    aUVW[ip*3+2] = -2*aXYZ[ip*3+2];
+  }
+  const double delta = 0.05;
+  std::vector<unsigned int> psup_ind, psup;
+  dfm2::JArray_PSuP_MeshElem(
+      psup_ind, psup,
+      aTri.data(), aTri.size()/3, 3, aXYZ.size()/3);
+  std::vector<dfm2::CNodeBVH2> aNodeBVH;
+  std::vector<dfm2::CBV3d_AABB> aBB;
+  dfm2::BuildBVH_MeshTri3D_Morton(aNodeBVH, aBB, aXYZ, aTri);
+  std::vector<dfm2::CContactElement> aContactElem;
+  {
+    dfm2::CLeafVolumeMaker_DynamicTriangle<dfm2::CBV3d_AABB, double> lvm(
+        1.0, aXYZ, aUVW, aTri, 1.0e-10);
+    dfm2::BVH_BuildBVHGeometry(aBB, 0, aNodeBVH, lvm);
+    std::set<dfm2::CContactElement> setCE;
+    dfm2::GetContactElement_CCD(setCE, 1.0, delta, aXYZ, aUVW, aTri, 0, aNodeBVH, aBB);
+    aContactElem.assign(setCE.begin(), setCE.end());
+  }
+  EXPECT_GT(aContactElem.size(), 10);
+  // the contacts are added in two steps to merge them to the existing RIZs
+  const std::vector<dfm2::CContactElement> aCE0(aContactElem.begin(), aContactElem.begin()+aContactElem.size()/2);
+  const std::vector<dfm2::CContactElement> aCE1(aContactElem.begin()+aContactElem.size()/2, aContactElem.end());
+  std::vector< std::set<int> > aRIZ0, aRIZ1;
+  for(const auto& aCE : {aCE0, aCE1}){
+    MakeRigidImpactZone_LinearSearch(aRIZ0, aCE, psup_ind, psup);
+    MakeRigidImpactZone(aRIZ1, aCE, psup_ind, psup);
+    EXPECT_EQ(
+        std::set< std::set<int> >(aRIZ0.begin(), aRIZ0.end()),
+        std::set< std::set<int> >(aRIZ1.begin(), aRIZ1.end()));
+  }
+  EXPECT_GT(aRIZ1.size(), 1);
+  {
+    std::vector<double> aUVW0 = aUVW, aUVW1 = aUVW;
+    ApplyRigidImpactZone(aUVW0, aRIZ0, aXYZ, aUVW, 1);
+    ApplyRigidImpactZone(aUVW1, aRIZ1, aXYZ, aUVW, 0);
+    for(unsigned int i=0;i<aUVW.size();++i){
+      EXPECT_NEAR(aUVW0[i], aUVW1[i], 1.0e-10);
+    }
+  }
+}
+
+TEST(cloth_selfcollision, contact_resolved_nthread)
+{
+  std::vector<double> aXYZ;
+  std::vector<unsigned int> aTri;
+  dfm2::MeshTri3D_Sphere(aXYZ, aTri, 1.0, 8, 16);
+  for(unsigned int ip=0;ip<aXYZ.size()/3;++ip){ aXYZ[ip*3+2] *= 0.03; } // flat pancake
+  std::vector<double> aUVW(aXYZ.size(), 0.0);
+  for(unsigned int ip=0;ip<aXYZ.size()/3;++ip){ aUVW[ip*3+2] = -2*aXYZ[ip*3+2]; } // top and bottom swap
+  std::vector<unsigned int> psup_ind, psup;
+  dfm2::JArray_PSuP_MeshElem(
+      psup_ind, psup,
+      aTri.data(), aTri.size()/3, 3, aXYZ.size()/3);
+  std::vector<double> aUVWm[2];
+  for(unsigned int i=0;i<2;++i){
+    std::vector<dfm2::CNodeBVH2> aNodeBVH;
+    std::vector<dfm2::CBV3d_AABB> aBB;
+    dfm2::BuildBVH_MeshTri3D_Morton(aNodeBVH, aBB, aXYZ, aTri);
+    aUVWm[i] = aUVW;
+    bool is_impulse_applied = false;
+    GetIntermidiateVelocityContactResolved(
+        aUVWm[i], is_impulse_applied,
+        1.0, 0.05, 1.0, 1000.0,
+        aXYZ, aTri, psup_ind, psup,
+        0, aNodeBVH, aBB,
+        i == 0 ? 1 : 0);
+    EXPECT_TRUE(is_impulse_applied);
+  }
+  for(unsigned int i=0;i<aUVW.size();++i){
+    EXPECT_NEAR(aUVWm[0][i], aUVWm[1][i], 1.0e-10);
+  }
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <random>
+#include <vector>
+#include <climits>
+
+#include "gtest/gtest.h"
+
+#include "delfem2/dtet_v3.h"
+
+namespace dfm2 = delfem2;
+
+namespace {
+
+void MakeSuperTet(
+    std::vector<dfm2::CDynPointTet> &aPo3D,
+    std::vector<dfm2::CDynTet> &aSTet,
+    std::vector<dfm2::CVec3d> &aCent,
+    double len) {
+  aPo3D.emplace_back(-len, +len, -len);
+  aPo3D.emplace_back(+len, -len, -len);
+  aPo3D.emplace_back(+len, +len, +len);
+  aPo3D.emplace_back(-len, -len, +len);
+  for (unsigned int ip = 0; ip < 4; ++ip) {
+    aPo3D[ip].e = 0;
+    aPo3D[ip].poel = ip;
+  }
+  aSTet.resize(1);
+  for (unsigned int i = 0; i < 4; ++i) {
+    aSTet[0].v[i] = i;
+    aSTet[0].s[i] = UINT_MAX;
+  }
+  aCent.push_back(dfm2::CircumCenter(aPo3D[0].p, aPo3D[1].p, aPo3D[2].p, aPo3D[3].p));
+}
+
+}
+
+TEST(dtet_v3, add_points_delaunay) {
+  std::mt19937 rndeng(0);
+  std::uniform_real_distribution<double> dist_m1p1(-1, +1);
+  std::vector<dfm2::CDynPointTet> aPo3D;
+  std::vector<dfm2::CDynTet> aSTet;
+  std::vector<dfm2::CVec3d> aCent;
+  MakeSuperTet(aPo3D, aSTet, aCent, 10.0);
+  const double vol_super = dfm2::TetVolume(aSTet[0], aPo3D);
+  for (unsigned int ip = 0; ip < 2000; ++ip) {
+    aPo3D.emplace_back(dist_m1p1(rndeng), dist_m1p1(rndeng), dist_m1p1(rndeng));
+  }
+  aPo3D.push_back(aPo3D[10]);  // duplicated point is not added
+  EXPECT_EQ(dfm2::AddPointsTetDelaunay(aPo3D, aSTet, aCent), 1);
+  EXPECT_EQ(aPo3D.back().e, UINT_MAX);
+  aPo3D.pop_back();
+  unsigned int ntet = 0;
+  double vol = 0.0;
+  for (unsigned int it = 0; it < aSTet.size(); ++it) {
+    const dfm2::CDynTet &tet = aSTet[it];
+    if (!tet.isActive()) { continue; }
+    ntet++;
+    EXPECT_GT(dfm2::TetVolume(tet, aPo3D), 0.0);
+    vol += dfm2::TetVolume(tet, aPo3D);
+    for (unsigned int ifc = 0; ifc < 4; ++ifc) {
+      const unsigned int jt = tet.s[ifc];
+      if (jt == UINT_MAX) { continue; }
+      const int irel = dfm2::GetRelationshipTet(tet.v, aSTet[jt].v);
+      ASSERT_TRUE(irel >= 0 && irel < 12);
+      const unsigned int jfc = dfm2::tetRel[irel][ifc];
+      EXPECT_EQ(aSTet[jt].s[jfc], it);
+      // the opposite point is not inside the circumsphere
+      EXPECT_FALSE(dfm2::IsInsideCircumSphere(aPo3D[aSTet[jt].v[jfc]].p, tet, aCent[it], aPo3D));
+    }
+  }
+  EXPECT_NEAR(vol, vol_super, 1.0e-8 * vol_super);
+  for (unsigned int ip = 0; ip < aPo3D.size(); ++ip) {
+    ASSERT_NE(aPo3D[ip].e, UINT_MAX);
+    EXPECT_EQ(aSTet[aPo3D[ip].e].v[aPo3D[ip].poel], ip);
+  }
+  { // the delaunay tetrahedralization of the points in general position is unique
+    std::vector<dfm2::CDynPointTet> aPo3D1;
+    std::vector<dfm2::CDynTet> aSTet1;
+    std::vector<dfm2::CVec3d> aCent1;
+    MakeSuperTet(aPo3D1, aSTet1, aCent1, 10.0);
+    std::vector<int> tmp_buffer;
+    for (unsigned int ip = 4; ip < aPo3D.size(); ++ip) {
+      aPo3D1.emplace_back(aPo3D[ip].p.x, aPo3D[ip].p.y, aPo3D[ip].p.z);
+      const unsigned int itet = dfm2::FindTet_Walk(aPo3D1[ip].p, aPo3D1[ip - 1].e, aPo3D1, aSTet1);
+      ASSERT_NE(itet, UINT_MAX);
+      EXPECT_TRUE(dfm2::AddPointTetDelaunay(ip, itet, aPo3D1, aSTet1, aCent1, tmp_buffer));
+    }
+    unsigned int ntet1 = 0;
+    for (const auto &tet: aSTet1) { ntet1 += tet.isActive() ? 1 : 0; }
+    EXPECT_EQ(ntet, ntet1);
+  }
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <random>
+#include <vector>
+#include <climits>
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+#include "delfem2/dtri2_v2dtri.h"
+
+namespace dfm2 = delfem2;
+
+TEST(dtri2, meshing_initialize) {
+  std::mt19937 rndeng(0);
+  std::uniform_real_distribution<double> dist_01(0, 1);
+  for (unsigned int ndiv: {0, 1, 40}) {  // points on the lattice have the degenerated configurations
+    std::vector<dfm2::CVec2d> aVec2;
+    if (ndiv == 0) {
+      for (unsigned int ip = 0; ip < 3000; ++ip) {
+        aVec2.emplace_back(dist_01(rndeng), dist_01(rndeng));
+      }
+    } else {
+      for (unsigned int ix = 0; ix < ndiv + 1; ++ix) {
+        for (unsigned int iy = 0; iy < ndiv + 1; ++iy) {
+          aVec2.emplace_back(ix / static_cast<double>(ndiv), iy / static_cast<double>(ndiv));
+        }
+      }
+      std::shuffle(aVec2.begin(), aVec2.end(), rndeng);
+    }
+    const size_t np = aVec2.size();
+    std::vector<dfm2::CDynPntSur> aPo2D;
+    std::vector<dfm2::CDynTri> aTri;
+    dfm2::Meshing_Initialize(aPo2D, aTri, aVec2);
+    EXPECT_EQ(aVec2.size(), np + 3);  // points of the super triangle
+    for (const auto &po: aPo2D) { EXPECT_NE(po.e, UINT_MAX); }
+    EXPECT_EQ(aTri.size(), np * 2 + 1);  // every point is added inside the super triangle
+    for (unsigned int itri = 0; itri < aTri.size(); ++itri) {
+      const dfm2::CDynTri &tri = aTri[itri];
+      EXPECT_GT(dfm2::Area_Tri2(aVec2[tri.v[0]], aVec2[tri.v[1]], aVec2[tri.v[2]]), 0.0);
+      for (unsigned int iedge = 0; iedge < 3; ++iedge) {
+        const unsigned int jtri = tri.s2[iedge];
+        if (jtri == UINT_MAX) { continue; }
+        const unsigned int jno = dfm2::FindAdjEdgeIndex(tri, iedge, aTri);
+        EXPECT_EQ(aTri[jtri].s2[jno], itri);
+        const unsigned int jpo = aTri[jtri].v[jno];
+        if (ndiv != 0) { continue; }  // the co-circular points on the lattice are flipped either way
+        if (tri.v[0] >= np || tri.v[1] >= np || tri.v[2] >= np || jpo >= np) { continue; }  // super triangle
+        const int idet = dfm2::DetDelaunay(
+            aVec2[tri.v[0]], aVec2[tri.v[1]], aVec2[tri.v[2]],
+            aVec2[jpo]);
+        EXPECT_NE(idet, 0);  // the opposite point is not inside the circumcircle
+      }
+    }
+  }
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "gtest/gtest.h" // need to be defined in the beginning
+
+#include <random>
+#include <vector>
+#include <array>
+
+#include "delfem2/geo_ccd_batch.h"
+#include "delfem2/geo_ccd.h"
+#include "delfem2/geo_tri.h"
+#include "delfem2/geo_edge.h"
+#include "delfem2/vec3.h"
+
+namespace dfm2 = delfem2;
+
+namespace {
+
+// the four points at the start and the end. the points get close in the time step
+void MakeRandomPairs(
+    std::vector<std::array<dfm2::CVec3d, 8>> &aPoint,
+    dfm2::CPairsCCD<double> &pairs_d,
+    dfm2::CPairsCCD<float> &pairs_f,
+    unsigned int npair) {
+  std::mt19937 rndeng(0);
+  std::uniform_real_distribution<double> dist_m1p1(-1, +1);
+  aPoint.resize(npair);
+  for (auto &p: aPoint) {
+    for (unsigned int i = 0; i < 4; ++i) {
+      p[i] = dfm2::CVec3d(dist_m1p1(rndeng), dist_m1p1(rndeng), dist_m1p1(rndeng));
+      p[i + 4] = -0.5 * p[i] + 0.5 * dfm2::CVec3d(dist_m1p1(rndeng), dist_m1p1(rndeng), dist_m1p1(rndeng));
+    }
+    pairs_d.PushBack(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7]);
+    pairs_f.PushBack(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7]);
+  }
+}
+
+}
+
+TEST(geo_ccd_batch, coplanar_time) {
+  std::vector<std::array<dfm2::CVec3d, 8>> aPoint;
+  dfm2::CPairsCCD<double> pairs_d;
+  dfm2::CPairsCCD<float> pairs_f;
+  MakeRandomPairs(aPoint, pairs_d, pairs_f, 1003);
+  std::vector<double> aT;
+  std::vector<unsigned char> aFlg;
+  dfm2::FindCoplanarTime_Batch(aT, aFlg, pairs_d);
+  unsigned int ncoplanar = 0;
+  for (unsigned int ipair = 0; ipair < aPoint.size(); ++ipair) {
+    const auto &p = aPoint[ipair];
+    double t;
+    const bool res = dfm2::FindCoplanerInterp(t, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7]);
+    EXPECT_EQ(res, aFlg[ipair] == 1);
+    if (!res) { continue; }
+    EXPECT_EQ(t, aT[ipair]);
+    ncoplanar++;
+  }
+  EXPECT_GT(ncoplanar, 100);
+}
+
+TEST(geo_ccd_batch, vertex_face) {
+  std::vector<std::array<dfm2::CVec3d, 8>> aPoint;
+  dfm2::CPairsCCD<double> pairs_d;
+  dfm2::CPairsCCD<float> pairs_f;
+  MakeRandomPairs(aPoint, pairs_d, pairs_f, 1003);
+  std::vector<unsigned char> aFlgD, aFlgF;
+  dfm2::IsContact_FV_CCD_Batch(aFlgD, pairs_d);
+  dfm2::IsContact_FV_CCD_Batch(aFlgF, pairs_f);
+  unsigned int ncontact = 0, ndiff_f = 0;
+  for (unsigned int ipair = 0; ipair < aPoint.size(); ++ipair) {
+    const auto &p = aPoint[ipair];
+    const bool res = dfm2::IsContact_FV_CCD2(0, 1, 2, 3, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7]);
+    EXPECT_EQ(res, aFlgD[ipair] == 1);
+    if (res) { ncontact++; }
+    if (aFlgD[ipair] != aFlgF[ipair]) { ndiff_f++; }
+  }
+  EXPECT_GT(ncontact, 50);
+  EXPECT_LE(ndiff_f, aPoint.size() / 100); // single precision differs only near the boundaries
+}
+
+TEST(geo_ccd_batch, edge_edge) {
+  std::vector<std::array<dfm2::CVec3d, 8>> aPoint;
+  dfm2::CPairsCCD<double> pairs_d;
+  dfm2::CPairsCCD<float> pairs_f;
+  MakeRandomPairs(aPoint, pairs_d, pairs_f, 1003);
+  const double dist_max = 1.0e-2;
+  std::vector<unsigned char> aFlgD, aFlgF;
+  dfm2::IsContact_EE_CCD_Batch(aFlgD, pairs_d, dist_max);
+  dfm2::IsContact_EE_CCD_Batch(aFlgF, pairs_f, static_cast<float>(dist_max));
+  unsigned int ncontact = 0, ndiff_f = 0;
+  for (unsigned int ipair = 0; ipair < aPoint.size(); ++ipair) {
+    const auto &p = aPoint[ipair];
+    bool res = false;
+    double t;
+    if (dfm2::FindCoplanerInterp(t, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7])) {
+      const dfm2::CVec3d p0m = (1 - t) * p[0] + t * p[4];
+      const dfm2::CVec3d p1m = (1 - t) * p[1] + t * p[5];
+      const dfm2::CVec3d q0m = (1 - t) * p[2] + t * p[6];
+      const dfm2::CVec3d q1m = (1 - t) * p[3] + t * p[7];
+      double w0, w1;
+      const double dist = dfm2::Distance_Edge3_Edge3(p0m, p1m, q0m, q1m, w0, w1);
+      res = !(w0 < 0 || w0 > 1 || w1 < 0 || w1 > 1 || dist > dist_max);
+    }
+    EXPECT_EQ(res, aFlgD[ipair] == 1);
+    if (res) { ncontact++; }
+    if (aFlgD[ipair] != aFlgF[ipair]) { ndiff_f++; }
+  }
+  EXPECT_GT(ncontact, 5);
+  EXPECT_LE(ndiff_f, aPoint.size() / 100);
+}
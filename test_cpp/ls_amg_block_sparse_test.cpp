@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "gtest/gtest.h"
+
+#include "delfem2/ls_block_sparse.h"
+#include "delfem2/ls_ilu_block_sparse.h"
+#include "delfem2/ls_amg_block_sparse.h"
+#include "delfem2/lsitrsol.h"
+#include "delfem2/vecxitrsol.h"
+#include "delfem2/view_vectorx.h"
+#include "delfem2/fem_poisson.h"
+#include "delfem2/fem_solidlinear.h"
+#include "delfem2/msh_primitive.h"
+#include "delfem2/msh_topology_uniform.h"
+
+namespace dfm2 = delfem2;
+
+namespace {
+
+/**
+ * Poisson equation on the (n x n) grid with the Dirichlet boundary
+ */
+void MatrixPoisson2D(
+    dfm2::CMatrixSparse<double> &mat,
+    std::vector<double> &vec_b,
+    unsigned int n) {
+  std::vector<double> vtx_xy;
+  std::vector<unsigned int> quad_vtx;
+  dfm2::MeshQuad2D_Grid(vtx_xy, quad_vtx, n, n);
+  std::vector<unsigned int> tri_vtx;
+  for (unsigned int iq = 0; iq < quad_vtx.size() / 4; ++iq) {
+    const unsigned int *q = quad_vtx.data() + iq * 4;
+    tri_vtx.insert(tri_vtx.end(), {q[0], q[1], q[2], q[0], q[2], q[3]});
+  }
+  const size_t np = vtx_xy.size() / 2;
+  std::vector<unsigned int> psup_ind, psup;
+  dfm2::JArray_PSuP_MeshElem(psup_ind, psup, tri_vtx.data(), tri_vtx.size() / 3, 3, np);
+  mat.Initialize(np, 1, true);
+  mat.SetPattern(psup_ind.data(), psup_ind.size(), psup.data(), psup.size());
+  mat.setZero();
+  vec_b.assign(np, 0.);
+  const std::vector<double> val(np, 0.);
+  dfm2::MergeLinSys_Poission_MeshTri2D(
+      mat, vec_b.data(), 1., 1.,
+      vtx_xy.data(), np, tri_vtx.data(), tri_vtx.size() / 3, val.data());
+  std::vector<int> bc_flag(np, 0);
+  for (unsigned int ip = 0; ip < np; ++ip) {
+    const double x = vtx_xy[ip * 2 + 0], y = vtx_xy[ip * 2 + 1];
+    if (x < 0.5 || y < 0.5 || x > n - 0.5 || y > n - 0.5) { bc_flag[ip] = 1; }
+  }
+  mat.SetFixedBC(bc_flag.data());
+  dfm2::setRHS_Zero(vec_b, bc_flag, 0);
+}
+
+/**
+ * linear elastic cube made of (n x n x n) cells split into tetrahedra. The bottom face is fixed.
+ */
+void MatrixSolidLinear3D(
+    dfm2::CMatrixSparse<double> &mat,
+    std::vector<double> &vec_b,
+    std::vector<double> &vtx_xyz,
+    unsigned int n) {
+  const double h = 1. / n;
+  vtx_xyz.clear();
+  for (unsigned int iz = 0; iz <= n; ++iz) {
+    for (unsigned int iy = 0; iy <= n; ++iy) {
+      for (unsigned int ix = 0; ix <= n; ++ix) {
+        vtx_xyz.insert(vtx_xyz.end(), {ix * h, iy * h, iz * h});
+      }
+    }
+  }
+  const auto ivtx = [n](unsigned int ix, unsigned int iy, unsigned int iz) {
+    return (iz * (n + 1) + iy) * (n + 1) + ix;
+  };
+  std::vector<unsigned int> tet_vtx;
+  const unsigned int axis_order[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+  for (unsigned int iz = 0; iz < n; ++iz) {
+    for (unsigned int iy = 0; iy < n; ++iy) {
+      for (unsigned int ix = 0; ix < n; ++ix) {
+        for (const auto &ao: axis_order) {  // Kuhn subdivision of a cube into six tetrahedra
+          unsigned int c[3] = {ix, iy, iz};
+          unsigned int tet[4];
+          tet[0] = ivtx(c[0], c[1], c[2]);
+          for (unsigned int i = 0; i < 3; ++i) {
+            c[ao[i]]++;
+            tet[i + 1] = ivtx(c[0], c[1], c[2]);
+          }
+          const double *p0 = vtx_xyz.data() + tet[0] * 3, *p1 = vtx_xyz.data() + tet[1] * 3;
+          const double *p2 = vtx_xyz.data() + tet[2] * 3, *p3 = vtx_xyz.data() + tet[3] * 3;
+          const double a[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+          const double b[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+          const double d[3] = {p3[0] - p0[0], p3[1] - p0[1], p3[2] - p0[2]};
+          const double vol = a[0] * (b[1] * d[2] - b[2] * d[1])
+              - a[1] * (b[0] * d[2] - b[2] * d[0])
+              + a[2] * (b[0] * d[1] - b[1] * d[0]);
+          if (vol < 0) { std::swap(tet[2], tet[3]); }
+          tet_vtx.insert(tet_vtx.end(), tet, tet + 4);
+        }
+      }
+    }
+  }
+  const size_t np = vtx_xyz.size() / 3;
+  std::vector<unsigned int> psup_ind, psup;
+  dfm2::JArray_PSuP_MeshElem(psup_ind, psup, tet_vtx.data(), tet_vtx.size() / 4, 4, np);
+  mat.Initialize(np, 3, true);
+  mat.SetPattern(psup_ind.data(), psup_ind.size(), psup.data(), psup.size());
+  mat.setZero();
+  vec_b.assign(np * 3, 0.);
+  const std::vector<double> disp(np * 3, 0.);
+  const double gravity[3] = {0., 0., -1.};
+  dfm2::MergeLinSys_SolidLinear_Static_MeshTet3D(
+      mat, vec_b.data(), 1., 1., 1., gravity,
+      vtx_xyz.data(), np, tet_vtx.data(), tet_vtx.size() / 4, disp.data());
+  std::vector<int> bc_flag(np * 3, 0);
+  for (unsigned int ip = 0; ip < np; ++ip) {
+    if (vtx_xyz[ip * 3 + 2] > 0.5 * h) { continue; }
+    bc_flag[ip * 3 + 0] = bc_flag[ip * 3 + 1] = bc_flag[ip * 3 + 2] = 1;
+  }
+  mat.SetFixedBC(bc_flag.data());
+  dfm2::setRHS_Zero(vec_b, bc_flag, 0);
+}
+
+template<class PREC>
+std::vector<double> SolvePCG(
+    std::vector<double> &vec_x,
+    const dfm2::CMatrixSparse<double> &mat,
+    const std::vector<double> &vec_b,
+    const PREC &prec) {
+  const size_t n = vec_b.size();
+  std::vector<double> r = vec_b, tmp0(n), tmp1(n);
+  vec_x.resize(n);
+  return dfm2::Solve_PCG(
+      dfm2::ViewAsVectorXd(r), dfm2::ViewAsVectorXd(vec_x),
+      dfm2::ViewAsVectorXd(tmp0), dfm2::ViewAsVectorXd(tmp1),
+      1.0e-8, 1000, mat, prec);
+}
+
+double RelativeResidual(
+    const dfm2::CMatrixSparse<double> &mat,
+    const std::vector<double> &vec_b,
+    const std::vector<double> &vec_x) {
+  std::vector<double> r = vec_b;
+  mat.MatVec(r.data(), -1., vec_x.data(), 1.);
+  return std::sqrt(dfm2::Dot(r, r) / dfm2::Dot(vec_b, vec_b));
+}
+
+}
+
+TEST(ls_amg_block_sparse, poisson2d) {
+  std::vector<size_t> aNItr;
+  for (unsigned int n: {16, 32, 64}) {
+    dfm2::CMatrixSparse<double> mat;
+    std::vector<double> vec_b;
+    MatrixPoisson2D(mat, vec_b, n);
+    dfm2::CPreconditionerAMG<double> amg;
+    EXPECT_TRUE(amg.Initialize(mat));
+    EXPECT_GT(amg.NumLevel(), 1);
+    EXPECT_EQ(amg.levels[0]->mat, &mat); // the finest level is not copied
+    std::vector<double> vec_x;
+    const std::vector<double> hist = SolvePCG(vec_x, mat, vec_b, amg);
+    EXPECT_LT(RelativeResidual(mat, vec_b, vec_x), 1.0e-7);
+    aNItr.push_back(hist.size());
+  }
+  // the number of iterations hardly grows with the mesh resolution
+  EXPECT_LT(aNItr[2], aNItr[0] * 2);
+}
+
+TEST(ls_amg_block_sparse, solidlinear3d) {
+  for (unsigned int n: {4, 8}) {
+    dfm2::CMatrixSparse<double> mat;
+    std::vector<double> vec_b, vtx_xyz;
+    MatrixSolidLinear3D(mat, vec_b, vtx_xyz, n);
+    std::vector<double> nullspace;
+    const unsigned int nmode = dfm2::NearNullSpace_RigidBodyMode(
+        nullspace, vtx_xyz.data(), vtx_xyz.size() / 3, 3);
+    EXPECT_EQ(nmode, 6);
+    for (unsigned int nthread: {1, 0}) {
+      dfm2::CPreconditionerAMG<double> amg;
+      amg.nblk_coarsest = 16;
+      amg.nthread = nthread;
+      EXPECT_TRUE(amg.Initialize(mat, nullspace.data(), nmode));
+      std::vector<double> vec_x;
+      const std::vector<double> hist_amg = SolvePCG(vec_x, mat, vec_b, amg);
+      EXPECT_LT(RelativeResidual(mat, vec_b, vec_x), 1.0e-7);
+      dfm2::CPreconditionerILU<double> ilu;
+      ilu.Initialize_ILUk(mat, 0);
+      ilu.CopyValue(mat);
+      EXPECT_TRUE(ilu.Decompose());
+      const std::vector<double> hist_ilu = SolvePCG(vec_x, mat, vec_b, ilu);
+      if (n == 8) { EXPECT_LT(hist_amg.size(), hist_ilu.size()); }
+    }
+  }
+}
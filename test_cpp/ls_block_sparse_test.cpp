@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+#include "delfem2/ls_block_sparse.h"
+#include "delfem2/ls_ilu_block_sparse.h"
+#include "delfem2/ls_solver_block_sparse_ilu.h"
+#include "delfem2/msh_topology_uniform.h"
+#include "delfem2/msh_primitive.h"
+
+namespace dfm2 = delfem2;
+
+namespace {
+
+/**
+ * make a random block sparse matrix whose pattern is the one-ring neighborhood of a sphere mesh
+ */
+template<typename T>
+void RandomMatrix_SphereMesh(
+    dfm2::CMatrixSparse<T> &mat,
+    unsigned int ndim,
+    std::mt19937 &rdeng) {
+  std::vector<double> vtx_xyz;
+  std::vector<unsigned int> tri_vtx;
+  dfm2::MeshTri3D_Sphere(vtx_xyz, tri_vtx, 1., 16, 32);
+  const size_t nvtx = vtx_xyz.size() / 3;
+  std::vector<unsigned int> psup_ind, psup;
+  dfm2::JArray_PSuP_MeshElem(
+      psup_ind, psup,
+      tri_vtx.data(), tri_vtx.size() / 3, 3, nvtx);
+  mat.Initialize(nvtx, ndim, true);
+  mat.SetPattern(psup_ind.data(), psup_ind.size(), psup.data(), psup.size());
+  std::uniform_real_distribution<T> dist(-1, 1);
+  for (auto &v: mat.val_crs_) { v = dist(rdeng); }
+  for (auto &v: mat.val_dia_) { v = dist(rdeng); }
+}
+
+template<typename T>
+void CompareMatVec(
+    std::mt19937 &rdeng,
+    T tol) {
+  std::uniform_real_distribution<T> dist(-1, 1);
+  for (unsigned int ndim = 1; ndim < 6; ++ndim) {
+    dfm2::CMatrixSparse<T> mat;
+    RandomMatrix_SphereMesh(mat, ndim, rdeng);
+    const size_t n = mat.nrowblk_ * ndim;
+    std::vector<T> x(n), y0(n);
+    for (auto &v: x) { v = dist(rdeng); }
+    for (auto &v: y0) { v = dist(rdeng); }
+    std::vector<T> y_ref = y0, yt_ref = y0;
+    mat.MatVec(y_ref.data(), 0.3, x.data(), 0.7);
+    mat.MatTVec(yt_ref.data(), 0.3, x.data(), 0.7);
+    for (unsigned int nthread: {0, 2}) {
+      for (bool is_simd: {false, true}) {
+        mat.nthread_matvec_ = nthread;
+        mat.is_simd_matvec_ = is_simd;
+        std::vector<T> y = y0, yt = y0;
+        mat.MatVec(y.data(), 0.3, x.data(), 0.7);
+        mat.MatTVec(yt.data(), 0.3, x.data(), 0.7);
+        for (unsigned int i = 0; i < n; ++i) {
+          EXPECT_NEAR(y[i], y_ref[i], tol);
+          EXPECT_NEAR(yt[i], yt_ref[i], tol);
+        }
+      }
+    }
+  }
+}
+
+}
+
+TEST(ls_block_sparse, matvec_parallel) {
+  std::mt19937 rdeng(0);
+  CompareMatVec<double>(rdeng, 1.0e-10);
+  CompareMatVec<float>(rdeng, 1.0e-4f);
+}
+
+TEST(ls_block_sparse, mattvec_pattern_version) {
+  std::mt19937 rdeng(0);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  dfm2::CMatrixSparse<double> mat;
+  RandomMatrix_SphereMesh(mat, 2, rdeng);
+  mat.nthread_matvec_ = 2;
+  const size_t n = mat.nrowblk_ * 2;
+  std::vector<double> x(n), y(n, 0.);
+  for (auto &v: x) { v = dist(rdeng); }
+  mat.MatTVec(y.data(), 1., x.data(), 0.);  // make the cache of the transposed pattern
+  // change the pattern keeping its size. the values are re-assigned to the other columns
+  for (unsigned int iblk = 0; iblk < mat.nrowblk_; ++iblk) {
+    std::reverse(mat.row_ptr_.begin() + mat.col_ind_[iblk], mat.row_ptr_.begin() + mat.col_ind_[iblk + 1]);
+  }
+  ++mat.pattern_version_;
+  mat.MatTVec(y.data(), 1., x.data(), 0.);
+  mat.nthread_matvec_ = 1;
+  std::vector<double> y_ref(n, 0.);
+  mat.MatTVec(y_ref.data(), 1., x.data(), 0.);
+  for (unsigned int i = 0; i < n; ++i) { EXPECT_NEAR(y[i], y_ref[i], 1.0e-10); }
+}
+
+TEST(ls_ilu_block_sparse, level_schedule) {
+  std::mt19937 rdeng(0);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  for (unsigned int ndim = 1; ndim < 6; ++ndim) {
+    dfm2::CMatrixSparse<double> mat;
+    RandomMatrix_SphereMesh(mat, ndim, rdeng);
+    mat.AddDia(20. * ndim);
+    const size_t n = mat.nrowblk_ * ndim;
+    std::vector<double> r(n);
+    for (auto &v: r) { v = dist(rdeng); }
+    for (int lev_fill: {0, 1, -1}) {
+      dfm2::CPreconditionerILU<double> ilu0, ilu1;
+      ilu0.Initialize_ILUk(mat, lev_fill);
+      ilu1.Initialize_ILUk(mat, lev_fill);
+      ilu1.nthread = 0;
+      { // the rows in a level do not refer each other
+        const auto &li = ilu1.levelFwdInd;
+        std::vector<unsigned int> blk2lev(ilu1.nblk);
+        for (unsigned int ilev = 0; ilev + 1 < li.size(); ++ilev) {
+          for (unsigned int k = li[ilev]; k < li[ilev + 1]; ++k) { blk2lev[ilu1.levelFwdBlk[k]] = ilev; }
+        }
+        for (unsigned int iblk = 0; iblk < ilu1.nblk; ++iblk) {
+          for (unsigned int icrs = ilu1.colInd[iblk]; icrs < ilu1.m_diaInd[iblk]; ++icrs) {
+            EXPECT_LT(blk2lev[ilu1.rowPtr[icrs]], blk2lev[iblk]);
+          }
+        }
+      }
+      ilu0.CopyValue(mat);
+      ilu1.CopyValue(mat);
+      EXPECT_TRUE(ilu0.Decompose());
+      EXPECT_TRUE(ilu1.Decompose());
+      for (unsigned int i = 0; i < ilu0.valCrs.size(); ++i) { EXPECT_NEAR(ilu0.valCrs[i], ilu1.valCrs[i], 1.0e-10); }
+      for (unsigned int i = 0; i < ilu0.valDia.size(); ++i) { EXPECT_NEAR(ilu0.valDia[i], ilu1.valDia[i], 1.0e-10); }
+      std::vector<double> x0 = r, x1 = r;
+      ilu0.SolvePrecond(x0.data());
+      ilu1.SolvePrecond(x1.data());
+      for (unsigned int i = 0; i < n; ++i) { EXPECT_NEAR(x0[i], x1[i], 1.0e-10); }
+    }
+  }
+}
+
+TEST(ls_ilu_block_sparse, level_schedule_2x2_block) {
+  std::mt19937 rdeng(1);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  dfm2::CMatrixSparse<double> mat;
+  RandomMatrix_SphereMesh(mat, 2, rdeng);
+  for (unsigned int iblk = 0; iblk < mat.nrowblk_; ++iblk) {
+    // non-singular diagonal block with zero (0,0) entry needs the pivoting in the Gauss-Jordan elimination
+    double *d = mat.val_dia_.data() + iblk * 4;
+    d[0] = 0.;
+    d[1] = 40.;
+    d[2] = -40.;
+    d[3] = 5.;
+  }
+  const size_t n = mat.nrowblk_ * 2;
+  std::vector<double> r(n);
+  for (auto &v: r) { v = dist(rdeng); }
+  dfm2::CPreconditionerILU<double> ilu0, ilu1;
+  ilu0.Initialize_ILUk(mat, 0);
+  ilu1.Initialize_ILUk(mat, 0);
+  ilu1.nthread = 0;
+  ilu0.CopyValue(mat);
+  ilu1.CopyValue(mat);
+  EXPECT_TRUE(ilu0.Decompose());
+  EXPECT_TRUE(ilu1.Decompose());
+  for (unsigned int i = 0; i < ilu0.valCrs.size(); ++i) { EXPECT_NEAR(ilu0.valCrs[i], ilu1.valCrs[i], 1.0e-10); }
+  for (unsigned int i = 0; i < ilu0.valDia.size(); ++i) { EXPECT_NEAR(ilu0.valDia[i], ilu1.valDia[i], 1.0e-10); }
+  std::vector<double> x0 = r, x1 = r;
+  ilu0.SolvePrecond(x0.data());
+  ilu1.SolvePrecond(x1.data());
+  for (unsigned int i = 0; i < n; ++i) { EXPECT_NEAR(x0[i], x1[i], 1.0e-10); }
+}
+
+TEST(ls_block_sparse, merge_plan) {
+  std::vector<double> vtx_xyz;
+  std::vector<unsigned int> tri_vtx;
+  dfm2::MeshTri3D_Sphere(vtx_xyz, tri_vtx, 1., 8, 16);
+  const size_t nvtx = vtx_xyz.size() / 3;
+  const size_t ntri = tri_vtx.size() / 3;
+  std::vector<unsigned int> psup_ind, psup;
+  dfm2::JArray_PSuP_MeshElem(
+      psup_ind, psup,
+      tri_vtx.data(), ntri, 3, nvtx);
+  dfm2::CMatrixSparse<double> mat0, mat1;
+  for (auto *mat: {&mat0, &mat1}) {
+    mat->Initialize(nvtx, 3, true);
+    mat->SetPattern(psup_ind.data(), psup_ind.size(), psup.data(), psup.size());
+    mat->setZero();
+  }
+  dfm2::CMergePlan plan;
+  EXPECT_TRUE(plan.Initialize(mat1, tri_vtx.data(), ntri, 3));
+  std::mt19937 rdeng(0);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  std::vector<unsigned int> merge_buffer;
+  for (unsigned int itri = 0; itri < ntri; ++itri) {
+    double emat[3][3][3][3];
+    for (unsigned int i = 0; i < 81; ++i) { (&emat[0][0][0][0])[i] = dist(rdeng); }
+    dfm2::Merge<3, 3, 3, 3, double>(mat0, tri_vtx.data() + itri * 3, tri_vtx.data() + itri * 3, emat, merge_buffer);
+    EXPECT_TRUE((plan.Merge<3, 3, 3>(mat1, itri, emat)));
+  }
+  for (unsigned int i = 0; i < mat0.val_crs_.size(); ++i) { EXPECT_EQ(mat0.val_crs_[i], mat1.val_crs_[i]); }
+  for (unsigned int i = 0; i < mat0.val_dia_.size(); ++i) { EXPECT_EQ(mat0.val_dia_[i], mat1.val_dia_[i]); }
+  { // the poles of the sphere are not connected, so the plan cannot be made
+    const unsigned int elem_vtx[3] = {0, 1, static_cast<unsigned int>(nvtx - 1)};
+    dfm2::CMergePlan plan_bad;
+    EXPECT_FALSE(plan_bad.Initialize(mat1, elem_vtx, 1, 3));
+    EXPECT_TRUE(plan_bad.elem_blk_.empty());
+  }
+}
+
+TEST(ls_solver_block_sparse_ilu, mixed_precision) {
+  std::mt19937 rdeng(0);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  { // symmetric positive definite matrix (weighted graph Laplacian plus small diagonal)
+    dfm2::CMatrixSparse<double> mat;
+    RandomMatrix_SphereMesh(mat, 3, rdeng);
+    mat.setZero();
+    for (unsigned int iblk = 0; iblk < mat.nrowblk_; ++iblk) {
+      for (unsigned int icrs = mat.col_ind_[iblk]; icrs < mat.col_ind_[iblk + 1]; ++icrs) {
+        const unsigned int jblk = mat.row_ptr_[icrs];
+        const double w = 1. + 0.1 * ((std::min(iblk, jblk) * 7 + std::max(iblk, jblk) * 13) % 5);
+        for (unsigned int idim = 0; idim < 3; ++idim) {
+          mat.val_crs_[icrs * 9 + idim * 4] = -w;
+          mat.val_dia_[iblk * 9 + idim * 4] += w;
+        }
+      }
+    }
+    mat.AddDia(0.1);
+    const size_t n = mat.nrowblk_ * 3;
+    std::vector<double> b(n);
+    for (auto &v: b) { v = dist(rdeng); }
+    std::vector<double> x0(n);
+    {
+      dfm2::CPreconditionerILU<double> ilu;
+      ilu.Initialize_ILUk(mat, 0);
+      ilu.CopyValue(mat);
+      EXPECT_TRUE(ilu.Decompose());
+      std::vector<double> r = b, tmp0(n), tmp1(n);
+      dfm2::Solve_PCG(
+          dfm2::ViewAsVectorXd(r), dfm2::ViewAsVectorXd(x0),
+          dfm2::ViewAsVectorXd(tmp0), dfm2::ViewAsVectorXd(tmp1),
+          1.0e-12, 1000, mat, ilu);
+    }
+    dfm2::CMatrixSparse<float> mat_low;
+    mat_low.CopyCast(mat);
+    dfm2::CPreconditionerILU<float> ilu_low;
+    ilu_low.Initialize_ILUk(mat_low, 0);
+    ilu_low.CopyValue(mat_low);
+    EXPECT_TRUE(ilu_low.Decompose());
+    std::vector<double> r = b, x1(n);
+    const std::vector<double> hist = dfm2::Solve_PCG_MixedPrecision(
+        r.data(), x1.data(), 1.0e-10, 20, 1000, mat, mat_low, ilu_low);
+    EXPECT_LT(hist.back(), 1.0e-10);
+    EXPECT_LT(hist.size(), 20);
+    for (unsigned int i = 0; i < n; ++i) { EXPECT_NEAR(x0[i], x1[i], 1.0e-7); }
+  }
+  for (unsigned int ndim = 1; ndim < 6; ++ndim) { // non-symmetric matrix
+    dfm2::CMatrixSparse<double> mat;
+    RandomMatrix_SphereMesh(mat, ndim, rdeng);
+    mat.AddDia(20. * ndim);
+    const size_t n = mat.nrowblk_ * ndim;
+    dfm2::CMatrixSparse<float> mat_low;
+    mat_low.CopyCast(mat);
+    for (unsigned int nthread: {1, 0}) {
+      dfm2::CPreconditionerILU<float> ilu_low;
+      ilu_low.Initialize_ILUk(mat_low, 0);
+      ilu_low.nthread = nthread;
+      ilu_low.CopyValue(mat_low);
+      EXPECT_TRUE(ilu_low.Decompose());
+      std::vector<double> b(n);
+      for (auto &v: b) { v = dist(rdeng); }
+      std::vector<double> r = b, x(n);
+      const std::vector<double> hist = dfm2::Solve_PBiCGStab_MixedPrecision(
+          r.data(), x.data(), 1.0e-10, 20, 1000, mat, mat_low, ilu_low);
+      EXPECT_LT(hist.back(), 1.0e-10);
+      // check the residual independently
+      mat.MatVec(b.data(), -1.0, x.data(), 1.0);
+      double sq_norm_res = 0.;
+      for (unsigned int i = 0; i < n; ++i) { sq_norm_res += b[i] * b[i]; }
+      double sq_norm_r = 0.;
+      for (unsigned int i = 0; i < n; ++i) { sq_norm_r += r[i] * r[i]; }
+      EXPECT_NEAR(sq_norm_res, sq_norm_r, 1.0e-20);
+    }
+  }
+}
+
+TEST(ls_solver_block_sparse_ilu, mixed_precision_new_pattern) {
+  std::vector<double> vtx_xyz;
+  std::vector<unsigned int> tri_vtx;
+  dfm2::MeshTri3D_Sphere(vtx_xyz, tri_vtx, 1., 8, 16);
+  const size_t nvtx = vtx_xyz.size() / 3;
+  std::vector<unsigned int> psup_ind0(nvtx + 1, 0), psup0; // diagonal only
+  std::vector<unsigned int> psup_ind1, psup1;
+  dfm2::JArray_PSuP_MeshElem(
+      psup_ind1, psup1,
+      tri_vtx.data(), tri_vtx.size() / 3, 3, nvtx);
+  dfm2::LinearSystemSolver_BlockSparseILU solver;
+  for (auto *pattern: {&psup_ind0, &psup_ind1}) {
+    // the same size but the different pattern in the second loop
+    auto &psup = (pattern == &psup_ind0) ? psup0 : psup1;
+    solver.Initialize(nvtx, 1, *pattern, psup);
+    solver.BeginMerge();
+    for (unsigned int iblk = 0; iblk < nvtx; ++iblk) {
+      for (unsigned int icrs = solver.matrix.col_ind_[iblk]; icrs < solver.matrix.col_ind_[iblk + 1]; ++icrs) {
+        solver.matrix.val_crs_[icrs] = -1.;
+        solver.matrix.val_dia_[iblk] += 1.;
+      }
+      solver.matrix.val_dia_[iblk] += 0.1;
+      solver.vec_r[iblk] = std::sin(iblk);
+    }
+    solver.Solve_PcgIlu_MixedPrecision();
+    dfm2::CPreconditionerILU<float> ilu;
+    ilu.Initialize_ILUk(solver.matrix_low, 0);
+    EXPECT_EQ(solver.ilu_low.colInd, ilu.colInd);
+    EXPECT_EQ(solver.ilu_low.rowPtr, ilu.rowPtr);
+    EXPECT_LT(solver.conv_hist.back(), 1.0e-5);
+  }
+}
@@ -5,10 +5,18 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <fstream>
+#include <climits>
+#include <chrono>
+#include <iomanip>
+#include <random>
+
 #include "gtest/gtest.h"
 
 #include "delfem2/mshmisc.h"
 #include "delfem2/msh_io_obj.h"
+#include "delfem2/msh_io_ply.h"
+#include "delfem2/msh_io_binary.h"
 
 #ifndef M_PI
 #  define M_PI 3.14159265359
@@ -26,3 +34,147 @@ TEST(mshio, load_obj) {
       std::filesystem::path(PATH_INPUT_DIR) / "bunny_1k.obj");
   EXPECT_EQ(aTri.size(), 1000 * 3);
 }
+
+TEST(mshio, load_obj_parallel) {
+  { // same as the serial reader
+    const auto path = std::filesystem::path(PATH_INPUT_DIR) / "bunny_1k.obj";
+    std::vector<double> vtx_xyz0, vtx_xyz1;
+    std::vector<unsigned int> tri_vtx0, tri_vtx1;
+    dfm2::Read_Obj3(vtx_xyz0, tri_vtx0, path);
+    EXPECT_TRUE(dfm2::Read_Obj3_Parallel(vtx_xyz1, tri_vtx1, path));
+    EXPECT_EQ(vtx_xyz0, vtx_xyz1);
+    EXPECT_EQ(tri_vtx0, tri_vtx1);
+    std::vector<float> vtx_xyz2, vtx_xyz3;
+    dfm2::Read_Obj3(vtx_xyz2, tri_vtx0, path);
+    EXPECT_TRUE(dfm2::Read_Obj3_Parallel(vtx_xyz3, tri_vtx1, path));
+    EXPECT_EQ(vtx_xyz2, vtx_xyz3);
+    EXPECT_EQ(tri_vtx0, tri_vtx1);
+  }
+  { // large file split into chunks with the relative indices, attributes and CRLF
+    const auto path = std::filesystem::temp_directory_path()
+        / ("dfm2_load_obj_parallel_" + std::to_string(std::random_device{}()) + ".obj");  // unique for concurrent runs
+    std::mt19937 rdeng(0);
+    std::uniform_real_distribution<double> dist(-1.e+3, 1.e+3);
+    std::vector<double> vtx_xyz0;
+    std::vector<unsigned int> tri_vtx0;
+    {
+      std::ofstream fout(path, std::ios::binary);
+      fout << "# comment\r\n";
+      const unsigned int nvtx = 30000;
+      for (unsigned int ivtx = 0; ivtx < nvtx; ++ivtx) {
+        double v[3];
+        fout << "v";
+        for (auto &c: v) {
+          c = dist(rdeng);
+          if (ivtx % 3 == 1) { c = std::round(c * 100.) / 100.; }  // short decimal
+          if (ivtx % 3 == 2) { c *= 1.0e-30; }  // large exponent
+          fout << " " << std::setprecision(17) << c;
+          vtx_xyz0.push_back(c);
+        }
+        fout << ((ivtx % 2 == 0) ? "\r\n" : "\n");
+        fout << "vn 0 0 1\nvt 0.5 0.5\n";
+        if (ivtx < 3) { continue; }
+        if (ivtx % 2 == 0) {  // triangle with the relative indices
+          fout << "f -1/1/1 -2/1/1 -3/1/1\n";
+          tri_vtx0.insert(tri_vtx0.end(), {ivtx, ivtx - 1, ivtx - 2});
+        } else {  // quad
+          fout << "f " << ivtx + 1 << "//1 " << ivtx << "//1 " << ivtx - 1 << "//1 " << ivtx - 2 << "//1\n";
+          tri_vtx0.insert(tri_vtx0.end(), {ivtx, ivtx - 1, ivtx - 2, ivtx, ivtx - 2, ivtx - 3});
+        }
+      }
+    }
+    std::vector<double> vtx_xyz1;
+    std::vector<unsigned int> tri_vtx1;
+    EXPECT_TRUE(dfm2::Read_Obj3_Parallel(vtx_xyz1, tri_vtx1, path));
+    EXPECT_EQ(vtx_xyz0, vtx_xyz1);
+    EXPECT_EQ(tri_vtx0, tri_vtx1);
+    std::filesystem::remove(path);
+  }
+}
+
+TEST(mshio, binary_cache) {
+  const auto dir = std::filesystem::temp_directory_path()
+      / ("dfm2_binary_cache_" + std::to_string(std::random_device{}()));  // unique for concurrent runs
+  std::filesystem::create_directories(dir);
+  for (const char *name: {"bunny_1k.obj", "bunny_1k.ply"}) {
+    const auto path = dir / name;
+    std::filesystem::copy_file(
+        std::filesystem::path(PATH_INPUT_DIR) / name, path,
+        std::filesystem::copy_options::overwrite_existing);
+    const auto path_cache = dfm2::MeshBinary_CachePath(path);
+    std::filesystem::remove(path_cache);
+    std::vector<double> vtx_xyz0;
+    std::vector<unsigned int> tri_vtx0;
+    if (path.extension() == ".obj") {
+      dfm2::Read_Obj3(vtx_xyz0, tri_vtx0, path);
+    } else {
+      dfm2::Read_Ply(vtx_xyz0, tri_vtx0, path);
+    }
+    std::vector<double> vtx_xyz1;
+    std::vector<unsigned int> tri_vtx1;
+    EXPECT_TRUE(dfm2::Read_MeshTri3_Cached(vtx_xyz1, tri_vtx1, path));  // parse and write the cache
+    EXPECT_TRUE(std::filesystem::exists(path_cache));
+    EXPECT_EQ(vtx_xyz0, vtx_xyz1);
+    EXPECT_EQ(tri_vtx0, tri_vtx1);
+    {
+      dfm2::CMeshBinaryView view;
+      EXPECT_TRUE(view.Open(path_cache));
+      size_t n;
+      const double *p = view.Array<double>(dfm2::MESHBIN_ARRAY::VTX_XYZ, n);
+      ASSERT_NE(p, nullptr);
+      EXPECT_EQ(n, vtx_xyz0.size());
+      EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p) % dfm2::MeshBinary_Alignment, 0);
+      EXPECT_EQ(view.Array<float>(dfm2::MESHBIN_ARRAY::VTX_XYZ, n), nullptr);
+      EXPECT_EQ(view.Array<unsigned int>(dfm2::MESHBIN_ARRAY::PSUP, n), nullptr);
+    }
+    std::vector<float> vtx_xyz2;
+    EXPECT_TRUE(dfm2::Read_MeshTri3_Cached(vtx_xyz2, tri_vtx1, path));  // read from the cache
+    EXPECT_EQ(vtx_xyz2, std::vector<float>(vtx_xyz0.begin(), vtx_xyz0.end()));
+    EXPECT_EQ(tri_vtx0, tri_vtx1);
+    { // the stale cache is not used
+      std::ofstream fout(path, std::ios::app);
+      fout << "\n";
+    }
+    std::filesystem::last_write_time(
+        path, std::filesystem::last_write_time(path) + std::chrono::seconds(1));
+    std::ofstream(path_cache, std::ios::binary | std::ios::in | std::ios::out).write("X", 1);  // break the magic
+    EXPECT_TRUE(dfm2::Read_MeshTri3_Cached(vtx_xyz1, tri_vtx1, path));
+    EXPECT_EQ(vtx_xyz0, vtx_xyz1);
+    EXPECT_EQ(tri_vtx0, tri_vtx1);
+    { // the cache written by a "float" reader keeps the precision for a "double" reader
+      std::filesystem::remove(path_cache);
+      EXPECT_TRUE(dfm2::Read_MeshTri3_Cached(vtx_xyz2, tri_vtx1, path));
+      EXPECT_TRUE(std::filesystem::exists(path_cache));
+      EXPECT_TRUE(dfm2::Read_MeshTri3_Cached(vtx_xyz1, tri_vtx1, path));
+      EXPECT_EQ(vtx_xyz0, vtx_xyz1);
+    }
+  }
+  for (const auto &entry: std::filesystem::directory_iterator(dir)) {  // no temporary file is left
+    EXPECT_NE(entry.path().extension(), ".tmp");
+  }
+  { // optional arrays
+    dfm2::CMeshBinary<float> mesh;
+    mesh.vtx_xyz = {0, 0, 0, 1, 0, 0, 0, 1, 0};
+    mesh.elem_vtx = {0, 1, 2};
+    mesh.psup_ind = {0, 2, 4, 6};
+    mesh.psup = {1, 2, 0, 2, 0, 1};
+    mesh.bvh_node = {UINT_MAX, 0, UINT_MAX};
+    mesh.bvh_aabb = {0, 1, 0, 1, 0, 0};
+    const auto path = dir / "tri.dfm2bin";
+    EXPECT_TRUE(dfm2::Write_MeshBinary(path, mesh));
+    dfm2::CMeshBinaryView view;
+    EXPECT_TRUE(view.Open(path));
+    EXPECT_EQ(view.ndim, 3);
+    EXPECT_EQ(view.num_node_elem, 3);
+    size_t n;
+    const unsigned int *psup = view.Array<unsigned int>(dfm2::MESHBIN_ARRAY::PSUP, n);
+    ASSERT_NE(psup, nullptr);
+    EXPECT_EQ(std::vector<unsigned int>(psup, psup + n), mesh.psup);
+    std::vector<double> aabb;
+    EXPECT_TRUE(view.CopyArray(aabb, dfm2::MESHBIN_ARRAY::BVH_AABB));
+    EXPECT_EQ(aabb, std::vector<double>(mesh.bvh_aabb.begin(), mesh.bvh_aabb.end()));
+    std::vector<double> nrm;
+    EXPECT_FALSE(view.CopyArray(nrm, dfm2::MESHBIN_ARRAY::VTX_NRM));
+  }
+  std::filesystem::remove_all(dir);
+}
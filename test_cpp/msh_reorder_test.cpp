@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#include "gtest/gtest.h"
+
+#include "delfem2/msh_reorder.h"
+#include "delfem2/msh_topology_uniform.h"
+#include "delfem2/msh_primitive.h"
+
+namespace dfm2 = delfem2;
+
+namespace {
+
+// largest and average differences of the indices of the adjacent points
+std::pair<unsigned int, double> Bandwidth(
+    const std::vector<unsigned int> &elem_vtx,
+    unsigned int nnoel,
+    size_t num_vtx) {
+  std::vector<unsigned int> psup_ind, psup;
+  dfm2::JArray_PSuP_MeshElem(psup_ind, psup, elem_vtx.data(), elem_vtx.size() / nnoel, nnoel, num_vtx);
+  unsigned int bw = 0;
+  double sum = 0.0;
+  for (unsigned int ip = 0; ip < num_vtx; ++ip) {
+    for (unsigned int ipsup = psup_ind[ip]; ipsup < psup_ind[ip + 1]; ++ipsup) {
+      const unsigned int jp = psup[ipsup];
+      bw = std::max(bw, ip > jp ? ip - jp : jp - ip);
+      sum += ip > jp ? ip - jp : jp - ip;
+    }
+  }
+  return {bw, sum / psup.size()};
+}
+
+bool IsPermutation(const std::vector<unsigned int> &new2old, size_t n) {
+  std::vector<unsigned int> tmp = new2old;
+  std::sort(tmp.begin(), tmp.end());
+  std::vector<unsigned int> iota(n);
+  std::iota(iota.begin(), iota.end(), 0);
+  return tmp == iota;
+}
+
+}
+
+TEST(msh_reorder, reverse_cuthill_mckee) {
+  std::vector<double> vtx_xyz0;
+  std::vector<unsigned int> elem_vtx0;
+  dfm2::MeshHex3_Grid(vtx_xyz0, elem_vtx0, 12, 9, 5, 0.1);
+  const size_t np = vtx_xyz0.size() / 3;
+  const size_t nelem = elem_vtx0.size() / 8;
+  { // shuffle the points and the elements
+    std::vector<unsigned int> new2old(np);
+    std::iota(new2old.begin(), new2old.end(), 0);
+    std::shuffle(new2old.begin(), new2old.end(), std::mt19937(0));
+    std::vector<unsigned int> old2new;
+    dfm2::InversePermutation(old2new, new2old);
+    std::vector<unsigned int> elem_new2old(nelem);
+    std::iota(elem_new2old.begin(), elem_new2old.end(), 0);
+    std::shuffle(elem_new2old.begin(), elem_new2old.end(), std::mt19937(1));
+    dfm2::Permute_Values(vtx_xyz0, new2old, 3);
+    dfm2::Renumber_MeshElem(elem_vtx0, 8, old2new, elem_new2old);
+  }
+  // add a point not used by any element to test the isolated component
+  vtx_xyz0.insert(vtx_xyz0.end(), {-1., -1., -1.});
+  const auto [bw0, avg0] = Bandwidth(elem_vtx0, 8, np + 1);
+  //
+  std::vector<double> vtx_xyz1 = vtx_xyz0;
+  std::vector<unsigned int> elem_vtx1 = elem_vtx0;
+  std::vector<unsigned int> vtx_new2old, elem_new2old;
+  dfm2::Reorder_MeshElem_ReverseCuthillMcKee(
+      vtx_new2old, elem_new2old,
+      vtx_xyz1, 3, elem_vtx1, 8);
+  EXPECT_TRUE(IsPermutation(vtx_new2old, np + 1));
+  EXPECT_TRUE(IsPermutation(elem_new2old, nelem));
+  const auto [bw1, avg1] = Bandwidth(elem_vtx1, 8, np + 1);
+  EXPECT_LT(bw1 * 4, bw0);
+  EXPECT_LT(avg1 * 4, avg0);
+  EXPECT_LE(bw1, 2 * 6 * 10 + 2 * 10 + 2);  // bandwidth of the grid ordered along the longest axis
+  // the elements have the same geometry
+  for (unsigned int ielem = 0; ielem < nelem; ++ielem) {
+    for (unsigned int inoel = 0; inoel < 8; ++inoel) {
+      const unsigned int ip1 = elem_vtx1[ielem * 8 + inoel];
+      const unsigned int ip0 = elem_vtx0[elem_new2old[ielem] * 8 + inoel];
+      EXPECT_EQ(vtx_new2old[ip1], ip0);
+      for (unsigned int idim = 0; idim < 3; ++idim) {
+        EXPECT_EQ(vtx_xyz1[ip1 * 3 + idim], vtx_xyz0[ip0 * 3 + idim]);
+      }
+    }
+  }
+  // the elements are sorted by their smallest point
+  for (unsigned int ielem = 0; ielem + 1 < nelem; ++ielem) {
+    const unsigned int *p0 = elem_vtx1.data() + ielem * 8;
+    const unsigned int *p1 = elem_vtx1.data() + ielem * 8 + 8;
+    EXPECT_LE(*std::min_element(p0, p0 + 8), *std::min_element(p1, p1 + 8));
+  }
+  { // a value computed on the reordered mesh is mapped back
+    std::vector<double> vtx_xyz2(vtx_xyz1.size());
+    for (unsigned int inew = 0; inew < np + 1; ++inew) {
+      for (unsigned int idim = 0; idim < 3; ++idim) {
+        vtx_xyz2[vtx_new2old[inew] * 3 + idim] = vtx_xyz1[inew * 3 + idim];
+      }
+    }
+    EXPECT_EQ(vtx_xyz2, vtx_xyz0);
+  }
+  { // Morton ordering of the points makes the adjacent points close in the memory
+    std::vector<unsigned int> new2old;
+    dfm2::Permutation_MortonCode_Points3(new2old, vtx_xyz0);
+    EXPECT_TRUE(IsPermutation(new2old, np + 1));
+    std::vector<unsigned int> old2new;
+    dfm2::InversePermutation(old2new, new2old);
+    std::vector<unsigned int> elem_vtx2 = elem_vtx0;
+    dfm2::Renumber_MeshElem(elem_vtx2, 8, old2new, {});
+    EXPECT_LT(Bandwidth(elem_vtx2, 8, np + 1).second * 4, avg0);
+  }
+}
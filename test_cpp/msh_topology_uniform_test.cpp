@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <vector>
+#include <filesystem>
+
+#include "gtest/gtest.h"
+
+#include "delfem2/msh_topology_uniform.h"
+#include "delfem2/msh_primitive.h"
+#include "delfem2/msh_io_ply.h"
+
+namespace dfm2 = delfem2;
+
+namespace {
+
+// the jagged arrays made by the parallel code are the same as the serial ones
+void CompareSerialParallel(
+    const std::vector<unsigned int> &elem_vtx,
+    dfm2::MESHELEM_TYPE elem_type,
+    size_t num_vtx) {
+  const unsigned int nnoel = dfm2::nNodeElem(elem_type);
+  const size_t nelem = elem_vtx.size() / nnoel;
+  std::vector<unsigned int> elsup_ind0, elsup0;
+  dfm2::JArray_ElSuP_MeshElem(elsup_ind0, elsup0, elem_vtx.data(), nelem, nnoel, num_vtx, 1);
+  std::vector<unsigned int> elsuel0;
+  dfm2::ElSuEl_MeshElem(elsuel0, elem_vtx.data(), nelem, elem_type, num_vtx, 1);
+  std::vector<unsigned int> psup_ind0, psup0;
+  dfm2::JArray_PSuP_MeshElem(psup_ind0, psup0, elem_vtx.data(), nelem, nnoel, num_vtx, 1);
+  std::vector<unsigned int> edge_ind0, edge0;
+  dfm2::JArrayEdge_MeshElem(edge_ind0, edge0, elem_vtx.data(), elem_type, elsup_ind0, elsup0, false, 1);
+  for (unsigned int nthread: {0, 4}) {
+    std::vector<unsigned int> elsup_ind1, elsup1;
+    dfm2::JArray_ElSuP_MeshElem(elsup_ind1, elsup1, elem_vtx.data(), nelem, nnoel, num_vtx, nthread);
+    EXPECT_EQ(elsup_ind0, elsup_ind1);
+    EXPECT_EQ(elsup0, elsup1);
+    std::vector<unsigned int> elsuel1;
+    dfm2::ElSuEl_MeshElem(elsuel1, elem_vtx.data(), nelem, elem_type, num_vtx, nthread);
+    EXPECT_EQ(elsuel0, elsuel1);
+    std::vector<unsigned int> psup_ind1, psup1;
+    dfm2::JArray_PSuP_MeshElem(psup_ind1, psup1, elem_vtx.data(), nelem, nnoel, num_vtx, nthread);
+    EXPECT_EQ(psup_ind0, psup_ind1);
+    EXPECT_EQ(psup0, psup1);
+    std::vector<unsigned int> edge_ind1, edge1;
+    dfm2::JArrayEdge_MeshElem(edge_ind1, edge1, elem_vtx.data(), elem_type, elsup_ind1, elsup1, false, nthread);
+    EXPECT_EQ(edge_ind0, edge_ind1);
+    EXPECT_EQ(edge0, edge1);
+  }
+}
+
+}
+
+TEST(msh_topology_uniform, parallel) {
+  {
+    std::vector<double> vtx_xyz;
+    std::vector<unsigned int> tri_vtx;
+    dfm2::Read_Ply(
+        vtx_xyz, tri_vtx,
+        std::filesystem::path(PATH_INPUT_DIR) / "bunny_1k.ply");
+    CompareSerialParallel(tri_vtx, dfm2::MESHELEM_TRI, vtx_xyz.size() / 3);
+  }
+  {
+    std::vector<double> vtx_xyz;
+    std::vector<unsigned int> hex_vtx;
+    dfm2::MeshHex3_Grid(vtx_xyz, hex_vtx, 7, 5, 6, 1.0);
+    CompareSerialParallel(hex_vtx, dfm2::MESHELEM_HEX, vtx_xyz.size() / 3);
+  }
+}
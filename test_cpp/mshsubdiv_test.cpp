@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <vector>
+#include <cmath>
+
+#include "gtest/gtest.h"
+
+#include "delfem2/mshsubdiv.h"
+#include "delfem2/msh_primitive.h"
+
+namespace dfm2 = delfem2;
+
+TEST(mshsubdiv, stencil_catmull_clark) {
+  for (unsigned int imesh = 0; imesh < 2; ++imesh) {
+    std::vector<double> vtx_xyz0;
+    std::vector<unsigned int> quad_vtx0;
+    if (imesh == 0) { // closed mesh
+      const double bbmin[3] = {-1, -1, -1};
+      const double bbmax[3] = {+1, +1, +1};
+      dfm2::MeshQuad3_CubeVox(vtx_xyz0, quad_vtx0, bbmin, bbmax);
+    } else { // mesh with the boundary
+      std::vector<double> vtx_xy;
+      dfm2::MeshQuad2D_Grid(vtx_xy, quad_vtx0, 4, 3);
+      for (unsigned int ip = 0; ip < vtx_xy.size() / 2; ++ip) {
+        const double x = vtx_xy[ip * 2 + 0], y = vtx_xy[ip * 2 + 1];
+        vtx_xyz0.insert(vtx_xyz0.end(), {x, y, std::sin(x) * std::cos(y)});
+      }
+    }
+    const unsigned int nlevel = 3;
+    // subdivision level by level
+    std::vector<unsigned int> quad_vtx1 = quad_vtx0;
+    std::vector<double> vtx_xyz1 = vtx_xyz0;
+    for (unsigned int ilevel = 0; ilevel < nlevel; ++ilevel) {
+      const std::vector<unsigned int> quad_vtx = quad_vtx1;
+      const std::vector<double> vtx_xyz = vtx_xyz1;
+      std::vector<unsigned int> psup_ind, psup, aEdgeFace;
+      dfm2::SubdivTopo_MeshQuad(
+          quad_vtx1, psup_ind, psup, aEdgeFace,
+          quad_vtx.data(), quad_vtx.size() / 4, vtx_xyz.size() / 3);
+      dfm2::SubdivisionPoints_QuadCatmullClark(
+          vtx_xyz1,
+          quad_vtx1, aEdgeFace, psup_ind, psup,
+          quad_vtx.data(), quad_vtx.size() / 4,
+          vtx_xyz.data(), vtx_xyz.size() / 3);
+    }
+    for (unsigned int nthread: {1, 0, 4}) {
+      std::vector<unsigned int> quad_vtx2, stencil_ind, stencil_vtx;
+      std::vector<double> stencil_weight;
+      dfm2::SubdivStencil_MeshQuadCatmullClark(
+          quad_vtx2, stencil_ind, stencil_vtx, stencil_weight,
+          quad_vtx0.data(), quad_vtx0.size() / 4, vtx_xyz0.size() / 3,
+          nlevel, false, nthread);
+      EXPECT_EQ(quad_vtx2, quad_vtx1);
+      ASSERT_EQ(stencil_ind.size(), vtx_xyz1.size() / 3 + 1);
+      for (unsigned int iv = 0; iv < stencil_ind.size() - 1; ++iv) { // partition of unity
+        double sum = 0.0;
+        for (unsigned int ist = stencil_ind[iv]; ist < stencil_ind[iv + 1]; ++ist) { sum += stencil_weight[ist]; }
+        EXPECT_NEAR(sum, 1.0, 1.0e-10);
+      }
+      std::vector<double> vtx_xyz2;
+      dfm2::Points_Stencil(
+          vtx_xyz2,
+          stencil_ind, stencil_vtx, stencil_weight,
+          vtx_xyz0.data(), 3, nthread);
+      ASSERT_EQ(vtx_xyz2.size(), vtx_xyz1.size());
+      for (unsigned int i = 0; i < vtx_xyz1.size(); ++i) {
+        EXPECT_NEAR(vtx_xyz2[i], vtx_xyz1[i], 1.0e-10);
+      }
+    }
+    if (imesh == 0) { // the limit points are closer to the points after more subdivisions
+      std::vector<double> aDist[2];
+      for (bool is_limit: {false, true}) {
+        std::vector<unsigned int> quad_vtx2, stencil_ind, stencil_vtx;
+        std::vector<double> stencil_weight;
+        dfm2::SubdivStencil_MeshQuadCatmullClark(
+            quad_vtx2, stencil_ind, stencil_vtx, stencil_weight,
+            quad_vtx0.data(), quad_vtx0.size() / 4, vtx_xyz0.size() / 3,
+            1, is_limit, 1);
+        std::vector<double> vtx_xyz2;
+        dfm2::Points_Stencil(
+            vtx_xyz2,
+            stencil_ind, stencil_vtx, stencil_weight,
+            vtx_xyz0.data(), 3, 1);
+        // the points of the first level keep their indexes in the finer levels
+        for (unsigned int iv = 0; iv < vtx_xyz2.size() / 3; ++iv) {
+          double dist = 0.0;
+          for (unsigned int idim = 0; idim < 3; ++idim) {
+            const double d = vtx_xyz2[iv * 3 + idim] - vtx_xyz1[iv * 3 + idim];
+            dist += d * d;
+          }
+          aDist[is_limit ? 1 : 0].push_back(std::sqrt(dist));
+        }
+      }
+      for (unsigned int iv = 0; iv < aDist[0].size(); ++iv) {
+        EXPECT_LT(aDist[1][iv], aDist[0][iv] * 0.2);
+      }
+    }
+  }
+}
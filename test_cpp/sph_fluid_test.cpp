@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "delfem2/sph_fluid.h"
+
+namespace dfm2 = delfem2;
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+TEST(sph_fluid, neighbor_grid) {
+  dfm2::CSphFluid3 sph;
+  const double box_min[3] = {0.0, 0.0, 0.0};
+  const double box_max[3] = {0.03, 0.03, 0.03};
+  sph.AddParticlesInBox(box_min, box_max);
+  const unsigned int np = sph.NumParticle();
+  EXPECT_GT(np, 200);
+  for (unsigned int istep = 0; istep < 20; ++istep) { sph.Step(); }
+  sph.UpdateNeighborGrid();
+  sph.DensityPressure();
+  sph.AccumulateForce();
+  // compare with the brute force
+  const double h = sph.radius_cutoff;
+  const double poly6_kern = 315.0 / (64.0 * M_PI * std::pow(h, 9));
+  const double spiky_kern = -45.0 / (M_PI * std::pow(h, 6));
+  const double lap_kern = 45.0 / (M_PI * std::pow(h, 6));
+  std::vector<double> aRhoInv(np);
+  for (unsigned int ip = 0; ip < np; ++ip) {
+    double sum = 0;
+    for (unsigned int jp = 0; jp < np; ++jp) {
+      if (ip == jp) { continue; }
+      double sqr = 0;
+      for (int idim = 0; idim < 3; ++idim) {
+        const double d = sph.xyz[ip * 3 + idim] - sph.xyz[jp * 3 + idim];
+        sqr += d * d;
+      }
+      if (sqr > h * h) { continue; }
+      sum += (h * h - sqr) * (h * h - sqr) * (h * h - sqr);
+    }
+    aRhoInv[ip] = 1.0 / (sum * sph.mass * poly6_kern);
+    EXPECT_NEAR(aRhoInv[ip], sph.rho_inv[ip], std::abs(aRhoInv[ip]) * 1.0e-10);
+  }
+  for (unsigned int ip = 0; ip < np; ip += 7) {
+    double f[3] = {0, 0, 0};
+    for (unsigned int jp = 0; jp < np; ++jp) {
+      if (ip == jp) { continue; }
+      double dr[3], sqr = 0;
+      for (int idim = 0; idim < 3; ++idim) {
+        dr[idim] = sph.xyz[ip * 3 + idim] - sph.xyz[jp * 3 + idim];
+        sqr += dr[idim] * dr[idim];
+      }
+      const double r = std::sqrt(sqr);
+      if (r > h) { continue; }
+      const double c = h - r;
+      const double pterm = -0.5 * c * spiky_kern * (sph.pressure[ip] + sph.pressure[jp]) / r;
+      for (int idim = 0; idim < 3; ++idim) {
+        const double dv = sph.velo[jp * 3 + idim] - sph.velo[ip * 3 + idim];
+        f[idim] += (pterm * dr[idim] + lap_kern * sph.viscosity * dv) * c * aRhoInv[ip] * aRhoInv[jp];
+      }
+    }
+    const double scale = std::sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]) + 1.0e-10;
+    for (int idim = 0; idim < 3; ++idim) {
+      EXPECT_NEAR(f[idim], sph.force[ip * 3 + idim], scale * 1.0e-8);
+    }
+  }
+}
+
+TEST(sph_fluid, parallel) {
+  const double box_min[3] = {0.0, 0.0, 0.0};
+  const double box_max[3] = {0.05, 0.1, 0.05};
+  dfm2::CSphFluid3 sph0, sph1;
+  sph0.AddParticlesInBox(box_min, box_max);
+  sph1.AddParticlesInBox(box_min, box_max);
+  for (unsigned int istep = 0; istep < 30; ++istep) {
+    sph0.Step(1);
+    sph1.Step(0);
+  }
+  EXPECT_EQ(sph0.xyz, sph1.xyz);  // the result does not depend on the threads
+  for (unsigned int ip = 0; ip < sph0.NumParticle(); ++ip) {
+    for (int idim = 0; idim < 3; ++idim) {
+      const double x = sph0.xyz[ip * 3 + idim];
+      EXPECT_TRUE(std::isfinite(x));
+      EXPECT_GT(x, sph0.bbmin[idim] - 0.01);
+      EXPECT_LT(x, sph0.bbmax[idim] + 0.01);
+    }
+  }
+}
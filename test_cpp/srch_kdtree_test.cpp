@@ -9,3 +9,60 @@ TEST(kdtree, test0)
 {
 	TestKdtreeTest0<delfem2::CVec3d>(20);
 }
+
+TEST(kdtree, flat)
+{
+	std::mt19937 rngeng(0);
+	std::uniform_real_distribution<double> dist_m1p1(-1, +1);
+	for (unsigned int np : { 1, 7, 1000, 5000 }) {
+		std::vector<delfem2::CVec3d> points(np);
+		for (auto& p : points) {
+			p = { dist_m1p1(rngeng), dist_m1p1(rngeng), dist_m1p1(rngeng) };
+		}
+		if (np > 100) {
+			points[10] = points[20];  // duplicated point
+			for (unsigned int ip = 0; ip < 50; ++ip) { points[ip].p[2] = 0.5; }  // points on a plane
+		}
+		std::vector<delfem2::CVec3d> queries(200);
+		for (auto& q : queries) {
+			q = { dist_m1p1(rngeng), dist_m1p1(rngeng), dist_m1p1(rngeng) };
+		}
+		for (unsigned int nthread : { 1, 0 }) {
+			const delfem2::KDTreePoint<delfem2::CVec3d> kdt(points, nthread);
+			EXPECT_EQ(kdt.Size(), np);
+			std::vector<unsigned int> aIndNearest;
+			std::vector<double> aDistNearest;
+			kdt.NearestPoints(aIndNearest, aDistNearest, queries, nthread);
+			for (unsigned int iq = 0; iq < queries.size(); ++iq) {
+				const delfem2::CVec3d& q = queries[iq];
+				std::vector<std::pair<double, unsigned int> > aDistInd;
+				for (unsigned int ip = 0; ip < np; ++ip) {
+					aDistInd.emplace_back((points[ip] - q).squaredNorm(), ip);
+				}
+				std::sort(aDistInd.begin(), aDistInd.end());
+				EXPECT_EQ(aDistNearest[iq], aDistInd[0].first);
+				EXPECT_EQ((points[aIndNearest[iq]] - q).squaredNorm(), aDistInd[0].first);
+				// k nearest
+				const unsigned int k = 5;
+				std::vector<std::pair<double, unsigned int> > aNeighbor;
+				kdt.KNearestPoints(aNeighbor, q, k);
+				EXPECT_EQ(aNeighbor.size(), std::min(k, np));
+				for (unsigned int i = 0; i < aNeighbor.size(); ++i) {
+					EXPECT_EQ(aNeighbor[i].first, aDistInd[i].first);
+					EXPECT_EQ((points[aNeighbor[i].second] - q).squaredNorm(), aNeighbor[i].first);
+				}
+				// radius
+				const double radius = 0.3;
+				std::vector<unsigned int> aInd;
+				kdt.PointsInSphere(aInd, q, radius);
+				std::vector<unsigned int> aIndBruteForce;
+				for (const auto& di : aDistInd) {
+					if (di.first <= radius * radius) { aIndBruteForce.push_back(di.second); }
+				}
+				std::sort(aInd.begin(), aInd.end());
+				std::sort(aIndBruteForce.begin(), aIndBruteForce.end());
+				EXPECT_EQ(aInd, aIndBruteForce);
+			}
+		}
+	}
+}
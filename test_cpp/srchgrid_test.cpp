@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2019 Nobuyuki Umetani
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <random>
+#include <vector>
+#include <cmath>
+
+#include "gtest/gtest.h"
+
+#include "delfem2/srchgrid.h"
+
+namespace dfm2 = delfem2;
+
+namespace {
+
+// indices of the points within the radius from "p" by the brute force
+std::vector<unsigned int> NeighborsBruteForce(
+    const std::vector<double> &aXYZ,
+    const double p[3],
+    double radius,
+    const double period[3]) {
+  std::vector<unsigned int> aIP;
+  for (unsigned int ip = 0; ip < aXYZ.size() / 3; ++ip) {
+    double sqdist = 0;
+    for (unsigned int idim = 0; idim < 3; ++idim) {
+      double d = p[idim] - aXYZ[ip * 3 + idim];
+      if (period != nullptr) { d -= period[idim] * std::round(d / period[idim]); }
+      sqdist += d * d;
+    }
+    if (sqdist <= radius * radius) { aIP.push_back(ip); }
+  }
+  return aIP;
+}
+
+}
+
+TEST(srchgrid, cell_list) {
+  std::mt19937 rndeng(0);
+  std::uniform_real_distribution<double> dist_01(0, 1);
+  const double bbmin[3] = {0, 0, 0};
+  const double bbmax[3] = {1.0, 0.5, 0.25};
+  const double period[3] = {1.0, 0.5, 0.25};
+  using DOMAIN_TYPE = dfm2::CCellList3::DOMAIN_TYPE;
+  for (auto domain: {DOMAIN_TYPE::BOUNDED, DOMAIN_TYPE::PERIODIC, DOMAIN_TYPE::UNBOUNDED}) {
+    // 0.3 makes less than three cells in the z axis and is larger than half of the z period.
+    // only the nearest image is reported, the same as the brute force
+    for (double radius: {0.1, 0.3}) {
+      std::vector<double> aXYZ;
+      for (unsigned int ip = 0; ip < 2000; ++ip) {
+        for (unsigned int idim = 0; idim < 3; ++idim) {
+          // some points are outside the box
+          aXYZ.push_back(bbmin[idim] + (bbmax[idim] - bbmin[idim]) * (1.2 * dist_01(rndeng) - 0.1));
+        }
+      }
+      dfm2::CCellList3 cl;
+      cl.Initialize(bbmin, bbmax, radius, domain);
+      for (unsigned int nthread: {1, 0}) {
+        cl.Build(aXYZ.data(), static_cast<unsigned int>(aXYZ.size() / 3), nthread);
+        EXPECT_EQ(cl.cell_ind.back(), aXYZ.size() / 3);
+        for (unsigned int iq = 0; iq < 100; ++iq) {
+          const double q[3] = {
+              1.4 * dist_01(rndeng) - 0.2,
+              0.7 * dist_01(rndeng) - 0.1,
+              0.35 * dist_01(rndeng) - 0.05};
+          std::vector<unsigned int> aIP;
+          cl.ForEachNeighbor(
+              q,
+              [&](unsigned int jp, const double d[3], double sqdist) {
+                EXPECT_NEAR(d[0] * d[0] + d[1] * d[1] + d[2] * d[2], sqdist, 1.0e-12);
+                aIP.push_back(jp);
+              });
+          std::sort(aIP.begin(), aIP.end());
+          const double *per = (domain == DOMAIN_TYPE::PERIODIC) ? period : nullptr;
+          EXPECT_EQ(aIP, NeighborsBruteForce(aXYZ, q, radius, per));
+        }
+      }
+      { // reordered points are in the order of the cells
+        cl.Reorder(aXYZ, 3);
+        EXPECT_EQ(aXYZ, cl.cell_xyz);
+        cl.Build(aXYZ.data(), static_cast<unsigned int>(aXYZ.size() / 3));
+        for (unsigned int ip = 0; ip < aXYZ.size() / 3; ++ip) { EXPECT_EQ(cl.cell_vtx[ip], ip); }
+      }
+    }
+  }
+}
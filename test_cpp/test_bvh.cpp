@@ -14,8 +14,13 @@
 #include "delfem2/srch_bv3_sphere.h"
 #include "delfem2/srch_bv3_aabb.h"
 #include "delfem2/srch_bvh.h"
+#include "delfem2/srch_bvh_wide.h"
+#include "delfem2/srch_bvh_io_binary.h"
+#include "delfem2/srch_selfintersection_bvh.h"
+#include "delfem2/srch_spatialhash.h"
 #include "delfem2/vec3.h"
 #include "delfem2/vec3_funcs.h"
+#include "delfem2/mat4.h"
 #include "delfem2/msh_primitive.h"
 #include "delfem2/msh_normal.h"
 #include "delfem2/msh_affine_transformation.h"
@@ -565,3 +570,456 @@ TEST(bvh,morton_code)
     }
   }
 }
+
+TEST(bvh,morton_parallel)
+{
+  std::mt19937 rndeng(0);
+  std::uniform_real_distribution<double> dist_01(0.0, 1.0);
+  std::vector<double> aXYZ(30000*3);
+  for(auto& v : aXYZ){ v = dist_01(rndeng); }
+  for(unsigned int ip=0;ip<100;++ip){ // duplicated points
+    for(int i=0;i<3;++i){ aXYZ[(ip+100)*3+i] = aXYZ[ip*3+i]; }
+  }
+  const size_t N = aXYZ.size()/3;
+  const double min_xyz[3] = {0,0,0};
+  const double max_xyz[3] = {1,1,1};
+  { // 30-bit code
+    std::vector<std::pair<std::uint32_t,unsigned int>> aMcId;
+    for(unsigned int ip=0;ip<N;++ip){
+      aMcId.emplace_back(dfm2::MortonCode(aXYZ[ip*3+0],aXYZ[ip*3+1],aXYZ[ip*3+2]), ip);
+    }
+    std::sort(aMcId.begin(), aMcId.end());
+    for(unsigned int nthread : {1,0}) {
+      std::vector<unsigned int> aSortedId;
+      std::vector<std::uint32_t> aSortedMc;
+      dfm2::SortedMortenCode_Points3(aSortedId, aSortedMc, aXYZ, min_xyz, max_xyz, nthread);
+      for(unsigned int i=0;i<N;++i){ // stable sort
+        EXPECT_EQ(aSortedMc[i], aMcId[i].first);
+        EXPECT_EQ(aSortedId[i], aMcId[i].second);
+      }
+    }
+  }
+  std::vector<unsigned int> aSortedId;
+  std::vector<std::uint64_t> aSortedMc;
+  dfm2::SortedMortenCode_Points3(aSortedId, aSortedMc, aXYZ, min_xyz, max_xyz, 0);
+  for(unsigned int i=0;i<N;++i){
+    const unsigned int ip = aSortedId[i];
+    EXPECT_EQ(aSortedMc[i], dfm2::MortonCode64(aXYZ[ip*3+0],aXYZ[ip*3+1],aXYZ[ip*3+2]));
+    if( i > 0 ){ EXPECT_LE(aSortedMc[i-1], aSortedMc[i]); }
+  }
+  std::vector<dfm2::CNodeBVH2> aNodeBVH0, aNodeBVH1;
+  dfm2::BVHTopology_Morton(aNodeBVH0, aSortedId, aSortedMc, 1);
+  dfm2::BVHTopology_Morton(aNodeBVH1, aSortedId, aSortedMc, 0);
+  {
+    std::vector<int> aFlgBranch(N-1,0), aFlgLeaf(N,0), aFlgID(N,0);
+    mark_child(aFlgBranch,aFlgLeaf,aFlgID, N, 0,aNodeBVH1);
+    for(unsigned int i=0;i<N;++i){
+      EXPECT_EQ(aFlgLeaf[i],1);
+      EXPECT_EQ(aFlgID[i],1);
+    }
+    for(size_t i=0;i<N-1;++i){ EXPECT_EQ(aFlgBranch[i],1); }
+  }
+  for(unsigned int inode=0;inode<aNodeBVH0.size();++inode){
+    EXPECT_EQ(aNodeBVH0[inode].iparent, aNodeBVH1[inode].iparent);
+    EXPECT_EQ(aNodeBVH0[inode].ichild[0], aNodeBVH1[inode].ichild[0]);
+    EXPECT_EQ(aNodeBVH0[inode].ichild[1], aNodeBVH1[inode].ichild[1]);
+  }
+  { // bottom-up refit gives the same volumes
+    std::vector<dfm2::CBV3_AABB<double>> aAABB0, aAABB1;
+    dfm2::CLeafVolumeMaker_Point<dfm2::CBV3_AABB<double>,double> lvm(aXYZ.data(), N);
+    dfm2::BVH_BuildBVHGeometry(aAABB0, 0, aNodeBVH1, lvm);
+    for(unsigned int nthread : {1, 0}){
+      dfm2::BVH_BuildBVHGeometry_BottomUp(aAABB1, aNodeBVH1, lvm, nthread);
+      for(unsigned int inode=0;inode<aNodeBVH1.size();++inode){
+        for(int i=0;i<3;++i){
+          EXPECT_EQ(aAABB0[inode].bbmin[i], aAABB1[inode].bbmin[i]);
+          EXPECT_EQ(aAABB0[inode].bbmax[i], aAABB1[inode].bbmax[i]);
+        }
+      }
+    }
+  }
+  { // mesh with spheres
+    std::vector<double> aXYZ1;
+    std::vector<unsigned int> aTri;
+    dfm2::MeshTri3D_Sphere(aXYZ1, aTri, 1.0, 32, 32);
+    std::vector<dfm2::CNodeBVH2> aNodeBVH;
+    std::vector<dfm2::CBV3d_Sphere> aBV0, aBV1;
+    dfm2::ConstructBVHTriangleMeshMortonCode(aNodeBVH, aBV0, aXYZ1, aTri);
+    dfm2::CLeafVolumeMaker_Mesh<dfm2::CBV3d_Sphere, double> lvm(
+        1.0e-10, aXYZ1.data(), aXYZ1.size()/3, aTri.data(), aTri.size()/3, 3);
+    dfm2::BVH_BuildBVHGeometry_BottomUp(aBV1, aNodeBVH, lvm, 0);
+    for(unsigned int inode=0;inode<aNodeBVH.size();++inode){
+      EXPECT_EQ(aBV0[inode].r, aBV1[inode].r);
+      for(int i=0;i<3;++i){ EXPECT_EQ(aBV0[inode].c[i], aBV1[inode].c[i]); }
+    }
+    std::vector<dfm2::CNodeBVH2> aNodeBVH2, aNodeBVH3;
+    std::vector<dfm2::CBV3d_AABB> aAABB2, aAABB3;
+    dfm2::BuildBVH_MeshTri3D_Morton(aNodeBVH2, aAABB2, aXYZ1, aTri, 1);
+    dfm2::BuildBVH_MeshTri3D_Morton(aNodeBVH3, aAABB3, aXYZ1, aTri, 0);
+    ASSERT_EQ(aNodeBVH2.size(), aNodeBVH3.size());
+    for(unsigned int inode=0;inode<aNodeBVH2.size();++inode){
+      EXPECT_EQ(aNodeBVH2[inode].ichild[0], aNodeBVH3[inode].ichild[0]);
+      EXPECT_EQ(aNodeBVH2[inode].ichild[1], aNodeBVH3[inode].ichild[1]);
+      for(int i=0;i<3;++i){
+        EXPECT_EQ(aAABB2[inode].bbmin[i], aAABB3[inode].bbmin[i]);
+        EXPECT_EQ(aAABB2[inode].bbmax[i], aAABB3[inode].bbmax[i]);
+      }
+    }
+    // the linear BVH made in parallel answers the same queries as the top-down one
+    dfm2::CBVH_MeshTri3D<dfm2::CBV3d_AABB, double> bvh0, bvh1;
+    bvh0.Init(aXYZ1.data(), aXYZ1.size()/3, aTri.data(), aTri.size()/3, 0.0, 1);
+    bvh1.Init(aXYZ1.data(), aXYZ1.size()/3, aTri.data(), aTri.size()/3, 0.0, 0);
+    std::mt19937 rndeng(0);
+    std::uniform_real_distribution<double> dist_m1p1(-1, +1);
+    for(int itr=0;itr<100;++itr){
+      const dfm2::CVec3d p0(2*dist_m1p1(rndeng), 2*dist_m1p1(rndeng), 2*dist_m1p1(rndeng));
+      const dfm2::PointOnSurfaceMesh<double> pes0 = bvh0.NearestPoint_Global(p0, aXYZ1, aTri);
+      const dfm2::PointOnSurfaceMesh<double> pes1 = bvh1.NearestPoint_Global(p0, aXYZ1, aTri);
+      const dfm2::CVec3d q0 = pes0.PositionOnMeshTri3(aXYZ1, aTri);
+      const dfm2::CVec3d q1 = pes1.PositionOnMeshTri3(aXYZ1, aTri);
+      EXPECT_NEAR(Distance3(q0,p0), Distance3(q1,p0), 1.0e-10);
+    }
+  }
+}
+
+TEST(bvh,refit_incremental)
+{
+  std::vector<double> aXYZ;
+  std::vector<unsigned int> aTri;
+  dfm2::MeshTri3D_Sphere(aXYZ, aTri, 1.0, 32, 32);
+  const size_t nXYZ = aXYZ.size()/3;
+  dfm2::CBVH_MeshTri3D<dfm2::CBV3d_AABB, double> bvh0, bvh1;
+  bvh0.Init(aXYZ.data(), nXYZ, aTri.data(), aTri.size()/3, 0.01);
+  bvh1.Init(aXYZ.data(), nXYZ, aTri.data(), aTri.size()/3, 0.01);
+  std::mt19937 rndeng(0);
+  std::uniform_real_distribution<double> dist_m1p1(-1, +1);
+  std::uniform_int_distribution<unsigned int> dist_vtx(0, static_cast<unsigned int>(nXYZ-1));
+  for(int itr=0;itr<10;++itr){ // small deformation of a few vertices
+    std::vector<unsigned int> aIndVtxMoved;
+    for(int i=0;i<10;++i){
+      const unsigned int ip = dist_vtx(rndeng);
+      aIndVtxMoved.push_back(ip);
+      for(int idim=0;idim<3;++idim){ aXYZ[ip*3+idim] += 0.02*dist_m1p1(rndeng); }
+    }
+    bvh0.UpdateGeometry(aXYZ.data(), nXYZ, aTri.data(), aTri.size()/3, 0.01);
+    EXPECT_LT(bvh0.sum_area, 0); // not computed until requested
+    EXPECT_FALSE( bvh1.UpdateGeometry_MovedVertices(
+        aXYZ.data(), nXYZ, aTri.data(), aTri.size()/3, 0.01,
+        aIndVtxMoved.data(), aIndVtxMoved.size()) );
+    for(unsigned int ibvh=0;ibvh<bvh0.aBB_BVH.size();++ibvh){
+      for(int idim=0;idim<3;++idim){
+        EXPECT_EQ(bvh0.aBB_BVH[ibvh].bbmin[idim], bvh1.aBB_BVH[ibvh].bbmin[idim]);
+        EXPECT_EQ(bvh0.aBB_BVH[ibvh].bbmax[idim], bvh1.aBB_BVH[ibvh].bbmax[idim]);
+      }
+    }
+    EXPECT_NEAR(bvh1.sum_area,
+                dfm2::BVH_SumSurfaceArea(bvh1.iroot_bvh, bvh1.aNodeBVH, bvh1.aBB_BVH),
+                1.0e-8);
+  }
+  { // shuffling the vertices degrades the tree
+    std::vector<unsigned int> aIndVtxMoved;
+    for(unsigned int ip=0;ip<nXYZ;++ip){
+      const unsigned int jp = dist_vtx(rndeng);
+      for(int idim=0;idim<3;++idim){ std::swap(aXYZ[ip*3+idim], aXYZ[jp*3+idim]); }
+      aIndVtxMoved.push_back(ip);
+    }
+    bvh1.num_update_check_rebuild = 1;
+    EXPECT_TRUE( bvh1.UpdateGeometry_MovedVertices(
+        aXYZ.data(), nXYZ, aTri.data(), aTri.size()/3, 0.01,
+        aIndVtxMoved.data(), aIndVtxMoved.size()) );
+    EXPECT_NEAR(bvh1.SAHCost(), bvh1.sah_cost_rebuild, 1.0e-10);
+  }
+}
+
+template <typename BV>
+void TestTraversalIterative()
+{
+  std::vector<double> aXYZ;
+  std::vector<unsigned int> aTri;
+  dfm2::MeshTri3D_Sphere(aXYZ, aTri, 1.0, 16, 16);
+  std::vector<dfm2::CNodeBVH2> aNodeBVH;
+  std::vector<BV> aBV;
+  dfm2::BuildBVH_MeshTri3D_Morton(aNodeBVH, aBV, aXYZ, aTri);
+  std::vector<unsigned int> aIndTriAll(aTri.size()/3);
+  for(unsigned int itri=0;itri<aIndTriAll.size();++itri){ aIndTriAll[itri] = itri; }
+  std::mt19937 rndeng(0);
+  std::uniform_real_distribution<double> dist_m1p1(-1, +1);
+  const unsigned int nray = 200;
+  std::vector<double> ray_src, ray_dir;
+  for(unsigned int iray=0;iray<nray;++iray){
+    for(int idim=0;idim<3;++idim){ ray_src.push_back(2*dist_m1p1(rndeng)); }
+    for(int idim=0;idim<3;++idim){ // most of the rays hit the sphere
+      ray_dir.push_back(0.8*dist_m1p1(rndeng)-ray_src[iray*3+idim]);
+    }
+  }
+  std::vector<dfm2::PointOnSurfaceMesh<double>> aPes;
+  dfm2::Intersection_Rays3_Tri3_Bvh(
+      aPes,
+      ray_src.data(), ray_dir.data(), nray,
+      aXYZ, aTri, aNodeBVH, aBV);
+  unsigned int nhit = 0;
+  for(unsigned int iray=0;iray<nray;++iray){
+    const dfm2::CVec3d src(ray_src.data()+iray*3), dir(ray_dir.data()+iray*3);
+    std::map<double, dfm2::PointOnSurfaceMesh<double>> mapDepthPES;
+    dfm2::IntersectionRay_MeshTri3DPart(
+        mapDepthPES,
+        src, dir, aTri, aXYZ, aIndTriAll, 1.0e-10);
+    EXPECT_EQ( mapDepthPES.empty(), aPes[iray].itri == UINT_MAX );
+    if( mapDepthPES.empty() ){ continue; }
+    nhit++;
+    const dfm2::CVec3d q0 = aPes[iray].PositionOnMeshTri3(aXYZ, aTri);
+    EXPECT_NEAR( (q0-src).dot(dir)/dir.squaredNorm(), mapDepthPES.begin()->first, 1.0e-8 );
+  }
+  EXPECT_GT(nhit, nray/4);
+  // nearest points
+  const unsigned int npoint = 200;
+  std::vector<double> points;
+  for(unsigned int ip=0;ip<npoint*3;++ip){ points.push_back(1.5*dist_m1p1(rndeng)); }
+  dfm2::Nearest_Points3_Tri3_Bvh(
+      aPes,
+      points.data(), npoint,
+      aXYZ, aTri, aNodeBVH, aBV);
+  for(unsigned int ip=0;ip<npoint;++ip){
+    double dist_min = -1;
+    dfm2::PointOnSurfaceMesh<double> pes;
+    dfm2::BVH_NearestPoint_MeshTri3D(
+        dist_min, pes,
+        points[ip*3+0], points[ip*3+1], points[ip*3+2],
+        aXYZ, aTri, 0, aNodeBVH, aBV);
+    ASSERT_NE( aPes[ip].itri, UINT_MAX );
+    const dfm2::CVec3d q0 = aPes[ip].PositionOnMeshTri3(aXYZ, aTri);
+    EXPECT_NEAR( (q0-dfm2::CVec3d(points.data()+ip*3)).norm(), dist_min, 1.0e-10 );
+  }
+  { // early termination of the traversal
+    unsigned int nleaf = 0;
+    const bool is_complete = dfm2::BVH_Traverse(
+        0, aNodeBVH,
+        [](unsigned int){ return true; },
+        [&nleaf](unsigned int){ nleaf++; return nleaf < 10; });
+    EXPECT_FALSE(is_complete);
+    EXPECT_EQ(nleaf, 10);
+  }
+}
+
+TEST(bvh,traversal_iterative)
+{
+  TestTraversalIterative<dfm2::CBV3d_AABB>();
+  TestTraversalIterative<dfm2::CBV3_Sphere<double>>();
+}
+
+template <unsigned int N>
+void TestWideBVH()
+{
+  std::vector<double> aXYZ;
+  std::vector<unsigned int> aTri;
+  dfm2::MeshTri3_Torus(aXYZ, aTri, 1.0, 0.3, 32, 16);
+  std::vector<dfm2::CNodeBVH2> aNodeBVH;
+  std::vector<dfm2::CBV3d_AABB> aAABB;
+  dfm2::BuildBVH_MeshTri3D_Morton(aNodeBVH, aAABB, aXYZ, aTri);
+  dfm2::CBVHWide_MeshTri3D<N> bvh;
+  bvh.Build(0, aNodeBVH, aAABB, aXYZ.data(), aTri.data());
+  { // each triangle is in exactly one leaf
+    std::vector<unsigned int> aFlg(aTri.size()/3, 0);
+    for(const auto& leaf : bvh.leaves){
+      for(unsigned int k=0;k<N;++k){
+        if( leaf.itri[k] != UINT_MAX ){ aFlg[leaf.itri[k]]++; }
+      }
+    }
+    for(unsigned int flg : aFlg){ EXPECT_EQ(flg, 1); }
+    EXPECT_LT(bvh.nodes.size(), aNodeBVH.size()/N);
+  }
+  std::mt19937 rndeng(0);
+  std::uniform_real_distribution<double> dist_m1p1(-1, +1);
+  const unsigned int nray = 500;
+  std::vector<double> ray_src, ray_dir;
+  for(unsigned int iray=0;iray<nray;++iray){
+    for(int idim=0;idim<3;++idim){ ray_src.push_back(3*dist_m1p1(rndeng)); }
+    for(int idim=0;idim<3;++idim){ ray_dir.push_back(dist_m1p1(rndeng)-ray_src[iray*3+idim]); }
+  }
+  ray_dir[0] = 0.0; // axis parallel ray
+  std::vector<dfm2::PointOnSurfaceMesh<double>> aPes;
+  bvh.IntersectionRays(aPes, ray_src.data(), ray_dir.data(), nray);
+  unsigned int nhit = 0;
+  for(unsigned int iray=0;iray<nray;++iray){
+    const dfm2::CVec3d src(ray_src.data()+iray*3), dir(ray_dir.data()+iray*3);
+    dfm2::PointOnSurfaceMesh<double> pes;
+    double depth0;
+    const bool is_hit = dfm2::Intersection_Ray3_Tri3_Bvh(
+        pes, depth0,
+        src, dir, aXYZ, aTri, aNodeBVH, aAABB);
+    EXPECT_EQ( is_hit, aPes[iray].itri != UINT_MAX );
+    if( !is_hit ){ continue; }
+    nhit++;
+    const dfm2::CVec3d q0 = aPes[iray].PositionOnMeshTri3(aXYZ, aTri);
+    EXPECT_NEAR( (q0-src).dot(dir)/dir.squaredNorm(), depth0, 1.0e-8 );
+  }
+  EXPECT_GT(nhit, nray/4);
+  for(unsigned int ip=0;ip<aXYZ.size()/3;ip+=7){ // rays from far away aimed at the vertices on the faces of the boxes
+    dfm2::CVec3d dir(dist_m1p1(rndeng), dist_m1p1(rndeng), dist_m1p1(rndeng));
+    dir.normalize();
+    const dfm2::CVec3d src = dfm2::CVec3d(aXYZ.data()+ip*3) - 1000.*dir;
+    dfm2::PointOnSurfaceMesh<double> pes;
+    double depth;
+    EXPECT_TRUE(bvh.IntersectionRay(pes, depth, src.data(), dir.data()));
+    EXPECT_LE(depth, 1000.+1.0e-8);
+  }
+  { // image whose rays start far from the mesh. the rounding of the origin in single precision is not negligible
+    const unsigned int nw = 64, nh = 48;
+    double mMVP[16];
+    dfm2::Mat4_AffineProjectionOrtho(mMVP, -1.5, +1.5, -1.5, +1.5, -1000., +1000.);
+    std::vector<dfm2::PointOnSurfaceMesh<double>> aPes0, aPes1;
+    dfm2::Intersection_ImageRay_TriMesh3(aPes0, nh, nw, mMVP, aNodeBVH, aAABB, aXYZ, aTri, false);
+    dfm2::Intersection_ImageRay_TriMesh3(aPes1, nh, nw, mMVP, bvh, true);
+    unsigned int npix_hit = 0;
+    for(unsigned int ipix=0;ipix<nw*nh;++ipix){
+      EXPECT_EQ( aPes0[ipix].itri == UINT_MAX, aPes1[ipix].itri == UINT_MAX );
+      if( aPes0[ipix].itri == UINT_MAX || aPes1[ipix].itri == UINT_MAX ){ continue; }
+      npix_hit++;
+      const dfm2::CVec3d q0 = aPes0[ipix].PositionOnMeshTri3(aXYZ, aTri);
+      const dfm2::CVec3d q1 = aPes1[ipix].PositionOnMeshTri3(aXYZ, aTri);
+      EXPECT_LT( (q0-q1).norm(), 1.0e-8 );
+    }
+    EXPECT_GT(npix_hit, nw*nh/10);
+  }
+}
+
+TEST(bvh,wide)
+{
+  TestWideBVH<4>();
+  TestWideBVH<8>();
+}
+
+TEST(bvh,binary_file)
+{
+  std::vector<double> aXYZ;
+  std::vector<unsigned int> aTri;
+  dfm2::MeshTri3_Torus(aXYZ, aTri, 1.0, 0.3, 32, 16);
+  std::vector<dfm2::CNodeBVH2> aNodeBVH;
+  std::vector<dfm2::CBV3d_AABB> aAABB;
+  dfm2::BuildBVH_MeshTri3D_Morton(aNodeBVH, aAABB, aXYZ, aTri);
+  const std::uint64_t hash = dfm2::MeshBinary_Hash(aXYZ, aTri);
+  const auto path = std::filesystem::temp_directory_path()
+      / ("dfm2_bvh_torus_" + std::to_string(std::random_device{}()) + ".dfm2bin");  // unique for concurrent runs
+  EXPECT_TRUE(dfm2::Write_BVH_MeshBinary(path, aNodeBVH, aAABB, hash));
+  {
+    dfm2::CBVH_MeshBinaryView<double> view;
+    EXPECT_FALSE(view.Open(path, hash + 1)); // BVH of the other mesh
+    EXPECT_FALSE(view.IsOpen());
+    dfm2::CBVH_MeshBinaryView<float> view_f;
+    EXPECT_FALSE(view_f.Open(path, hash)); // different precision
+  }
+  { // the moved mesh has a different hash
+    std::vector<double> aXYZ1 = aXYZ;
+    aXYZ1[0] += 1.0e-10;
+    EXPECT_NE(dfm2::MeshBinary_Hash(aXYZ1, aTri), hash);
+  }
+  dfm2::CBVH_MeshBinaryView<double> view;
+  ASSERT_TRUE(view.Open(path, hash));
+  ASSERT_EQ(view.num_node, aNodeBVH.size());
+  for(unsigned int ibvh=0;ibvh<view.num_node;++ibvh){
+    EXPECT_EQ(view.nodes[ibvh].iparent, aNodeBVH[ibvh].iparent);
+    EXPECT_EQ(view.nodes[ibvh].ichild[0], aNodeBVH[ibvh].ichild[0]);
+    EXPECT_EQ(view.nodes[ibvh].ichild[1], aNodeBVH[ibvh].ichild[1]);
+    for(int idim=0;idim<3;++idim){
+      EXPECT_EQ(view.aabbs[ibvh].bbmin[idim], aAABB[ibvh].bbmin[idim]);
+      EXPECT_EQ(view.aabbs[ibvh].bbmax[idim], aAABB[ibvh].bbmax[idim]);
+    }
+  }
+  std::mt19937 rndeng(0);
+  std::uniform_real_distribution<double> dist_m1p1(-1, +1);
+  unsigned int nhit = 0;
+  for(unsigned int iray=0;iray<200;++iray){
+    const dfm2::CVec3d src(3*dist_m1p1(rndeng), 3*dist_m1p1(rndeng), 3*dist_m1p1(rndeng));
+    const dfm2::CVec3d dir = dfm2::CVec3d(dist_m1p1(rndeng), dist_m1p1(rndeng), dist_m1p1(rndeng)) - src;
+    dfm2::PointOnSurfaceMesh<double> pes0, pes1;
+    double depth0 = -1, depth1 = -1;
+    const bool is_hit0 = dfm2::Intersection_Ray3_Tri3_Bvh(
+        pes0, depth0, src, dir, aXYZ, aTri, aNodeBVH, aAABB);
+    const bool is_hit1 = dfm2::Intersection_Ray3_Tri3_Bvh(
+        pes1, depth1, src, dir, aXYZ, aTri, view.nodes, view.aabbs);
+    EXPECT_EQ(is_hit0, is_hit1);
+    if( !is_hit0 ){ continue; }
+    nhit++;
+    EXPECT_EQ(pes0.itri, pes1.itri);
+    EXPECT_EQ(depth0, depth1);
+  }
+  EXPECT_GT(nhit, 50);
+  view.Close();
+  std::filesystem::remove(path);
+}
+
+TEST(bvh,spatialhash_contact)
+{
+  std::vector<double> aXYZ;
+  std::vector<unsigned int> aTri;
+  dfm2::MeshTri3D_Sphere(aXYZ, aTri, 1.0, 16, 32);
+  for(unsigned int ip=0;ip<aXYZ.size()/3;++ip){ aXYZ[ip*3+2] *= 0.03; } // flat pancake
+  std::vector<double> aUVW(aXYZ.size(), 0.0);
+  for(unsigned int ip=0;ip<aXYZ.size()/3;++ip){ aUVW[ip*3+2] = -2*aXYZ[ip*3+2]; } // top and bottom swap
+  const double delta = 0.05;
+  std::vector<dfm2::CNodeBVH2> aNodeBVH;
+  std::vector<dfm2::CBV3d_AABB> aBB;
+  dfm2::BuildBVH_MeshTri3D_Morton(aNodeBVH, aBB, aXYZ, aTri);
+  dfm2::CSpatialHash hash;
+  {
+    dfm2::CLeafVolumeMaker_Mesh<dfm2::CBV3d_AABB, double> lvm(
+        delta*0.5,
+        aXYZ.data(), aXYZ.size()/3,
+        aTri.data(), aTri.size()/3, 3);
+    dfm2::BVH_BuildBVHGeometry(aBB, 0, aNodeBVH, lvm);
+    std::set<dfm2::CContactElement> setCE0, setCE1;
+    dfm2::GetContactElement_Proximity(setCE0, delta, aXYZ, aTri, 0, aNodeBVH, aBB);
+    dfm2::GetContactElement_Proximity(setCE1, delta, aXYZ, aTri, hash);
+    EXPECT_GT(setCE0.size(), 10);
+    EXPECT_TRUE(setCE0.size() == setCE1.size() && std::equal(setCE0.begin(), setCE0.end(), setCE1.begin(),
+        [](const auto& a, const auto& b){ return !(a < b) && !(b < a); }));
+    std::set<dfm2::CContactElement> setCE2;
+    dfm2::GetContactElement_Proximity(setCE2, delta, aXYZ, aTri, 0, aNodeBVH, aBB, 0u);
+    EXPECT_TRUE(setCE0.size() == setCE2.size() && std::equal(setCE0.begin(), setCE0.end(), setCE2.begin(),
+        [](const auto& a, const auto& b){ return !(a < b) && !(b < a); }));
+  }
+  {
+    dfm2::CLeafVolumeMaker_DynamicTriangle<dfm2::CBV3d_AABB, double> lvm(
+        1.0, aXYZ, aUVW, aTri, 1.0e-10);
+    dfm2::BVH_BuildBVHGeometry(aBB, 0, aNodeBVH, lvm);
+    std::set<dfm2::CContactElement> setCE0, setCE1;
+    dfm2::GetContactElement_CCD(setCE0, 1.0, delta, aXYZ, aUVW, aTri, 0, aNodeBVH, aBB);
+    dfm2::GetContactElement_CCD(setCE1, 1.0, delta, aXYZ, aUVW, aTri, hash);
+    EXPECT_GT(setCE0.size(), 10);
+    // the pairs of the triangles are tested in the same order in both, so the results are identical
+    EXPECT_TRUE(setCE0.size() == setCE1.size() && std::equal(setCE0.begin(), setCE0.end(), setCE1.begin(),
+        [](const auto& a, const auto& b){ return !(a < b) && !(b < a); }));
+    std::set<dfm2::CContactElement> setCE3;
+    dfm2::GetContactElement_CCD(setCE3, 1.0, delta, aXYZ, aUVW, aTri, 0, aNodeBVH, aBB, 0u);
+    EXPECT_TRUE(setCE0.size() == setCE3.size() && std::equal(setCE0.begin(), setCE0.end(), setCE3.begin(),
+        [](const auto& a, const auto& b){ return !(a < b) && !(b < a); }));
+  }
+}
+
+TEST(bvh,spatialhash_large_box)
+{
+  std::mt19937 rndeng(0);
+  std::uniform_real_distribution<double> dist_01(0, 1);
+  dfm2::CSpatialHash hash;
+  for(unsigned int ibox=0;ibox<300;++ibox){
+    const double c[3] = {dist_01(rndeng), dist_01(rndeng), dist_01(rndeng)};
+    const double bbmin[3] = {c[0]-0.02, c[1]-0.02, c[2]-0.02};
+    const double bbmax[3] = {c[0]+0.02, c[1]+0.02, c[2]+0.02};
+    hash.aabb.emplace_back(bbmin, bbmax);
+  }
+  const double bbmin[3] = {-1.e+3, -1.e+3, -1.e+3}, bbmax[3] = {+1.e+3, +1.e+3, +1.e+3};
+  hash.aabb.emplace_back(bbmin, bbmax); // a huge box
+  hash.Build(1.0e-4); // far too small cells for the huge box
+  const auto nelem = static_cast<unsigned int>(hash.aabb.size());
+  for(unsigned int ielem=0;ielem<nelem;++ielem){
+    EXPECT_LE(hash.elem_ind[ielem+1]-hash.elem_ind[ielem], 64);
+  }
+  std::set<std::pair<unsigned int,unsigned int>> pairs0, pairs1;
+  for(unsigned int i=0;i<nelem;++i){
+    for(unsigned int j=i+1;j<nelem;++j){
+      if( hash.aabb[i].IsIntersect(hash.aabb[j]) ){ pairs0.emplace(i,j); }
+    }
+  }
+  hash.ForEachPair([&pairs1](unsigned int i, unsigned int j){ pairs1.emplace(i,j); }, 1);
+  EXPECT_EQ(pairs0, pairs1);
+}
@@ -13,6 +13,10 @@
 #include "delfem2/geo_tri.h"
 #include "delfem2/fem_discreteshell.h"
 #include "delfem2/fem_poisson.h"
+#include "delfem2/fem_navierstokes.h"
+#include "delfem2/fem_solidlinear.h"
+#include "delfem2/msh_primitive.h"
+#include "delfem2/msh_topology_uniform.h"
 #include "delfem2/mshmisc.h"
 #include "delfem2/sampling.h"
 #include "delfem2/vec3_funcs.h"
@@ -78,3 +82,100 @@ TEST(pbd, Check_CdC_DiscreteShell) {
     }
   }
 }
+
+TEST(femem2, solidlinear_colored_merge) {
+  std::vector<double> vtx_xy;
+  std::vector<unsigned int> quad_vtx, tri_vtx;
+  dfm2::MeshQuad2D_Grid(vtx_xy, quad_vtx, 20, 15);
+  dfm2::convert2Tri_Quad(tri_vtx, quad_vtx);
+  const size_t nvtx = vtx_xy.size() / 2;
+  const size_t ntri = tri_vtx.size() / 3;
+  std::vector<unsigned int> color_ind, color_elem;
+  dfm2::JArray_ElemColoring_MeshElem(
+      color_ind, color_elem,
+      tri_vtx.data(), ntri, 3, nvtx);
+  EXPECT_EQ(color_elem.size(), ntri);
+  for (unsigned int icolor = 0; icolor + 1 < color_ind.size(); ++icolor) {
+    std::vector<int> vtx_flag(nvtx, 0);
+    for (unsigned int i = color_ind[icolor]; i < color_ind[icolor + 1]; ++i) {
+      for (unsigned int inoel = 0; inoel < 3; ++inoel) {
+        const unsigned int ivtx = tri_vtx[color_elem[i] * 3 + inoel];
+        EXPECT_EQ(vtx_flag[ivtx], 0);  // no vertex is shared in the same color
+        vtx_flag[ivtx] = 1;
+      }
+    }
+  }
+  std::vector<unsigned int> psup_ind, psup;
+  dfm2::JArray_PSuP_MeshElem(
+      psup_ind, psup,
+      tri_vtx.data(), ntri, 3, nvtx);
+  std::vector<double> disp(nvtx * 2, 0.01);
+  dfm2::CMatrixSparse<double> mat0, mat1;
+  std::vector<double> vec0(nvtx * 2, 0.0), vec1(nvtx * 2, 0.0);
+  for (auto *mat: {&mat0, &mat1}) {
+    mat->Initialize(nvtx, 2, true);
+    mat->SetPattern(psup_ind.data(), psup_ind.size(), psup.data(), psup.size());
+    mat->setZero();
+  }
+  dfm2::MergeLinSys_SolidLinear_Static_MeshTri2D(
+      mat0, vec0.data(), 1.0, 2.0, 1.0, 0.0, -1.0,
+      vtx_xy.data(), nvtx, tri_vtx.data(), ntri, disp.data());
+  dfm2::MergeLinSys_SolidLinear_Static_MeshTri2D(
+      mat1, vec1.data(), 1.0, 2.0, 1.0, 0.0, -1.0,
+      vtx_xy.data(), tri_vtx.data(), disp.data(),
+      color_ind, color_elem, 0);
+  for (unsigned int i = 0; i < vec0.size(); ++i) { EXPECT_NEAR(vec0[i], vec1[i], 1.0e-10); }
+  for (unsigned int i = 0; i < mat0.val_crs_.size(); ++i) { EXPECT_NEAR(mat0.val_crs_[i], mat1.val_crs_[i], 1.0e-10); }
+  for (unsigned int i = 0; i < mat0.val_dia_.size(); ++i) { EXPECT_NEAR(mat0.val_dia_[i], mat1.val_dia_[i], 1.0e-10); }
+}
+
+TEST(femem2, poisson_navierstokes_colored_merge) {
+  std::vector<double> vtx_xy;
+  std::vector<unsigned int> quad_vtx, tri_vtx;
+  dfm2::MeshQuad2D_Grid(vtx_xy, quad_vtx, 20, 15);
+  dfm2::convert2Tri_Quad(tri_vtx, quad_vtx);
+  const size_t nvtx = vtx_xy.size() / 2;
+  const size_t ntri = tri_vtx.size() / 3;
+  std::vector<unsigned int> color_ind, color_elem;
+  dfm2::JArray_ElemColoring_MeshElem(
+      color_ind, color_elem,
+      tri_vtx.data(), ntri, 3, nvtx);
+  std::vector<unsigned int> psup_ind, psup;
+  dfm2::JArray_PSuP_MeshElem(
+      psup_ind, psup,
+      tri_vtx.data(), ntri, 3, nvtx);
+  std::vector<double> val(nvtx * 3), dtval(nvtx * 3);
+  for (unsigned int i = 0; i < nvtx * 3; ++i) {
+    val[i] = std::sin(i);
+    dtval[i] = std::cos(i);
+  }
+  for (unsigned int ndim: {1, 3}) {
+    dfm2::CMatrixSparse<double> mat0, mat1;
+    std::vector<double> vec0(nvtx * ndim, 0.0), vec1(nvtx * ndim, 0.0);
+    for (auto *mat: {&mat0, &mat1}) {
+      mat->Initialize(nvtx, ndim, true);
+      mat->SetPattern(psup_ind.data(), psup_ind.size(), psup.data(), psup.size());
+      mat->setZero();
+    }
+    if (ndim == 1) {
+      dfm2::MergeLinSys_Poission_MeshTri2D(
+          mat0, vec0.data(), 1.0, 0.5,
+          vtx_xy.data(), nvtx, tri_vtx.data(), ntri, val.data());
+      dfm2::MergeLinSys_Poission_MeshTri2D(
+          mat1, vec1.data(), 1.0, 0.5,
+          vtx_xy.data(), tri_vtx.data(), val.data(),
+          color_ind, color_elem, 0);
+    } else {
+      dfm2::MergeLinSys_NavierStokes2D(
+          mat0, vec0.data(), 1.0, 1.0, 0.0, -1.0, 0.01, 0.6,
+          vtx_xy.data(), nvtx, tri_vtx.data(), ntri, val.data(), dtval.data());
+      dfm2::MergeLinSys_NavierStokes2D(
+          mat1, vec1.data(), 1.0, 1.0, 0.0, -1.0, 0.01, 0.6,
+          vtx_xy.data(), tri_vtx.data(), val.data(), dtval.data(),
+          color_ind, color_elem, 0);
+    }
+    for (unsigned int i = 0; i < vec0.size(); ++i) { EXPECT_NEAR(vec0[i], vec1[i], 1.0e-10); }
+    for (unsigned int i = 0; i < mat0.val_crs_.size(); ++i) { EXPECT_NEAR(mat0.val_crs_[i], mat1.val_crs_[i], 1.0e-10); }
+    for (unsigned int i = 0; i < mat0.val_dia_.size(); ++i) { EXPECT_NEAR(mat0.val_dia_[i], mat1.val_dia_[i], 1.0e-10); }
+  }
+}
@@ -7,6 +7,10 @@
 
 #include <cstring>
 #include <random>
+#include <stdexcept>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 #include "gtest/gtest.h"
 #include "delfem2/thread.h"
@@ -57,3 +61,75 @@ TEST(thread, parallel_for1) {
     }
   }
 }
+
+TEST(thread, parallel_for_range_concurrency) {
+  for (unsigned int nthread: {1, 2, 3}) {
+    std::atomic<unsigned int> num_running{0}, num_running_max{0};
+    std::vector<unsigned int> out(1000, 0);
+    dfm2::parallel_for_range(
+        1000u,
+        [&](unsigned int ib, unsigned int ie) {
+          const unsigned int n = num_running.fetch_add(1) + 1;
+          unsigned int n_max = num_running_max.load();
+          while (n > n_max && !num_running_max.compare_exchange_weak(n_max, n)) {}
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+          for (unsigned int i = ib; i < ie; ++i) { out[i] += i; }
+          num_running.fetch_sub(1);
+        },
+        0u, nthread);
+    EXPECT_LE(num_running_max.load(), nthread);
+    for (unsigned int i = 0; i < 1000; ++i) { EXPECT_EQ(out[i], i); }
+  }
+  { // exception thrown in a chunk is propagated to the caller
+    auto func = [](unsigned int ib, unsigned int ie) {
+      if (ib <= 500 && 500 < ie) { throw std::runtime_error("error"); }
+    };
+    EXPECT_THROW(dfm2::parallel_for_range(1000u, func, 0u, 0), std::runtime_error);
+  }
+}
+
+TEST(thread, parallel_reduce) {
+  std::mt19937 rdeng(std::random_device{}());
+  std::uniform_int_distribution<unsigned int> dist0(0, 10000);
+  std::uniform_int_distribution<unsigned int> dist1(0, 5);
+  for (unsigned int itr = 0; itr < 100; ++itr) {
+    const unsigned int N = dist0(rdeng);
+    const unsigned int nthread = dist1(rdeng);
+    const auto sum = dfm2::parallel_reduce(
+        N, 0ULL,
+        [](unsigned int ib, unsigned int ie, unsigned long long init) {
+          for (unsigned int i = ib; i < ie; ++i) { init += i; }
+          return init;
+        },
+        [](unsigned long long a, unsigned long long b) { return a + b; },
+        0u, nthread);
+    EXPECT_EQ(sum, static_cast<unsigned long long>(N) * (N - 1) / 2 * (N != 0));
+  }
+}
+
+TEST(thread, thread_pool) {
+  dfm2::ThreadPool pool(3);
+  EXPECT_EQ(pool.NumThreads(), 4);
+  { // nested tasks
+    std::vector<unsigned int> out(64 * 64, 0);
+    dfm2::ThreadPool::TaskGroup group0;
+    for (unsigned int j = 0; j < 64; ++j) {
+      pool.Submit(group0, [&pool, &out, j]() {
+        dfm2::ThreadPool::TaskGroup group1;
+        for (unsigned int i = 0; i < 64; ++i) {
+          pool.Submit(group1, [&out, i, j]() { out[j * 64 + i] = j * 64 + i; });
+        }
+        pool.Wait(group1);
+      });
+    }
+    pool.Wait(group0);
+    for (unsigned int i = 0; i < 64 * 64; ++i) { EXPECT_EQ(out[i], i); }
+  }
+  { // exception is propagated to the waiting thread
+    dfm2::ThreadPool::TaskGroup group;
+    for (unsigned int i = 0; i < 16; ++i) {
+      pool.Submit(group, [i]() { if (i == 7) { throw std::runtime_error("error"); }});
+    }
+    EXPECT_THROW(pool.Wait(group), std::runtime_error);
+  }
+}